@@ -647,6 +647,7 @@ void Annotation::setBoundingRectangle( const NormalizedRect &rectangle )
     if ( d->m_page )
     {
         d->transform( d->m_page->rotationMatrix() );
+        d->m_page->invalidateObjectRectIndex();
     }
 }
 
@@ -670,6 +671,7 @@ void Annotation::translate( const NormalizedPoint &coord )
     if ( d->m_page )
     {
         d->transform( d->m_page->rotationMatrix() );
+        d->m_page->invalidateObjectRectIndex();
     }
 }
 
@@ -27,9 +27,11 @@
 #include <QtCore/QFileInfo>
 #include <QtCore/QMap>
 #include <QtCore/QTextStream>
+#include <QtCore/QThread>
 #include <QtCore/QTimer>
 #include <QtGui/QApplication>
 #include <QtGui/QLabel>
+#include <QtGui/QPixmap>
 #include <QtGui/QPrinter>
 #include <QtGui/QPrintDialog>
 
@@ -75,6 +77,9 @@
 #include "sourcereference.h"
 #include "sourcereference_p.h"
 #include "texteditors_p.h"
+#include "textindex_p.h"
+#include "thumbnailstore_p.h"
+#include "tilesmanager_p.h"
 #include "utils_p.h"
 #include "view.h"
 #include "view_p.h"
@@ -85,16 +90,6 @@
 
 using namespace Okular;
 
-struct AllocatedPixmap
-{
-    // owner of the page
-    int id;
-    int page;
-    qulonglong memory;
-    // public constructor: initialize data
-    AllocatedPixmap( int i, int p, qulonglong m ) : id( i ), page( p ), memory( m ) {}
-};
-
 struct ArchiveData
 {
     ArchiveData()
@@ -178,31 +173,36 @@ void DocumentPrivate::cleanupPixmapMemory( qulonglong /*sure? bytesOffset*/ )
     // [MEM] choose memory parameters based on configuration profile
     qulonglong clipValue = 0;
     qulonglong memoryToFree = 0;
+    // the data cached by the generator is accounted with the pixmaps
+    qulonglong generatorMemory = 0;
+    if ( m_generator )
+        QMetaObject::invokeMethod( m_generator, "cacheMemory", Qt::DirectConnection, Q_RETURN_ARG(qulonglong, generatorMemory) );
+    const qulonglong allocatedMemory = m_pixmapCache.totalMemory() + generatorMemory;
     switch ( Settings::memoryLevel() )
     {
         case Settings::EnumMemoryLevel::Low:
-            memoryToFree = m_allocatedPixmapsTotalMemory;
+            memoryToFree = allocatedMemory;
             break;
 
         case Settings::EnumMemoryLevel::Normal:
         {
             qulonglong thirdTotalMemory = getTotalMemory() / 3;
             qulonglong freeMemory = getFreeMemory();
-            if (m_allocatedPixmapsTotalMemory > thirdTotalMemory) memoryToFree = m_allocatedPixmapsTotalMemory - thirdTotalMemory;
-            if (m_allocatedPixmapsTotalMemory > freeMemory) clipValue = (m_allocatedPixmapsTotalMemory - freeMemory) / 2;
+            if (allocatedMemory > thirdTotalMemory) memoryToFree = allocatedMemory - thirdTotalMemory;
+            if (allocatedMemory > freeMemory) clipValue = (allocatedMemory - freeMemory) / 2;
         }
         break;
 
         case Settings::EnumMemoryLevel::Aggressive:
         {
             qulonglong freeMemory = getFreeMemory();
-            if (m_allocatedPixmapsTotalMemory > freeMemory) clipValue = (m_allocatedPixmapsTotalMemory - freeMemory) / 2;
+            if (allocatedMemory > freeMemory) clipValue = (allocatedMemory - freeMemory) / 2;
         }
         break;
         case Settings::EnumMemoryLevel::Greedy:
         {
             const qulonglong memoryLimit = qMax(getFreeMemory(), getTotalMemory() / 2);
-            if (m_allocatedPixmapsTotalMemory > memoryLimit) clipValue = (m_allocatedPixmapsTotalMemory - memoryLimit) / 2;
+            if (allocatedMemory > memoryLimit) clipValue = (allocatedMemory - memoryLimit) / 2;
         }
         break;
     }
@@ -210,30 +210,28 @@ void DocumentPrivate::cleanupPixmapMemory( qulonglong /*sure? bytesOffset*/ )
     if ( clipValue > memoryToFree )
         memoryToFree = clipValue;
 
+    if ( memoryToFree > 0 && generatorMemory > 0 )
+    {
+        // [MEM] free the generator caches first, they only speed up the
+        // rendering of the pixmaps
+        qulonglong freedMemory = 0;
+        QMetaObject::invokeMethod( m_generator, "freeCacheMemory", Qt::DirectConnection, Q_RETURN_ARG(qulonglong, freedMemory), Q_ARG(qulonglong, memoryToFree) );
+        memoryToFree = freedMemory < memoryToFree ? memoryToFree - freedMemory : 0;
+    }
+
     if ( memoryToFree > 0 )
     {
-        // [MEM] free memory starting from older pixmaps
-        int pagesFreed = 0;
-        QLinkedList< AllocatedPixmap * >::iterator pIt = m_allocatedPixmapsFifo.begin();
-        QLinkedList< AllocatedPixmap * >::iterator pEnd = m_allocatedPixmapsFifo.end();
-        while ( (pIt != pEnd) && (memoryToFree > 0) )
+        // [MEM] free memory starting from the least recently used pixmaps
+        const QList< AllocatedPixmap * > evicted = m_pixmapCache.evict( memoryToFree, m_observers );
+        foreach ( AllocatedPixmap *p, evicted )
         {
-            AllocatedPixmap * p = *pIt;
-            if ( m_observers.value( p->id )->canUnloadPixmap( p->page ) )
-            {
-                // update internal variables
-                pIt = m_allocatedPixmapsFifo.erase( pIt );
-                m_allocatedPixmapsTotalMemory -= p->memory;
-                memoryToFree -= p->memory;
-                pagesFreed++;
-                // delete pixmap
-                m_pagesVector.at( p->page )->deletePixmap( p->id );
-                // delete allocation descriptor
-                delete p;
-            } else
-                ++pIt;
+            // delete pixmap
+            m_pagesVector.at( p->page )->deletePixmap( p->id );
+            // delete allocation descriptor
+            delete p;
         }
-        //p--rintf("freeMemory A:[%d -%d = %d] \n", m_allocatedPixmapsFifo.count() + pagesFreed, pagesFreed, m_allocatedPixmapsFifo.count() );
+        kDebug(OkularDebug).nospace() << "freed " << evicted.count() << " pixmaps, pixmap cache: " << m_pixmapCache.count() << " pixmaps, "
+            << m_pixmapCache.hits() << " hits, " << m_pixmapCache.misses() << " misses";
     }
 }
 
@@ -399,7 +397,16 @@ void DocumentPrivate::loadDocumentInfo( const QString &fileName )
 
                     // pass the domElement to the right page, to read config data from
                     if ( ok && pageNumber >= 0 && pageNumber < (int)m_pagesVector.count() )
-                        m_pagesVector[ pageNumber ]->d->restoreLocalContents( pageElement );
+                    {
+                        // the annotations and the forms of the document must be
+                        // there before, not to be mistaken for the local ones
+                        Page *page = m_pagesVector[ pageNumber ];
+                        QMetaObject::invokeMethod( m_generator, "loadPageData", Qt::DirectConnection, Q_ARG(Okular::Page*, page) );
+                        page->d->restoreLocalContents( pageElement );
+                    }
+                    // the generator may still append the page, it is restored then
+                    else if ( ok && pageNumber >= 0 && !m_pagesComplete )
+                        m_pendingPageElements.insert( pageNumber, pageElement );
                 }
                 pageNode = pageNode.nextSibling();
             }
@@ -757,12 +764,12 @@ bool DocumentPrivate::savePageDocumentInfo( KTemporaryFile *infoFile, int what )
     return false;
 }
 
-DocumentViewport DocumentPrivate::nextDocumentViewport() const
+DocumentViewport DocumentPrivate::nextDocumentViewport()
 {
     DocumentViewport ret = m_nextDocumentViewport;
-    if ( !m_nextDocumentDestination.isEmpty() && m_generator )
+    if ( !m_nextDocumentDestination.isEmpty() )
     {
-        DocumentViewport vp( m_generator->metaData( "NamedViewport", m_nextDocumentDestination ).toString() );
+        DocumentViewport vp = destinationViewport( m_nextDocumentDestination );
         if ( vp.isValid() )
         {
             ret = vp;
@@ -771,6 +778,17 @@ DocumentViewport DocumentPrivate::nextDocumentViewport() const
     return ret;
 }
 
+DocumentViewport DocumentPrivate::destinationViewport( const QString &name )
+{
+    if ( !m_generator )
+        return DocumentViewport();
+
+    // the generator may have to get the document ready up to the destination
+    QString viewport;
+    QMetaObject::invokeMethod( m_generator, "destinationViewport", Qt::DirectConnection, Q_RETURN_ARG(QString, viewport), Q_ARG(QString, name) );
+    return DocumentViewport( viewport );
+}
+
 void DocumentPrivate::warnLimitedAnnotSupport()
 {
     if ( !m_showWarningLimitedAnnotSupport )
@@ -823,6 +841,10 @@ void DocumentPrivate::saveDocumentInfo() const
         QVector< Page * >::const_iterator pIt = m_pagesVector.constBegin(), pEnd = m_pagesVector.constEnd();
         for ( ; pIt != pEnd; ++pIt )
             (*pIt)->d->saveLocalContents( pageList, doc, saveWhat );
+        // write back untouched the info of the pages the generator did not append yet
+        QMap< int, QDomElement >::const_iterator eIt = m_pendingPageElements.constBegin(), eEnd = m_pendingPageElements.constEnd();
+        for ( ; eIt != eEnd; ++eIt )
+            pageList.appendChild( doc.importNode( eIt.value(), true ) );
 
         // 2.2. Save document info (current viewport, history, ... ) to DOM
         QDomElement generalInfo = doc.createElement( "generalInfo" );
@@ -847,14 +869,18 @@ void DocumentPrivate::saveDocumentInfo() const
             QDomElement historyNode = doc.createElement( "history" );
             generalInfo.appendChild( historyNode );
 
+            // the viewport to restore on a page not appended yet, unless the user moved meanwhile
+            const bool keepPendingViewport = m_pendingViewport.isValid() && (*m_viewportIterator) == m_viewportBeforePending;
+
             // add old[backIterator] and present[viewportIterator] items
             QLinkedList< DocumentViewport >::const_iterator endIt = m_viewportIterator;
             ++endIt;
             while ( backIterator != endIt )
             {
-                QString name = (backIterator == m_viewportIterator) ? "current" : "oldPage";
+                const bool current = backIterator == m_viewportIterator;
+                QString name = current ? "current" : "oldPage";
                 QDomElement historyEntry = doc.createElement( name );
-                historyEntry.setAttribute( "viewport", (*backIterator).toString() );
+                historyEntry.setAttribute( "viewport", ( current && keepPendingViewport ? m_pendingViewport : *backIterator ).toString() );
                 historyNode.appendChild( historyEntry );
                 ++backIterator;
             }
@@ -883,76 +909,177 @@ void DocumentPrivate::slotTimedMemoryCheck()
 {
     // [MEM] clean memory (for 'free mem dependant' profiles only)
     if ( Settings::memoryLevel() != Settings::EnumMemoryLevel::Low &&
-         m_allocatedPixmapsTotalMemory > 1024*1024 )
+         m_pixmapCache.totalMemory() > 1024*1024 )
         cleanupPixmapMemory();
 }
 
 void DocumentPrivate::sendGeneratorRequest()
 {
-    // find a request
-    PixmapRequest * request = 0;
-    m_pixmapRequestsMutex.lock();
-    while ( !m_pixmapRequestsStack.isEmpty() && !request )
+    // keep feeding the generator as long as it has free rendering workers
+    bool requestSent = false;
+    forever
     {
-        PixmapRequest * r = m_pixmapRequestsStack.last();
-        if (!r)
-            m_pixmapRequestsStack.pop_back();
+        // find a request
+        PixmapRequest * request = 0;
+        m_pixmapRequestsMutex.lock();
+        while ( !m_pixmapRequestsStack.isEmpty() && !request )
+        {
+            PixmapRequest * r = m_pixmapRequestsStack.last();
+            if (!r)
+                m_pixmapRequestsStack.pop_back();
+
+            // request only if page isn't already present or request has invalid id
+            else if ( ( !r->d->mForce && r->d->hasPixmap() ) || r->id() <= 0 || r->id() >= MAX_OBSERVER_ID )
+            {
+                m_pixmapRequestsStack.pop_back();
+                delete r;
+            }
+            // the thumbnail may have been taken from the pixmaps of the GUI meanwhile
+            else if ( r->id() == THUMBNAILSTORE_ID && ( !m_thumbnailStore || m_rotation != Rotation0 ||
+                      !m_thumbnailStore->wantsThumbnail( r->pageNumber(), r->width() ) ) )
+            {
+                m_pixmapRequestsStack.pop_back();
+                delete r;
+            }
+            else if ( r->d->pixelCount() > 20000000L )
+            {
+                m_pixmapRequestsStack.pop_back();
+                if ( !m_warnedOutOfMemory )
+                {
+                    kWarning(OkularDebug).nospace() << "Running out of memory on page " << r->pageNumber()
+                        << " (" << r->width() << "x" << r->height() << " px);";
+                    kWarning(OkularDebug) << "this message will be reported only once.";
+                    m_warnedOutOfMemory = true;
+                }
+                delete r;
+            }
+            else
+                request = r;
+        }
 
-        // request only if page isn't already present or request has invalid id
-        else if ( ( !r->d->mForce && r->page()->hasPixmap( r->id(), r->width(), r->height() ) ) || r->id() <= 0 || r->id() >= MAX_OBSERVER_ID )
+        // if no request found (or already generated), return
+        if ( !request )
         {
-            m_pixmapRequestsStack.pop_back();
-            delete r;
+            m_pixmapRequestsMutex.unlock();
+            return;
         }
-        else if ( (long)r->width() * (long)r->height() > 20000000L )
+
+        // [MEM] preventive memory freeing
+        qulonglong pixmapBytes = 4 * request->d->pixelCount();
+        if ( pixmapBytes > (1024 * 1024) )
+            cleanupPixmapMemory( pixmapBytes );
+
+        // submit the request to the generator
+        if ( m_generator->canGeneratePixmap() )
         {
-            m_pixmapRequestsStack.pop_back();
-            if ( !m_warnedOutOfMemory )
-            {
-                kWarning(OkularDebug).nospace() << "Running out of memory on page " << r->pageNumber()
-                    << " (" << r->width() << "x" << r->height() << " px);";
-                kWarning(OkularDebug) << "this message will be reported only once.";
-                m_warnedOutOfMemory = true;
-            }
-            delete r;
+            kDebug(OkularDebug).nospace() << "sending request id=" << request->id() << " " <<request->width() << "x" << request->height() << "@" << request->pageNumber() << " async == " << request->asynchronous();
+            m_pixmapRequestsStack.removeAll ( request );
+
+            if ( (int)m_rotation % 2 )
+                request->d->swap();
+
+            // we always have to unlock _before_ the generatePixmap() because
+            // a sync generation would end with requestDone() -> deadlock, and
+            // we can not really know if the generator can do async requests
+            m_executingPixmapRequests.push_back( request );
+            m_pixmapRequestsMutex.unlock();
+            m_generator->generatePixmap( request );
+            requestSent = true;
         }
         else
-            request = r;
+        {
+            m_pixmapRequestsMutex.unlock();
+            // if we just sent something the next requestDone() will get us here
+            // again, otherwise poll until the generator is ready
+            // pino (7/4/2006): set the polling interval from 10 to 30
+            if ( !requestSent )
+                QTimer::singleShot( 30, m_parent, SLOT(sendGeneratorRequest()) );
+            return;
+        }
     }
+}
 
-    // if no request found (or already generated), return
-    if ( !request )
-    {
-        m_pixmapRequestsMutex.unlock();
-        return;
-    }
+bool DocumentPrivate::pixmapRequestCovers( const PixmapRequest *executing, const PixmapRequest *request ) const
+{
+    // whether the request already sent to the generator draws the pixmap
+    // (or a part of the area) the other one asks for
+    if ( executing->id() != request->id() || executing->pageNumber() != request->pageNumber() || request->d->mForce )
+        return false;
 
-    // [MEM] preventive memory freeing
-    qulonglong pixmapBytes = 4 * request->width() * request->height();
-    if ( pixmapBytes > (1024 * 1024) )
-        cleanupPixmapMemory( pixmapBytes );
+    // the requests sent for the rotated pages have their size swapped
+    const bool swapped = (int)m_rotation % 2;
+    if ( ( swapped ? executing->height() : executing->width() ) != request->width() ||
+         ( swapped ? executing->width() : executing->height() ) != request->height() )
+        return false;
 
-    // submit the request to the generator
-    if ( m_generator->canGeneratePixmap() )
+    if ( !request->isTile() )
+        return !executing->isTile();
+    return !executing->isTile() || executing->normalizedRect().intersects( request->normalizedRect() );
+}
+
+void DocumentPrivate::cancelPixmapRequests( int requesterID, const QSet< int > &pages, const QLinkedList< PixmapRequest * > &wanted )
+{
+    // the requests of the given requester (any, if negative) for the given
+    // pages (all, if empty) already sent to the generator, apart those
+    // still drawing what the @p wanted requests ask for: cancelling and
+    // sending them again would only lose their place in the generator
+    QList< PixmapRequest * > requests;
+    m_pixmapRequestsMutex.lock();
+    QLinkedList< PixmapRequest * >::const_iterator eIt = m_executingPixmapRequests.constBegin(), eEnd = m_executingPixmapRequests.constEnd();
+    for ( ; eIt != eEnd; ++eIt )
     {
-        kDebug(OkularDebug).nospace() << "sending request id=" << request->id() << " " <<request->width() << "x" << request->height() << "@" << request->pageNumber() << " async == " << request->asynchronous();
-        m_pixmapRequestsStack.removeAll ( request );
+        if ( ( requesterID >= 0 && (*eIt)->id() != requesterID )
+             || ( !pages.isEmpty() && !pages.contains( (*eIt)->pageNumber() ) ) )
+            continue;
+
+        bool isWanted = false;
+        QLinkedList< PixmapRequest * >::const_iterator wIt = wanted.constBegin(), wEnd = wanted.constEnd();
+        for ( ; wIt != wEnd && !isWanted; ++wIt )
+            isWanted = pixmapRequestCovers( *eIt, *wIt );
+        if ( !isWanted )
+            requests.append( *eIt );
+    }
+    m_pixmapRequestsMutex.unlock();
 
-        if ( (int)m_rotation % 2 )
-            request->d->swap();
+    // the generator cancels the ones it did not start generating yet
+    foreach ( PixmapRequest *request, requests )
+    {
+        bool cancelled = false;
+        QMetaObject::invokeMethod( m_generator, "cancelPixmapRequest", Qt::DirectConnection, Q_RETURN_ARG(bool, cancelled), Q_ARG(Okular::PixmapRequest*, request) );
+        if ( !cancelled )
+            continue;
 
-        // we always have to unlock _before_ the generatePixmap() because
-        // a sync generation would end with requestDone() -> deadlock, and
-        // we can not really know if the generator can do async requests
-        m_executingPixmapRequests.push_back( request );
+        m_pixmapRequestsMutex.lock();
+        m_executingPixmapRequests.removeAll( request );
         m_pixmapRequestsMutex.unlock();
-        m_generator->generatePixmap( request );
+        delete request;
     }
+}
+
+void DocumentPrivate::queuePixmapRequest( PixmapRequest *request )
+{
+    // the same pixmap is already being generated, as it was not cancelled
+    QLinkedList< PixmapRequest * >::const_iterator eIt = m_executingPixmapRequests.constBegin(), eEnd = m_executingPixmapRequests.constEnd();
+    for ( ; eIt != eEnd; ++eIt )
+    {
+        if ( pixmapRequestCovers( *eIt, request ) && (*eIt)->normalizedRect() == request->normalizedRect() )
+        {
+            delete request;
+            return;
+        }
+    }
+
+    // add request to the 'stack' at the right place
+    if ( !request->priority() )
+        // add priority zero requests to the top of the stack
+        m_pixmapRequestsStack.append( request );
     else
     {
-        m_pixmapRequestsMutex.unlock();
-        // pino (7/4/2006): set the polling interval from 10 to 30
-        QTimer::singleShot( 30, m_parent, SLOT(sendGeneratorRequest()) );
+        // insert in stack sorted by priority
+        QLinkedList< PixmapRequest * >::iterator sIt = m_pixmapRequestsStack.begin(), sEnd = m_pixmapRequestsStack.end();
+        while ( sIt != sEnd && (*sIt)->priority() > request->priority() )
+            ++sIt;
+        m_pixmapRequestsStack.insert( sIt, request );
     }
 }
 
@@ -1015,12 +1142,7 @@ void DocumentPrivate::slotGeneratorConfigChanged( const QString& )
         }
 
         // [MEM] remove allocation descriptors
-        QLinkedList< AllocatedPixmap * >::const_iterator aIt = m_allocatedPixmapsFifo.constBegin();
-        QLinkedList< AllocatedPixmap * >::const_iterator aEnd = m_allocatedPixmapsFifo.constEnd();
-        for ( ; aIt != aEnd; ++aIt )
-            delete *aIt;
-        m_allocatedPixmapsFifo.clear();
-        m_allocatedPixmapsTotalMemory = 0;
+        m_pixmapCache.clear();
 
         // send reload signals to observers
         foreachObserverD( notifyContentsCleared( DocumentObserver::Pixmap ) );
@@ -1028,7 +1150,7 @@ void DocumentPrivate::slotGeneratorConfigChanged( const QString& )
 
     // free memory if in 'low' profile
     if ( Settings::memoryLevel() == Settings::EnumMemoryLevel::Low &&
-         !m_allocatedPixmapsFifo.isEmpty() && !m_pagesVector.isEmpty() )
+         !m_pixmapCache.isEmpty() && !m_pagesVector.isEmpty() )
         cleanupPixmapMemory();
 }
 
@@ -1038,6 +1160,13 @@ void DocumentPrivate::refreshPixmaps( int pageNumber )
     if ( !page )
         return;
 
+    // the stored thumbnail shows the old contents of the page
+    if ( m_thumbnailStore )
+    {
+        m_thumbnailStore->removeThumbnail( pageNumber );
+        requestStoreThumbnails( pageNumber, pageNumber );
+    }
+
     QLinkedList< Okular::PixmapRequest * > requestedPixmaps;
     QMap< int, PagePrivate::PixmapObject >::ConstIterator it = page->d->m_pixmaps.constBegin(), itEnd = page->d->m_pixmaps.constEnd();
     for ( ; it != itEnd; ++it )
@@ -1049,12 +1178,28 @@ void DocumentPrivate::refreshPixmaps( int pageNumber )
         p->d->mForce = true;
         requestedPixmaps.push_back( p );
     }
+    QMap< int, TilesManager * >::ConstIterator tIt = page->d->m_tilesManagers.constBegin(), tEnd = page->d->m_tilesManagers.constEnd();
+    for ( ; tIt != tEnd; ++tIt )
+    {
+        foreach ( const Tile &tile, (*tIt)->tilesAt( NormalizedRect( 0.0, 0.0, 1.0, 1.0 ) ) )
+        {
+            if ( !tile.pixmap() )
+                continue;
+
+            PixmapRequest * p = new PixmapRequest( tIt.key(), pageNumber, (*tIt)->width(), (*tIt)->height(), 1, true );
+            p->setNormalizedRect( tile.rect() );
+            p->d->mForce = true;
+            requestedPixmaps.push_back( p );
+        }
+    }
     if ( !requestedPixmaps.isEmpty() )
         m_parent->requestPixmaps( requestedPixmaps, Okular::Document::NoOption );
 }
 
 void DocumentPrivate::_o_configChanged()
 {
+    calculateCacheMemoryBudget();
+
     // free text pages if needed
     calculateMaxTextPages();
     while (m_allocatedTextPagesFifo.count() > m_maxAllocatedTextPages)
@@ -1101,11 +1246,15 @@ void DocumentPrivate::doContinueNextMatchSearch(void *pagesToNotifySet, void * t
             {
                 // get page
                 Page * page = m_pagesVector[ currentPage ];
-                // request search page if needed
-                if ( !page->hasTextPage() )
-                    m_parent->requestTextPage( page->number() );
-                // if found a match on the current page, end the loop
-                match = page->findText( searchID, text, FromTop, caseSensitivity );
+                // skip the pages without text the index tells cannot match
+                if ( page->hasTextPage() || pageMayContain( page->number(), text ) )
+                {
+                    // request search page if needed
+                    if ( !page->hasTextPage() )
+                        m_parent->requestTextPage( page->number() );
+                    // if found a match on the current page, end the loop
+                    match = page->findText( searchID, text, FromTop, caseSensitivity );
+                }
 
                 if ( !match )
                 {
@@ -1214,11 +1363,15 @@ void DocumentPrivate::doContinuePrevMatchSearch(void *pagesToNotifySet, void * t
             {
                 // get page
                 Page * page = m_pagesVector[ currentPage ];
-                // request search page if needed
-                if ( !page->hasTextPage() )
-                    m_parent->requestTextPage( page->number() );
-                // if found a match on the current page, end the loop
-                match = page->findText( searchID, text, FromBottom, caseSensitivity );
+                // skip the pages without text the index tells cannot match
+                if ( page->hasTextPage() || pageMayContain( page->number(), text ) )
+                {
+                    // request search page if needed
+                    if ( !page->hasTextPage() )
+                        m_parent->requestTextPage( page->number() );
+                    // if found a match on the current page, end the loop
+                    match = page->findText( searchID, text, FromBottom, caseSensitivity );
+                }
 
                 if ( !match )
                 {
@@ -1239,212 +1392,219 @@ void DocumentPrivate::doContinuePrevMatchSearch(void *pagesToNotifySet, void * t
     doProcessSearchMatch( match, search, pagesToNotify, currentPage, searchID, moveViewport, color );
 }
 
-void DocumentPrivate::doContinueAllDocumentSearch(void *pagesToNotifySet, void *pageMatchesMap, int currentPage, int searchID, const QString & text, int theCaseSensitivity, const QColor & color)
+void DocumentPrivate::startTextSearch( int searchID, const QStringList &words, const QList< QColor > &colors, Qt::CaseSensitivity caseSensitivity, bool matchAll )
 {
-    QMap< Page *, QVector<RegularAreaRect *> > *pageMatches = static_cast< QMap< Page *, QVector<RegularAreaRect *> > * >(pageMatchesMap);
-    Qt::CaseSensitivity caseSensitivity = static_cast<Qt::CaseSensitivity>(theCaseSensitivity);
-    QSet< int > *pagesToNotify = static_cast< QSet< int > * >( pagesToNotifySet );
-    RunningSearch *search = m_searches.value(searchID);
+    // only a whole document search at a time
+    if ( m_textSearch )
+        textSearchFinished( m_textSearch, true );
 
-    if (m_searchCancelled || !search)
-    {
-        typedef QVector<RegularAreaRect *> MatchesVector;
-
-        QApplication::restoreOverrideCursor();
+    // extract the text in threads only if the generator can do that for
+    // more pages at the same time
+    int threads = 0;
+    if ( Settings::enableThreading() && m_generator->hasFeature( Generator::Threaded ) &&
+         m_generator->hasFeature( Generator::ConcurrentRendering ) )
+        threads = renderingThreads();
 
-        if (search) search->isCurrentlySearching = false;
+    m_textSearch = new TextSearch( this, searchID, words, colors, caseSensitivity, matchAll );
+    m_textSearch->start( threads );
+}
 
-        emit m_parent->searchFinished( searchID, Document::SearchCancelled );
-        foreach(const MatchesVector &mv, *pageMatches) qDeleteAll(mv);
-        delete pageMatches;
-        delete pagesToNotify;
-        return;
-    }
+void DocumentPrivate::textSearchPageDone( TextSearch *search, Page *page, TextPage *textPage, const QVector< TextSearch::Match > &matches )
+{
+    RunningSearch *s = m_searches.value( search->searchID() );
 
-    if (currentPage < m_pagesVector.count())
+    // keep the text extracted by the search, unless the page got one meanwhile
+    if ( textPage )
     {
-        // get page (from the first to the last)
-        Page *page = m_pagesVector.at(currentPage);
-        int pageNumber = page->number(); // redundant? is it == currentPage ?
-
-        // request search page if needed
         if ( !page->hasTextPage() )
-            m_parent->requestTextPage( pageNumber );
-
-        // loop on a page adding highlights for all found items
-        RegularAreaRect * lastMatch = 0;
-        while ( 1 )
         {
-            if ( lastMatch )
-                lastMatch = page->findText( searchID, text, NextResult, caseSensitivity, lastMatch );
-            else
-                lastMatch = page->findText( searchID, text, FromTop, caseSensitivity );
-
-            if ( !lastMatch )
-                break;
-
-            // add highligh rect to the matches map
-            (*pageMatches)[page].append(lastMatch);
+            page->setTextPage( textPage );
+            textGenerationDone( page );
         }
-        delete lastMatch;
-
-        QMetaObject::invokeMethod(m_parent, "doContinueAllDocumentSearch", Qt::QueuedConnection, Q_ARG(void *, pagesToNotifySet), Q_ARG(void *, pageMatches), Q_ARG(int, currentPage + 1), Q_ARG(int, searchID), Q_ARG(QString, text), Q_ARG(int, caseSensitivity), Q_ARG(QColor, color));
+        else
+            delete textPage;
     }
-    else
+
+    if ( matches.isEmpty() )
+        return;
+
+    foreach ( const TextSearch::Match &match, matches )
     {
-        // reset cursor to previous shape
-        QApplication::restoreOverrideCursor();
+        if ( s )
+            page->d->setHighlight( search->searchID(), match.first, match.second );
+        delete match.first;
+    }
+    if ( !s )
+        return;
 
-        search->isCurrentlySearching = false;
-        bool foundAMatch = pageMatches->count() != 0;
-        QMap< Page *, QVector<RegularAreaRect *> >::const_iterator it, itEnd;
-        it = pageMatches->constBegin();
-        itEnd = pageMatches->constEnd();
-        for ( ; it != itEnd; ++it)
-        {
-            foreach(RegularAreaRect *match, it.value())
-            {
-                it.key()->d->setHighlight( searchID, match, color );
-                delete match;
-            }
-            search->highlightedPages.insert( it.key()->number() );
-            pagesToNotify->insert( it.key()->number() );
-        }
+    // notify observers about highlights changes as soon as they are available
+    s->highlightedPages.insert( page->number() );
+    foreachObserverD( notifyPageChanged( page->number(), DocumentObserver::Highlights ) );
+}
 
-        foreach(DocumentObserver *observer, m_observers)
-            observer->notifySetup( m_pagesVector, 0 );
+void DocumentPrivate::textSearchFinished( TextSearch *search, bool cancelled )
+{
+    if ( search != m_textSearch )
+        return;
 
-        // notify observers about highlights changes
-        foreach(int pageNumber, *pagesToNotify)
-            foreach(DocumentObserver *observer, m_observers)
-                observer->notifyPageChanged( pageNumber, DocumentObserver::Highlights );
+    m_textSearch = 0;
+    const int searchID = search->searchID();
+    if ( cancelled )
+        search->cancel();
+    // we may be called by the search itself
+    search->deleteLater();
 
-        if (foundAMatch) emit m_parent->searchFinished(searchID, Document::MatchFound );
-        else emit m_parent->searchFinished( searchID, Document::NoMatchFound );
+    // reset cursor to previous shape
+    QApplication::restoreOverrideCursor();
 
-        delete pageMatches;
-        delete pagesToNotify;
+    RunningSearch *s = m_searches.value( searchID );
+    if ( s )
+        s->isCurrentlySearching = false;
+
+    if ( cancelled || !s )
+    {
+        emit m_parent->searchFinished( searchID, Document::SearchCancelled );
+        return;
     }
+
+    // send page lists to update observers (since some filter on bookmarks)
+    foreachObserverD( notifySetup( m_pagesVector, 0 ) );
+
+    if ( !s->highlightedPages.isEmpty() ) emit m_parent->searchFinished( searchID, Document::MatchFound );
+    else emit m_parent->searchFinished( searchID, Document::NoMatchFound );
 }
 
-void DocumentPrivate::doContinueGooglesDocumentSearch(void *pagesToNotifySet, void *pageMatchesMap, int currentPage, int searchID, const QStringList & words, int theCaseSensitivity, const QColor & color, bool matchAll)
+int DocumentPrivate::renderingThreads() const
 {
-    typedef QPair<RegularAreaRect *, QColor> MatchColor;
-    QMap< Page *, QVector<MatchColor> > *pageMatches = static_cast< QMap< Page *, QVector<MatchColor> > * >(pageMatchesMap);
-    Qt::CaseSensitivity caseSensitivity = static_cast<Qt::CaseSensitivity>(theCaseSensitivity);
-    QSet< int > *pagesToNotify = static_cast< QSet< int > * >( pagesToNotifySet );
-    RunningSearch *search = m_searches.value(searchID);
+    // 0 means "as many as the cores"
+    const int threads = Settings::renderingThreads();
+    return threads > 0 ? threads : qMax( 1, QThread::idealThreadCount() );
+}
 
-    if (m_searchCancelled || !search)
-    {
-        typedef QVector<MatchColor> MatchesVector;
+bool DocumentPrivate::pageMayContain( int page, const QString &text ) const
+{
+    return !m_textIndex || m_textIndex->mayContain( page, text );
+}
 
-        QApplication::restoreOverrideCursor();
+void DocumentPrivate::startTextIndex()
+{
+    if ( m_xmlFileName.isEmpty() || !m_generator->hasFeature( Generator::TextExtraction ) )
+        return;
 
-        if (search) search->isCurrentlySearching = false;
+    // the index is stored next to the document info file
+    QString indexFileName = m_xmlFileName;
+    if ( indexFileName.endsWith( QLatin1String( ".xml" ) ) )
+        indexFileName.chop( 4 );
+    indexFileName += QLatin1String( ".index" );
+    m_textIndex = new TextIndex( indexFileName, m_docFileName, m_pagesVector.count() );
 
-        emit m_parent->searchFinished( searchID, Document::SearchCancelled );
+    // the missing pages are indexed by the thread only if the generator can
+    // extract their text meanwhile the GUI uses it, otherwise the index is
+    // filled with the text pages of the GUI
+    Generator *generator = 0;
+    if ( Settings::enableThreading() && m_generator->hasFeature( Generator::Threaded ) &&
+         m_generator->hasFeature( Generator::ConcurrentRendering ) )
+        generator = m_generator;
 
-        foreach(const MatchesVector &mv, *pageMatches)
-        {
-            foreach(const MatchColor &mc, mv) delete mc.first;
-        }
-        delete pageMatches;
-        delete pagesToNotify;
-        return;
-    }
+    m_textIndexThread = new TextIndexThread( m_textIndex, generator, m_pagesVector );
+    m_textIndexThread->start( QThread::IdlePriority );
+}
 
-    const int wordCount = words.count();
-    const int hueStep = (wordCount > 1) ? (60 / (wordCount - 1)) : 60;
-    int baseHue, baseSat, baseVal;
-    color.getHsv( &baseHue, &baseSat, &baseVal );
+void DocumentPrivate::stopTextIndex()
+{
+    if ( m_textIndexThread )
+    {
+        m_textIndexThread->stopIndexing();
+        m_textIndexThread->wait();
+        delete m_textIndexThread;
+        m_textIndexThread = 0;
+    }
 
-    if (currentPage < m_pagesVector.count())
+    if ( m_textIndex )
     {
-        // get page (from the first to the last)
-        Page *page = m_pagesVector.at(currentPage);
-        int pageNumber = page->number(); // redundant? is it == currentPage ?
+        m_textIndex->save();
+        delete m_textIndex;
+        m_textIndex = 0;
+    }
+}
 
-        // request search page if needed
-        if ( !page->hasTextPage() )
-            m_parent->requestTextPage( pageNumber );
+void DocumentPrivate::startThumbnailStore()
+{
+    if ( m_xmlFileName.isEmpty() )
+        return;
 
-        // loop on a page adding highlights for all found items
-        bool allMatched = wordCount > 0,
-             anyMatched = false;
-        for ( int w = 0; w < wordCount; w++ )
-        {
-            const QString &word = words[ w ];
-            int newHue = baseHue - w * hueStep;
-            if ( newHue < 0 )
-                newHue += 360;
-            QColor wordColor = QColor::fromHsv( newHue, baseSat, baseVal );
-            RegularAreaRect * lastMatch = 0;
-            // add all highlights for current word
-            bool wordMatched = false;
-            while ( 1 )
-            {
-                if ( lastMatch )
-                    lastMatch = page->findText( searchID, word, NextResult, caseSensitivity, lastMatch );
-                else
-                    lastMatch = page->findText( searchID, word, FromTop, caseSensitivity);
+    // the thumbnails are stored next to the document info file
+    QString storeFileName = m_xmlFileName;
+    if ( storeFileName.endsWith( QLatin1String( ".xml" ) ) )
+        storeFileName.chop( 4 );
+    storeFileName += QLatin1String( ".thumbnails" );
+    m_thumbnailStore = new ThumbnailStore( storeFileName, m_docFileName, m_pagesVector.count() );
 
-                if ( !lastMatch )
-                    break;
+    // the embedded thumbnails are read by the thread only if the generator
+    // can work outside the GUI thread; the pages still missing a thumbnail
+    // are requested once it is done, see requestStoreThumbnails()
+    Generator *generator = 0;
+    if ( Settings::enableThreading() && m_generator->hasFeature( Generator::Threaded ) )
+        generator = m_generator;
 
-                // add highligh rect to the matches map
-                (*pageMatches)[page].append(MatchColor(lastMatch, wordColor));
-                wordMatched = true;
-            }
-            allMatched = allMatched && wordMatched;
-            anyMatched = anyMatched || wordMatched;
-        }
+    m_thumbnailStoreThread = new ThumbnailStoreThread( m_thumbnailStore, generator, m_pagesVector );
+    QObject::connect( m_thumbnailStoreThread, SIGNAL(finished()), m_parent, SLOT(thumbnailStoreFilled()) );
+    m_thumbnailStoreThread->start( QThread::IdlePriority );
+}
 
-        // if not all words are present in page, remove partial highlights
-        if ( !allMatched && matchAll )
-        {
-            QVector<MatchColor> &matches = (*pageMatches)[page];
-            foreach(const MatchColor &mc, matches) delete mc.first;
-            pageMatches->remove(page);
-        }
+void DocumentPrivate::thumbnailStoreFilled()
+{
+    // the signal may come from the thread of a document closed meanwhile
+    if ( !m_thumbnailStoreThread || !m_thumbnailStoreThread->isFinished() )
+        return;
 
-        QMetaObject::invokeMethod(m_parent, "doContinueGooglesDocumentSearch", Qt::QueuedConnection, Q_ARG(void *, pagesToNotifySet), Q_ARG(void *, pageMatches), Q_ARG(int, currentPage + 1), Q_ARG(int, searchID), Q_ARG(QStringList, words), Q_ARG(int, caseSensitivity), Q_ARG(QColor, color), Q_ARG(bool, matchAll));
-    }
-    else
-    {
-        // reset cursor to previous shape
-        QApplication::restoreOverrideCursor();
+    requestStoreThumbnails( 0, m_pagesVector.count() - 1 );
+}
 
-        search->isCurrentlySearching = false;
-        bool foundAMatch = pageMatches->count() != 0;
-        QMap< Page *, QVector<MatchColor> >::const_iterator it, itEnd;
-        it = pageMatches->constBegin();
-        itEnd = pageMatches->constEnd();
-        for ( ; it != itEnd; ++it)
-        {
-            foreach(const MatchColor &mc, it.value())
-            {
-                it.key()->d->setHighlight( searchID, mc.first, mc.second );
-                delete mc.first;
-            }
-            search->highlightedPages.insert( it.key()->number() );
-            pagesToNotify->insert( it.key()->number() );
-        }
+void DocumentPrivate::requestStoreThumbnails( int firstPage, int lastPage )
+{
+    // the pages are rendered for the store at the lowest priority, and only
+    // if that does not delay the rendering for the GUI; otherwise the store
+    // is filled with the pixmaps rendered for the GUI
+    if ( !m_thumbnailStoreThread || !m_thumbnailStoreThread->isFinished() || m_rotation != Rotation0 ||
+         !Settings::enableThreading() || !m_generator->hasFeature( Generator::Threaded ) ||
+         !m_generator->hasFeature( Generator::ConcurrentRendering ) )
+        return;
 
-        // send page lists to update observers (since some filter on bookmarks)
-        foreach(DocumentObserver *observer, m_observers)
-            observer->notifySetup( m_pagesVector, 0 );
+    QLinkedList< PixmapRequest * > requests;
+    for ( int i = qMax( firstPage, 0 ); i <= lastPage && i < m_pagesVector.count(); ++i )
+    {
+        const Page *page = m_pagesVector.at( i );
+        if ( page->width() <= 0 || page->height() <= 0 ||
+             !m_thumbnailStore->wantsThumbnail( i, ThumbnailStore::ThumbnailWidth ) )
+            continue;
 
-        // notify observers about highlights changes
-        foreach(int pageNumber, *pagesToNotify)
-            foreach(DocumentObserver *observer, m_observers)
-                observer->notifyPageChanged( pageNumber, DocumentObserver::Highlights );
+        const int height = qMax( 1, qRound( ThumbnailStore::ThumbnailWidth * page->ratio() ) );
+        requests.push_back( new PixmapRequest( THUMBNAILSTORE_ID, i, ThumbnailStore::ThumbnailWidth, height, THUMBNAILSTORE_PRIO, true ) );
+    }
+    if ( !requests.isEmpty() )
+        m_parent->requestPixmaps( requests, Document::NoOption );
+}
 
-        if (foundAMatch) emit m_parent->searchFinished( searchID, Document::MatchFound );
-        else emit m_parent->searchFinished( searchID, Document::NoMatchFound );
+void DocumentPrivate::stopThumbnailStore()
+{
+    if ( m_thumbnailStoreThread )
+    {
+        // it stops soon, but at its idle priority it could wait long
+        // behind the rendering threads before it notices
+        m_thumbnailStoreThread->stopFilling();
+        if ( m_thumbnailStoreThread->isRunning() )
+            m_thumbnailStoreThread->setPriority( QThread::NormalPriority );
+        m_thumbnailStoreThread->wait();
+        delete m_thumbnailStoreThread;
+        m_thumbnailStoreThread = 0;
+    }
 
-        delete pageMatches;
-        delete pagesToNotify;
+    if ( m_thumbnailStore )
+    {
+        m_thumbnailStore->save();
+        delete m_thumbnailStore;
+        m_thumbnailStore = 0;
     }
 }
 
@@ -1501,6 +1661,14 @@ QVariant DocumentPrivate::documentMetaData( const QString &key, const QVariant &
                 break;
         }
     }
+    else if ( key == QLatin1String( "RenderingThreads" ) )
+    {
+        return renderingThreads();
+    }
+    else if ( key == QLatin1String( "CacheMemoryBudget" ) )
+    {
+        return m_cacheMemoryBudget;
+    }
     else if ( key == QLatin1String( "TextHinting" ) )
     {
         switch ( Settings::textHinting() )
@@ -1524,6 +1692,10 @@ Document::Document( QWidget *widget )
     d->m_bookmarkManager = new BookmarkManager( d );
     d->m_viewportIterator = d->m_viewportHistory.insert( d->m_viewportHistory.end(), DocumentViewport() );
 
+    // [MEM] the pixmaps of the main views weigh more than the thumbnails
+    d->m_pixmapCache.setObserverWeight( PAGEVIEW_ID, 4 );
+    d->m_pixmapCache.setObserverWeight( PRESENTATION_ID, 4 );
+
     connect( PageController::self(), SIGNAL(rotationFinished(int,Okular::Page*)),
              this, SLOT(rotationFinished(int,Okular::Page*)) );
     connect( Settings::self(), SIGNAL(configChanged()), this, SLOT(_o_configChanged()) );
@@ -1707,12 +1879,16 @@ bool Document::openDocument( const QString & docFile, const KUrl& url, const KMi
     else
     {
         d->loadDocumentInfo();
-        d->m_annotationsNeedSaveAs = ( d->canAddAnnotationsNatively() && containsExternalAnnotations );
+        // the pages loaded while restoring may have found external annotations already
+        d->m_annotationsNeedSaveAs = d->m_annotationsNeedSaveAs || ( d->canAddAnnotationsNatively() && containsExternalAnnotations );
     }
 
     d->m_showWarningLimitedAnnotSupport = true;
     d->m_bookmarkManager->setUrl( d->m_url );
 
+    d->startTextIndex();
+    d->startThumbnailStore();
+
     // 3. setup observers inernal lists and data
     foreachObserver( notifySetup( d->m_pagesVector, DocumentObserver::DocumentChanged ) );
 
@@ -1722,11 +1898,17 @@ bool Document::openDocument( const QString & docFile, const KUrl& url, const KMi
     {
         (*d->m_viewportIterator) = DocumentViewport();
         if ( loadedViewport.pageNumber >= (int)d->m_pagesVector.size() )
+        {
+            // go there once the generator appends the page
+            if ( !d->m_pagesComplete )
+                d->m_pendingViewport = loadedViewport;
             loadedViewport.pageNumber = d->m_pagesVector.size() - 1;
+        }
     }
     else
         loadedViewport.pageNumber = 0;
     setViewport( loadedViewport );
+    d->m_viewportBeforePending = (*d->m_viewportIterator);
 
     // start bookmark saver timer
     if ( !d->m_saveBookmarksTimer )
@@ -1798,6 +1980,10 @@ void Document::closeDocument()
     d->m_pixmapRequestsStack.clear();
     d->m_pixmapRequestsMutex.unlock();
 
+    // do not wait for the requests the generator did not start yet
+    if ( d->m_generator )
+        d->cancelPixmapRequests( -1, QSet< int >() );
+
     QEventLoop loop;
     bool startEventLoop = false;
     do
@@ -1822,6 +2008,16 @@ void Document::closeDocument()
         d->m_fontThread = 0;
     }
 
+    // stop the whole document search, if any
+    if ( d->m_textSearch )
+        d->textSearchFinished( d->m_textSearch, true );
+
+    // stop indexing the text, saving what is complete
+    d->stopTextIndex();
+
+    // stop filling the thumbnails, saving them
+    d->stopThumbnailStore();
+
     // stop any audio playback
     AudioPlayer::instance()->stopPlaybacks();
 
@@ -1866,6 +2062,10 @@ void Document::closeDocument()
     d->m_fontsCached = false;
     d->m_fontsCache.clear();
     d->m_rotation = Rotation0;
+    d->m_pageSizesChanged = false;
+    d->m_pagesComplete = true;
+    d->m_pendingPageElements.clear();
+    d->m_pendingViewport = DocumentViewport();
 
     // send an empty list to observers (to free their data)
     foreachObserver( notifySetup( QVector< Page * >(), DocumentObserver::DocumentChanged ) );
@@ -1878,11 +2078,9 @@ void Document::closeDocument()
     d->m_pagesVector.clear();
 
     // clear 'memory allocation' descriptors
-    QLinkedList< AllocatedPixmap * >::const_iterator aIt = d->m_allocatedPixmapsFifo.constBegin();
-    QLinkedList< AllocatedPixmap * >::const_iterator aEnd = d->m_allocatedPixmapsFifo.constEnd();
-    for ( ; aIt != aEnd; ++aIt )
-        delete *aIt;
-    d->m_allocatedPixmapsFifo.clear();
+    kDebug(OkularDebug).nospace() << "pixmap cache: " << d->m_pixmapCache.hits() << " hits, " << d->m_pixmapCache.misses() << " misses";
+    d->m_pixmapCache.clear();
+    d->m_pixmapCache.resetCounters();
 
     // clear 'running searches' descriptors
     QMap< int, RunningSearch * >::const_iterator rIt = d->m_searches.constBegin();
@@ -1904,7 +2102,6 @@ void Document::closeDocument()
     d->m_viewportHistory.clear();
     d->m_viewportHistory.append( DocumentViewport() );
     d->m_viewportIterator = d->m_viewportHistory.begin();
-    d->m_allocatedPixmapsTotalMemory = 0;
     d->m_allocatedTextPagesFifo.clear();
     d->m_pageSize = PageSize();
     d->m_pageSizes.clear();
@@ -1940,19 +2137,7 @@ void Document::removeObserver( DocumentObserver * pObserver )
             (*it)->deletePixmap( observerId );
 
         // [MEM] free observer's allocation descriptors
-        QLinkedList< AllocatedPixmap * >::iterator aIt = d->m_allocatedPixmapsFifo.begin();
-        QLinkedList< AllocatedPixmap * >::iterator aEnd = d->m_allocatedPixmapsFifo.end();
-        while ( aIt != aEnd )
-        {
-            AllocatedPixmap * p = *aIt;
-            if ( p->id == observerId )
-            {
-                aIt = d->m_allocatedPixmapsFifo.erase( aIt );
-                delete p;
-            }
-            else
-                ++aIt;
-        }
+        d->m_pixmapCache.removeObserver( observerId );
 
         // delete observer entry from the map
         d->m_observers.remove( observerId );
@@ -1978,12 +2163,14 @@ void Document::reparseConfig()
         }
 
         // [MEM] remove allocation descriptors
-        QLinkedList< AllocatedPixmap * >::const_iterator aIt = d->m_allocatedPixmapsFifo.constBegin();
-        QLinkedList< AllocatedPixmap * >::const_iterator aEnd = d->m_allocatedPixmapsFifo.constEnd();
-        for ( ; aIt != aEnd; ++aIt )
-            delete *aIt;
-        d->m_allocatedPixmapsFifo.clear();
-        d->m_allocatedPixmapsTotalMemory = 0;
+        d->m_pixmapCache.clear();
+
+        // the stored thumbnails were rendered with the old settings
+        if ( d->m_thumbnailStore )
+        {
+            d->m_thumbnailStore->clear();
+            d->requestStoreThumbnails( 0, d->m_pagesVector.count() - 1 );
+        }
 
         // send reload signals to observers
         foreachObserver( notifyContentsCleared( DocumentObserver::Pixmap ) );
@@ -1991,7 +2178,7 @@ void Document::reparseConfig()
 
     // free memory if in 'low' profile
     if ( Settings::memoryLevel() == Settings::EnumMemoryLevel::Low &&
-         !d->m_allocatedPixmapsFifo.isEmpty() && !d->m_pagesVector.isEmpty() )
+         !d->m_pixmapCache.isEmpty() && !d->m_pagesVector.isEmpty() )
         d->cleanupPixmapMemory();
 }
 
@@ -2129,6 +2316,11 @@ void Document::setVisiblePageRects( const QVector< VisiblePageRect * > & visible
     for ( ; vIt != vEnd; ++vIt )
         delete *vIt;
     d->m_pageRects = visiblePageRects;
+    // [MEM] the visible pages are the most recently used ones
+    vIt = d->m_pageRects.constBegin();
+    vEnd = d->m_pageRects.constEnd();
+    for ( ; vIt != vEnd; ++vIt )
+        d->m_pixmapCache.touchPage( (*vIt)->pageNumber );
     // notify change to all other (different from id) observers
     QMap< int, DocumentObserver * >::const_iterator it = d->m_observers.constBegin(), end = d->m_observers.constEnd();
     for ( ; it != end ; ++ it )
@@ -2174,6 +2366,11 @@ bool Document::supportsPageSizes() const
     return d->m_generator ? d->m_generator->hasFeature( Generator::PageSizes ) : false;
 }
 
+bool Document::supportsTiles() const
+{
+    return d->m_generator ? d->m_generator->hasFeature( Generator::TiledRendering ) : false;
+}
+
 PageSize::List Document::pageSizes() const
 {
     if ( d->m_generator )
@@ -2299,6 +2496,9 @@ void Document::requestPixmaps( const QLinkedList< PixmapRequest * > & requests,
             requestedPages.insert( (*rIt)->pageNumber() );
     }
     const bool removeAllPrevious = reqOptions & RemoveAllPrevious;
+    // the previous requests already sent to the generator are not wanted either,
+    // unless they draw what is requested again
+    d->cancelPixmapRequests( requesterID, removeAllPrevious ? QSet< int >() : requestedPages, requests );
     d->m_pixmapRequestsMutex.lock();
     QLinkedList< PixmapRequest * >::iterator sIt = d->m_pixmapRequestsStack.begin(), sEnd = d->m_pixmapRequestsStack.end();
     while ( sIt != sEnd )
@@ -2316,6 +2516,7 @@ void Document::requestPixmaps( const QLinkedList< PixmapRequest * > & requests,
 
     // 2. [ADD TO STACK] add requests to stack
     bool threadingDisabled = !Settings::enableThreading();
+    QList< PixmapRequest * > thumbnailRequests;
     QLinkedList< PixmapRequest * >::const_iterator rIt = requests.constBegin(), rEnd = requests.constEnd();
     for ( ; rIt != rEnd; ++rIt )
     {
@@ -2337,23 +2538,84 @@ void Document::requestPixmaps( const QLinkedList< PixmapRequest * > & requests,
         if ( request->asynchronous() && threadingDisabled )
             request->d->mAsynchronous = false;
 
-        // add request to the 'stack' at the right place
-        if ( !request->priority() )
-            // add priority zero requests to the top of the stack
-            d->m_pixmapRequestsStack.append( request );
-        else
+        // [MEM] a request for an existing pixmap is a cache hit
+        const bool hit = !request->d->mForce && request->d->hasPixmap();
+        d->m_pixmapCache.countRequest( hit );
+        if ( hit )
+            d->m_pixmapCache.touch( request->id(), request->pageNumber() );
+
+        // the stored thumbnail of the page is enough for the thumbnail list,
+        // not for the other observers, as it is compressed lossy
+        if ( request->id() == THUMBNAILS_ID && !request->isTile() && !request->d->mForce && !request->d->hasPixmap() && d->m_thumbnailStore &&
+             d->m_rotation == Rotation0 && d->m_thumbnailStore->hasThumbnail( request->pageNumber(), request->width(), request->height() ) )
         {
-            // insert in stack sorted by priority
-            sIt = d->m_pixmapRequestsStack.begin();
-            sEnd = d->m_pixmapRequestsStack.end();
-            while ( sIt != sEnd && (*sIt)->priority() > request->priority() )
-                ++sIt;
-            d->m_pixmapRequestsStack.insert( sIt, request );
+            thumbnailRequests.append( request );
+            continue;
         }
+
+        if ( !request->isTile() )
+        {
+            d->queuePixmapRequest( request );
+            continue;
+        }
+
+        // tiles are not rotated, so rotated pages are requested as a whole
+        if ( !supportsTiles() || d->m_rotation != Rotation0 )
+        {
+            request->setNormalizedRect( NormalizedRect( 0.0, 0.0, 1.0, 1.0 ) );
+            d->queuePixmapRequest( request );
+            continue;
+        }
+
+        // split the request in one request for each tile to be rendered,
+        // keeping only the tiles around the requested area
+        Page *page = request->d->mPage;
+        TilesManager *tm = page->d->m_tilesManagers.value( request->id() );
+        if ( !tm )
+        {
+            tm = new TilesManager( request->width(), request->height() );
+            page->d->m_tilesManagers.insert( request->id(), tm );
+        }
+        tm->setSize( request->width(), request->height() );
+
+        const NormalizedRect &rect = request->normalizedRect();
+        const double marginX = ( rect.right - rect.left ) / 2.0;
+        const double marginY = ( rect.bottom - rect.top ) / 2.0;
+        tm->cleanupPixmaps( NormalizedRect( rect.left - marginX, rect.top - marginY, rect.right + marginX, rect.bottom + marginY ) );
+
+        foreach ( const Tile &tile, tm->tilesAt( rect ) )
+        {
+            if ( tile.pixmap() && !request->d->mForce )
+                continue;
+
+            PixmapRequest *tileRequest = new PixmapRequest( request->id(), request->pageNumber(), request->width(), request->height(), request->priority(), request->asynchronous() );
+            tileRequest->setNormalizedRect( tile.rect() );
+            tileRequest->d->mForce = request->d->mForce;
+            tileRequest->d->mPage = page;
+            d->queuePixmapRequest( tileRequest );
+        }
+        delete request;
     }
     d->m_pixmapRequestsMutex.unlock();
 
-    // 3. [START FIRST GENERATION] if <NO>generator is ready, start a new generation,
+    // 3. [THUMBNAILS] satisfy right away the requests the stored thumbnails are
+    // enough for, sending to the generator the ones they turn out to be not
+    foreach ( PixmapRequest *request, thumbnailRequests )
+    {
+        const QImage thumbnail = d->m_thumbnailStore->thumbnail( request->pageNumber(), request->width(), request->height() );
+        if ( thumbnail.isNull() )
+        {
+            d->m_pixmapRequestsMutex.lock();
+            d->queuePixmapRequest( request );
+            d->m_pixmapRequestsMutex.unlock();
+            continue;
+        }
+
+        request->page()->setPixmap( request->id(), new QPixmap( QPixmap::fromImage( thumbnail ) ) );
+        d->requestDone( request );
+    }
+
+    // 4. [START FIRST GENERATION] if <NO>generator is ready, start a new generation,
     // or else (if gen is running) it will be started when the new contents will
     //come from generator (in requestDone())</NO>
     // all handling of requests put into sendGeneratorRequest
@@ -2455,6 +2717,9 @@ void Document::modifyPageAnnotation( int page, Annotation * annotation, bool app
     if ( !d->m_generator || !kp )
         return;
 
+    // its geometry may have changed
+    kp->d->invalidateObjectRectIndex();
+
     // tell the annotation proxy
     if ( proxy && proxy->supports(AnnotationProxy::Modification) )
         proxy->notifyModification( annotation, page, appearanceChanged );
@@ -2715,26 +2980,8 @@ void Document::setViewport( const DocumentViewport & viewport, int excludeId, bo
         if ( it.key() != excludeId )
             (*it)->notifyViewportChanged( smoothMove );
 
-    // [MEM] raise position of currently viewed page in allocation queue
-    if ( d->m_allocatedPixmapsFifo.count() > 1 )
-    {
-        const int page = viewport.pageNumber;
-        QLinkedList< AllocatedPixmap * > viewportPixmaps;
-        QLinkedList< AllocatedPixmap * >::iterator aIt = d->m_allocatedPixmapsFifo.begin();
-        QLinkedList< AllocatedPixmap * >::iterator aEnd = d->m_allocatedPixmapsFifo.end();
-        while ( aIt != aEnd )
-        {
-            if ( (*aIt)->page == page )
-            {
-                viewportPixmaps.append( *aIt );
-                aIt = d->m_allocatedPixmapsFifo.erase( aIt );
-                continue;
-            }
-            ++aIt;
-        }
-        if ( !viewportPixmaps.isEmpty() )
-            d->m_allocatedPixmapsFifo += viewportPixmaps;
-    }
+    // [MEM] mark the pixmaps of currently viewed page as recently used
+    d->m_pixmapCache.touchPage( viewport.pageNumber );
 }
 
 void Document::setZoom(int factor, int excludeId)
@@ -2847,10 +3094,13 @@ void Document::searchText( int searchID, const QString & text, bool fromStart, Q
     // 1. ALLDOC - proces all document marking pages
     if ( type == AllDocument )
     {
-        QMap< Page *, QVector<RegularAreaRect *> > *pageMatches = new QMap< Page *, QVector<RegularAreaRect *> >;
+        // the removed highlights are not going to be replaced all at once
+        foreach(int pageNumber, *pagesToNotify)
+            foreachObserver( notifyPageChanged( pageNumber, DocumentObserver::Highlights ) );
+        delete pagesToNotify;
 
         // search and highlight 'text' (as a solid phrase) on all pages
-        QMetaObject::invokeMethod(this, "doContinueAllDocumentSearch", Qt::QueuedConnection, Q_ARG(void *, pagesToNotify), Q_ARG(void *, pageMatches), Q_ARG(int, 0), Q_ARG(int, searchID), Q_ARG(QString, text), Q_ARG(int, caseSensitivity), Q_ARG(QColor, color));
+        d->startTextSearch( searchID, QStringList() << text, QList< QColor >() << color, caseSensitivity, false );
     }
     // 2. NEXTMATCH - find next matching item (or start from top)
     else if ( type == NextMatch )
@@ -2909,11 +3159,29 @@ void Document::searchText( int searchID, const QString & text, bool fromStart, Q
     {
         bool matchAll = type == GoogleAll;
 
-        QMap< Page *, QVector< QPair<RegularAreaRect *, QColor> > > *pageMatches = new QMap< Page *, QVector<QPair<RegularAreaRect *, QColor> > >;
+        // the removed highlights are not going to be replaced all at once
+        foreach(int pageNumber, *pagesToNotify)
+            foreachObserver( notifyPageChanged( pageNumber, DocumentObserver::Highlights ) );
+        delete pagesToNotify;
+
         const QStringList words = text.split( ' ', QString::SkipEmptyParts );
 
+        // every word gets its own shade of the given color
+        const int wordCount = words.count();
+        const int hueStep = (wordCount > 1) ? (60 / (wordCount - 1)) : 60;
+        int baseHue, baseSat, baseVal;
+        color.getHsv( &baseHue, &baseSat, &baseVal );
+        QList< QColor > colors;
+        for ( int w = 0; w < wordCount; w++ )
+        {
+            int newHue = baseHue - w * hueStep;
+            if ( newHue < 0 )
+                newHue += 360;
+            colors.append( QColor::fromHsv( newHue, baseSat, baseVal ) );
+        }
+
         // search and highlight every word in 'text' on all pages
-        QMetaObject::invokeMethod(this, "doContinueGooglesDocumentSearch", Qt::QueuedConnection, Q_ARG(void *, pagesToNotify), Q_ARG(void *, pageMatches), Q_ARG(int, 0), Q_ARG(int, searchID), Q_ARG(QStringList, words), Q_ARG(int, caseSensitivity), Q_ARG(QColor, color), Q_ARG(bool, matchAll));
+        d->startTextSearch( searchID, words, colors, caseSensitivity, matchAll );
     }
 }
 
@@ -2973,6 +3241,10 @@ void Document::resetSearch( int searchID )
     // send the setup signal too (to update views that filter on matches)
     foreachObserver( notifySetup( d->m_pagesVector, 0 ) );
 
+    // stop the search if still running
+    if ( d->m_textSearch && d->m_textSearch->searchID() == searchID )
+        d->textSearchFinished( d->m_textSearch, true );
+
     // remove serch from the runningSearches list and delete it
     d->m_searches.erase( searchIt );
     delete s;
@@ -2981,6 +3253,9 @@ void Document::resetSearch( int searchID )
 void Document::cancelSearch()
 {
     d->m_searchCancelled = true;
+
+    if ( d->m_textSearch )
+        d->textSearchFinished( d->m_textSearch, true );
 }
 
 BookmarkManager * Document::bookmarkManager() const
@@ -3792,36 +4067,46 @@ void DocumentPrivate::requestDone( PixmapRequest * req )
         kDebug(OkularDebug) << "requestDone with generator not in READY state.";
 #endif
 
-    // [MEM] 1.1 find and remove a previous entry for the same page and id
-    QLinkedList< AllocatedPixmap * >::iterator aIt = m_allocatedPixmapsFifo.begin();
-    QLinkedList< AllocatedPixmap * >::iterator aEnd = m_allocatedPixmapsFifo.end();
-    for ( ; aIt != aEnd; ++aIt )
-        if ( (*aIt)->page == req->pageNumber() && (*aIt)->id == req->id() )
-        {
-            AllocatedPixmap * p = *aIt;
-            m_allocatedPixmapsFifo.erase( aIt );
-            m_allocatedPixmapsTotalMemory -= p->memory;
-            delete p;
-            break;
-        }
-
     QMap< int, DocumentObserver * >::const_iterator itObserver = m_observers.constFind( req->id() );
     if ( itObserver != m_observers.constEnd() )
     {
-        // [MEM] 1.2 append memory allocation descriptor to the FIFO
+        // [MEM] 1. record the memory allocation as the most recently used one,
+        // replacing a previous entry for the same page and id
         qulonglong memoryBytes = 4 * req->width() * req->height();
-        AllocatedPixmap * memoryPage = new AllocatedPixmap( req->id(), req->pageNumber(), memoryBytes );
-        m_allocatedPixmapsFifo.append( memoryPage );
-        m_allocatedPixmapsTotalMemory += memoryBytes;
+        if ( req->isTile() )
+        {
+            // the tiles of the page, plus its whole pixmap if still around
+            const TilesManager *tm = req->page()->d->m_tilesManagers.value( req->id() );
+            memoryBytes = tm ? tm->totalMemory() : 0;
+            QMap< int, PagePrivate::PixmapObject >::const_iterator it = req->page()->d->m_pixmaps.constFind( req->id() );
+            if ( it != req->page()->d->m_pixmaps.constEnd() )
+                memoryBytes += 4 * (*it).m_pixmap->width() * (*it).m_pixmap->height();
+        }
+        m_pixmapCache.insert( req->id(), req->pageNumber(), memoryBytes );
 
         // 2. notify an observer that its pixmap changed
         itObserver.value()->notifyPageChanged( req->pageNumber(), DocumentObserver::Pixmap );
     }
 #ifndef NDEBUG
-    else
+    else if ( req->id() != THUMBNAILSTORE_ID )
         kWarning(OkularDebug) << "Receiving a done request for the defunct observer" << req->id();
 #endif
 
+    // [THUMBNAILS] keep a small copy of the page, if better than the stored
+    // one or if the page has been rendered again as its contents changed;
+    // taken from the image the generator rendered, the store scales and
+    // compresses it in its own thread
+    if ( m_thumbnailStore && !req->isTile() && m_rotation == Rotation0 )
+    {
+        if ( req->d->mForce )
+            m_thumbnailStore->removeThumbnail( req->pageNumber() );
+        if ( !req->d->mImage.isNull() )
+            m_thumbnailStore->queueThumbnail( req->pageNumber(), req->d->mImage );
+    }
+    // nobody shows the pixmaps rendered just for the store
+    if ( req->id() == THUMBNAILSTORE_ID )
+        req->page()->deletePixmap( THUMBNAILSTORE_ID );
+
     // 3. delete request
     m_pixmapRequestsMutex.lock();
     m_executingPixmapRequests.removeAll( req );
@@ -3856,6 +4141,135 @@ void DocumentPrivate::setPageBoundingBox( int page, const NormalizedRect& boundi
 
 }
 
+void DocumentPrivate::pageDataChanged( int page )
+{
+    Page * kp = m_pagesVector[ page ];
+    if ( !m_generator || !kp )
+        return;
+
+    // the annotations of the document loaded now must be taken into account
+    // as if they had been there when opening it
+    if ( !m_annotationsNeedSaveAs && canAddAnnotationsNatively() )
+    {
+        foreach ( Annotation *annotation, kp->annotations() )
+        {
+            if ( annotation->flags() & Annotation::External )
+            {
+                m_annotationsNeedSaveAs = true;
+                break;
+            }
+        }
+    }
+
+    foreachObserverD( notifyPageChanged( page, DocumentObserver::Annotations ) );
+}
+
+void DocumentPrivate::pageSizeChanged( int page, double width, double height )
+{
+    Page * kp = m_pagesVector.value( page );
+    if ( !m_generator || !kp )
+        return;
+
+    // the size is given for the page not rotated
+    const bool rotated = kp->rotation() % 2;
+    if ( ( rotated ? kp->height() : kp->width() ) == width &&
+         ( rotated ? kp->width() : kp->height() ) == height )
+        return;
+
+    // the pixmaps of the page are deleted with the old size
+    kp->d->changeSize( PageSize( width, height, QString() ) );
+    foreach ( int id, m_observers.keys() )
+        m_pixmapCache.remove( id, page );
+
+    // relayout once for all the pages changed meanwhile
+    if ( !m_pageSizesChanged )
+    {
+        m_pageSizesChanged = true;
+        QMetaObject::invokeMethod( m_parent, "_o_pageSizesChanged", Qt::QueuedConnection );
+    }
+}
+
+void DocumentPrivate::pagesAppended( const QVector< Page * > &pages )
+{
+    if ( !m_generator || pages.isEmpty() )
+    {
+        qDeleteAll( pages );
+        return;
+    }
+
+    foreach ( Page * page, pages )
+    {
+        Q_ASSERT( page->number() == m_pagesVector.count() );
+        if ( m_rotation != Rotation0 )
+            page->d->rotateAt( m_rotation );
+        m_pagesVector.append( page );
+
+        // the document info kept aside for the page, see loadDocumentInfo()
+        const QDomElement pageElement = m_pendingPageElements.take( page->number() );
+        if ( !pageElement.isNull() )
+        {
+            QMetaObject::invokeMethod( m_generator, "loadPageData", Qt::DirectConnection, Q_ARG(Okular::Page*, page) );
+            page->d->restoreLocalContents( pageElement );
+        }
+    }
+
+    if ( m_textIndex )
+        m_textIndex->setPageCount( m_pagesVector.count() );
+    if ( m_thumbnailStore )
+    {
+        m_thumbnailStore->setPageCount( m_pagesVector.count() );
+        requestStoreThumbnails( pages.first()->number(), m_pagesVector.count() - 1 );
+    }
+
+    foreachObserverD( notifySetup( m_pagesVector, DocumentObserver::PagesAppended ) );
+
+    restorePendingViewport();
+}
+
+void DocumentPrivate::setPagesComplete( bool complete )
+{
+    if ( complete == m_pagesComplete )
+        return;
+
+    m_pagesComplete = complete;
+    if ( !complete )
+        return;
+
+    // the document info of pages the document does not have anymore
+    m_pendingPageElements.clear();
+
+    foreachObserverD( notifySetup( m_pagesVector, DocumentObserver::PagesAppended | DocumentObserver::PagesComplete ) );
+
+    restorePendingViewport();
+}
+
+void DocumentPrivate::restorePendingViewport()
+{
+    if ( !m_pendingViewport.isValid() ||
+         ( m_pendingViewport.pageNumber >= m_pagesVector.count() && !m_pagesComplete ) )
+        return;
+
+    DocumentViewport viewport = m_pendingViewport;
+    m_pendingViewport = DocumentViewport();
+
+    // do not move the view away from where the user went meanwhile
+    if ( !( (*m_viewportIterator) == m_viewportBeforePending ) )
+        return;
+
+    if ( viewport.pageNumber >= m_pagesVector.count() )
+        viewport.pageNumber = m_pagesVector.count() - 1;
+    m_parent->setViewport( viewport );
+}
+
+void DocumentPrivate::_o_pageSizesChanged()
+{
+    if ( !m_pageSizesChanged )
+        return;
+
+    m_pageSizesChanged = false;
+    foreachObserverD( notifySetup( m_pagesVector, DocumentObserver::NewLayoutForPages ) );
+}
+
 void DocumentPrivate::calculateMaxTextPages()
 {
     int multipliers = qMax(1, qRound(getTotalMemory() / 536870912.0)); // 512 MB
@@ -3879,6 +4293,30 @@ void DocumentPrivate::calculateMaxTextPages()
     }
 }
 
+void DocumentPrivate::calculateCacheMemoryBudget()
+{
+    const qulonglong multipliers = qMax(1, qRound(getTotalMemory() / 536870912.0)); // 512 MB
+    switch (Settings::memoryLevel())
+    {
+        case Settings::EnumMemoryLevel::Low:
+            // nothing more than the data needed for the current work
+            m_cacheMemoryBudget = 0;
+        break;
+
+        case Settings::EnumMemoryLevel::Normal:
+            m_cacheMemoryBudget = multipliers * 16777216; // 16 MB
+        break;
+
+        case Settings::EnumMemoryLevel::Aggressive:
+            m_cacheMemoryBudget = multipliers * 67108864; // 64 MB
+        break;
+
+        case Settings::EnumMemoryLevel::Greedy:
+            m_cacheMemoryBudget = multipliers * 268435456; // 256 MB
+        break;
+    }
+}
+
 void DocumentPrivate::textGenerationDone( Page *page )
 {
     if ( !m_generator || m_closingLoop ) return;
@@ -3895,6 +4333,10 @@ void DocumentPrivate::textGenerationDone( Page *page )
 
     // 2. Add the page to the fifo of generated text pages
     m_allocatedTextPagesFifo.append( page->number() );
+
+    // 3. Add the text of the page to the index, if not there yet
+    if ( m_textIndex && !m_textIndex->hasPage( page->number() ) )
+        m_textIndex->addPage( page->number(), page->d->m_text );
 }
 
 void Document::setRotation( int r )
@@ -3946,12 +4388,7 @@ void Document::setPageSize( const PageSize &size )
     for ( ; pIt != pEnd; ++pIt )
         (*pIt)->d->changeSize( size );
     // clear 'memory allocation' descriptors
-    QLinkedList< AllocatedPixmap * >::const_iterator aIt = d->m_allocatedPixmapsFifo.constBegin();
-    QLinkedList< AllocatedPixmap * >::const_iterator aEnd = d->m_allocatedPixmapsFifo.constEnd();
-    for ( ; aIt != aEnd; ++aIt )
-        delete *aIt;
-    d->m_allocatedPixmapsFifo.clear();
-    d->m_allocatedPixmapsTotalMemory = 0;
+    d->m_pixmapCache.clear();
     // notify the generator that the current page size has changed
     d->m_generator->pageSizeChanged( size, d->m_pageSize );
     // set the new page size
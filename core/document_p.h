@@ -19,6 +19,7 @@
 #include <QtCore/QMap>
 #include <QtCore/QMutex>
 #include <QtCore/QPointer>
+#include <QtXml/QDomElement>
 
 #include <kcomponentdata.h>
 #include <kservicetypetrader.h>
@@ -26,12 +27,13 @@
 // local includes
 #include "fontinfo.h"
 #include "generator.h"
+#include "pixmapcache_p.h"
+#include "textsearch_p.h"
 
 class QEventLoop;
 class QTimer;
 class KTemporaryFile;
 
-struct AllocatedPixmap;
 struct ArchiveData;
 struct RunningSearch;
 
@@ -62,17 +64,26 @@ struct GeneratorInfo
 namespace Okular {
 
 class FontExtractionThread;
+class TextIndex;
+class TextIndexThread;
+class ThumbnailStore;
+class ThumbnailStoreThread;
 
 class DocumentPrivate
 {
     public:
         DocumentPrivate( Document *parent )
           : m_parent( parent ),
+            m_textSearch( 0 ),
+            m_textIndex( 0 ),
+            m_textIndexThread( 0 ),
+            m_thumbnailStore( 0 ),
+            m_thumbnailStoreThread( 0 ),
             m_lastSearchID( -1 ),
             m_tempFile( 0 ),
             m_docSize( -1 ),
-            m_allocatedPixmapsTotalMemory( 0 ),
             m_maxAllocatedTextPages( 0 ),
+            m_cacheMemoryBudget( 0 ),
             m_warnedOutOfMemory( false ),
             m_rotation( Rotation0 ),
             m_exportCached( false ),
@@ -87,16 +98,21 @@ class DocumentPrivate
             m_fontsCached( false ),
             m_documentInfo( 0 ),
             m_annotationEditingEnabled ( true ),
-            m_annotationBeingMoved( false )
+            m_annotationBeingMoved( false ),
+            m_pageSizesChanged( false ),
+            m_pagesComplete( true )
         {
             calculateMaxTextPages();
+            calculateCacheMemoryBudget();
         }
 
         // private methods
         QString pagesSizeString() const;
         QString localizedSize(const QSizeF &size) const;
         void cleanupPixmapMemory( qulonglong bytesOffset = 0 );
+        void cancelPixmapRequests( int requesterID, const QSet< int > &pages, const QLinkedList< PixmapRequest * > &wanted = QLinkedList< PixmapRequest * >() );
         void calculateMaxTextPages();
+        void calculateCacheMemoryBudget();
         qulonglong getTotalMemory();
         qulonglong getFreeMemory();
         void loadDocumentInfo();
@@ -115,7 +131,8 @@ class DocumentPrivate
         SaveInterface* generatorSave( GeneratorInfo& info );
         bool openDocumentInternal( const KService::Ptr& offer, bool isstdin, const QString& docFile, const QByteArray& filedata );
         bool savePageDocumentInfo( KTemporaryFile *infoFile, int what ) const;
-        DocumentViewport nextDocumentViewport() const;
+        DocumentViewport nextDocumentViewport();
+        DocumentViewport destinationViewport( const QString &name );
         void notifyAnnotationChanges( int page );
         bool canAddAnnotationsNatively() const;
         bool canModifyExternalAnnotations() const;
@@ -126,16 +143,28 @@ class DocumentPrivate
         void saveDocumentInfo() const;
         void slotTimedMemoryCheck();
         void sendGeneratorRequest();
+        void queuePixmapRequest( PixmapRequest *request );
+        bool pixmapRequestCovers( const PixmapRequest *executing, const PixmapRequest *request ) const;
         void rotationFinished( int page, Okular::Page *okularPage );
         void fontReadingProgress( int page );
         void fontReadingGotFont( const Okular::FontInfo& font );
         void slotGeneratorConfigChanged( const QString& );
         void refreshPixmaps( int );
         void _o_configChanged();
+        void _o_pageSizesChanged();
         void doContinueNextMatchSearch(void *pagesToNotifySet, void * match, int currentPage, int searchID, const QString & text, int caseSensitivity, bool moveViewport, const QColor & color, bool noDialogs, int donePages);
         void doContinuePrevMatchSearch(void *pagesToNotifySet, void * theMatch, int currentPage, int searchID, const QString & text, int theCaseSensitivity, bool moveViewport, const QColor & color, bool noDialogs, int donePages);
-        void doContinueAllDocumentSearch(void *pagesToNotifySet, void *pageMatchesMap, int currentPage, int searchID, const QString & text, int caseSensitivity, const QColor & color);
-        void doContinueGooglesDocumentSearch(void *pagesToNotifySet, void *pageMatchesMap, int currentPage, int searchID, const QStringList & words, int caseSensitivity, const QColor & color, bool matchAll);
+        void startTextSearch( int searchID, const QStringList &words, const QList< QColor > &colors, Qt::CaseSensitivity caseSensitivity, bool matchAll );
+        void textSearchPageDone( TextSearch *search, Page *page, TextPage *textPage, const QVector< TextSearch::Match > &matches );
+        void textSearchFinished( TextSearch *search, bool cancelled );
+        int renderingThreads() const;
+        bool pageMayContain( int page, const QString &text ) const;
+        void startTextIndex();
+        void stopTextIndex();
+        void startThumbnailStore();
+        void stopThumbnailStore();
+        void thumbnailStoreFilled();
+        void requestStoreThumbnails( int firstPage, int lastPage );
 
         void doProcessSearchMatch( RegularAreaRect *match, RunningSearch *search, QSet< int > *pagesToNotify, int currentPage, int searchID, bool moveViewport, const QColor & color );
 
@@ -150,6 +179,11 @@ class DocumentPrivate
          * Sets the bounding box of the given @p page (in terms of upright orientation, i.e., Rotation0).
          */
         void setPageBoundingBox( int page, const NormalizedRect& boundingBox );
+        void pageDataChanged( int page );
+        void pageSizeChanged( int page, double width, double height );
+        void pagesAppended( const QVector< Page * > &pages );
+        void setPagesComplete( bool complete );
+        void restorePendingViewport();
         /**
          * Request a particular metadata of the Document itself (ie, not something
          * depending on the document type/backend).
@@ -162,6 +196,11 @@ class DocumentPrivate
 
         // find descriptors, mapped by ID (we handle multiple searches)
         QMap< int, RunningSearch * > m_searches;
+        TextSearch *m_textSearch;
+        TextIndex *m_textIndex;
+        TextIndexThread *m_textIndexThread;
+        ThumbnailStore *m_thumbnailStore;
+        ThumbnailStoreThread *m_thumbnailStoreThread;
         int m_lastSearchID;
         bool m_searchCancelled;
 
@@ -186,10 +225,11 @@ class DocumentPrivate
         QLinkedList< PixmapRequest * > m_pixmapRequestsStack;
         QLinkedList< PixmapRequest * > m_executingPixmapRequests;
         QMutex m_pixmapRequestsMutex;
-        QLinkedList< AllocatedPixmap * > m_allocatedPixmapsFifo;
-        qulonglong m_allocatedPixmapsTotalMemory;
+        PixmapCache m_pixmapCache;
         QList< int > m_allocatedTextPagesFifo;
         int m_maxAllocatedTextPages;
+        // the memory the generator can use for caching its data
+        qulonglong m_cacheMemoryBudget;
         bool m_warnedOutOfMemory;
 
         // the rotation applied to the document
@@ -239,6 +279,14 @@ class DocumentPrivate
         bool m_annotationEditingEnabled;
         bool m_annotationsNeedSaveAs;
         bool m_annotationBeingMoved; // is an annotation currently being moved?
+        bool m_pageSizesChanged; // is a new layout of the pages pending?
+
+        // the pages still to be appended by the generator: their document
+        // info, and the viewport restored on one of them
+        bool m_pagesComplete;
+        QMap< int, QDomElement > m_pendingPageElements;
+        DocumentViewport m_pendingViewport;
+        DocumentViewport m_viewportBeforePending;
         bool m_showWarningLimitedAnnotSupport;
 };
 
@@ -28,7 +28,7 @@ using namespace Okular;
 
 GeneratorPrivate::GeneratorPrivate()
     : m_document( 0 ),
-      mPixmapGenerationThread( 0 ), mTextPageGenerationThread( 0 ),
+      mRunningPixmapThreads( 0 ), mTextPageGenerationThread( 0 ),
       m_mutex( 0 ), m_threadsMutex( 0 ), mPixmapReady( true ), mTextPageReady( true ),
       m_closing( false ), m_closingLoop( 0 )
 {
@@ -36,10 +36,10 @@ GeneratorPrivate::GeneratorPrivate()
 
 GeneratorPrivate::~GeneratorPrivate()
 {
-    if ( mPixmapGenerationThread )
-        mPixmapGenerationThread->wait();
+    foreach ( PixmapGenerationThread *thread, mPixmapGenerationThreads )
+        thread->wait();
 
-    delete mPixmapGenerationThread;
+    qDeleteAll( mPixmapGenerationThreads );
 
     if ( mTextPageGenerationThread )
         mTextPageGenerationThread->wait();
@@ -52,16 +52,37 @@ GeneratorPrivate::~GeneratorPrivate()
 
 PixmapGenerationThread* GeneratorPrivate::pixmapGenerationThread()
 {
-    if ( mPixmapGenerationThread )
-        return mPixmapGenerationThread;
+    foreach ( PixmapGenerationThread *thread, mPixmapGenerationThreads )
+    {
+        if ( !thread->request() )
+            return thread;
+    }
+
+    if ( mPixmapGenerationThreads.count() >= maxPixmapGenerationThreads() )
+        return 0;
 
     Q_Q( Generator );
-    mPixmapGenerationThread = new PixmapGenerationThread( q );
-    QObject::connect( mPixmapGenerationThread, SIGNAL(finished()),
+    PixmapGenerationThread *thread = new PixmapGenerationThread( q );
+    QObject::connect( thread, SIGNAL(finished()),
                       q, SLOT(pixmapGenerationFinished()),
                       Qt::QueuedConnection );
+    mPixmapGenerationThreads.append( thread );
 
-    return mPixmapGenerationThread;
+    return thread;
+}
+
+int GeneratorPrivate::maxPixmapGenerationThreads() const
+{
+    Q_Q( const Generator );
+    if ( !q->hasFeature( Generator::ConcurrentRendering ) )
+        return 1;
+
+    return qMax( 1, q->documentMetaData( QLatin1String( "RenderingThreads" ) ).toInt() );
+}
+
+bool GeneratorPrivate::pixmapGenerationIdle() const
+{
+    return mPixmapReady && mRunningPixmapThreads == 0;
 }
 
 TextPageGenerationThread* GeneratorPrivate::textPageGenerationThread()
@@ -81,16 +102,23 @@ TextPageGenerationThread* GeneratorPrivate::textPageGenerationThread()
 void GeneratorPrivate::pixmapGenerationFinished()
 {
     Q_Q( Generator );
-    PixmapRequest *request = mPixmapGenerationThread->request();
-    mPixmapGenerationThread->endGeneration();
+    PixmapGenerationThread *thread = qobject_cast< PixmapGenerationThread * >( q->sender() );
+    if ( !thread || !thread->request() )
+        return;
+
+    PixmapRequest *request = thread->request();
+    const QImage img = thread->image();
+    const bool calcBoundingBox = thread->calcBoundingBox();
+    const NormalizedRect boundingBox = thread->boundingBox();
+    thread->endGeneration();
 
     QMutexLocker locker( threadsLock() );
-    mPixmapReady = true;
+    --mRunningPixmapThreads;
 
     if ( m_closing )
     {
         delete request;
-        if ( mTextPageReady )
+        if ( mTextPageReady && pixmapGenerationIdle() )
         {
             locker.unlock();
             m_closingLoop->quit();
@@ -98,13 +126,18 @@ void GeneratorPrivate::pixmapGenerationFinished()
         return;
     }
 
-    const QImage& img = mPixmapGenerationThread->image();
-    request->page()->setPixmap( request->id(), new QPixmap( QPixmap::fromImage( img ) ) );
+    locker.unlock();
+
+    request->d->mImage = img;
+    if ( request->isTile() )
+        request->page()->setPixmap( request->id(), new QPixmap( QPixmap::fromImage( img ) ), request->normalizedRect() );
+    else
+        request->page()->setPixmap( request->id(), new QPixmap( QPixmap::fromImage( img ) ) );
     const int pageNumber = request->page()->number();
 
     q->signalPixmapRequestDone( request );
-    if ( mPixmapGenerationThread->calcBoundingBox() )
-        q->updatePageBoundingBox( pageNumber, mPixmapGenerationThread->boundingBox() );
+    if ( calcBoundingBox )
+        q->updatePageBoundingBox( pageNumber, boundingBox );
 }
 
 void GeneratorPrivate::textpageGenerationFinished()
@@ -119,7 +152,7 @@ void GeneratorPrivate::textpageGenerationFinished()
     if ( m_closing )
     {
         delete mTextPageGenerationThread->textPage();
-        if ( mPixmapReady )
+        if ( pixmapGenerationIdle() )
         {
             locker.unlock();
             m_closingLoop->quit();
@@ -184,7 +217,7 @@ bool Generator::closeDocument()
     d->m_closing = true;
 
     d->threadsLock()->lock();
-    if ( !( d->mPixmapReady && d->mTextPageReady ) )
+    if ( !( d->pixmapGenerationIdle() && d->mTextPageReady ) )
     {
         QEventLoop loop;
         d->m_closingLoop = &loop;
@@ -210,17 +243,24 @@ bool Generator::closeDocument()
 bool Generator::canGeneratePixmap() const
 {
     Q_D( const Generator );
-    return d->mPixmapReady;
+    return d->mPixmapReady && d->mRunningPixmapThreads < d->maxPixmapGenerationThreads();
 }
 
 void Generator::generatePixmap( PixmapRequest *request )
 {
     Q_D( Generator );
-    d->mPixmapReady = false;
 
+    // all the workers busy should not happen (see canGeneratePixmap()),
+    // in that case we just fall back to a synchronous generation
+    PixmapGenerationThread *thread = 0;
     if ( request->asynchronous() && hasFeature( Threaded ) )
+        thread = d->pixmapGenerationThread();
+
+    if ( thread )
     {
-        d->pixmapGenerationThread()->startGeneration( request, !request->page()->isBoundingBoxKnown() );
+        ++d->mRunningPixmapThreads;
+        // tiles do not tell anything about the bounding box of the whole page
+        thread->startGeneration( request, !request->isTile() && !request->page()->isBoundingBoxKnown() );
 
         /**
          * We create the text page for every page that is visible to the
@@ -234,9 +274,15 @@ void Generator::generatePixmap( PixmapRequest *request )
         return;
     }
 
+    d->mPixmapReady = false;
+
     const QImage& img = image( request );
-    request->page()->setPixmap( request->id(), new QPixmap( QPixmap::fromImage( img ) ) );
-    const bool bboxKnown = request->page()->isBoundingBoxKnown();
+    request->d->mImage = img;
+    if ( request->isTile() )
+        request->page()->setPixmap( request->id(), new QPixmap( QPixmap::fromImage( img ) ), request->normalizedRect() );
+    else
+        request->page()->setPixmap( request->id(), new QPixmap( QPixmap::fromImage( img ) ) );
+    const bool bboxKnown = request->isTile() || request->page()->isBoundingBoxKnown();
     const int pageNumber = request->page()->number();
 
     d->mPixmapReady = true;
@@ -324,6 +370,35 @@ Generator::PrintError Generator::printError() const
     return UnknownPrintError;
 }
 
+qulonglong Generator::cacheMemory() const
+{
+    return 0;
+}
+
+qulonglong Generator::freeCacheMemory( qulonglong /*memoryToFree*/ )
+{
+    return 0;
+}
+
+bool Generator::cancelPixmapRequest( Okular::PixmapRequest * /*request*/ )
+{
+    return false;
+}
+
+QImage Generator::thumbnail( int /*page*/ )
+{
+    return QImage();
+}
+
+void Generator::loadPageData( Okular::Page * /*page*/ )
+{
+}
+
+QString Generator::destinationViewport( const QString &name )
+{
+    return metaData( "NamedViewport", name ).toString();
+}
+
 QVariant Generator::metaData( const QString &key, const QVariant &option ) const
 {
     Q_D( const Generator );
@@ -411,6 +486,36 @@ void Generator::updatePageBoundingBox( int page, const NormalizedRect & bounding
         d->m_document->setPageBoundingBox( page, boundingBox );
 }
 
+void Generator::updatePageData( int page )
+{
+    Q_D( Generator );
+    if ( d->m_document ) // still connected to document?
+        d->m_document->pageDataChanged( page );
+}
+
+void Generator::updatePageSize( int page, double width, double height )
+{
+    Q_D( Generator );
+    if ( d->m_document ) // still connected to document?
+        d->m_document->pageSizeChanged( page, width, height );
+}
+
+void Generator::appendPages( const QVector<Page*> &pages )
+{
+    Q_D( Generator );
+    if ( d->m_document ) // still connected to document?
+        d->m_document->pagesAppended( pages );
+    else
+        qDeleteAll( pages );
+}
+
+void Generator::setPagesComplete( bool complete )
+{
+    Q_D( Generator );
+    if ( d->m_document ) // still connected to document?
+        d->m_document->setPagesComplete( complete );
+}
+
 void Generator::requestFontData(const Okular::FontInfo & /*font*/, QByteArray * /*data*/)
 {
 
@@ -431,6 +536,8 @@ PixmapRequest::PixmapRequest( int id, int pageNumber, int width, int height, int
     d->mPriority = priority;
     d->mAsynchronous = asynchronous;
     d->mForce = false;
+    d->mTile = false;
+    d->mNormalizedRect = NormalizedRect( 0.0, 0.0, 1.0, 1.0 );
 }
 
 PixmapRequest::~PixmapRequest()
@@ -473,11 +580,49 @@ Page* PixmapRequest::page() const
     return d->mPage;
 }
 
+void PixmapRequest::setNormalizedRect( const NormalizedRect &rect )
+{
+    if ( d->mNormalizedRect == rect )
+        return;
+
+    d->mNormalizedRect = rect;
+    d->mTile = !( rect == NormalizedRect( 0.0, 0.0, 1.0, 1.0 ) );
+}
+
+const NormalizedRect& PixmapRequest::normalizedRect() const
+{
+    return d->mNormalizedRect;
+}
+
+bool PixmapRequest::isTile() const
+{
+    return d->mTile;
+}
+
 void PixmapRequestPrivate::swap()
 {
     qSwap( mWidth, mHeight );
 }
 
+bool PixmapRequestPrivate::hasPixmap() const
+{
+    if ( mTile )
+        return mPage->hasPixmap( mId, mWidth, mHeight, mNormalizedRect );
+
+    return mPage->hasPixmap( mId, mWidth, mHeight );
+}
+
+qulonglong PixmapRequestPrivate::pixelCount() const
+{
+    if ( mTile )
+    {
+        const QRect geometry = mNormalizedRect.roundedGeometry( mWidth, mHeight );
+        return (qulonglong)geometry.width() * geometry.height();
+    }
+
+    return (qulonglong)mWidth * mHeight;
+}
+
 class Okular::ExportFormatPrivate : public QSharedData
 {
     public:
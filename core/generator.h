@@ -186,6 +186,8 @@ class OKULAR_EXPORT Generator : public QObject
     /// @cond PRIVATE
     friend class PixmapGenerationThread;
     friend class TextPageGenerationThread;
+    friend class TextSearchThread;
+    friend class TextIndexThread;
     /// @endcond
 
     Q_OBJECT
@@ -204,7 +206,9 @@ class OKULAR_EXPORT Generator : public QObject
             PageSizes,         ///< Whether the Generator can change the size of the document pages.
             PrintNative,       ///< Whether the Generator supports native cross-platform printing (QPainter-based).
             PrintPostscript,   ///< Whether the Generator supports postscript-based file printing.
-            PrintToFile        ///< Whether the Generator supports export to PDF & PS through the Print Dialog
+            PrintToFile,       ///< Whether the Generator supports export to PDF & PS through the Print Dialog
+            ConcurrentRendering, ///< Whether image() and textPage() can be called by more than one thread at the same time (requires Threaded). @since 0.16 (KDE 4.10)
+            TiledRendering     ///< Whether image() can render only a part of the page, see PixmapRequest::isTile(). @since 0.16 (KDE 4.10)
         };
 
         /**
@@ -431,7 +435,8 @@ class OKULAR_EXPORT Generator : public QObject
          * the passed pixmap @p request.
          *
          * @warning this method may be executed in its own separated thread if the
-         * @ref Threaded is enabled!
+         * @ref Threaded is enabled, and in several threads at the same time if
+         * @ref ConcurrentRendering is enabled too!
          */
         virtual QImage image( PixmapRequest *page );
 
@@ -439,7 +444,8 @@ class OKULAR_EXPORT Generator : public QObject
          * Returns the text page for the given @p page.
          *
          * @warning this method may be executed in its own separated thread if the
-         * @ref Threaded is enabled!
+         * @ref Threaded is enabled, and in several threads at the same time if
+         * @ref ConcurrentRendering is enabled too!
          */
         virtual TextPage* textPage( Page *page );
 
@@ -473,6 +479,56 @@ class OKULAR_EXPORT Generator : public QObject
          */
         void updatePageBoundingBox( int page, const NormalizedRect & boundingBox );
 
+        /**
+         * Tells the Document that the annotations, the form fields, the actions
+         * or the transition of a page have been set after the page has already
+         * been handed to the Document, so that all observers are notified.
+         *
+         * Call this from the GUI thread only.
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        void updatePageData( int page );
+
+        /**
+         * Sets the size of a page after the page has already been handed to the
+         * Document, for generators which know the actual size of some pages
+         * only after the document has been loaded. The observers are told
+         * of the new layout of the pages once for all the changes done in
+         * the same event loop iteration.
+         *
+         * Call this from the GUI thread only.
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        void updatePageSize( int page, double width, double height );
+
+        /**
+         * Adds the @p pages at the end of the document, for generators which
+         * find out their pages while the document is already shown.
+         * The numbers of the pages must follow the one of the last page of
+         * the document, which takes the ownership of them. The document
+         * synopsis may grow along with the pages, keeping the items it has
+         * already in their place.
+         *
+         * Call this from the GUI thread only.
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        void appendPages( const QVector<Page*> &pages );
+
+        /**
+         * Tells whether the document has all its pages, or whether more are
+         * going to be added with appendPages(). Until the pages are complete,
+         * the document info of the pages still missing is kept aside, to be
+         * restored when they are added, and saved back unchanged meanwhile.
+         *
+         * Call this from the GUI thread only.
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        void setPagesComplete( bool complete );
+
     protected Q_SLOTS:
         /**
          * Gets the font data for the given font
@@ -496,6 +552,80 @@ class OKULAR_EXPORT Generator : public QObject
          */
         Okular::Generator::PrintError printError() const;
 
+        /**
+         * Returns the memory, in bytes, the generator is using to cache data
+         * of the document (like decoded pages), which the Document accounts
+         * together with the pixmaps of the pages.
+         *
+         * Generators caching data should keep it within the
+         * "CacheMemoryBudget" document meta data, in bytes.
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        qulonglong cacheMemory() const;
+
+        /**
+         * Asks the generator to release at least @p memoryToFree bytes of its
+         * cached data, if possible, as the memory is needed; it is called
+         * from the GUI thread.
+         *
+         * Returns the memory actually freed, in bytes.
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        qulonglong freeCacheMemory( qulonglong memoryToFree );
+
+        /**
+         * Asks the generator to cancel the pixmap generation of the given
+         * @p request, sent with generatePixmap(), as it is not needed any more;
+         * it is called from the GUI thread.
+         *
+         * Returns whether the generation is cancelled: in that case the
+         * generator must not signal the request done, and the Document
+         * deletes it. Usually only the generations not started yet can
+         * be cancelled.
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        bool cancelPixmapRequest( Okular::PixmapRequest *request );
+
+        /**
+         * Returns the thumbnail of the given @p page embedded in the
+         * document, if any.
+         *
+         * The Document keeps it until it gets a better image of the page.
+         *
+         * @warning this method may be executed in a thread other than the
+         * GUI one, at the same time as image() and textPage().
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        QImage thumbnail( int page );
+
+        /**
+         * Asks the generator to set now the annotations, the form fields,
+         * the actions and the transition of the given @p page, if it sets
+         * them only when needed (see updatePageData()); it is called from
+         * the GUI thread before restoring the local contents of the page,
+         * like its annotations and the values of its forms.
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        void loadPageData( Okular::Page *page );
+
+        /**
+         * Returns the viewport of the named destination @p name, as the
+         * "NamedViewport" meta data does, for generators which have to
+         * convert or lay out the document up to the destination first;
+         * the document may get more pages meanwhile. It is called from
+         * the GUI thread when a link to the destination is followed.
+         *
+         * The default implementation returns the "NamedViewport" meta data.
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        QString destinationViewport( const QString &name );
+
     protected:
         /// @cond PRIVATE
         Generator( GeneratorPrivate &dd, QObject *parent, const QVariantList &args );
@@ -579,6 +709,34 @@ class OKULAR_EXPORT PixmapRequest
          */
         Page *page() const;
 
+        /**
+         * Sets the region of the page to request.
+         *
+         * Requesting a region different from the whole page turns the
+         * request into a tile request, see isTile().
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        void setNormalizedRect( const NormalizedRect &rect );
+
+        /**
+         * Returns the normalized region of the page to request.
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        const NormalizedRect& normalizedRect() const;
+
+        /**
+         * Returns whether only a part of the page is requested.
+         *
+         * Generators supporting @ref Generator::TiledRendering shall return
+         * from image() only the area normalizedRect().roundedGeometry( width(), height() )
+         * of the page rendered at width() x height().
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        bool isTile() const;
+
     private:
         Q_DISABLE_COPY( PixmapRequest )
 
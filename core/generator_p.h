@@ -12,6 +12,7 @@
 
 #include "area.h"
 
+#include <QtCore/QList>
 #include <QtCore/QSet>
 #include <QtCore/QThread>
 #include <QtGui/QImage>
@@ -42,6 +43,8 @@ class GeneratorPrivate
 
         PixmapGenerationThread* pixmapGenerationThread();
         TextPageGenerationThread* textPageGenerationThread();
+        int maxPixmapGenerationThreads() const;
+        bool pixmapGenerationIdle() const;
 
         void pixmapGenerationFinished();
         void textpageGenerationFinished();
@@ -55,7 +58,9 @@ class GeneratorPrivate
         // NOTE: the following should be a QSet< GeneratorFeature >,
         // but it is not to avoid #include'ing generator.h
         QSet< int > m_features;
-        PixmapGenerationThread *mPixmapGenerationThread;
+        // the rendering workers; more than one only for ConcurrentRendering generators
+        QList< PixmapGenerationThread * > mPixmapGenerationThreads;
+        int mRunningPixmapThreads;
         TextPageGenerationThread *mTextPageGenerationThread;
         mutable QMutex *m_mutex;
         QMutex *m_threadsMutex;
@@ -70,6 +75,8 @@ class PixmapRequestPrivate
 {
     public:
         void swap();
+        bool hasPixmap() const;
+        qulonglong pixelCount() const;
 
         int mId;
         int mPageNumber;
@@ -78,7 +85,11 @@ class PixmapRequestPrivate
         int mPriority;
         bool mAsynchronous;
         bool mForce : 1;
+        bool mTile : 1;
         Page *mPage;
+        NormalizedRect mNormalizedRect;
+        // the image of the pixmap, when rendered through Generator::image()
+        QImage mImage;
 };
 
 
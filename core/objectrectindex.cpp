@@ -0,0 +1,156 @@
+/***************************************************************************
+ *   Copyright (C) 2012 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "objectrectindex_p.h"
+
+#include <QtCore/QRectF>
+#include <QtGui/QPainterPath>
+
+#include <math.h>
+
+using namespace Okular;
+
+// rects per cell the grid is sized for, on average
+static const int RectsPerCell = 4;
+// the maximum number of cells of a side of the grid
+static const int MaxGridSize = 64;
+// the maximum number of cells a rect can enter, the bigger ones are kept apart
+static const int MaxCellsPerRect = 64;
+// pixels added around the annotations, for the rounding of their geometry
+static const int AnnotationPadding = 2;
+
+ObjectRectIndex::ObjectRectIndex( const QLinkedList< ObjectRect * > &rects, double xScale, double yScale )
+    : m_rectsByType( ObjectRect::SourceRef + 1 ), m_xScale( qMax( xScale, 1.0 ) ), m_yScale( qMax( yScale, 1.0 ) ),
+      m_hasScaledRects( false ), m_gridSize( 1 )
+{
+    m_rects.reserve( rects.count() );
+    QLinkedList< ObjectRect * >::const_iterator it = rects.constBegin(), end = rects.constEnd();
+    for ( ; it != end; ++it )
+    {
+        m_rects.append( *it );
+        m_rectsByType[ (*it)->objectType() ].append( *it );
+    }
+
+    const int gridRects = m_rects.count() - m_rectsByType.at( ObjectRect::SourceRef ).count();
+    m_gridSize = qBound( 1, (int)ceil( sqrt( (double)gridRects / RectsPerCell ) ), MaxGridSize );
+    m_cells.resize( m_gridSize * m_gridSize );
+
+    // the rects are added in the order of the page, so the cells keep it
+    for ( int i = 0; i < m_rects.count(); ++i )
+    {
+        const ObjectRect *object = m_rects.at( i );
+        if ( !isInGrid( object->objectType() ) )
+            continue;
+
+        QRectF rect;
+        if ( object->objectType() == ObjectRect::OAnnotation )
+        {
+            // the icons keep their size in pixels, so at smaller scales
+            // they cover more of the page
+            rect = QRectF( object->boundingRect( m_xScale, m_yScale ) ).adjusted( -AnnotationPadding, -AnnotationPadding, AnnotationPadding, AnnotationPadding );
+            rect = QRectF( rect.left() / m_xScale, rect.top() / m_yScale, rect.width() / m_xScale, rect.height() / m_yScale );
+            m_hasScaledRects = true;
+        }
+        else
+        {
+            rect = object->region().boundingRect();
+        }
+
+        const int left = cellColumn( rect.left() ), right = cellColumn( rect.right() );
+        const int top = cellRow( rect.top() ), bottom = cellRow( rect.bottom() );
+        if ( ( right - left + 1 ) * ( bottom - top + 1 ) > MaxCellsPerRect )
+        {
+            m_oversizedRects.append( i );
+            continue;
+        }
+
+        for ( int row = top; row <= bottom; ++row )
+            for ( int column = left; column <= right; ++column )
+                m_cells[ row * m_gridSize + column ].append( i );
+    }
+}
+
+bool ObjectRectIndex::isValidForScale( double xScale, double yScale ) const
+{
+    // the padding of the annotations is enough for the bigger scales only
+    return !m_hasScaledRects || ( xScale >= m_xScale && yScale >= m_yScale );
+}
+
+double ObjectRectIndex::xScale() const
+{
+    return m_xScale;
+}
+
+double ObjectRectIndex::yScale() const
+{
+    return m_yScale;
+}
+
+const ObjectRect * ObjectRectIndex::objectRect( ObjectRect::ObjectType type, double x, double y, double xScale, double yScale ) const
+{
+    if ( isInGrid( type ) )
+        return gridObjectRect( false, type, x, y, xScale, yScale );
+
+    const QVector< ObjectRect * > &rects = m_rectsByType.at( type );
+    QVector< ObjectRect * >::const_iterator it = rects.constBegin(), end = rects.constEnd();
+    for ( ; it != end; ++it )
+        if ( (*it)->contains( x, y, xScale, yScale ) )
+            return *it;
+    return 0;
+}
+
+bool ObjectRectIndex::hasObjectRect( double x, double y, double xScale, double yScale ) const
+{
+    return gridObjectRect( true, ObjectRect::Action, x, y, xScale, yScale )
+        || objectRect( ObjectRect::SourceRef, x, y, xScale, yScale );
+}
+
+const QVector< ObjectRect * > &ObjectRectIndex::objectRects( ObjectRect::ObjectType type ) const
+{
+    return m_rectsByType.at( type );
+}
+
+bool ObjectRectIndex::isInGrid( ObjectRect::ObjectType type )
+{
+    // the source references are hit from a distance in pixels
+    return type != ObjectRect::SourceRef;
+}
+
+const ObjectRect * ObjectRectIndex::gridObjectRect( bool anyType, ObjectRect::ObjectType type, double x, double y, double xScale, double yScale ) const
+{
+    const QVector< int > &cell = m_cells.at( cellRow( y ) * m_gridSize + cellColumn( x ) );
+
+    // merge the cell with the oversized rects, both in the order of the page
+    QVector< int >::const_iterator it = cell.constBegin(), end = cell.constEnd();
+    QVector< int >::const_iterator oversizedIt = m_oversizedRects.constBegin(), oversizedEnd = m_oversizedRects.constEnd();
+    while ( it != end || oversizedIt != oversizedEnd )
+    {
+        int position;
+        if ( oversizedIt == oversizedEnd || ( it != end && *it < *oversizedIt ) )
+            position = *it++;
+        else
+            position = *oversizedIt++;
+
+        const ObjectRect *rect = m_rects.at( position );
+        if ( ( anyType || rect->objectType() == type ) && rect->contains( x, y, xScale, yScale ) )
+            return rect;
+    }
+    return 0;
+}
+
+int ObjectRectIndex::cellColumn( double x ) const
+{
+    // the points and the rects outside of the page fall in the border cells
+    return qBound( 0, (int)floor( x * m_gridSize ), m_gridSize - 1 );
+}
+
+int ObjectRectIndex::cellRow( double y ) const
+{
+    return qBound( 0, (int)floor( y * m_gridSize ), m_gridSize - 1 );
+}
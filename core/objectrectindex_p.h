@@ -0,0 +1,101 @@
+/***************************************************************************
+ *   Copyright (C) 2012 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_OBJECTRECTINDEX_P_H_
+#define _OKULAR_OBJECTRECTINDEX_P_H_
+
+#include <QtCore/QLinkedList>
+#include <QtCore/QVector>
+
+#include "area.h"
+
+namespace Okular {
+
+/**
+ * @short Finds the object rects of a page at a point without testing all of them.
+ *
+ * The links, the images and the annotations are put in a grid of cells over
+ * the page, each cell listing the rects whose bounding box overlaps it, so a
+ * point needs the exact test only for the rects of its cell. The rects which
+ * would enter too many cells are kept apart and tested for every point, so
+ * that many big rects do not fill the whole grid with each of them.
+ *
+ * The geometry of the annotations depends on the scale, as some of them are
+ * drawn as icons of a fixed size in pixels, so their bounding box is padded
+ * for the scale the index is built for, which is good for any bigger scale.
+ * The source references are not in the grid, as they are hit from a distance
+ * in pixels too; they are kept in a list of their own.
+ *
+ * The rects are tested in the same order as in the page, so the rect found
+ * is the same one a walk of the whole list would find. The index is built
+ * for the rects as they are, and has to be built again when they change.
+ */
+class ObjectRectIndex
+{
+    public:
+        /**
+         * Indexes the @p rects for the scale @p xScale x @p yScale and the
+         * bigger ones.
+         */
+        ObjectRectIndex( const QLinkedList< ObjectRect * > &rects, double xScale, double yScale );
+
+        /**
+         * Returns whether the index can be used at the scale @p xScale x
+         * @p yScale.
+         */
+        bool isValidForScale( double xScale, double yScale ) const;
+
+        /**
+         * Returns the scale the index has been built for.
+         */
+        double xScale() const;
+        double yScale() const;
+
+        /**
+         * Returns the first object rect of the given @p type containing the
+         * point @p x, @p y, or 0 if there is none.
+         */
+        const ObjectRect * objectRect( ObjectRect::ObjectType type, double x, double y, double xScale, double yScale ) const;
+
+        /**
+         * Returns whether any object rect contains the point @p x, @p y.
+         */
+        bool hasObjectRect( double x, double y, double xScale, double yScale ) const;
+
+        /**
+         * Returns the object rects of the given @p type.
+         */
+        const QVector< ObjectRect * > &objectRects( ObjectRect::ObjectType type ) const;
+
+    private:
+        static bool isInGrid( ObjectRect::ObjectType type );
+        const ObjectRect * gridObjectRect( bool anyType, ObjectRect::ObjectType type, double x, double y, double xScale, double yScale ) const;
+        int cellColumn( double x ) const;
+        int cellRow( double y ) const;
+
+        // all the rects, in the order of the page
+        QVector< ObjectRect * > m_rects;
+        // the rects of each type, indexed by ObjectRect::ObjectType
+        QVector< QVector< ObjectRect * > > m_rectsByType;
+
+        double m_xScale;
+        double m_yScale;
+        bool m_hasScaledRects;
+
+        // the grid is m_gridSize x m_gridSize cells, row by row, listing
+        // the positions of the rects in m_rects
+        int m_gridSize;
+        QVector< QVector< int > > m_cells;
+        // the rects too big for the grid
+        QVector< int > m_oversizedRects;
+};
+
+}
+
+#endif
@@ -29,9 +29,10 @@ namespace Okular {
 #define PAGESIZELABEL_ID 9
 #define BOOKMARKLIST_ID 10
 #define ANNOTATIONMODEL_ID 11
+#define THUMBNAILSTORE_ID 12
 
 // the biggest id, useful for ignoring wrong id request
-#define MAX_OBSERVER_ID 12
+#define MAX_OBSERVER_ID 13
 
 /** PRIORITIES for requests. Globally defined here. **/
 #define PAGEVIEW_PRIO 1
@@ -40,6 +41,7 @@ namespace Okular {
 #define THUMBNAILS_PRELOAD_PRIO 5
 #define PRESENTATION_PRIO 0
 #define PRESENTATION_PRELOAD_PRIO 3
+#define THUMBNAILSTORE_PRIO 10
 
 class Page;
 
@@ -82,7 +84,9 @@ class OKULAR_EXPORT DocumentObserver
          */
         enum SetupFlags {
             DocumentChanged = 1,    ///< The document is a new document.
-            NewLayoutForPages = 2   ///< All the pages have
+            NewLayoutForPages = 2,  ///< All the pages have
+            PagesAppended = 4,      ///< Pages have been added at the end of the document @since 0.16 (KDE 4.10)
+            PagesComplete = 8       ///< Set along with PagesAppended when the document has all its pages @since 0.16 (KDE 4.10)
         };
 
         /**
@@ -31,12 +31,14 @@
 #include "document_p.h"
 #include "form.h"
 #include "form_p.h"
+#include "objectrectindex_p.h"
 #include "pagecontroller_p.h"
 #include "pagesize.h"
 #include "pagetransition.h"
 #include "rotationjob_p.h"
 #include "textpage.h"
 #include "textpage_p.h"
+#include "tilesmanager_p.h"
 
 #include <limits>
 
@@ -63,7 +65,7 @@ PagePrivate::PagePrivate( Page *page, uint n, double w, double h, Rotation o )
     : m_page( page ), m_number( n ), m_orientation( o ),
       m_width( w ), m_height( h ), m_doc( 0 ), m_boundingBox( 0, 0, 1, 1 ),
       m_rotation( Rotation0 ),
-      m_text( 0 ), m_transition( 0 ), m_textSelections( 0 ),
+      m_text( 0 ), m_transition( 0 ), m_textSelections( 0 ), m_objectRectIndex( 0 ),
       m_openingAction( 0 ), m_closingAction( 0 ), m_duration( -1 ),
       m_isBoundingBoxKnown( false )
 {
@@ -82,6 +84,7 @@ PagePrivate::~PagePrivate()
     delete m_closingAction;
     delete m_text;
     delete m_transition;
+    delete m_objectRectIndex;
 }
 
 
@@ -215,6 +218,15 @@ bool Page::hasPixmap( int id, int width, int height ) const
     return (pixmap->width() == width && pixmap->height() == height);
 }
 
+bool Page::hasPixmap( int id, int width, int height, const NormalizedRect &rect ) const
+{
+    const TilesManager *tm = d->m_tilesManagers.value( id );
+    if ( !tm || tm->width() != width || tm->height() != height )
+        return false;
+
+    return tm->hasPixmaps( rect );
+}
+
 bool Page::hasTextPage() const
 {
     return d->m_text != 0;
@@ -241,12 +253,7 @@ bool Page::hasObjectRect( double x, double y, double xScale, double yScale ) con
     if ( m_rects.isEmpty() )
         return false;
 
-    QLinkedList< ObjectRect * >::const_iterator it = m_rects.begin(), end = m_rects.end();
-    for ( ; it != end; ++it )
-        if ( (*it)->contains( x, y, xScale, yScale ) )
-            return true;
-
-    return false;
+    return d->objectRectIndex( xScale, yScale )->hasObjectRect( x, y, xScale, yScale );
 }
 
 bool Page::hasHighlights( int s_id ) const
@@ -353,8 +360,12 @@ void PagePrivate::rotateAt( Rotation orientation )
     m_rotation = orientation;
 
     /**
-     * Rotate the images of the page.
+     * Rotate the images of the page; the tiles are just dropped, as they are
+     * not used for rotated pages.
      */
+    qDeleteAll( m_tilesManagers );
+    m_tilesManagers.clear();
+
     QMapIterator< int, PagePrivate::PixmapObject > it( m_pixmaps );
     while ( it.hasNext() ) {
         it.next();
@@ -373,6 +384,7 @@ void PagePrivate::rotateAt( Rotation orientation )
     QLinkedList< ObjectRect * >::const_iterator objectIt = m_page->m_rects.begin(), end = m_page->m_rects.end();
     for ( ; objectIt != end; ++objectIt )
         (*objectIt)->transform( matrix );
+    invalidateObjectRectIndex();
 
     QLinkedList< HighlightAreaRect* >::const_iterator hlIt = m_page->m_highlights.begin(), hlItEnd = m_page->m_highlights.end();
     for ( ; hlIt != hlItEnd; ++hlIt )
@@ -398,11 +410,10 @@ void PagePrivate::changeSize( const PageSize &size )
 
 const ObjectRect * Page::objectRect( ObjectRect::ObjectType type, double x, double y, double xScale, double yScale ) const
 {
-    QLinkedList< ObjectRect * >::const_iterator it = m_rects.begin(), end = m_rects.end();
-    for ( ; it != end; ++it )
-        if ( ( (*it)->objectType() == type ) && (*it)->contains( x, y, xScale, yScale ) )
-            return *it;
-    return 0;
+    if ( m_rects.isEmpty() )
+        return 0;
+
+    return d->objectRectIndex( xScale, yScale )->objectRect( type, x, y, xScale, yScale );
 }
 
 const ObjectRect* Page::nearestObjectRect( ObjectRect::ObjectType type, double x, double y, double xScale, double yScale, double * distance ) const
@@ -410,17 +421,15 @@ const ObjectRect* Page::nearestObjectRect( ObjectRect::ObjectType type, double x
     ObjectRect * res = 0;
     double minDistance = std::numeric_limits<double>::max();
 
-    QLinkedList< ObjectRect * >::const_iterator it = m_rects.constBegin(), end = m_rects.constEnd();
+    const QVector< ObjectRect * > &rects = d->objectRectIndex( xScale, yScale )->objectRects( type );
+    QVector< ObjectRect * >::const_iterator it = rects.constBegin(), end = rects.constEnd();
     for ( ; it != end; ++it )
     {
-        if ( (*it)->objectType() == type )
+        double d = (*it)->distanceSqr( x, y, xScale, yScale );
+        if ( d < minDistance )
         {
-            double d = (*it)->distanceSqr( x, y, xScale, yScale );
-            if ( d < minDistance )
-            {
-                res = (*it);
-                minDistance = d;
-            }
+            res = (*it);
+            minDistance = d;
         }
     }
 
@@ -461,6 +470,9 @@ QLinkedList< FormField * > Page::formFields() const
 
 void Page::setPixmap( int id, QPixmap *pixmap )
 {
+    // a whole page pixmap makes the tiles useless
+    delete d->m_tilesManagers.take( id );
+
     if ( d->m_rotation == Rotation0 ) {
         QMap< int, PagePrivate::PixmapObject >::iterator it = d->m_pixmaps.find( id );
         if ( it != d->m_pixmaps.end() )
@@ -482,6 +494,19 @@ void Page::setPixmap( int id, QPixmap *pixmap )
     }
 }
 
+void Page::setPixmap( int id, QPixmap *pixmap, const NormalizedRect &rect )
+{
+    // tiles are used only for not rotated pages, see Document::requestPixmaps()
+    TilesManager *tm = d->m_tilesManagers.value( id );
+    if ( !tm || d->m_rotation != Rotation0 )
+    {
+        delete pixmap;
+        return;
+    }
+
+    tm->setPixmap( rect, pixmap );
+}
+
 void Page::setTextPage( TextPage * textPage )
 {
     delete d->m_text;
@@ -513,6 +538,7 @@ void Page::setObjectRects( const QLinkedList< ObjectRect * > & rects )
         (*objectIt)->transform( matrix );
 
     m_rects << rects;
+    d->invalidateObjectRectIndex();
 }
 
 void PagePrivate::setHighlight( int s_id, RegularAreaRect *rect, const QColor & color )
@@ -542,6 +568,7 @@ void Page::setSourceReferences( const QLinkedList< SourceRefObjectRect * > & ref
     deleteSourceReferences();
     foreach( SourceRefObjectRect * rect, refRects )
         m_rects << rect;
+    d->invalidateObjectRectIndex();
 }
 
 void Page::setDuration( double seconds )
@@ -593,6 +620,7 @@ void Page::addAnnotation( Annotation * annotation )
     annotation->d_ptr->annotationTransform( matrix );
 
     m_rects.append( rect );
+    d->invalidateObjectRectIndex();
 }
 
 bool Page::removeAnnotation( Annotation * annotation )
@@ -614,6 +642,7 @@ bool Page::removeAnnotation( Annotation * annotation )
                     it = m_rects.erase( it );
                     rectfound = true;
                 }
+            d->invalidateObjectRectIndex();
             kDebug(OkularDebug) << "removed annotation:" << annotation->uniqueName();
             delete *aIt;
             m_annotations.erase( aIt );
@@ -660,6 +689,7 @@ void Page::deletePixmap( int id )
 {
     PagePrivate::PixmapObject object = d->m_pixmaps.take( id );
     delete object.m_pixmap;
+    delete d->m_tilesManagers.take( id );
 }
 
 void Page::deletePixmaps()
@@ -671,6 +701,9 @@ void Page::deletePixmaps()
     }
 
     d->m_pixmaps.clear();
+
+    qDeleteAll( d->m_tilesManagers );
+    d->m_tilesManagers.clear();
 }
 
 void Page::deleteRects()
@@ -679,6 +712,7 @@ void Page::deleteRects()
     QSet<ObjectRect::ObjectType> which;
     which << ObjectRect::Action << ObjectRect::Image;
     deleteObjectRects( m_rects, which );
+    d->invalidateObjectRectIndex();
 }
 
 void PagePrivate::deleteHighlights( int s_id )
@@ -704,15 +738,39 @@ void PagePrivate::deleteTextSelections()
     m_textSelections = 0;
 }
 
+const ObjectRectIndex * PagePrivate::objectRectIndex( double xScale, double yScale )
+{
+    if ( m_objectRectIndex && !m_objectRectIndex->isValidForScale( xScale, yScale ) )
+    {
+        // build it for the smallest scale asked, so that views of the page
+        // at different scales do not build it again in turn
+        xScale = qMin( xScale, m_objectRectIndex->xScale() );
+        yScale = qMin( yScale, m_objectRectIndex->yScale() );
+        invalidateObjectRectIndex();
+    }
+
+    if ( !m_objectRectIndex )
+        m_objectRectIndex = new ObjectRectIndex( m_page->m_rects, xScale, yScale );
+    return m_objectRectIndex;
+}
+
+void PagePrivate::invalidateObjectRectIndex()
+{
+    delete m_objectRectIndex;
+    m_objectRectIndex = 0;
+}
+
 void Page::deleteSourceReferences()
 {
     deleteObjectRects( m_rects, QSet<ObjectRect::ObjectType>() << ObjectRect::SourceRef );
+    d->invalidateObjectRectIndex();
 }
 
 void Page::deleteAnnotations()
 {
     // delete ObjectRects of type Annotation
     deleteObjectRects( m_rects, QSet<ObjectRect::ObjectType>() << ObjectRect::OAnnotation );
+    d->invalidateObjectRectIndex();
     // delete all stored annotations
     QLinkedList< Annotation * >::const_iterator aIt = m_annotations.begin(), aEnd = m_annotations.end();
     for ( ; aIt != aEnd; ++aIt )
@@ -895,6 +953,11 @@ void PagePrivate::saveLocalContents( QDomNode & parentNode, QDomDocument & docum
         parentNode.appendChild( pageElement );
 }
 
+TilesManager * Page::tilesManager( int id ) const
+{
+    return d->m_tilesManagers.value( id );
+}
+
 const QPixmap * Page::_o_nearestPixmap( int pixID, int w, int h ) const
 {
     Q_UNUSED( h )
@@ -31,6 +31,7 @@ class PagePrivate;
 class PageTransition;
 class SourceReference;
 class TextSelection;
+class TilesManager;
 
 /**
  * @short Collector for all the data belonging to a page.
@@ -141,6 +142,14 @@ class OKULAR_EXPORT Page
          */
         bool hasPixmap( int id, int width = -1, int height = -1 ) const;
 
+        /**
+         * Returns whether the page has all the tiles covering the area @p rect
+         * of a pixmap of size @p width x @p height for the observer with given @p id.
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        bool hasPixmap( int id, int width, int height, const NormalizedRect &rect ) const;
+
         /**
          * Returns whether the page provides a text page (@ref TextPage).
          */
@@ -257,6 +266,15 @@ class OKULAR_EXPORT Page
          */
         void setPixmap( int id, QPixmap *pixmap );
 
+        /**
+         * Sets the @p pixmap of the tile covering the area @p rect of the page
+         * for the observer with the given @p id.
+         *
+         * @see PixmapRequest::isTile()
+         * @since 0.16 (KDE 4.10)
+         */
+        void setPixmap( int id, QPixmap *pixmap, const NormalizedRect &rect );
+
         /**
          * Sets the @p text page.
          */
@@ -372,6 +390,7 @@ class OKULAR_EXPORT Page
         /// @endcond
 
         const QPixmap * _o_nearestPixmap( int, int, int ) const;
+        TilesManager * tilesManager( int id ) const;
 
         QLinkedList< ObjectRect* > m_rects;
         QLinkedList< HighlightAreaRect* > m_highlights;
@@ -31,11 +31,13 @@ class Annotation;
 class DocumentPrivate;
 class FormField;
 class HighlightAreaRect;
+class ObjectRectIndex;
 class Page;
 class PageSize;
 class PageTransition;
 class RotationJob;
 class TextPage;
+class TilesManager;
 
 enum PageItem
 {
@@ -102,6 +104,17 @@ class PagePrivate
          */
         void deleteTextSelections();
 
+        /**
+         * Returns the index of the object rects of the page for the scale
+         * @p xScale x @p yScale, building it if needed.
+         */
+        const ObjectRectIndex * objectRectIndex( double xScale, double yScale );
+
+        /**
+         * Drops the index of the object rects, as they changed.
+         */
+        void invalidateObjectRectIndex();
+
         class PixmapObject
         {
             public:
@@ -109,6 +122,7 @@ class PagePrivate
                 Rotation m_rotation;
         };
         QMap< int, PixmapObject > m_pixmaps;
+        QMap< int, TilesManager * > m_tilesManagers;
 
         Page *m_page;
         int m_number;
@@ -121,6 +135,7 @@ class PagePrivate
         TextPage * m_text;
         PageTransition * m_transition;
         HighlightAreaRect *m_textSelections;
+        ObjectRectIndex *m_objectRectIndex;
         QLinkedList< FormField * > formfields;
         Action * m_openingAction;
         Action * m_closingAction;
@@ -0,0 +1,212 @@
+/***************************************************************************
+ *   Copyright (C) 2012 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "pixmapcache_p.h"
+
+#include <QtCore/QSet>
+
+#include "observer.h"
+
+PixmapCache::PixmapCache()
+    : m_totalMemory( 0 ), m_hits( 0 ), m_misses( 0 )
+{
+}
+
+PixmapCache::~PixmapCache()
+{
+    clear();
+}
+
+void PixmapCache::insert( int id, int page, qulonglong memory )
+{
+    remove( id, page );
+
+    ObserverPixmaps &pixmaps = m_observers[ id ];
+    List::iterator it = pixmaps.lru.insert( pixmaps.lru.end(), new AllocatedPixmap( id, page, memory ) );
+    m_index.insert( Key( id, page ), it );
+    pixmaps.memory += memory;
+    m_totalMemory += memory;
+}
+
+bool PixmapCache::touch( int id, int page )
+{
+    QHash< Key, List::iterator >::iterator indexIt = m_index.find( Key( id, page ) );
+    if ( indexIt == m_index.end() )
+        return false;
+
+    // move the entry to the end of the list, the iterators of the other
+    // entries stay valid
+    List &lru = m_observers[ id ].lru;
+    AllocatedPixmap *p = *indexIt.value();
+    lru.erase( indexIt.value() );
+    indexIt.value() = lru.insert( lru.end(), p );
+    return true;
+}
+
+void PixmapCache::touchPage( int page )
+{
+    QMap< int, ObserverPixmaps >::const_iterator it = m_observers.constBegin(), itEnd = m_observers.constEnd();
+    for ( ; it != itEnd; ++it )
+        touch( it.key(), page );
+}
+
+void PixmapCache::remove( int id, int page )
+{
+    QHash< Key, List::iterator >::iterator indexIt = m_index.find( Key( id, page ) );
+    if ( indexIt == m_index.end() )
+        return;
+
+    AllocatedPixmap *p = *indexIt.value();
+    take( m_observers[ id ], indexIt.value() );
+    delete p;
+}
+
+void PixmapCache::removeObserver( int id )
+{
+    QMap< int, ObserverPixmaps >::iterator it = m_observers.find( id );
+    if ( it == m_observers.end() )
+        return;
+
+    foreach ( AllocatedPixmap *p, it.value().lru )
+    {
+        m_index.remove( Key( id, p->page ) );
+        delete p;
+    }
+    m_totalMemory -= it.value().memory;
+    it.value().lru.clear();
+    it.value().memory = 0;
+}
+
+void PixmapCache::clear()
+{
+    QMap< int, ObserverPixmaps >::iterator it = m_observers.begin(), itEnd = m_observers.end();
+    for ( ; it != itEnd; ++it )
+    {
+        qDeleteAll( it.value().lru );
+        it.value().lru.clear();
+        it.value().memory = 0;
+    }
+    m_index.clear();
+    m_totalMemory = 0;
+}
+
+void PixmapCache::take( ObserverPixmaps &pixmaps, List::iterator it )
+{
+    AllocatedPixmap *p = *it;
+    m_index.remove( Key( p->id, p->page ) );
+    pixmaps.lru.erase( it );
+    pixmaps.memory -= p->memory;
+    m_totalMemory -= p->memory;
+}
+
+QList< AllocatedPixmap * > PixmapCache::evict( qulonglong memoryToFree, const QMap< int, Okular::DocumentObserver * > &observers )
+{
+    QList< AllocatedPixmap * > evicted;
+    QSet< int > exhausted;
+    // where the scan of each observer got to, so that its pixmaps which
+    // cannot be unloaded are passed only once
+    QHash< int, List::iterator > scanPositions;
+
+    while ( memoryToFree > 0 )
+    {
+        // pick the observer using the most memory for its weight
+        QMap< int, ObserverPixmaps >::iterator victim = m_observers.end();
+        double victimLoad = -1.0;
+        QMap< int, ObserverPixmaps >::iterator it = m_observers.begin(), itEnd = m_observers.end();
+        for ( ; it != itEnd; ++it )
+        {
+            if ( it.value().lru.isEmpty() || exhausted.contains( it.key() ) )
+                continue;
+
+            const double load = (double)it.value().memory / it.value().weight;
+            if ( load > victimLoad )
+            {
+                victim = it;
+                victimLoad = load;
+            }
+        }
+        if ( victim == m_observers.end() )
+            break;
+
+        // take its least recently used pixmap which can be unloaded
+        const Okular::DocumentObserver *observer = observers.value( victim.key() );
+        List &lru = victim.value().lru;
+        QHash< int, List::iterator >::const_iterator scanIt = scanPositions.constFind( victim.key() );
+        List::iterator pIt = scanIt != scanPositions.constEnd() ? scanIt.value() : lru.begin(), pEnd = lru.end();
+        while ( pIt != pEnd && observer && !observer->canUnloadPixmap( (*pIt)->page ) )
+            ++pIt;
+
+        if ( pIt == pEnd )
+        {
+            exhausted.insert( victim.key() );
+            continue;
+        }
+
+        // the iterators of the other entries stay valid
+        List::iterator next = pIt;
+        ++next;
+        scanPositions.insert( victim.key(), next );
+
+        AllocatedPixmap *p = *pIt;
+        take( victim.value(), pIt );
+        evicted.append( p );
+        memoryToFree -= qMin( memoryToFree, p->memory );
+    }
+
+    return evicted;
+}
+
+void PixmapCache::setObserverWeight( int id, int weight )
+{
+    m_observers[ id ].weight = qMax( 1, weight );
+}
+
+bool PixmapCache::isEmpty() const
+{
+    return m_index.isEmpty();
+}
+
+int PixmapCache::count() const
+{
+    return m_index.count();
+}
+
+qulonglong PixmapCache::totalMemory() const
+{
+    return m_totalMemory;
+}
+
+qulonglong PixmapCache::observerMemory( int id ) const
+{
+    return m_observers.value( id ).memory;
+}
+
+void PixmapCache::countRequest( bool hit )
+{
+    if ( hit )
+        ++m_hits;
+    else
+        ++m_misses;
+}
+
+qulonglong PixmapCache::hits() const
+{
+    return m_hits;
+}
+
+qulonglong PixmapCache::misses() const
+{
+    return m_misses;
+}
+
+void PixmapCache::resetCounters()
+{
+    m_hits = 0;
+    m_misses = 0;
+}
@@ -0,0 +1,143 @@
+/***************************************************************************
+ *   Copyright (C) 2012 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_PIXMAPCACHE_P_H_
+#define _OKULAR_PIXMAPCACHE_P_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QLinkedList>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QPair>
+
+namespace Okular {
+
+class DocumentObserver;
+
+}
+
+/**
+ * The memory allocated for the pixmap(s) of a page for an observer.
+ */
+struct AllocatedPixmap
+{
+    // owner of the page
+    int id;
+    int page;
+    qulonglong memory;
+    // public constructor: initialize data
+    AllocatedPixmap( int i, int p, qulonglong m ) : id( i ), page( p ), memory( m ) {}
+};
+
+/**
+ * @short Keeps track of the memory used by the pixmaps of the pages.
+ *
+ * Each observer has its own list of allocated pixmaps, sorted from the least
+ * to the most recently used one; inserting, touching and removing a pixmap
+ * are constant time operations.
+ *
+ * When memory has to be freed, the pixmaps are taken from the observer
+ * using the most memory with respect to its weight, so that an observer
+ * with many small pixmaps (e.g. the thumbnails) cannot make the pixmaps of
+ * the others be evicted first.
+ */
+class PixmapCache
+{
+    public:
+        PixmapCache();
+        ~PixmapCache();
+
+        /**
+         * Records @p memory bytes allocated for the pixmap of @p page for the
+         * observer @p id, replacing a previous entry of the same pixmap, and
+         * marks it as the most recently used one.
+         */
+        void insert( int id, int page, qulonglong memory );
+
+        /**
+         * Marks the pixmap of @p page for the observer @p id as the most
+         * recently used one, returning false if it is not in the cache.
+         */
+        bool touch( int id, int page );
+
+        /**
+         * Marks all the pixmaps of @p page as the most recently used ones.
+         */
+        void touchPage( int page );
+
+        /**
+         * Removes the pixmap of @p page for the observer @p id.
+         */
+        void remove( int id, int page );
+
+        /**
+         * Removes all the pixmaps of the observer @p id.
+         */
+        void removeObserver( int id );
+
+        /**
+         * Removes all the pixmaps.
+         */
+        void clear();
+
+        /**
+         * Removes and returns the least recently used pixmaps which can be
+         * unloaded according to the @p observers, until at least
+         * @p memoryToFree bytes are freed or there is nothing left to free.
+         *
+         * The caller takes the ownership of the returned entries.
+         */
+        QList< AllocatedPixmap * > evict( qulonglong memoryToFree, const QMap< int, Okular::DocumentObserver * > &observers );
+
+        /**
+         * Sets the weight of the observer @p id in the eviction choice:
+         * an observer with twice the weight of another one keeps twice its
+         * memory. The default weight is 1.
+         */
+        void setObserverWeight( int id, int weight );
+
+        bool isEmpty() const;
+        int count() const;
+        qulonglong totalMemory() const;
+        qulonglong observerMemory( int id ) const;
+
+        /**
+         * Records whether a requested pixmap was already present.
+         */
+        void countRequest( bool hit );
+
+        qulonglong hits() const;
+        qulonglong misses() const;
+        void resetCounters();
+
+    private:
+        typedef QPair< int, int > Key;
+        typedef QLinkedList< AllocatedPixmap * > List;
+
+        struct ObserverPixmaps
+        {
+            ObserverPixmaps() : memory( 0 ), weight( 1 ) {}
+
+            List lru;
+            qulonglong memory;
+            int weight;
+        };
+
+        void take( ObserverPixmaps &pixmaps, List::iterator it );
+
+        QMap< int, ObserverPixmaps > m_observers;
+        QHash< Key, List::iterator > m_index;
+        qulonglong m_totalMemory;
+        qulonglong m_hits;
+        qulonglong m_misses;
+
+        Q_DISABLE_COPY( PixmapCache )
+};
+
+#endif
@@ -228,7 +228,7 @@ static KJSObject docGotoNamedDest( KJSContext *ctx, void *object,
 
     QString dest = arguments.at( 0 ).toString( ctx );
 
-    DocumentViewport viewport( doc->m_generator->metaData( "NamedViewport", dest ).toString() );
+    DocumentViewport viewport = doc->destinationViewport( dest );
     if ( !viewport.isValid() )
         return KJSUndefined();
 
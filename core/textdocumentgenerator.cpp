@@ -10,13 +10,18 @@
 #include "textdocumentgenerator.h"
 #include "textdocumentgenerator_p.h"
 
+#include <QtCore/QBuffer>
 #include <QtCore/QFile>
 #include <QtCore/QMutex>
 #include <QtCore/QStack>
 #include <QtCore/QTextStream>
+#include <QtCore/QTime>
+#include <QtCore/QTimer>
+#include <QtCore/QUrl>
 #include <QtCore/QVector>
 #include <QtGui/QFontDatabase>
 #include <QtGui/QImage>
+#include <QtGui/QImageReader>
 #include <QtGui/QPainter>
 #include <QtGui/QPrinter>
 #if QT_VERSION >= 0x040500
@@ -29,9 +34,129 @@
 #include "textpage.h"
 
 #include "document.h"
+#include "document_p.h"
+
+#include <limits.h>
 
 using namespace Okular;
 
+// how many pages are laid out before showing the document, the layout
+// of the others goes on afterwards
+static const int InitialPages = 10;
+
+// the decoded images are kept sharp up to this zoom factor
+static const int MaxImageScale = 2;
+
+// the memory the decoded images of a document may take at most
+static const qulonglong MaxImageCacheMemory = 32 * 1024 * 1024;
+
+static bool linkPositionLessThan( const TextDocumentGeneratorPrivate::LinkPosition &a, const TextDocumentGeneratorPrivate::LinkPosition &b )
+{
+    return a.startPosition < b.startPosition;
+}
+
+static bool annotationPositionLessThan( const TextDocumentGeneratorPrivate::AnnotationPosition &a, const TextDocumentGeneratorPrivate::AnnotationPosition &b )
+{
+    return a.startPosition < b.startPosition;
+}
+
+/**
+ * Text Document Implementation
+ */
+TextDocument::TextDocument()
+    : QTextDocument(), d_ptr( new TextDocumentPrivate )
+{
+}
+
+TextDocument::~TextDocument()
+{
+    delete d_ptr;
+}
+
+void TextDocument::addImage( const QString &name, const QByteArray &data )
+{
+    Q_D( TextDocument );
+
+    TextDocumentPrivate::ImageData imageData;
+    imageData.data = data;
+
+    QBuffer buffer( &imageData.data );
+    buffer.open( QIODevice::ReadOnly );
+    QImageReader reader( &buffer );
+    imageData.size = reader.size();
+
+    // not every image format can tell its size without decoding it
+    if ( !imageData.size.isValid() )
+        imageData.size = QImage::fromData( data ).size();
+
+    d->mImages.insert( name, imageData );
+}
+
+QSize TextDocument::imageSize( const QString &name ) const
+{
+    Q_D( const TextDocument );
+
+    return d->mImages.value( name ).size;
+}
+
+void TextDocument::setImageDisplaySize( const QString &name, const QSizeF &size )
+{
+    Q_D( TextDocument );
+
+    QHash<QString, TextDocumentPrivate::ImageData>::iterator it = d->mImages.find( name );
+    if ( it == d->mImages.end() )
+        return;
+
+    it->displaySize = it->displaySize.expandedTo( size );
+}
+
+QVariant TextDocument::loadResource( int type, const QUrl &name )
+{
+    Q_D( TextDocument );
+
+    const QString imageName = name.toString();
+    if ( type != QTextDocument::ImageResource || !d->mImages.contains( imageName ) )
+        return QTextDocument::loadResource( type, name );
+
+    QMutexLocker locker( &d->mCacheMutex );
+
+    for ( int i = 0; i < d->mImageCache.count(); ++i ) {
+        if ( d->mImageCache.at( i ).name == imageName ) {
+            d->mImageCache.move( i, 0 );
+            return d->mImageCache.first().image;
+        }
+    }
+
+    TextDocumentPrivate::CachedImage cachedImage;
+    cachedImage.name = imageName;
+    cachedImage.image = d->decodeImage( d->mImages.value( imageName ) );
+
+    d->mImageCache.prepend( cachedImage );
+    d->mImageCacheMemory += cachedImage.image.byteCount();
+    while ( d->mImageCache.count() > 1 && d->mImageCacheMemory > MaxImageCacheMemory )
+        d->mImageCacheMemory -= d->mImageCache.takeLast().image.byteCount();
+
+    return cachedImage.image;
+}
+
+QImage TextDocumentPrivate::decodeImage( const ImageData &imageData ) const
+{
+    QByteArray data = imageData.data;
+    QBuffer buffer( &data );
+    buffer.open( QIODevice::ReadOnly );
+    QImageReader reader( &buffer );
+
+    const QSize displaySize = ( imageData.displaySize * MaxImageScale ).toSize();
+    if ( imageData.size.isValid() && !displaySize.isEmpty() &&
+         imageData.size.width() > displaySize.width() && imageData.size.height() > displaySize.height() ) {
+        QSize scaledSize = imageData.size;
+        scaledSize.scale( displaySize, Qt::KeepAspectRatioByExpanding );
+        reader.setScaledSize( scaledSize );
+    }
+
+    return reader.read();
+}
+
 /**
  * Generic Converter Implementation
  */
@@ -55,6 +180,11 @@ TextDocumentGenerator* TextDocumentConverter::generator() const
     return d_ptr->mParent ? d_ptr->mParent->q_func() : 0;
 }
 
+bool TextDocumentConverter::convertMore()
+{
+    return false;
+}
+
 /**
  * Generic Generator Implementation
  */
@@ -62,34 +192,9 @@ Okular::TextPage* TextDocumentGeneratorPrivate::createTextPage( int pageNumber )
 {
 #ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
     Q_Q( const TextDocumentGenerator );
-#endif
-
-    Okular::TextPage *textPage = new Okular::TextPage;
-
-    int start, end;
-
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
     q->userMutex()->lock();
 #endif
-    TextDocumentUtils::calculatePositions( mDocument, pageNumber, start, end );
-
-    {
-    QTextCursor cursor( mDocument );
-    for ( int i = start; i < end - 1; ++i ) {
-        cursor.setPosition( i );
-        cursor.setPosition( i + 1, QTextCursor::KeepAnchor );
-
-        QString text = cursor.selectedText();
-        if ( text.length() == 1 ) {
-            QRectF rect;
-            TextDocumentUtils::calculateBoundingRect( mDocument, i, i + 1, rect, pageNumber );
-            if ( pageNumber == -1 )
-                text = "\n";
-
-            textPage->append( text, new Okular::NormalizedRect( rect.left(), rect.top(), rect.right(), rect.bottom() ) );
-        }
-    }
-    }
+    Okular::TextPage *textPage = TextDocumentUtils::createTextPage( mDocument, pageNumber );
 #ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
     q->userMutex()->unlock();
 #endif
@@ -135,6 +240,21 @@ void TextDocumentGeneratorPrivate::addTitle( int level, const QString &title, co
     mTitlePositions.append( position );
 }
 
+void TextDocumentGeneratorPrivate::addTitle( int level, const QString &title, const QString &destination )
+{
+    TitlePosition position;
+    position.level = level;
+    position.title = title;
+    position.destination = destination;
+
+    mTitlePositions.append( position );
+}
+
+void TextDocumentGeneratorPrivate::addDestination( const QString &name, const QTextBlock &block )
+{
+    mDestinations.insert( name, block );
+}
+
 void TextDocumentGeneratorPrivate::addMetaData( const QString &key, const QString &value, const QString &title )
 {
     mDocumentInfo.set( key, value, title );
@@ -147,8 +267,11 @@ void TextDocumentGeneratorPrivate::addMetaData( DocumentInfo::Key key, const QSt
 
 void TextDocumentGeneratorPrivate::generateLinkInfos()
 {
-    for ( int i = 0; i < mLinkPositions.count(); ++i ) {
-        const LinkPosition &linkPosition = mLinkPositions[ i ];
+    const int laidOut = laidOutPosition();
+    for ( ; mLinkPositionsDone < mLinkPositions.count(); ++mLinkPositionsDone ) {
+        const LinkPosition &linkPosition = mLinkPositions[ mLinkPositionsDone ];
+        if ( linkPosition.startPosition >= laidOut )
+            break;
 
         LinkInfo info;
         info.link = linkPosition.link;
@@ -163,8 +286,11 @@ void TextDocumentGeneratorPrivate::generateLinkInfos()
 
 void TextDocumentGeneratorPrivate::generateAnnotationInfos()
 {
-    for ( int i = 0; i < mAnnotationPositions.count(); ++i ) {
-        const AnnotationPosition &annotationPosition = mAnnotationPositions[ i ];
+    const int laidOut = laidOutPosition();
+    for ( ; mAnnotationPositionsDone < mAnnotationPositions.count(); ++mAnnotationPositionsDone ) {
+        const AnnotationPosition &annotationPosition = mAnnotationPositions[ mAnnotationPositionsDone ];
+        if ( annotationPosition.startPosition >= laidOut )
+            break;
 
         AnnotationInfo info;
         info.annotation = annotationPosition.annotation;
@@ -179,38 +305,236 @@ void TextDocumentGeneratorPrivate::generateAnnotationInfos()
 
 void TextDocumentGeneratorPrivate::generateTitleInfos()
 {
-    QStack< QPair<int,QDomNode> > parentNodeStack;
-
     QDomNode parentNode = mDocumentSynopsis;
 
-    parentNodeStack.push( qMakePair( 0, parentNode ) );
+    if ( mTitleParents.isEmpty() )
+        mTitleParents.push( qMakePair( 0, parentNode ) );
 
-    for ( int i = 0; i < mTitlePositions.count(); ++i ) {
-        const TitlePosition &position = mTitlePositions[ i ];
-
-        Okular::DocumentViewport viewport = TextDocumentUtils::calculateViewport( mDocument, position.block );
+    // all the titles go in the synopsis right away, the ones of the parts
+    // not converted yet can be followed through their destination
+    for ( ; mTitlePositionsDone < mTitlePositions.count(); ++mTitlePositionsDone ) {
+        TitlePosition &position = mTitlePositions[ mTitlePositionsDone ];
 
         QDomElement item = mDocumentSynopsis.createElement( position.title );
-        item.setAttribute( "Viewport", viewport.toString() );
+        if ( !position.destination.isEmpty() )
+            item.setAttribute( "ViewportName", position.destination );
+        position.item = item;
 
         int headingLevel = position.level;
 
         // we need a parent, which has to be at a higher heading level than this heading level
         // so we just work through the stack
-        while ( ! parentNodeStack.isEmpty() ) {
-            int parentLevel = parentNodeStack.top().first;
+        while ( ! mTitleParents.isEmpty() ) {
+            int parentLevel = mTitleParents.top().first;
             if ( parentLevel < headingLevel ) {
                 // this is OK as a parent
-                parentNode = parentNodeStack.top().second;
+                parentNode = mTitleParents.top().second;
                 break;
             } else {
                 // we'll need to be further into the stack
-                parentNodeStack.pop();
+                mTitleParents.pop();
             }
         }
         parentNode.appendChild( item );
-        parentNodeStack.push( qMakePair( headingLevel, QDomNode(item) ) );
+        mTitleParents.push( qMakePair( headingLevel, QDomNode(item) ) );
+    }
+
+    const int laidOut = laidOutPosition();
+    const int pages = completePages();
+    for ( ; mTitleViewportsDone < mTitlePositions.count(); ++mTitleViewportsDone ) {
+        TitlePosition &position = mTitlePositions[ mTitleViewportsDone ];
+        const QTextBlock block = position.block.isValid() ? position.block : mDestinations.value( position.destination );
+        if ( !block.isValid() ) {
+            // the destination may still come, otherwise it is a broken title
+            if ( mConverting )
+                break;
+            continue;
+        }
+        if ( block.position() >= laidOut )
+            break;
+
+        // only once the page of the title is there
+        const Okular::DocumentViewport viewport = TextDocumentUtils::calculateViewport( mDocument, block );
+        if ( viewport.pageNumber >= pages )
+            break;
+        position.item.setAttribute( "Viewport", viewport.toString() );
+    }
+}
+
+bool TextDocumentGeneratorPrivate::layoutPages( int pages, int msecs, const QTextBlock &destination )
+{
+#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
+    Q_Q( TextDocumentGenerator );
+    q->userMutex()->lock();
+#endif
+    const QAbstractTextDocumentLayout *layout = mDocument->documentLayout();
+
+    QTime time;
+    time.start();
+    while ( mLayoutBlock.isValid() ) {
+        // asking for the position of a block lays out the document up to it
+        const QRectF rect = layout->blockBoundingRect( mLayoutBlock );
+        mLayoutBottom = qMax( mLayoutBottom, rect.bottom() );
+        if ( mLayoutBlock == destination )
+            pages = qMax( pages, qRound( rect.y() ) / qRound( mDocument->pageSize().height() ) + 1 );
+
+        // the next part of the document is appended once the layout gets
+        // to the end of the converted one
+        QTextBlock next = mLayoutBlock.next();
+        while ( !next.isValid() && convertMore() )
+            next = mLayoutBlock.next();
+        mLayoutBlock = next;
+
+        if ( ( pages > 0 && completePages() >= pages ) || ( msecs > 0 && time.elapsed() >= msecs ) )
+            break;
+    }
+#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
+    q->userMutex()->unlock();
+#endif
+
+    return !mLayoutBlock.isValid();
+}
+
+bool TextDocumentGeneratorPrivate::convertMore()
+{
+    if ( !mConverting )
+        return false;
+
+    QMetaObject::invokeMethod( mConverter, "convertMore", Qt::DirectConnection, Q_RETURN_ARG(bool, mConverting) );
+
+    // the infos are generated in the order of the document, and the new
+    // positions are all behind the ones not used yet
+    qStableSort( mLinkPositions.begin() + mLinkPositionsDone, mLinkPositions.end(), linkPositionLessThan );
+    qStableSort( mAnnotationPositions.begin() + mAnnotationPositionsDone, mAnnotationPositions.end(), annotationPositionLessThan );
+
+    return true;
+}
+
+int TextDocumentGeneratorPrivate::laidOutPosition() const
+{
+    return mLayoutBlock.isValid() ? mLayoutBlock.position() : INT_MAX;
+}
+
+int TextDocumentGeneratorPrivate::completePages() const
+{
+    if ( !mLayoutBlock.isValid() )
+        return mDocument->pageCount();
+
+    return (int)( mLayoutBottom / mDocument->pageSize().height() );
+}
+
+void TextDocumentGeneratorPrivate::createPages( int from, int to, QVector<Okular::Page*> &pagesVector )
+{
+    const QSize size = mDocument->pageSize().toSize();
+
+    // the infos are sorted by page, as they are generated in the order of
+    // the document
+    QVector< QLinkedList<Okular::ObjectRect*> > objects( to - from );
+    for ( ; mLinkInfosUsed < mLinkInfos.count() && mLinkInfos.at( mLinkInfosUsed ).page < to; ++mLinkInfosUsed ) {
+        const LinkInfo &info = mLinkInfos.at( mLinkInfosUsed );
+
+        // in case that the converter report bogus link info data, do not assert here
+        if ( info.page < from )
+          continue;
+
+        const QRectF rect = info.boundingRect;
+        objects[ info.page - from ].append( new Okular::ObjectRect( rect.left(), rect.top(), rect.right(), rect.bottom(), false,
+                                                                    Okular::ObjectRect::Action, info.link ) );
+    }
+
+    QVector< QLinkedList<Okular::Annotation*> > annots( to - from );
+    for ( ; mAnnotationInfosUsed < mAnnotationInfos.count() && mAnnotationInfos.at( mAnnotationInfosUsed ).page < to; ++mAnnotationInfosUsed ) {
+        const AnnotationInfo &info = mAnnotationInfos.at( mAnnotationInfosUsed );
+        if ( info.page < from )
+          continue;
+
+        QRect rect( 0, info.page * size.height(), size.width(), size.height() );
+        info.annotation->setBoundingRectangle( Okular::NormalizedRect( rect.left(), rect.top(), rect.right(), rect.bottom() ) );
+        annots[ info.page - from ].append( info.annotation );
+    }
+
+    pagesVector.resize( to - from );
+    for ( int i = from; i < to; ++i ) {
+        Okular::Page * page = new Okular::Page( i, size.width(), size.height(), Okular::Rotation0 );
+        pagesVector[ i - from ] = page;
+
+        if ( !objects.at( i - from ).isEmpty() ) {
+            page->setObjectRects( objects.at( i - from ) );
+        }
+        QLinkedList<Okular::Annotation*>::ConstIterator annIt = annots.at( i - from ).begin(), annEnd = annots.at( i - from ).end();
+        for ( ; annIt != annEnd; ++annIt ) {
+            page->addAnnotation( *annIt );
+        }
+    }
+    mPagesCreated = to;
+}
+
+void TextDocumentGeneratorPrivate::appendPages()
+{
+    generateTitleInfos();
+    generateLinkInfos();
+    generateAnnotationInfos();
+
+    const int pages = completePages();
+    if ( pages > mPagesCreated ) {
+        QVector<Okular::Page*> newPages;
+        createPages( mPagesCreated, pages, newPages );
+        if ( m_document )
+            m_document->pagesAppended( newPages );
+        else
+            qDeleteAll( newPages );
     }
+
+    if ( !mLayoutBlock.isValid() && m_document )
+        m_document->setPagesComplete( true );
+}
+
+void TextDocumentGeneratorPrivate::layoutMorePages()
+{
+    Q_Q( TextDocumentGenerator );
+
+    // the document could have been closed meanwhile
+    if ( !mDocument || !mLayoutBlock.isValid() )
+        return;
+
+    // lay out in short slices, so that the GUI never blocks
+    layoutPages( 0, 20 );
+    appendPages();
+
+    if ( mLayoutBlock.isValid() )
+        QTimer::singleShot( 0, q, SLOT(layoutMorePages()) );
+}
+
+Okular::DocumentViewport TextDocumentGeneratorPrivate::destinationViewport( const QString &name )
+{
+    if ( !mDocument )
+        return Okular::DocumentViewport();
+
+    // convert the document up to the destination; the parts before it are
+    // needed anyway, as they give the number of its page
+    QTextBlock block = mDestinations.value( name );
+    if ( !block.isValid() && mConverting ) {
+#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
+        Q_Q( TextDocumentGenerator );
+        q->userMutex()->lock();
+#endif
+        while ( !block.isValid() && convertMore() )
+            block = mDestinations.value( name );
+#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
+        q->userMutex()->unlock();
+#endif
+    }
+    if ( !block.isValid() )
+        return Okular::DocumentViewport();
+
+    // do not wait for the layout to reach the destination, but lay out
+    // the document up to its page right now
+    if ( block.position() >= laidOutPosition() ) {
+        layoutPages( 0, 0, block );
+        appendPages();
+    }
+
+    return TextDocumentUtils::calculateViewport( mDocument, block );
 }
 
 TextDocumentGenerator::TextDocumentGenerator( TextDocumentConverter *converter, QObject *parent, const QVariantList &args )
@@ -232,6 +556,10 @@ TextDocumentGenerator::TextDocumentGenerator( TextDocumentConverter *converter,
              this, SLOT(addAnnotation(Annotation*,int,int)) );
     connect( converter, SIGNAL(addTitle(int,QString,QTextBlock)),
              this, SLOT(addTitle(int,QString,QTextBlock)) );
+    connect( converter, SIGNAL(addTitle(int,QString,QString)),
+             this, SLOT(addTitle(int,QString,QString)) );
+    connect( converter, SIGNAL(addDestination(QString,QTextBlock)),
+             this, SLOT(addDestination(QString,QTextBlock)) );
     connect( converter, SIGNAL(addMetaData(QString,QString,QString)),
              this, SLOT(addMetaData(QString,QString,QString)) );
     connect( converter, SIGNAL(addMetaData(DocumentInfo::Key,QString)),
@@ -258,6 +586,7 @@ bool TextDocumentGenerator::loadDocument( const QString & fileName, QVector<Okul
     {
         // loading failed, cleanup all the stuff eventually gathered from the converter
         d->mTitlePositions.clear();
+        d->mDestinations.clear();
         Q_FOREACH ( const TextDocumentGeneratorPrivate::LinkPosition &linkPos, d->mLinkPositions )
         {
             delete linkPos.link;
@@ -272,47 +601,27 @@ bool TextDocumentGenerator::loadDocument( const QString & fileName, QVector<Okul
         return false;
     }
 
+    // the infos are generated in the order of the document, along with the layout
+    qStableSort( d->mLinkPositions.begin(), d->mLinkPositions.end(), linkPositionLessThan );
+    qStableSort( d->mAnnotationPositions.begin(), d->mAnnotationPositions.end(), annotationPositionLessThan );
+
+    // lay out only the first pages now, the others are added to the
+    // document while the layout goes on, and so the parts of the document
+    // the converter did not convert yet
+    d->mConverting = true;
+    d->mLayoutBlock = d->mDocument->begin();
+    const bool laidOut = d->layoutPages( InitialPages, 0 );
+
     d->generateTitleInfos();
     d->generateLinkInfos();
     d->generateAnnotationInfos();
 
-    pagesVector.resize( d->mDocument->pageCount() );
-
-    const QSize size = d->mDocument->pageSize().toSize();
-
-    QVector< QLinkedList<Okular::ObjectRect*> > objects( d->mDocument->pageCount() );
-    for ( int i = 0; i < d->mLinkInfos.count(); ++i ) {
-        const TextDocumentGeneratorPrivate::LinkInfo &info = d->mLinkInfos.at( i );
-
-        // in case that the converter report bogus link info data, do not assert here
-        if ( info.page >= objects.count() )
-          continue;
+    d->createPages( 0, d->completePages(), pagesVector );
 
-        const QRectF rect = info.boundingRect;
-        objects[ info.page ].append( new Okular::ObjectRect( rect.left(), rect.top(), rect.right(), rect.bottom(), false,
-                                                             Okular::ObjectRect::Action, info.link ) );
-    }
-
-    QVector< QLinkedList<Okular::Annotation*> > annots( d->mDocument->pageCount() );
-    for ( int i = 0; i < d->mAnnotationInfos.count(); ++i ) {
-        const TextDocumentGeneratorPrivate::AnnotationInfo &info = d->mAnnotationInfos[ i ];
-
-        QRect rect( 0, info.page * size.height(), size.width(), size.height() );
-        info.annotation->setBoundingRectangle( Okular::NormalizedRect( rect.left(), rect.top(), rect.right(), rect.bottom() ) );
-        annots[ info.page ].append( info.annotation );
-    }
-
-    for ( int i = 0; i < d->mDocument->pageCount(); ++i ) {
-        Okular::Page * page = new Okular::Page( i, size.width(), size.height(), Okular::Rotation0 );
-        pagesVector[ i ] = page;
-
-        if ( !objects.at( i ).isEmpty() ) {
-            page->setObjectRects( objects.at( i ) );
-        }
-        QLinkedList<Okular::Annotation*>::ConstIterator annIt = annots.at( i ).begin(), annEnd = annots.at( i ).end();
-        for ( ; annIt != annEnd; ++annIt ) {
-            page->addAnnotation( *annIt );
-        }
+    if ( !laidOut )
+    {
+        setPagesComplete( false );
+        QTimer::singleShot( 0, this, SLOT(layoutMorePages()) );
     }
 
     return true;
@@ -325,10 +634,22 @@ bool TextDocumentGenerator::doCloseDocument()
     d->mDocument = 0;
 
     d->mTitlePositions.clear();
+    d->mDestinations.clear();
     d->mLinkPositions.clear();
     d->mLinkInfos.clear();
     d->mAnnotationPositions.clear();
     d->mAnnotationInfos.clear();
+    d->mConverting = false;
+    d->mLayoutBlock = QTextBlock();
+    d->mLayoutBottom = 0;
+    d->mPagesCreated = 0;
+    d->mTitleParents.clear();
+    d->mTitlePositionsDone = 0;
+    d->mTitleViewportsDone = 0;
+    d->mLinkPositionsDone = 0;
+    d->mLinkInfosUsed = 0;
+    d->mAnnotationPositionsDone = 0;
+    d->mAnnotationInfosUsed = 0;
     // do not use clear() for the following two, otherwise they change type
     d->mDocumentInfo = Okular::DocumentInfo();
     d->mDocumentSynopsis = Okular::DocumentSynopsis();
@@ -383,6 +704,13 @@ QImage TextDocumentGeneratorPrivate::image( PixmapRequest * request )
     return image;
 }
 
+QString TextDocumentGenerator::destinationViewport( const QString &name )
+{
+    Q_D( TextDocumentGenerator );
+    const Okular::DocumentViewport viewport = d->destinationViewport( name );
+    return viewport.isValid() ? viewport.toString() : QString();
+}
+
 Okular::TextPage* TextDocumentGenerator::textPage( Okular::Page * page )
 {
     Q_D( TextDocumentGenerator );
@@ -417,11 +745,22 @@ const Okular::DocumentSynopsis* TextDocumentGenerator::generateDocumentSynopsis(
 
 QVariant TextDocumentGeneratorPrivate::metaData( const QString &key, const QVariant &option ) const
 {
-    Q_UNUSED( option )
     if ( key == "DocumentTitle" )
     {
         return mDocumentInfo.get( "title" );
     }
+    else if ( key == "NamedViewport" && !option.toString().isEmpty() )
+    {
+        // only the destinations on the pages there already, getting to the
+        // others changes the document (see destinationViewport())
+        const QTextBlock block = mDestinations.value( option.toString() );
+        if ( block.isValid() && block.position() < laidOutPosition() )
+        {
+            const Okular::DocumentViewport viewport = TextDocumentUtils::calculateViewport( mDocument, block );
+            if ( viewport.pageNumber < mPagesCreated )
+                return viewport.toString();
+        }
+    }
     return QVariant();
 }
 
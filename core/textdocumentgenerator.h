@@ -15,14 +15,67 @@
 #include "document.h"
 #include "generator.h"
 
+#include <QtGui/QTextDocument>
+
 class QTextBlock;
-class QTextDocument;
 
 namespace Okular {
 
 class TextDocumentConverterPrivate;
 class TextDocumentGenerator;
 class TextDocumentGeneratorPrivate;
+class TextDocumentPrivate;
+
+/**
+ * @brief QTextDocument decoding its images only when they are drawn
+ *
+ * The converters can fill this document instead of a plain QTextDocument
+ * when the document has images: the images added with addImage() are kept
+ * encoded, and decoded at most at twice the size they are displayed at
+ * when the pages are drawn. The decoded images are kept in a cache of
+ * limited size, shared by the threads drawing the pages.
+ *
+ * @since 0.16 (KDE 4.10)
+ */
+class OKULAR_EXPORT TextDocument : public QTextDocument
+{
+    public:
+        /**
+         * Creates a new empty text document.
+         */
+        TextDocument();
+
+        /**
+         * Destroys the text document.
+         */
+        ~TextDocument();
+
+        /**
+         * Registers the encoded image @p data under @p name, only
+         * its size is read from the header of the image.
+         */
+        void addImage( const QString &name, const QByteArray &data );
+
+        /**
+         * Returns the size of the image @p name or an invalid size
+         * if there is no such image.
+         */
+        QSize imageSize( const QString &name ) const;
+
+        /**
+         * Sets the @p size the image @p name is displayed at, so it is
+         * not decoded larger than needed.
+         */
+        void setImageDisplaySize( const QString &name, const QSizeF &size );
+
+    protected:
+        virtual QVariant loadResource( int type, const QUrl &name );
+
+    private:
+        TextDocumentPrivate *d_ptr;
+        Q_DECLARE_PRIVATE( TextDocument )
+        Q_DISABLE_COPY( TextDocument )
+};
 
 class OKULAR_EXPORT TextDocumentConverter : public QObject
 {
@@ -65,6 +118,26 @@ class OKULAR_EXPORT TextDocumentConverter : public QObject
          */
         void addTitle( int level, const QString &title, const QTextBlock &position );
 
+        /**
+         * Adds a new title at the given level which leads to the named
+         * destination @p destination, for the titles of the parts of the
+         * document not converted yet (see convertMore()).
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        void addTitle( int level, const QString &title, const QString &destination );
+
+        /**
+         * Adds a new named destination which is located at position to the generator.
+         *
+         * A GotoAction to the destination name is resolved only when it is
+         * followed, so unlike calculateViewport() it does not need the
+         * document to be laid out up to the destination while converting.
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        void addDestination( const QString &name, const QTextBlock &position );
+
         /**
          * Adds a set of meta data to the generator.
          */
@@ -119,6 +192,22 @@ class OKULAR_EXPORT TextDocumentConverter : public QObject
          */
         TextDocumentGenerator* generator() const;
 
+    protected Q_SLOTS:
+        /**
+         * Converts the next part of the document, for converters which
+         * return from convert() only the beginning of the document, so that
+         * it is shown sooner. The part is appended at the end of the document
+         * returned by convert(), and its titles, actions and destinations are
+         * added as usual. It is called from the GUI thread while the document
+         * is laid out, or when a destination not converted yet is needed.
+         *
+         * Returns whether there is more of the document to convert; the
+         * default implementation returns false.
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        bool convertMore();
+
     private:
         TextDocumentConverterPrivate *d_ptr;
         Q_DECLARE_PRIVATE( TextDocumentConverter )
@@ -170,6 +259,9 @@ class OKULAR_EXPORT TextDocumentGenerator : public Generator
         bool doCloseDocument();
         Okular::TextPage* textPage( Okular::Page *page );
 
+    protected Q_SLOTS:
+        QString destinationViewport( const QString &name );
+
     private:
         Q_DECLARE_PRIVATE( TextDocumentGenerator )
         Q_DISABLE_COPY( TextDocumentGenerator )
@@ -177,8 +269,11 @@ class OKULAR_EXPORT TextDocumentGenerator : public Generator
         Q_PRIVATE_SLOT( d_func(), void addAction( Action*, int, int ) )
         Q_PRIVATE_SLOT( d_func(), void addAnnotation( Annotation*, int, int ) )
         Q_PRIVATE_SLOT( d_func(), void addTitle( int, const QString&, const QTextBlock& ) )
+        Q_PRIVATE_SLOT( d_func(), void addTitle( int, const QString&, const QString& ) )
+        Q_PRIVATE_SLOT( d_func(), void addDestination( const QString&, const QTextBlock& ) )
         Q_PRIVATE_SLOT( d_func(), void addMetaData( const QString&, const QString&, const QString& ) )
         Q_PRIVATE_SLOT( d_func(), void addMetaData( DocumentInfo::Key, const QString& ) )
+        Q_PRIVATE_SLOT( d_func(), void layoutMorePages() )
 };
 
 }
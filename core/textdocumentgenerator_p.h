@@ -10,14 +10,21 @@
 #ifndef _OKULAR_TEXTDOCUMENTGENERATOR_P_H_
 #define _OKULAR_TEXTDOCUMENTGENERATOR_P_H_
 
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QStack>
+#include <QtGui/QImage>
 #include <QtGui/QAbstractTextDocumentLayout>
 #include <QtGui/QTextBlock>
 #include <QtGui/QTextDocument>
 
 #include "action.h"
+#include "area.h"
 #include "document.h"
 #include "generator_p.h"
 #include "textdocumentgenerator.h"
+#include "textpage.h"
 
 namespace Okular {
 
@@ -74,6 +81,110 @@ namespace TextDocumentUtils {
             end = layout->hitTest( QPointF( margin, ((page + 1) * pageSize.height()) - margin ), Qt::FuzzyHit );
         }
 
+        /**
+         * Creates the text page of the given @p page by walking the lines of the
+         * laid out blocks once, instead of looking up block and line again for
+         * every single character. The result is the same as calling
+         * calculateBoundingRect() for each character of the page.
+         */
+        static Okular::TextPage* createTextPage( QTextDocument *document, int page )
+        {
+            const QAbstractTextDocumentLayout *documentLayout = document->documentLayout();
+            const QSizeF pageSize = document->pageSize();
+            const int pageHeight = qRound( pageSize.height() );
+
+            int start, end;
+            calculatePositions( document, page, start, end );
+
+            QStringList texts;
+            QVector< NormalizedRect > areas;
+            if ( end - 1 > start ) {
+                texts.reserve( end - 1 - start );
+                areas.reserve( end - 1 - start );
+            }
+
+            QTextBlock block = document->findBlock( start );
+            QRectF blockRect = documentLayout->blockBoundingRect( block );
+            while ( block.isValid() && block.position() < end - 1 ) {
+                const QTextBlock nextBlock = block.next();
+                const QRectF nextBlockRect = nextBlock.isValid() ? documentLayout->blockBoundingRect( nextBlock ) : QRectF();
+
+                const QTextLayout *layout = block.layout();
+                const int lineCount = layout->lineCount();
+                if ( lineCount == 0 ) {
+                    block = nextBlock;
+                    blockRect = nextBlockRect;
+                    continue;
+                }
+
+                const QString blockText = block.text();
+                const int textLength = blockText.length();
+                const int blockPosition = block.position();
+                const int from = qMax( start, blockPosition ) - blockPosition;
+                const int to = qMin( end - 1, blockPosition + block.length() ) - blockPosition;
+
+                int lineNumber = 0;
+                QTextLine line = layout->lineAt( lineNumber );
+                for ( int pos = from; pos < to; ++pos ) {
+                    // the line of a position is the first one which ends behind it
+                    while ( lineNumber < lineCount - 1 && pos >= line.textStart() + line.textLength() )
+                        line = layout->lineAt( ++lineNumber );
+
+                    QString text;
+                    QTextLine endLine;
+                    double r, b;
+                    if ( pos < textLength ) {
+                        text = blockText.at( pos );
+                        if ( pos + 1 == textLength ) {
+                            endLine = layout->lineAt( lineCount - 1 );
+                        } else {
+                            endLine = line;
+                            int endLineNumber = lineNumber;
+                            while ( endLineNumber < lineCount - 1 && pos + 1 >= endLine.textStart() + endLine.textLength() )
+                                endLine = layout->lineAt( ++endLineNumber );
+                        }
+                        r = blockRect.x() + endLine.cursorToX( pos + 1 );
+                        b = blockRect.y() + endLine.y() + endLine.height();
+                    } else {
+                        // the block separator ends at the start of the next block
+                        text = document->characterAt( blockPosition + pos );
+                        if ( nextBlock.isValid() && nextBlock.layout()->lineCount() > 0 ) {
+                            endLine = nextBlock.layout()->lineForTextPosition( 0 );
+                            r = nextBlockRect.x() + endLine.cursorToX( 0 );
+                            b = nextBlockRect.y() + endLine.y() + endLine.height();
+                        } else {
+                            r = -1;
+                            b = 0;
+                        }
+                    }
+
+                    const double x = blockRect.x() + line.cursorToX( pos );
+                    const double y = blockRect.y() + line.y();
+                    const int offset = qRound( y ) % pageHeight;
+
+                    QRectF rect;
+                    if ( x > r ) { // line break, so add a pseudo character on the start line
+                        text = QLatin1String( "\n" );
+                        rect = QRectF( x / pageSize.width(), offset / pageSize.height(),
+                                       3 / pageSize.width(), line.height() / pageSize.height() );
+                    } else {
+                        rect = QRectF( x / pageSize.width(), offset / pageSize.height(),
+                                       (r - x) / pageSize.width(), (b - y) / pageSize.height() );
+                    }
+
+                    texts.append( text );
+                    areas.append( NormalizedRect( rect.left(), rect.top(), rect.right(), rect.bottom() ) );
+                }
+
+                block = nextBlock;
+                blockRect = nextBlockRect;
+            }
+
+            Okular::TextPage *textPage = new Okular::TextPage;
+            textPage->append( texts, areas );
+            return textPage;
+        }
+
         static Okular::DocumentViewport calculateViewport( QTextDocument *document, const QTextBlock &block )
         {
             const QSizeF pageSize = document->pageSize();
@@ -92,6 +203,36 @@ namespace TextDocumentUtils {
         }
 }
 
+class TextDocumentPrivate
+{
+    public:
+        struct ImageData
+        {
+            QByteArray data;
+            QSize size;
+            QSizeF displaySize;
+        };
+
+        struct CachedImage
+        {
+            QString name;
+            QImage image;
+        };
+
+        TextDocumentPrivate()
+            : mImageCacheMemory( 0 )
+        {
+        }
+
+        QImage decodeImage( const ImageData &imageData ) const;
+
+        QHash<QString, ImageData> mImages;
+
+        QMutex mCacheMutex;
+        QList<CachedImage> mImageCache;
+        qulonglong mImageCacheMemory;
+};
+
 class TextDocumentConverterPrivate
 {
     public:
@@ -109,7 +250,9 @@ class TextDocumentGeneratorPrivate : public GeneratorPrivate
 
     public:
         TextDocumentGeneratorPrivate( TextDocumentConverter *converter )
-            : mConverter( converter ), mDocument( 0 )
+            : mConverter( converter ), mDocument( 0 ), mConverting( false ), mLayoutBottom( 0 ), mPagesCreated( 0 ),
+              mTitlePositionsDone( 0 ), mTitleViewportsDone( 0 ), mLinkPositionsDone( 0 ), mLinkInfosUsed( 0 ),
+              mAnnotationPositionsDone( 0 ), mAnnotationInfosUsed( 0 )
         {
         }
 
@@ -131,6 +274,8 @@ class TextDocumentGeneratorPrivate : public GeneratorPrivate
         void addAction( Action *action, int cursorBegin, int cursorEnd );
         void addAnnotation( Annotation *annotation, int cursorBegin, int cursorEnd );
         void addTitle( int level, const QString &title, const QTextBlock &position );
+        void addTitle( int level, const QString &title, const QString &destination );
+        void addDestination( const QString &name, const QTextBlock &position );
         void addMetaData( const QString &key, const QString &value, const QString &title );
         void addMetaData( DocumentInfo::Key, const QString &value );
 
@@ -138,6 +283,29 @@ class TextDocumentGeneratorPrivate : public GeneratorPrivate
         void generateAnnotationInfos();
         void generateTitleInfos();
 
+        /**
+         * Lays out the document until @p pages pages are complete, or for
+         * @p msecs milliseconds; a value of 0 means no limit. When the
+         * @p destination block is given, the layout goes on at least until
+         * its page is complete.
+         * Returns whether all the document is laid out.
+         */
+        bool layoutPages( int pages, int msecs, const QTextBlock &destination = QTextBlock() );
+        /**
+         * Has the converter append the next part of the document, with the
+         * user mutex held. Returns false when there was nothing left to convert.
+         */
+        bool convertMore();
+        // the first position of the document not laid out yet
+        int laidOutPosition() const;
+        // how many pages have all their content laid out
+        int completePages() const;
+        void createPages( int from, int to, QVector<Okular::Page*> &pagesVector );
+        // adds the pages completed by the layout to the document
+        void appendPages();
+        void layoutMorePages();
+        Okular::DocumentViewport destinationViewport( const QString &name );
+
         TextDocumentConverter *mConverter;
 
         QTextDocument *mDocument;
@@ -149,9 +317,14 @@ class TextDocumentGeneratorPrivate : public GeneratorPrivate
           int level;
           QString title;
           QTextBlock block;
+          // the destination leading to the title, if it was not converted yet
+          QString destination;
+          QDomElement item;
         };
         QList<TitlePosition> mTitlePositions;
 
+        QHash<QString, QTextBlock> mDestinations;
+
         struct LinkPosition
         {
           int startPosition;
@@ -183,6 +356,26 @@ class TextDocumentGeneratorPrivate : public GeneratorPrivate
           Annotation *annotation;
         };
         QList<AnnotationInfo> mAnnotationInfos;
+
+        // whether the converter may still append parts of the document
+        bool mConverting;
+
+        // state of the layout done incrementally, the first block not
+        // laid out yet is invalid when all the document is laid out
+        QTextBlock mLayoutBlock;
+        qreal mLayoutBottom;
+        int mPagesCreated;
+
+        // how much of the positions and infos above has been used already,
+        // as they are turned into pages as the layout goes on; the titles
+        // are all in the synopsis, and get their viewport along the layout
+        QStack< QPair<int,QDomNode> > mTitleParents;
+        int mTitlePositionsDone;
+        int mTitleViewportsDone;
+        int mLinkPositionsDone;
+        int mLinkInfosUsed;
+        int mAnnotationPositionsDone;
+        int mAnnotationInfosUsed;
 };
 
 }
@@ -0,0 +1,432 @@
+/***************************************************************************
+ *   Copyright (C) 2012 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "textindex_p.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QFile>
+
+#include <kdebug.h>
+#include <ksavefile.h>
+
+#include "debug_p.h"
+#include "generator.h"
+#include "page.h"
+#include "textpage.h"
+#include "utils_p.h"
+
+using namespace Okular;
+
+static const quint32 TextIndexMagic = 0x4f4b5449; // "OKTI"
+static const quint32 TextIndexVersion = 1;
+
+class TextIndex::SuffixLessThan
+{
+    public:
+        SuffixLessThan( const QStringList &terms )
+            : m_terms( terms )
+        {
+        }
+
+        bool operator()( const Suffix &a, const Suffix &b ) const
+        {
+            return QStringRef::compare( m_terms.at( a.term ).midRef( a.start ), m_terms.at( b.term ).midRef( b.start ) ) < 0;
+        }
+
+        bool operator()( const Suffix &a, const QString &text ) const
+        {
+            return m_terms.at( a.term ).midRef( a.start ).compare( text ) < 0;
+        }
+
+    private:
+        const QStringList &m_terms;
+};
+
+TextIndex::TextIndex( const QString &indexFileName, const QString &documentFileName, int pageCount )
+    : m_indexFileName( indexFileName ), m_documentFileName( documentFileName ), m_documentModified( 0 ),
+      m_indexedPages( pageCount ), m_indexedCount( 0 ), m_modified( false )
+{
+}
+
+TextIndex::~TextIndex()
+{
+}
+
+bool TextIndex::load()
+{
+    const QByteArray documentHash = fileHash( m_documentFileName );
+    const qint64 documentModified = fileModified( m_documentFileName );
+    {
+        QMutexLocker locker( &m_mutex );
+        m_documentHash = documentHash;
+        m_documentModified = documentModified;
+    }
+
+    QFile file( m_indexFileName );
+    if ( documentHash.isEmpty() || !file.open( QIODevice::ReadOnly ) )
+        return false;
+
+    QDataStream stream( &file );
+    stream.setVersion( QDataStream::Qt_4_6 );
+
+    quint32 magic, version;
+    QByteArray hash;
+    qint64 modified;
+    qint32 pageCount;
+    stream >> magic >> version >> hash >> modified >> pageCount;
+    // the index can have more pages, if the document added some after the
+    // first ones (see setPageCount())
+    int pageCountNow;
+    {
+        QMutexLocker locker( &m_mutex );
+        pageCountNow = m_indexedPages.size();
+    }
+    if ( magic != TextIndexMagic || version != TextIndexVersion || hash != documentHash ||
+         modified != documentModified || pageCount < pageCountNow )
+    {
+        kDebug(OkularDebug) << "Discarding the outdated text index" << m_indexFileName;
+        return false;
+    }
+
+    QHash< QString, QVector< Occurrence > > terms;
+    quint32 termCount;
+    stream >> termCount;
+    for ( quint32 i = 0; i < termCount && stream.status() == QDataStream::Ok; ++i )
+    {
+        QString term;
+        quint32 occurrenceCount;
+        stream >> term >> occurrenceCount;
+        QVector< Occurrence > &occurrences = terms[ term ];
+        occurrences.resize( occurrenceCount );
+        for ( quint32 j = 0; j < occurrenceCount; ++j )
+        {
+            qint32 page, offset;
+            stream >> page >> offset;
+            occurrences[ j ].page = page;
+            occurrences[ j ].offset = offset;
+        }
+    }
+    if ( stream.status() != QDataStream::Ok )
+        return false;
+
+    QMutexLocker locker( &m_mutex );
+    m_terms = terms;
+    m_termList.clear();
+    m_suffixes.clear();
+    m_indexedPages.fill( true, qMax( m_indexedPages.size(), (int)pageCount ) );
+    m_indexedCount = m_indexedPages.size();
+    m_modified = false;
+    m_lastQuery.clear();
+    return true;
+}
+
+bool TextIndex::save()
+{
+    QMutexLocker locker( &m_mutex );
+    if ( !m_modified || m_indexedCount < m_indexedPages.size() )
+        return false;
+
+    if ( m_documentHash.isEmpty() )
+    {
+        m_documentHash = fileHash( m_documentFileName );
+        m_documentModified = fileModified( m_documentFileName );
+        if ( m_documentHash.isEmpty() )
+            return false;
+    }
+
+    KSaveFile file( m_indexFileName );
+    if ( !file.open( QIODevice::WriteOnly ) )
+        return false;
+
+    QDataStream stream( &file );
+    stream.setVersion( QDataStream::Qt_4_6 );
+    stream << TextIndexMagic << TextIndexVersion << m_documentHash << m_documentModified
+           << (qint32)m_indexedPages.size() << (quint32)m_terms.count();
+
+    QHash< QString, QVector< Occurrence > >::const_iterator it = m_terms.constBegin(), itEnd = m_terms.constEnd();
+    for ( ; it != itEnd; ++it )
+    {
+        stream << it.key() << (quint32)it.value().count();
+        foreach ( const Occurrence &occurrence, it.value() )
+            stream << (qint32)occurrence.page << (qint32)occurrence.offset;
+    }
+
+    if ( !file.finalize() )
+        return false;
+
+    m_modified = false;
+    return true;
+}
+
+void TextIndex::addPage( int page, const TextPage *textPage )
+{
+    // tokenize out of the lock, it is the slow part
+    const QList< QPair< QString, int > > pageTerms = textPage ? terms( textPage->text() ) : QList< QPair< QString, int > >();
+
+    QMutexLocker locker( &m_mutex );
+    if ( page < 0 || page >= m_indexedPages.size() || m_indexedPages.testBit( page ) )
+        return;
+
+    for ( int i = 0; i < pageTerms.count(); ++i )
+    {
+        Occurrence occurrence;
+        occurrence.page = page;
+        occurrence.offset = pageTerms.at( i ).second;
+        m_terms[ pageTerms.at( i ).first ].append( occurrence );
+    }
+    m_indexedPages.setBit( page );
+    ++m_indexedCount;
+    m_modified = true;
+    m_termList.clear();
+    m_suffixes.clear();
+    m_lastQuery.clear();
+}
+
+bool TextIndex::hasPage( int page ) const
+{
+    QMutexLocker locker( &m_mutex );
+    return page >= 0 && page < m_indexedPages.size() && m_indexedPages.testBit( page );
+}
+
+void TextIndex::setPageCount( int pageCount )
+{
+    QMutexLocker locker( &m_mutex );
+    if ( pageCount <= m_indexedPages.size() )
+        return;
+
+    m_indexedPages.resize( pageCount );
+    m_lastQuery.clear();
+}
+
+bool TextIndex::isComplete() const
+{
+    QMutexLocker locker( &m_mutex );
+    return m_indexedCount == m_indexedPages.size();
+}
+
+bool TextIndex::mayContain( int page, const QString &text ) const
+{
+    QMutexLocker locker( &m_mutex );
+    if ( m_indexedCount < m_indexedPages.size() )
+        return true;
+
+    if ( m_lastQuery.isNull() || m_lastQuery != text )
+    {
+        m_lastQueryPages = pagesContainingLocked( text );
+        m_lastQuery = text;
+    }
+    return m_lastQueryPages.contains( page );
+}
+
+QSet< int > TextIndex::pagesContaining( const QStringList &words, bool matchAll ) const
+{
+    QMutexLocker locker( &m_mutex );
+    QSet< int > pages;
+    if ( m_indexedCount < m_indexedPages.size() )
+    {
+        for ( int i = 0; i < m_indexedPages.size(); ++i )
+            pages.insert( i );
+        return pages;
+    }
+
+    for ( int w = 0; w < words.count(); ++w )
+    {
+        const QSet< int > wordPages = pagesContainingLocked( words.at( w ) );
+        if ( w == 0 )
+            pages = wordPages;
+        else if ( matchAll )
+            pages.intersect( wordPages );
+        else
+            pages.unite( wordPages );
+    }
+    return pages;
+}
+
+QSet< int > TextIndex::pagesContainingLocked( const QString &text ) const
+{
+    QSet< int > pages;
+    const QList< QPair< QString, int > > textTerms = terms( text );
+    if ( textTerms.isEmpty() )
+    {
+        for ( int i = 0; i < m_indexedPages.size(); ++i )
+            pages.insert( i );
+        return pages;
+    }
+
+    // a text matches only inside or across terms, so the pages containing
+    // it have each of its terms inside one of their terms, and in the same
+    // order: the page terms containing the following terms of the text
+    // never start before the ones containing the previous terms
+    QHash< int, int > reached; // by page, where the last term of the text was found
+    int lastOffset = -1;
+    for ( int t = 0; t < textTerms.count(); ++t )
+    {
+        // a word broken by a hyphen comes whole after its parts, with the
+        // offset of the first one: it only needs to be there
+        const bool ordered = textTerms.at( t ).second > lastOffset;
+        const QHash< int, QVector< int > > termOffsets = offsetsContaining( textTerms.at( t ).first );
+
+        QHash< int, int > nextReached;
+        if ( t == 0 )
+        {
+            QHash< int, QVector< int > >::const_iterator it = termOffsets.constBegin(), itEnd = termOffsets.constEnd();
+            for ( ; it != itEnd; ++it )
+                nextReached.insert( it.key(), it.value().first() );
+        }
+        else
+        {
+            QHash< int, int >::const_iterator it = reached.constBegin(), itEnd = reached.constEnd();
+            for ( ; it != itEnd; ++it )
+            {
+                QHash< int, QVector< int > >::const_iterator offsets = termOffsets.find( it.key() );
+                if ( offsets == termOffsets.constEnd() )
+                    continue;
+
+                if ( !ordered )
+                {
+                    nextReached.insert( it.key(), it.value() );
+                    continue;
+                }
+                QVector< int >::const_iterator offset = qLowerBound( offsets.value().constBegin(), offsets.value().constEnd(), it.value() );
+                if ( offset != offsets.value().constEnd() )
+                    nextReached.insert( it.key(), *offset );
+            }
+        }
+
+        reached = nextReached;
+        if ( reached.isEmpty() )
+            break;
+        if ( ordered )
+            lastOffset = textTerms.at( t ).second;
+    }
+
+    QHash< int, int >::const_iterator it = reached.constBegin(), itEnd = reached.constEnd();
+    for ( ; it != itEnd; ++it )
+        pages.insert( it.key() );
+    return pages;
+}
+
+QHash< int, QVector< int > > TextIndex::offsetsContaining( const QString &text ) const
+{
+    if ( m_suffixes.isEmpty() )
+        buildSuffixes();
+
+    // the suffixes starting with the text are all together
+    QSet< int > matchingTerms;
+    QVector< Suffix >::const_iterator it = qLowerBound( m_suffixes.constBegin(), m_suffixes.constEnd(), text, SuffixLessThan( m_termList ) );
+    for ( ; it != m_suffixes.constEnd() && m_termList.at( it->term ).midRef( it->start, text.length() ) == text; ++it )
+        matchingTerms.insert( it->term );
+
+    QHash< int, QVector< int > > offsets;
+    foreach ( int term, matchingTerms )
+    {
+        foreach ( const Occurrence &occurrence, m_terms.value( m_termList.at( term ) ) )
+            offsets[ occurrence.page ].append( occurrence.offset );
+    }
+
+    // the occurrences of each term are sorted, but not the ones of different terms
+    if ( matchingTerms.count() > 1 )
+    {
+        QHash< int, QVector< int > >::iterator pageIt = offsets.begin(), pageEnd = offsets.end();
+        for ( ; pageIt != pageEnd; ++pageIt )
+            qSort( pageIt.value() );
+    }
+    return offsets;
+}
+
+void TextIndex::buildSuffixes() const
+{
+    m_termList = m_terms.keys();
+
+    int suffixCount = 0;
+    foreach ( const QString &term, m_termList )
+        suffixCount += term.length();
+
+    m_suffixes.resize( suffixCount );
+    int i = 0;
+    for ( int term = 0; term < m_termList.count(); ++term )
+    {
+        for ( int start = 0; start < m_termList.at( term ).length(); ++start, ++i )
+        {
+            m_suffixes[ i ].term = term;
+            m_suffixes[ i ].start = start;
+        }
+    }
+    qSort( m_suffixes.begin(), m_suffixes.end(), SuffixLessThan( m_termList ) );
+}
+
+QList< QPair< QString, int > > TextIndex::terms( const QString &text )
+{
+    QList< QPair< QString, int > > result;
+    const QString folded = text.normalized( QString::NormalizationForm_KC ).toCaseFolded();
+    const int length = folded.length();
+
+    int start = -1;
+    int lastStart = -1, lastEnd = -1;
+    for ( int i = 0; i <= length; ++i )
+    {
+        if ( i < length && ( folded.at( i ).isLetterOrNumber() || folded.at( i ).isMark() ) )
+        {
+            if ( start < 0 )
+                start = i;
+            continue;
+        }
+
+        if ( start < 0 )
+            continue;
+
+        const QString term = folded.mid( start, i - start );
+        result.append( qMakePair( term, start ) );
+
+        // a word broken by a hyphen at the end of a line is searched whole,
+        // so index it whole too
+        if ( lastStart >= 0 && folded.mid( lastEnd, start - lastEnd ).trimmed() == QLatin1String( "-" ) )
+            result.append( qMakePair( folded.mid( lastStart, lastEnd - lastStart ) + term, lastStart ) );
+
+        lastStart = start;
+        lastEnd = i;
+        start = -1;
+    }
+
+    return result;
+}
+
+
+TextIndexThread::TextIndexThread( TextIndex *index, Generator *generator, const QVector< Page * > &pages )
+    : QThread(), mIndex( index ), mGenerator( generator ), mPages( pages ), mGoOn( true )
+{
+}
+
+void TextIndexThread::stopIndexing()
+{
+    mGoOn = false;
+}
+
+void TextIndexThread::run()
+{
+    if ( mIndex->load() || !mGenerator )
+        return;
+
+    foreach ( Page *page, mPages )
+    {
+        if ( !mGoOn )
+            return;
+
+        if ( mIndex->hasPage( page->number() ) )
+            continue;
+
+        TextPage *textPage = mGenerator->textPage( page );
+        mIndex->addPage( page->number(), textPage );
+        delete textPage;
+    }
+
+    mIndex->save();
+}
+
+#include "textindex_p.moc"
@@ -0,0 +1,159 @@
+/***************************************************************************
+ *   Copyright (C) 2012 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_TEXTINDEX_P_H_
+#define _OKULAR_TEXTINDEX_P_H_
+
+#include <QtCore/QBitArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+namespace Okular {
+
+class Generator;
+class Page;
+class TextPage;
+
+/**
+ * @short Full-text index of the pages of a document.
+ *
+ * Maps every term of the text of the pages to the pages (and the character
+ * offsets in their text) where it appears. The index is stored on disk, and
+ * it is valid only for the document file with the same contents and
+ * modification time it was built for.
+ *
+ * The index is used only to skip the pages which surely do not contain
+ * a searched text; the actual matches are always found in the TextPage
+ * of the remaining pages. All the methods are thread safe.
+ */
+class TextIndex
+{
+    public:
+        struct Occurrence
+        {
+            int page;
+            int offset;
+        };
+
+        TextIndex( const QString &indexFileName, const QString &documentFileName, int pageCount );
+        ~TextIndex();
+
+        /**
+         * Loads the index from disk, returning whether it is valid for the document.
+         */
+        bool load();
+
+        /**
+         * Saves the index to disk, if it is complete and it has been changed.
+         */
+        bool save();
+
+        /**
+         * Indexes the text of the given @p page, unless already indexed.
+         */
+        void addPage( int page, const TextPage *textPage );
+
+        bool hasPage( int page ) const;
+
+        /**
+         * Makes room for the pages added to the document after the index
+         * has been created.
+         */
+        void setPageCount( int pageCount );
+
+        /**
+         * Whether all the pages have been indexed.
+         */
+        bool isComplete() const;
+
+        /**
+         * Returns whether the @p page may contain the @p text; it is true
+         * for all the pages if the index is not complete.
+         */
+        bool mayContain( int page, const QString &text ) const;
+
+        /**
+         * Returns the pages which may contain the @p words: all of them if
+         * @p matchAll is true, any of them otherwise.
+         */
+        QSet< int > pagesContaining( const QStringList &words, bool matchAll ) const;
+
+        /**
+         * Splits @p text in the terms as they are indexed, with their offsets.
+         */
+        static QList< QPair< QString, int > > terms( const QString &text );
+
+    private:
+        // a suffix of a term of m_termList, starting at start
+        struct Suffix
+        {
+            int term;
+            int start;
+        };
+        class SuffixLessThan;
+
+        QSet< int > pagesContainingLocked( const QString &text ) const;
+        // the offsets, by page, of the terms containing the @p text
+        QHash< int, QVector< int > > offsetsContaining( const QString &text ) const;
+        void buildSuffixes() const;
+
+        QString m_indexFileName;
+        QString m_documentFileName;
+        QByteArray m_documentHash;
+        qint64 m_documentModified;
+        QHash< QString, QVector< Occurrence > > m_terms;
+        // all the suffixes of the terms, sorted, so that the terms containing
+        // a text are found by binary search; built at the first query
+        mutable QStringList m_termList;
+        mutable QVector< Suffix > m_suffixes;
+        QBitArray m_indexedPages;
+        int m_indexedCount;
+        bool m_modified;
+
+        // cache of the last query
+        mutable QString m_lastQuery;
+        mutable QSet< int > m_lastQueryPages;
+
+        mutable QMutex m_mutex;
+};
+
+/**
+ * Loads the text index of a document, and builds the missing part of it
+ * extracting the text of the pages not indexed yet.
+ */
+class TextIndexThread : public QThread
+{
+    Q_OBJECT
+
+    public:
+        /**
+         * The text is extracted only if a @p generator is given.
+         */
+        TextIndexThread( TextIndex *index, Generator *generator, const QVector< Page * > &pages );
+
+        void stopIndexing();
+
+    protected:
+        virtual void run();
+
+    private:
+        TextIndex *mIndex;
+        Generator *mGenerator;
+        QVector< Page * > mPages;
+        volatile bool mGoOn;
+};
+
+}
+
+#endif
@@ -265,6 +265,19 @@ void TextPage::append( const QString &text, NormalizedRect *area )
     delete area;
 }
 
+void TextPage::append( const QStringList &texts, const QVector< NormalizedRect > &areas )
+{
+    Q_ASSERT( texts.count() == areas.count() );
+
+    d->m_words.reserve( d->m_words.count() + texts.count() );
+    for ( int i = 0; i < texts.count(); ++i )
+    {
+        const QString &text = texts.at( i );
+        if ( !text.isEmpty() )
+            d->m_words.append( new TinyTextEntity( text.normalized(QString::NormalizationForm_KC), areas.at( i ) ) );
+    }
+}
+
 struct WordWithCharacters
 {
     WordWithCharacters(TinyTextEntity *w, const TextList &c)
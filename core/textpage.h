@@ -12,6 +12,8 @@
 
 #include <QtCore/QList>
 #include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
 
 #include "okular_export.h"
 #include "global.h"
@@ -126,6 +128,16 @@ class OKULAR_EXPORT TextPage
          */
         void append( const QString &text, NormalizedRect *area );
 
+        /**
+         * Appends each of the given @p texts with the area at the same
+         * position in @p areas as new @ref TextEntity to the page.
+         *
+         * This is faster than appending the entities one by one.
+         *
+         * @since 0.16 (KDE 4.10)
+         */
+        void append( const QStringList &texts, const QVector< NormalizedRect > &areas );
+
         /**
          * Returns the bounding rect of the text which matches the following criteria
          * or 0 if the search is not successful.
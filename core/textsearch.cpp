@@ -0,0 +1,228 @@
+/***************************************************************************
+ *   Copyright (C) 2012 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "textsearch_p.h"
+
+#include <QtCore/QTime>
+#include <QtCore/QTimer>
+
+#include "area.h"
+#include "document_p.h"
+#include "generator.h"
+#include "page.h"
+#include "textindex_p.h"
+#include "textpage.h"
+
+using namespace Okular;
+
+// how long (in ms) the GUI thread can be busy searching before going back to the event loop
+static const int SearchSliceTime = 20;
+
+TextSearchThread::TextSearchThread( TextSearch *search, Generator *generator )
+    : QThread(), mSearch( search ), mGenerator( generator )
+{
+}
+
+void TextSearchThread::run()
+{
+    while ( Page *page = mSearch->takePendingPage() )
+    {
+        TextPage *textPage = mGenerator->textPage( page );
+        QVector< TextSearch::Match > matches;
+        if ( textPage )
+            matches = mSearch->findMatches( textPage );
+        mSearch->addResult( page, textPage, matches );
+    }
+}
+
+
+TextSearch::TextSearch( DocumentPrivate *doc, int searchID, const QStringList &words, const QList< QColor > &colors,
+                        Qt::CaseSensitivity caseSensitivity, bool matchAll )
+    : QObject(), m_doc( doc ), m_searchID( searchID ), m_words( words ), m_colors( colors ),
+      m_caseSensitivity( caseSensitivity ), m_matchAll( matchAll ), m_remainingPages( 0 ), m_cancelled( false )
+{
+}
+
+TextSearch::~TextSearch()
+{
+    cancel();
+}
+
+int TextSearch::searchID() const
+{
+    return m_searchID;
+}
+
+void TextSearch::start( int threads )
+{
+    m_remainingPages = m_doc->m_pagesVector.count();
+
+    // the complete text index tells which pages cannot match, so they are
+    // done already
+    QSet< int > candidatePages;
+    const bool useIndex = m_doc->m_textIndex && m_doc->m_textIndex->isComplete();
+    if ( useIndex )
+        candidatePages = m_doc->m_textIndex->pagesContaining( m_words, m_matchAll );
+
+    // the pages without text are given to the threads, if any
+    foreach ( Page *page, m_doc->m_pagesVector )
+    {
+        if ( useIndex && !candidatePages.contains( page->number() ) )
+            --m_remainingPages;
+        else if ( threads > 0 && !page->hasTextPage() )
+            m_pendingPages.append( page );
+        else
+            m_pages.append( page );
+    }
+
+    threads = qMin( threads, m_pendingPages.count() );
+    for ( int i = 0; i < threads; ++i )
+    {
+        TextSearchThread *thread = new TextSearchThread( this, m_doc->m_generator );
+        m_threads.append( thread );
+        thread->start( QThread::LowPriority );
+    }
+
+    QMetaObject::invokeMethod( this, "processPages", Qt::QueuedConnection );
+}
+
+void TextSearch::cancel()
+{
+    m_mutex.lock();
+    m_cancelled = true;
+    m_pendingPages.clear();
+    m_mutex.unlock();
+
+    // every thread ends as soon as its current page is done
+    foreach ( TextSearchThread *thread, m_threads )
+    {
+        thread->wait();
+        delete thread;
+    }
+    m_threads.clear();
+
+    foreach ( const Result &result, m_results )
+    {
+        delete result.textPage;
+        foreach ( const Match &match, result.matches )
+            delete match.first;
+    }
+    m_results.clear();
+    m_pages.clear();
+}
+
+void TextSearch::processPages()
+{
+    if ( m_cancelled )
+        return;
+
+    QTime time;
+    time.start();
+    while ( !m_pages.isEmpty() && time.elapsed() < SearchSliceTime )
+    {
+        Page *page = m_pages.takeFirst();
+
+        // request search page if needed
+        if ( !page->hasTextPage() )
+            m_doc->m_parent->requestTextPage( page->number() );
+
+        pageDone( page, 0, findMatches( page ) );
+        if ( m_cancelled )
+            return;
+    }
+
+    if ( !m_pages.isEmpty() )
+        QMetaObject::invokeMethod( this, "processPages", Qt::QueuedConnection );
+    else if ( m_remainingPages == 0 )
+        m_doc->textSearchFinished( this, false );
+}
+
+void TextSearch::processResults()
+{
+    m_mutex.lock();
+    const QList< Result > results = m_results;
+    m_results.clear();
+    m_mutex.unlock();
+
+    foreach ( const Result &result, results )
+    {
+        if ( m_cancelled )
+        {
+            delete result.textPage;
+            foreach ( const Match &match, result.matches )
+                delete match.first;
+            continue;
+        }
+
+        pageDone( result.page, result.textPage, result.matches );
+    }
+}
+
+template < typename T >
+QVector< TextSearch::Match > TextSearch::findMatches( T *textSource ) const
+{
+    QVector< Match > matches;
+    bool allMatched = !m_words.isEmpty();
+    for ( int w = 0; w < m_words.count(); ++w )
+    {
+        // add all the matches of the current word
+        bool wordMatched = false;
+        RegularAreaRect *lastMatch = 0;
+        while ( ( lastMatch = textSource->findText( m_searchID, m_words.at( w ), lastMatch ? NextResult : FromTop, m_caseSensitivity, lastMatch ) ) )
+        {
+            matches.append( Match( lastMatch, m_colors.at( w ) ) );
+            wordMatched = true;
+        }
+        allMatched = allMatched && wordMatched;
+    }
+
+    // if not all words are present in page, remove partial matches
+    if ( m_matchAll && !allMatched )
+    {
+        foreach ( const Match &match, matches )
+            delete match.first;
+        matches.clear();
+    }
+
+    return matches;
+}
+
+Page *TextSearch::takePendingPage()
+{
+    QMutexLocker locker( &m_mutex );
+    if ( m_cancelled || m_pendingPages.isEmpty() )
+        return 0;
+
+    return m_pendingPages.takeFirst();
+}
+
+void TextSearch::addResult( Page *page, TextPage *textPage, const QVector< Match > &matches )
+{
+    QMutexLocker locker( &m_mutex );
+    Result result;
+    result.page = page;
+    result.textPage = textPage;
+    result.matches = matches;
+    m_results.append( result );
+
+    // the results are processed in batches, so schedule only the first one
+    if ( m_results.count() == 1 )
+        QMetaObject::invokeMethod( this, "processResults", Qt::QueuedConnection );
+}
+
+void TextSearch::pageDone( Page *page, TextPage *textPage, const QVector< Match > &matches )
+{
+    --m_remainingPages;
+    m_doc->textSearchPageDone( this, page, textPage, matches );
+
+    if ( m_remainingPages == 0 )
+        m_doc->textSearchFinished( this, false );
+}
+
+#include "textsearch_p.moc"
@@ -0,0 +1,130 @@
+/***************************************************************************
+ *   Copyright (C) 2012 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_TEXTSEARCH_P_H_
+#define _OKULAR_TEXTSEARCH_P_H_
+
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QPair>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include <QtGui/QColor>
+
+namespace Okular {
+
+class DocumentPrivate;
+class Generator;
+class Page;
+class RegularAreaRect;
+class TextPage;
+class TextSearch;
+
+class TextSearchThread : public QThread
+{
+    Q_OBJECT
+
+    public:
+        TextSearchThread( TextSearch *search, Generator *generator );
+
+    protected:
+        virtual void run();
+
+    private:
+        TextSearch *mSearch;
+        Generator *mGenerator;
+};
+
+/**
+ * @short A search of some words in all the pages of the document.
+ *
+ * The text of the pages not having a text page yet is extracted (and
+ * searched) by a pool of TextSearchThread, if the generator can extract
+ * text of more pages at the same time; the pages already having a text page
+ * are searched in the GUI thread in short slices, so that it never blocks.
+ *
+ * The pages the complete TextIndex of the document tells cannot match are
+ * not searched at all.
+ *
+ * The matches of every page are given to the document as soon as the page
+ * has been searched.
+ */
+class TextSearch : public QObject
+{
+    Q_OBJECT
+
+    public:
+        typedef QPair< RegularAreaRect *, QColor > Match;
+
+        /**
+         * Creates a search of the @p words: if @p matchAll is true, only the
+         * pages containing all the words are matches. The matches of each
+         * word get the corresponding color of @p colors.
+         */
+        TextSearch( DocumentPrivate *doc, int searchID, const QStringList &words, const QList< QColor > &colors,
+                    Qt::CaseSensitivity caseSensitivity, bool matchAll );
+        ~TextSearch();
+
+        int searchID() const;
+
+        /**
+         * Starts the search using up to @p threads threads.
+         */
+        void start( int threads );
+
+        /**
+         * Stops the search, dropping the results not delivered yet.
+         */
+        void cancel();
+
+    private slots:
+        void processPages();
+        void processResults();
+
+    private:
+        friend class TextSearchThread;
+
+        struct Result
+        {
+            Page *page;
+            TextPage *textPage;
+            QVector< Match > matches;
+        };
+
+        template < typename T >
+        QVector< Match > findMatches( T *textSource ) const;
+
+        // called by the threads
+        Page *takePendingPage();
+        void addResult( Page *page, TextPage *textPage, const QVector< Match > &matches );
+
+        void pageDone( Page *page, TextPage *textPage, const QVector< Match > &matches );
+
+        DocumentPrivate *m_doc;
+        int m_searchID;
+        QStringList m_words;
+        QList< QColor > m_colors;
+        Qt::CaseSensitivity m_caseSensitivity;
+        bool m_matchAll;
+
+        QList< Page * > m_pages;
+        int m_remainingPages;
+        QList< TextSearchThread * > m_threads;
+
+        QMutex m_mutex;
+        QList< Page * > m_pendingPages;
+        QList< Result > m_results;
+        bool m_cancelled;
+};
+
+}
+
+#endif
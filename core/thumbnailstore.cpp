@@ -0,0 +1,334 @@
+/***************************************************************************
+ *   Copyright (C) 2012 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "thumbnailstore_p.h"
+
+#include <QtCore/QBuffer>
+#include <QtCore/QDataStream>
+#include <QtCore/QFile>
+#include <QtCore/QRunnable>
+
+#include <kdebug.h>
+#include <ksavefile.h>
+
+#include "debug_p.h"
+#include "generator.h"
+#include "page.h"
+#include "utils_p.h"
+
+using namespace Okular;
+
+static const quint32 ThumbnailStoreMagic = 0x4f4b5453; // "OKTS"
+static const quint32 ThumbnailStoreVersion = 1;
+
+static QByteArray encodeImage( const QImage &image )
+{
+    QByteArray data;
+    QBuffer buffer( &data );
+    buffer.open( QIODevice::WriteOnly );
+    // JPEG is way smaller for rendered pages, but it has no transparency
+    if ( image.hasAlphaChannel() || !image.save( &buffer, "JPEG", 90 ) )
+    {
+        buffer.seek( 0 );
+        data.clear();
+        image.save( &buffer, "PNG" );
+    }
+    return data;
+}
+
+class ThumbnailStore::QueuedThumbnail : public QRunnable
+{
+    public:
+        QueuedThumbnail( ThumbnailStore *store, int page, const QImage &image, int generation )
+            : m_store( store ), m_page( page ), m_image( image ), m_generation( generation )
+        {
+        }
+
+        void run()
+        {
+            m_store->storeThumbnail( m_page, m_image, m_generation );
+        }
+
+    private:
+        ThumbnailStore *m_store;
+        int m_page;
+        QImage m_image;
+        int m_generation;
+};
+
+ThumbnailStore::ThumbnailStore( const QString &storeFileName, const QString &documentFileName, int pageCount )
+    : m_storeFileName( storeFileName ), m_documentFileName( documentFileName ), m_documentModified( 0 ),
+      m_thumbnails( pageCount ), m_modified( false )
+{
+    m_queuePool.setMaxThreadCount( 1 );
+}
+
+ThumbnailStore::~ThumbnailStore()
+{
+    m_queuePool.waitForDone();
+}
+
+bool ThumbnailStore::load( const volatile bool *goOn )
+{
+    // nothing to check the document against, it is hashed later if needed
+    QFile file( m_storeFileName );
+    if ( !file.open( QIODevice::ReadOnly ) )
+        return false;
+
+    QDataStream stream( &file );
+    stream.setVersion( QDataStream::Qt_4_6 );
+
+    quint32 magic, version;
+    QByteArray hash;
+    qint64 modified;
+    qint32 pageCount;
+    stream >> magic >> version >> hash >> modified >> pageCount;
+    if ( magic != ThumbnailStoreMagic || version != ThumbnailStoreVersion || pageCount < 0 ||
+         modified != fileModified( m_documentFileName ) )
+    {
+        kDebug(OkularDebug) << "Discarding the outdated thumbnails" << m_storeFileName;
+        return false;
+    }
+
+    // the document is read in full only if everything else matches
+    identifyDocument( goOn );
+    m_mutex.lock();
+    const QByteArray documentHash = m_documentHash;
+    m_mutex.unlock();
+    if ( documentHash.isEmpty() )
+        return false;
+    if ( hash != documentHash )
+    {
+        kDebug(OkularDebug) << "Discarding the outdated thumbnails" << m_storeFileName;
+        return false;
+    }
+
+    QVector< Thumbnail > thumbnails( pageCount );
+    for ( int i = 0; i < pageCount && stream.status() == QDataStream::Ok; ++i )
+        stream >> thumbnails[ i ].size >> thumbnails[ i ].data;
+    if ( stream.status() != QDataStream::Ok )
+        return false;
+
+    QMutexLocker locker( &m_mutex );
+    // the thumbnails taken meanwhile are kept, they cannot be worse
+    for ( int i = 0; i < qMin( pageCount, m_thumbnails.count() ); ++i )
+    {
+        if ( thumbnails.at( i ).size.width() > m_thumbnails.at( i ).size.width() )
+        {
+            m_thumbnails[ i ].size = thumbnails.at( i ).size;
+            m_thumbnails[ i ].data = thumbnails.at( i ).data;
+        }
+    }
+    return true;
+}
+
+void ThumbnailStore::identifyDocument( const volatile bool *goOn )
+{
+    m_mutex.lock();
+    const bool identified = !m_documentHash.isEmpty();
+    m_mutex.unlock();
+    if ( identified )
+        return;
+
+    // the modification time first, so that a change while hashing shows
+    const qint64 documentModified = fileModified( m_documentFileName );
+    const QByteArray documentHash = fileHash( m_documentFileName, goOn );
+    if ( documentHash.isEmpty() )
+        return;
+
+    QMutexLocker locker( &m_mutex );
+    m_documentHash = documentHash;
+    m_documentModified = documentModified;
+}
+
+bool ThumbnailStore::save()
+{
+    m_queuePool.waitForDone();
+
+    // the document is not hashed here, as this runs in the GUI thread
+    QMutexLocker locker( &m_mutex );
+    if ( !m_modified || m_documentHash.isEmpty() )
+        return false;
+
+    KSaveFile file( m_storeFileName );
+    if ( !file.open( QIODevice::WriteOnly ) )
+        return false;
+
+    QDataStream stream( &file );
+    stream.setVersion( QDataStream::Qt_4_6 );
+    stream << ThumbnailStoreMagic << ThumbnailStoreVersion << m_documentHash << m_documentModified
+           << (qint32)m_thumbnails.count();
+    foreach ( const Thumbnail &thumbnail, m_thumbnails )
+        stream << thumbnail.size << thumbnail.data;
+
+    if ( !file.finalize() )
+        return false;
+
+    m_modified = false;
+    return true;
+}
+
+bool ThumbnailStore::hasThumbnail( int page ) const
+{
+    QMutexLocker locker( &m_mutex );
+    return page >= 0 && page < m_thumbnails.count() && !m_thumbnails.at( page ).data.isEmpty();
+}
+
+bool ThumbnailStore::hasThumbnail( int page, int width, int height ) const
+{
+    QMutexLocker locker( &m_mutex );
+    if ( page < 0 || page >= m_thumbnails.count() || m_thumbnails.at( page ).data.isEmpty() )
+        return false;
+
+    // big enough, and with the same shape of the page (apart rounding)
+    const QSize size = m_thumbnails.at( page ).size;
+    const qint64 shapeDifference = qAbs( (qint64)size.width() * height - (qint64)size.height() * width );
+    return size.width() >= width && size.height() >= height - 1 &&
+           shapeDifference * 50 <= (qint64)size.width() * height;
+}
+
+QImage ThumbnailStore::thumbnail( int page, int width, int height ) const
+{
+    if ( !hasThumbnail( page, width, height ) )
+        return QImage();
+
+    m_mutex.lock();
+    const QByteArray data = m_thumbnails.at( page ).data;
+    m_mutex.unlock();
+
+    const QImage image = QImage::fromData( data );
+    if ( image.isNull() || image.size() == QSize( width, height ) )
+        return image;
+    return image.scaled( width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+}
+
+bool ThumbnailStore::wantsThumbnail( int page, int width ) const
+{
+    QMutexLocker locker( &m_mutex );
+    if ( page < 0 || page >= m_thumbnails.count() )
+        return false;
+
+    const Thumbnail &thumbnail = m_thumbnails.at( page );
+    const int storedWidth = qMax( thumbnail.size.width(), thumbnail.queuedWidth );
+    return storedWidth < ThumbnailWidth && width > storedWidth;
+}
+
+void ThumbnailStore::setThumbnail( int page, const QImage &image )
+{
+    if ( image.isNull() || !wantsThumbnail( page, image.width() ) )
+        return;
+
+    m_mutex.lock();
+    const int generation = m_thumbnails.at( page ).generation;
+    m_mutex.unlock();
+    storeThumbnail( page, image, generation );
+}
+
+void ThumbnailStore::queueThumbnail( int page, const QImage &image )
+{
+    if ( image.isNull() || !wantsThumbnail( page, image.width() ) )
+        return;
+
+    QMutexLocker locker( &m_mutex );
+    m_thumbnails[ page ].queuedWidth = qMin( image.width(), (int)ThumbnailWidth );
+    m_queuePool.start( new QueuedThumbnail( this, page, image, m_thumbnails.at( page ).generation ) );
+}
+
+void ThumbnailStore::storeThumbnail( int page, const QImage &image, int generation )
+{
+    // scale and compress out of the lock, it is the slow part
+    const QImage thumbnail = image.width() > ThumbnailWidth ? image.scaledToWidth( ThumbnailWidth, Qt::SmoothTransformation ) : image;
+    const QByteArray data = encodeImage( thumbnail );
+
+    QMutexLocker locker( &m_mutex );
+    if ( generation != m_thumbnails.at( page ).generation )
+        return; // dropped meanwhile, the image may be outdated
+
+    if ( m_thumbnails.at( page ).queuedWidth == thumbnail.width() )
+        m_thumbnails[ page ].queuedWidth = 0;
+    if ( data.isEmpty() || m_thumbnails.at( page ).size.width() >= thumbnail.width() )
+        return;
+
+    m_thumbnails[ page ].size = thumbnail.size();
+    m_thumbnails[ page ].data = data;
+    m_modified = true;
+}
+
+void ThumbnailStore::removeThumbnail( int page )
+{
+    QMutexLocker locker( &m_mutex );
+    if ( page >= 0 && page < m_thumbnails.count() )
+        dropThumbnail( page );
+}
+
+void ThumbnailStore::clear()
+{
+    QMutexLocker locker( &m_mutex );
+    for ( int i = 0; i < m_thumbnails.count(); ++i )
+        dropThumbnail( i );
+}
+
+void ThumbnailStore::dropThumbnail( int page )
+{
+    Thumbnail &thumbnail = m_thumbnails[ page ];
+    ++thumbnail.generation;
+    thumbnail.queuedWidth = 0;
+    if ( thumbnail.data.isEmpty() )
+        return;
+
+    thumbnail.size = QSize();
+    thumbnail.data.clear();
+    m_modified = true;
+}
+
+void ThumbnailStore::setPageCount( int pageCount )
+{
+    QMutexLocker locker( &m_mutex );
+    if ( pageCount > m_thumbnails.count() )
+        m_thumbnails.resize( pageCount );
+}
+
+
+ThumbnailStoreThread::ThumbnailStoreThread( ThumbnailStore *store, Generator *generator, const QVector< Page * > &pages )
+    : QThread(), mStore( store ), mGenerator( generator ), mPages( pages ), mGoOn( true )
+{
+}
+
+void ThumbnailStoreThread::stopFilling()
+{
+    mGoOn = false;
+}
+
+void ThumbnailStoreThread::run()
+{
+    mStore->load( &mGoOn );
+
+    // the thumbnails embedded in the document come for free
+    if ( mGenerator )
+    {
+        foreach ( Page *page, mPages )
+        {
+            if ( !mGoOn )
+                return;
+
+            const int number = page->number();
+            if ( mStore->hasThumbnail( number ) )
+                continue;
+
+            QImage embedded;
+            QMetaObject::invokeMethod( mGenerator, "thumbnail", Qt::DirectConnection, Q_RETURN_ARG(QImage, embedded), Q_ARG(int, number) );
+            mStore->setThumbnail( number, embedded );
+        }
+    }
+
+    // to save the thumbnails taken meanwhile
+    mStore->identifyDocument( &mGoOn );
+}
+
+#include "thumbnailstore_p.moc"
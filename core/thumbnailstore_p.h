@@ -0,0 +1,179 @@
+/***************************************************************************
+ *   Copyright (C) 2012 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_THUMBNAILSTORE_P_H_
+#define _OKULAR_THUMBNAILSTORE_P_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+#include <QtCore/QSize>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QVector>
+#include <QtGui/QImage>
+
+namespace Okular {
+
+class Generator;
+class Page;
+
+/**
+ * @short Small images of the pages of a document, kept on disk.
+ *
+ * The thumbnails are stored compressed, at most ThumbnailWidth pixels
+ * wide, and they are valid only for the document file with the same
+ * contents and modification time they were taken from. They are taken
+ * from the images of the pages rendered for any reason, or from the
+ * thumbnails embedded in the document.
+ *
+ * A stored thumbnail replaces the rendering of the page when the
+ * thumbnail list requests a small enough image of it. All the methods are
+ * thread safe.
+ */
+class ThumbnailStore
+{
+    public:
+        /**
+         * The width of the thumbnails taken from bigger images.
+         */
+        static const int ThumbnailWidth = 256;
+
+        ThumbnailStore( const QString &storeFileName, const QString &documentFileName, int pageCount );
+        ~ThumbnailStore();
+
+        /**
+         * Loads the thumbnails from disk, returning whether they are valid
+         * for the document. The document file is read only if there are
+         * thumbnails stored, and the reading stops as soon as @p goOn
+         * becomes false.
+         */
+        bool load( const volatile bool *goOn = 0 );
+
+        /**
+         * Hashes the document file, if not done by load() already, so that
+         * the thumbnails can be saved. Stops as soon as @p goOn becomes false.
+         */
+        void identifyDocument( const volatile bool *goOn = 0 );
+
+        /**
+         * Saves the thumbnails to disk, if they have been changed, once
+         * the queued ones are stored. Nothing is saved if the document has
+         * not been identified.
+         */
+        bool save();
+
+        bool hasThumbnail( int page ) const;
+
+        /**
+         * Returns whether the thumbnail of the @p page can be shown as
+         * an image of @p width x @p height pixels.
+         */
+        bool hasThumbnail( int page, int width, int height ) const;
+
+        /**
+         * Returns the thumbnail of the @p page scaled to @p width x
+         * @p height pixels, or a null image if there is none big enough.
+         */
+        QImage thumbnail( int page, int width, int height ) const;
+
+        /**
+         * Returns whether an image @p width pixels wide would give a better
+         * thumbnail of the @p page than the stored one.
+         */
+        bool wantsThumbnail( int page, int width ) const;
+
+        /**
+         * Stores the @p image as the thumbnail of the @p page, unless it
+         * is not better than the stored one.
+         */
+        void setThumbnail( int page, const QImage &image );
+
+        /**
+         * Like setThumbnail(), but scales and compresses the @p image in a
+         * thread of the store, so that the caller does not wait for it.
+         */
+        void queueThumbnail( int page, const QImage &image );
+
+        /**
+         * Drops the thumbnail of the @p page, as its contents changed.
+         */
+        void removeThumbnail( int page );
+
+        /**
+         * Drops all the thumbnails, as the pages are rendered differently.
+         */
+        void clear();
+
+        /**
+         * Makes room for the pages added to the document after the store
+         * has been created.
+         */
+        void setPageCount( int pageCount );
+
+    private:
+        class QueuedThumbnail;
+        friend class QueuedThumbnail;
+
+        struct Thumbnail
+        {
+            Thumbnail() : queuedWidth( 0 ), generation( 0 ) { }
+
+            QSize size;
+            QByteArray data;
+            // the width of the image queued for the page, if any
+            int queuedWidth;
+            // changed when the thumbnail is dropped, to discard the queued image
+            int generation;
+        };
+
+        void dropThumbnail( int page );
+
+        void storeThumbnail( int page, const QImage &image, int generation );
+
+        QString m_storeFileName;
+        QString m_documentFileName;
+        QByteArray m_documentHash;
+        qint64 m_documentModified;
+        QVector< Thumbnail > m_thumbnails;
+        bool m_modified;
+
+        mutable QMutex m_mutex;
+        QThreadPool m_queuePool;
+};
+
+/**
+ * Loads the thumbnails of a document, and takes the missing ones from
+ * the thumbnails embedded in the document. The pages still missing one
+ * are rendered afterwards through the Document, like any other pixmap.
+ */
+class ThumbnailStoreThread : public QThread
+{
+    Q_OBJECT
+
+    public:
+        /**
+         * The embedded thumbnails are taken only if a @p generator is given.
+         */
+        ThumbnailStoreThread( ThumbnailStore *store, Generator *generator, const QVector< Page * > &pages );
+
+        void stopFilling();
+
+    protected:
+        virtual void run();
+
+    private:
+        ThumbnailStore *mStore;
+        Generator *mGenerator;
+        QVector< Page * > mPages;
+        volatile bool mGoOn;
+};
+
+}
+
+#endif
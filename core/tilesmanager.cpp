@@ -0,0 +1,172 @@
+/***************************************************************************
+ *   Copyright (C) 2012 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "tilesmanager_p.h"
+
+#include <QtGui/QPixmap>
+
+#include <math.h>
+
+using namespace Okular;
+
+Tile::Tile()
+    : m_pixmap( 0 )
+{
+}
+
+NormalizedRect Tile::rect() const
+{
+    return m_rect;
+}
+
+QRect Tile::geometry() const
+{
+    return m_geometry;
+}
+
+QPixmap * Tile::pixmap() const
+{
+    return m_pixmap;
+}
+
+
+TilesManager::TilesManager( int width, int height )
+    : m_width( width ), m_height( height ), m_columns( 0 ), m_rows( 0 )
+{
+    buildGrid();
+}
+
+TilesManager::~TilesManager()
+{
+    deletePixmaps();
+}
+
+void TilesManager::setSize( int width, int height )
+{
+    if ( width == m_width && height == m_height )
+        return;
+
+    deletePixmaps();
+    m_width = width;
+    m_height = height;
+    buildGrid();
+}
+
+int TilesManager::width() const
+{
+    return m_width;
+}
+
+int TilesManager::height() const
+{
+    return m_height;
+}
+
+QList< Tile > TilesManager::tilesAt( const NormalizedRect &rect ) const
+{
+    QList< Tile > result;
+
+    int left, top, right, bottom;
+    tileRange( rect, &left, &top, &right, &bottom );
+    for ( int row = top; row <= bottom; ++row )
+        for ( int column = left; column <= right; ++column )
+            result.append( m_tiles.at( row * m_columns + column ) );
+
+    return result;
+}
+
+bool TilesManager::hasPixmaps( const NormalizedRect &rect ) const
+{
+    int left, top, right, bottom;
+    tileRange( rect, &left, &top, &right, &bottom );
+    for ( int row = top; row <= bottom; ++row )
+        for ( int column = left; column <= right; ++column )
+            if ( !m_tiles.at( row * m_columns + column ).m_pixmap )
+                return false;
+
+    return true;
+}
+
+void TilesManager::setPixmap( const NormalizedRect &rect, QPixmap *pixmap )
+{
+    const QRect geometry = rect.roundedGeometry( m_width, m_height );
+    const int column = geometry.left() / TileSize;
+    const int row = geometry.top() / TileSize;
+    if ( column >= m_columns || row >= m_rows || m_tiles.at( row * m_columns + column ).m_geometry != geometry
+         || pixmap->size() != geometry.size() )
+    {
+        delete pixmap;
+        return;
+    }
+
+    Tile &tile = m_tiles[ row * m_columns + column ];
+    delete tile.m_pixmap;
+    tile.m_pixmap = pixmap;
+}
+
+void TilesManager::cleanupPixmaps( const NormalizedRect &rect )
+{
+    QVector< Tile >::iterator it = m_tiles.begin(), itEnd = m_tiles.end();
+    for ( ; it != itEnd; ++it )
+    {
+        if ( (*it).m_pixmap && !(*it).m_rect.intersects( rect ) )
+        {
+            delete (*it).m_pixmap;
+            (*it).m_pixmap = 0;
+        }
+    }
+}
+
+qulonglong TilesManager::totalMemory() const
+{
+    qulonglong memory = 0;
+    QVector< Tile >::const_iterator it = m_tiles.constBegin(), itEnd = m_tiles.constEnd();
+    for ( ; it != itEnd; ++it )
+    {
+        if ( (*it).m_pixmap )
+            memory += 4 * (*it).m_pixmap->width() * (*it).m_pixmap->height();
+    }
+    return memory;
+}
+
+void TilesManager::buildGrid()
+{
+    m_columns = qMax( 1, ( m_width + TileSize - 1 ) / TileSize );
+    m_rows = qMax( 1, ( m_height + TileSize - 1 ) / TileSize );
+    m_tiles.resize( m_columns * m_rows );
+
+    for ( int row = 0; row < m_rows; ++row )
+    {
+        for ( int column = 0; column < m_columns; ++column )
+        {
+            Tile &tile = m_tiles[ row * m_columns + column ];
+            tile.m_geometry = QRect( column * TileSize, row * TileSize, TileSize, TileSize ).intersect( QRect( 0, 0, m_width, m_height ) );
+            tile.m_rect = NormalizedRect( tile.m_geometry, m_width, m_height );
+            tile.m_pixmap = 0;
+        }
+    }
+}
+
+void TilesManager::deletePixmaps()
+{
+    QVector< Tile >::iterator it = m_tiles.begin(), itEnd = m_tiles.end();
+    for ( ; it != itEnd; ++it )
+    {
+        delete (*it).m_pixmap;
+        (*it).m_pixmap = 0;
+    }
+}
+
+void TilesManager::tileRange( const NormalizedRect &rect, int *left, int *top, int *right, int *bottom ) const
+{
+    *left = qBound( 0, (int)floor( rect.left * m_width ) / TileSize, m_columns - 1 );
+    *top = qBound( 0, (int)floor( rect.top * m_height ) / TileSize, m_rows - 1 );
+    *right = qBound( 0, (int)floor( rect.right * m_width ) / TileSize, m_columns - 1 );
+    *bottom = qBound( 0, (int)floor( rect.bottom * m_height ) / TileSize, m_rows - 1 );
+}
@@ -0,0 +1,127 @@
+/***************************************************************************
+ *   Copyright (C) 2012 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_TILESMANAGER_P_H_
+#define _OKULAR_TILESMANAGER_P_H_
+
+#include <QtCore/QList>
+#include <QtCore/QRect>
+#include <QtCore/QVector>
+
+#include "okular_export.h"
+#include "area.h"
+
+class QPixmap;
+
+namespace Okular {
+
+class TilesManager;
+
+/**
+ * A piece of the pixmap of a page, see TilesManager.
+ */
+class OKULAR_EXPORT Tile
+{
+    public:
+        Tile();
+
+        /**
+         * The area of the page covered by the tile.
+         */
+        NormalizedRect rect() const;
+
+        /**
+         * The area of the page covered by the tile, in pixels at the
+         * size of its TilesManager.
+         */
+        QRect geometry() const;
+
+        /**
+         * The rendered tile, or 0 if it has not been rendered yet.
+         */
+        QPixmap * pixmap() const;
+
+    private:
+        friend class TilesManager;
+
+        NormalizedRect m_rect;
+        QRect m_geometry;
+        QPixmap *m_pixmap;
+};
+
+/**
+ * @short Splits the pixmap of a page in a grid of tiles.
+ *
+ * Used for the pages so large (i.e. at high zoom levels) that only the
+ * visible part of them is worth rendering and keeping in memory.
+ * The grid depends only on the size of the page, so changing the size
+ * drops all the tiles.
+ */
+class OKULAR_EXPORT TilesManager
+{
+    public:
+        TilesManager( int width, int height );
+        ~TilesManager();
+
+        /**
+         * Sets the size of the page, deleting all the tiles if it changed.
+         */
+        void setSize( int width, int height );
+
+        int width() const;
+        int height() const;
+
+        /**
+         * Returns the tiles intersecting the given @p rect.
+         */
+        QList< Tile > tilesAt( const NormalizedRect &rect ) const;
+
+        /**
+         * Returns whether all the tiles intersecting @p rect have a pixmap.
+         */
+        bool hasPixmaps( const NormalizedRect &rect ) const;
+
+        /**
+         * Sets the @p pixmap of the tile covering @p rect, taking its ownership.
+         * The pixmap is discarded if it does not match a tile of the grid.
+         */
+        void setPixmap( const NormalizedRect &rect, QPixmap *pixmap );
+
+        /**
+         * Deletes the pixmaps of the tiles not intersecting @p rect.
+         */
+        void cleanupPixmaps( const NormalizedRect &rect );
+
+        /**
+         * Returns the memory (in bytes) used by the pixmaps of the tiles.
+         */
+        qulonglong totalMemory() const;
+
+        /**
+         * The side of a tile, in pixels.
+         */
+        static const int TileSize = 512;
+
+    private:
+        void buildGrid();
+        void deletePixmaps();
+        void tileRange( const NormalizedRect &rect, int *left, int *top, int *right, int *bottom ) const;
+
+        int m_width;
+        int m_height;
+        int m_columns;
+        int m_rows;
+        QVector< Tile > m_tiles;
+
+        Q_DISABLE_COPY( TilesManager )
+};
+
+}
+
+#endif
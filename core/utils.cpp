@@ -11,6 +11,10 @@
 #include "utils.h"
 #include "utils_p.h"
 
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
 #include <QtCore/QRect>
 #include <QApplication>
 #include <QDesktopWidget>
@@ -21,6 +25,10 @@
 #include <QX11Info>
 #endif
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #ifdef Q_WS_MAC
 #include <ApplicationServices/ApplicationServices.h>
 #include <IOKit/graphics/IOGraphicsLib.h>
@@ -191,13 +199,67 @@ inline static bool isWhite( QRgb argb ) {
     return ( argb & 0xFFFFFF ) == 0xFFFFFF; // ignore alpha
 }
 
+// how many pixels are checked at once before looking at them one by one
+static const int WhiteBlockSize = 16;
+
+// whether the WhiteBlockSize pixels from @p pixels are all white
+inline static bool isWhiteBlock( const QRgb * pixels )
+{
+#ifdef __SSE2__
+    const __m128i mask = _mm_set1_epi32( 0x00FFFFFF );
+    const __m128i *p = reinterpret_cast< const __m128i * >( pixels );
+    __m128i all = _mm_and_si128( _mm_and_si128( _mm_loadu_si128( p ), _mm_loadu_si128( p + 1 ) ),
+                                 _mm_and_si128( _mm_loadu_si128( p + 2 ), _mm_loadu_si128( p + 3 ) ) );
+    all = _mm_and_si128( all, mask );
+    return _mm_movemask_epi8( _mm_cmpeq_epi32( all, mask ) ) == 0xFFFF;
+#else
+    QRgb all = 0xFFFFFFFF;
+    for ( int i = 0; i < WhiteBlockSize; ++i )
+        all &= pixels[ i ];
+    return isWhite( all );
+#endif
+}
+
+// the first non white pixel of @p line in [from, to), or -1
+static int firstNonWhite( const QRgb * line, int from, int to )
+{
+    int x = from;
+    while ( x + WhiteBlockSize <= to && isWhiteBlock( line + x ) )
+        x += WhiteBlockSize;
+    for ( ; x < to; ++x )
+        if ( !isWhite( line[ x ] ) )
+            return x;
+    return -1;
+}
+
+// the last non white pixel of @p line in [from, to), or -1
+static int lastNonWhite( const QRgb * line, int from, int to )
+{
+    int x = to;
+    while ( x - WhiteBlockSize >= from && isWhiteBlock( line + x - WhiteBlockSize ) )
+        x -= WhiteBlockSize;
+    for ( --x; x >= from; --x )
+        if ( !isWhite( line[ x ] ) )
+            return x;
+    return -1;
+}
+
 NormalizedRect Utils::imageBoundingBox( const QImage * image )
 {
     if ( !image )
         return NormalizedRect();
 
-    int width = image->width();
-    int height = image->height();
+    // the scan works on 32 bit pixels
+    QImage converted;
+    if ( image->format() != QImage::Format_RGB32 && image->format() != QImage::Format_ARGB32 &&
+         image->format() != QImage::Format_ARGB32_Premultiplied )
+    {
+        converted = image->convertToFormat( QImage::Format_RGB32 );
+        image = &converted;
+    }
+
+    const int width = image->width();
+    const int height = image->height();
     int left, top, bottom, right, x, y;
 
 #ifdef BBOX_DEBUG
@@ -205,36 +267,41 @@ NormalizedRect Utils::imageBoundingBox( const QImage * image )
     time.start();
 #endif
 
-    // Scan pixels for top non-white
+    // Scan lines for top non-white
     for ( top = 0; top < height; ++top )
-        for ( x = 0; x < width; ++x )
-            if ( !isWhite( image->pixel( x, top ) ) )
-                goto got_top;
-    return NormalizedRect( 0, 0, 0, 0 ); // the image is blank
-got_top:
+    {
+        x = firstNonWhite( reinterpret_cast< const QRgb * >( image->scanLine( top ) ), 0, width );
+        if ( x >= 0 )
+            break;
+    }
+    if ( top == height )
+        return NormalizedRect( 0, 0, 0, 0 ); // the image is blank
     left = right = x;
 
-    // Scan pixels for bottom non-white
+    // Scan lines for bottom non-white
     for ( bottom = height-1; bottom >= top; --bottom )
-        for ( x = width-1; x >= 0; --x )
-            if ( !isWhite( image->pixel( x, bottom ) ) )
-                goto got_bottom;
-    Q_ASSERT( 0 ); // image changed?!
-got_bottom:
+    {
+        x = lastNonWhite( reinterpret_cast< const QRgb * >( image->scanLine( bottom ) ), 0, width );
+        if ( x >= 0 )
+            break;
+    }
+    Q_ASSERT( bottom >= top ); // image changed?!
     if ( x < left )
         left = x;
     if ( x > right )
         right = x;
 
-    // Scan for leftmost and rightmost (we already found some bounds on these):
+    // Scan for leftmost and rightmost (we already found some bounds on these),
+    // only outside of the bounds found so far:
     for ( y = top; y <= bottom && ( left > 0 || right < width-1 ); ++y )
     {
-        for ( x = 0; x < left; ++x )
-            if ( !isWhite( image->pixel( x, y ) ) )
-                left = x;
-        for ( x = width-1; x > right+1; --x )
-            if ( !isWhite( image->pixel( x, y ) ) )
-                right = x;
+        const QRgb * line = reinterpret_cast< const QRgb * >( image->scanLine( y ) );
+        x = firstNonWhite( line, 0, left );
+        if ( x >= 0 )
+            left = x;
+        x = lastNonWhite( line, right+1, width );
+        if ( x >= 0 )
+            right = x;
     }
 
     NormalizedRect bbox( QRect( left, top, ( right - left + 1), ( bottom - top + 1 ) ),
@@ -259,3 +326,24 @@ void Okular::copyQIODevice( QIODevice *from, QIODevice *to )
             break;
     }
 }
+
+QByteArray Okular::fileHash( const QString &fileName, const volatile bool *goOn )
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly ) )
+        return QByteArray();
+
+    QCryptographicHash hash( QCryptographicHash::Md5 );
+    while ( !file.atEnd() )
+    {
+        if ( goOn && !*goOn )
+            return QByteArray();
+        hash.addData( file.read( 1024 * 1024 ) );
+    }
+    return hash.result();
+}
+
+qint64 Okular::fileModified( const QString &fileName )
+{
+    return QFileInfo( fileName ).lastModified().toTime_t();
+}
@@ -10,13 +10,28 @@
 #ifndef _OKULAR_UTILS_P_H_
 #define _OKULAR_UTILS_P_H_
 
+#include <QtCore/QtGlobal>
+
+class QByteArray;
 class QIODevice;
+class QString;
 
 namespace Okular
 {
 
 void copyQIODevice( QIODevice *from, QIODevice *to );
 
+/**
+ * Returns the MD5 hash of the contents of the file, or an empty array if
+ * it cannot be read, or if @p goOn is given and becomes false meanwhile.
+ */
+QByteArray fileHash( const QString &fileName, const volatile bool *goOn = 0 );
+
+/**
+ * Returns the modification time of the file, in seconds since the epoch.
+ */
+qint64 fileModified( const QString &fileName );
+
 }
 
 #endif
@@ -9,6 +9,7 @@
 
 #include "document.h"
 
+#include <QtCore/QFileInfo>
 #include <QtCore/QScopedPointer>
 #include <QtGui/QImage>
 #include <QtGui/QImageReader>
@@ -133,6 +134,7 @@ void Document::close()
     mUnrar = 0;
     mPageMap.clear();
     mEntries.clear();
+    mGuessedPageSizes.clear();
 }
 
 bool Document::processArchive() {
@@ -167,18 +169,29 @@ void Document::pages( QVector<Okular::Page*> * pagesVector )
     pagesVector->clear();
     pagesVector->resize( mEntries.size() );
     QImageReader reader;
+    const QList<QByteArray> imageFormats = QImageReader::supportedImageFormats();
+    QSize firstPageSize;
     foreach(const QString &file, mEntries) {
-        if ( mArchive ) {
-            const KArchiveFile *entry = static_cast<const KArchiveFile*>( mArchiveDir->entry( file ) );
-            if ( entry ) {
-                dev.reset( entry->createDevice() );
+        /**
+         * The files of rar archives are extracted only when needed, so only
+         * the first image is read now, and the other pages get its size
+         * until they are rendered
+         */
+        if ( mUnrar ) {
+            if ( !imageFormats.contains( QFileInfo( file ).suffix().toLower().toLatin1() ) )
+                continue;
+
+            if ( firstPageSize.isValid() ) {
+                pagesVector->replace( count, new Okular::Page( count, firstPageSize.width(), firstPageSize.height(), Okular::Rotation0 ) );
+                mPageMap.append(file);
+                mGuessedPageSizes.insert(count);
+                count++;
+                continue;
             }
-        } else if ( mDirectory ) {
-            dev.reset( mDirectory->createDevice( file ) );
-        } else {
-            dev.reset( mUnrar->createDevice( file ) );
         }
 
+        dev.reset( createDevice( file ) );
+
         if ( ! dev.isNull() ) {
             reader.setDevice( dev.data() );
             if ( reader.canRead() )
@@ -189,6 +202,7 @@ void Document::pages( QVector<Okular::Page*> * pagesVector )
                 }
                 pagesVector->replace( count, new Okular::Page( count, pageSize.width(), pageSize.height(), Okular::Rotation0 ) );
                 mPageMap.append(file);
+                firstPageSize = pageSize;
                 count++;
             }
         }
@@ -201,19 +215,49 @@ QStringList Document::pageTitles() const
     return QStringList();
 }
 
-QImage Document::pageImage( int page ) const
+QImage Document::pageImage( int page, const QSize &scaledSize, QSize *imageSize ) const
+{
+    // the image is read from the archive as it is decoded, rather than
+    // extracting the whole entry first
+    QScopedPointer< QIODevice > dev( createDevice( mPageMap[ page ] ) );
+    if ( dev.isNull() )
+        return QImage();
+
+    QImageReader reader( dev.data() );
+    if ( imageSize )
+        *imageSize = reader.size();
+    if ( scaledSize.isValid() )
+        reader.setScaledSize( scaledSize );
+
+    return reader.read();
+}
+
+bool Document::takeGuessedPageSize( int page )
+{
+    return mGuessedPageSizes.remove( page );
+}
+
+void Document::prefetchPages( int page, int count )
+{
+    if ( !mUnrar )
+        return;
+
+    mUnrar->prefetch( mPageMap.mid( page, count ) );
+}
+
+QIODevice* Document::createDevice( const QString &file ) const
 {
     if ( mArchive ) {
-        const KArchiveFile *entry = static_cast<const KArchiveFile*>( mArchiveDir->entry( mPageMap[ page ] ) );
+        const KArchiveFile *entry = static_cast<const KArchiveFile*>( mArchiveDir->entry( file ) );
         if ( entry )
-            return QImage::fromData( entry->data() );
+            return entry->createDevice();
     } else if ( mDirectory ) {
-        return QImage( mPageMap[ page ] );
-    } else {
-        return QImage::fromData( mUnrar->contentOf( mPageMap[ page ] ) );
+        return mDirectory->createDevice( file );
+    } else if ( mUnrar ) {
+        return mUnrar->createDevice( file );
     }
 
-    return QImage();
+    return 0;
 }
 
 QString Document::lastErrorString() const
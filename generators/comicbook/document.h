@@ -10,11 +10,14 @@
 #ifndef COMICBOOK_DOCUMENT_H
 #define COMICBOOK_DOCUMENT_H
 
+#include <QtCore/QSet>
+#include <QtCore/QSize>
 #include <QtCore/QStringList>
 
 class KArchiveDirectory;
 class KArchive;
 class QImage;
+class QIODevice;
 class QSize;
 class Unrar;
 class Directory;
@@ -37,12 +40,30 @@ class Document
         void pages( QVector<Okular::Page*> * pagesVector );
         QStringList pageTitles() const;
 
-        QImage pageImage( int page ) const;
+        /**
+         * Decodes the image of the given page, directly at @p scaledSize
+         * when that is valid (JPEG images are then scaled while decoding).
+         * The size of the original image is stored in @p imageSize if given.
+         */
+        QImage pageImage( int page, const QSize &scaledSize = QSize(), QSize *imageSize = 0 ) const;
+
+        /**
+         * Returns whether the size of the given page was only guessed when
+         * loading, and forgets about it.
+         */
+        bool takeGuessedPageSize( int page );
+
+        /**
+         * Prepares the images of @p count pages starting from @p page in
+         * the background, if reading them is slow.
+         */
+        void prefetchPages( int page, int count );
 
         QString lastErrorString() const;
 
     private:
         bool processArchive();
+        QIODevice* createDevice( const QString &file ) const;
 
         QStringList mPageMap;
         Directory *mDirectory;
@@ -51,6 +72,7 @@ class Document
         KArchiveDirectory *mArchiveDir;
         QString mLastErrorString;
         QStringList mEntries;
+        QSet<int> mGuessedPageSizes;
 };
 
 }
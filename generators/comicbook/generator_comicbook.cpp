@@ -9,6 +9,7 @@
 
 #include "generator_comicbook.h"
 
+#include <QtCore/QMutexLocker>
 #include <QtGui/QPainter>
 #include <QtGui/QPrinter>
 
@@ -37,8 +38,14 @@ static KAboutData createAboutData()
 
 OKULAR_EXPORT_PLUGIN( ComicBookGenerator, createAboutData() )
 
+// enough for a two pages spread and its thumbnails
+static const int MaxCachedImages = 6;
+
+// how many of the next pages are prepared after rendering one
+static const int PrefetchedPages = 3;
+
 ComicBookGenerator::ComicBookGenerator( QObject *parent, const QVariantList &args )
-    : Generator( parent, args )
+    : Generator( parent, args ), mImageCacheMemory( 0 )
 {
     setFeature( Threaded );
     setFeature( PrintNative );
@@ -65,19 +72,94 @@ bool ComicBookGenerator::loadDocument( const QString & fileName, QVector<Okular:
 
 bool ComicBookGenerator::doCloseDocument()
 {
+    QMutexLocker lock( userMutex() );
     mDocument.close();
 
+    QMutexLocker cacheLock( &mImageCacheMutex );
+    mImageCache.clear();
+    mImageCacheMemory = 0;
+
     return true;
 }
 
 QImage ComicBookGenerator::image( Okular::PixmapRequest * request )
 {
-    int width = request->width();
-    int height = request->height();
+    const int page = request->pageNumber();
+    const QSize size( request->width(), request->height() );
+
+    QMutexLocker lock( userMutex() );
+
+    mImageCacheMutex.lock();
+    for ( int i = mImageCache.count() - 1; i >= 0; --i ) {
+        if ( mImageCache.at( i ).page == page && mImageCache.at( i ).image.size() == size ) {
+            const CachedImage cached = mImageCache.takeAt( i );
+            mImageCache.append( cached );
+            mImageCacheMutex.unlock();
+            return cached.image;
+        }
+    }
+    mImageCacheMutex.unlock();
+
+    // let the image reader scale while decoding, as JPEG can be decoded
+    // directly at a fraction of its size
+    QSize imageSize;
+    QImage image = mDocument.pageImage( page, size, &imageSize );
+    if ( !image.isNull() && image.size() != size )
+        image = image.scaled( size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+
+    // the page could have been given the size of another one when loading
+    if ( mDocument.takeGuessedPageSize( page ) && imageSize.isValid()
+         && ( imageSize.width() != qRound( request->page()->width() ) || imageSize.height() != qRound( request->page()->height() ) ) )
+        QMetaObject::invokeMethod( this, "pageSizeFound", Qt::QueuedConnection, Q_ARG( int, page ), Q_ARG( QSize, imageSize ) );
+
+    mDocument.prefetchPages( page + 1, PrefetchedPages );
+
+    cacheImage( page, image );
+    return image;
+}
+
+void ComicBookGenerator::pageSizeFound( int page, const QSize &size )
+{
+    // the document could have been closed meanwhile
+    if ( page < document()->pages() )
+        updatePageSize( page, size.width(), size.height() );
+}
+
+void ComicBookGenerator::cacheImage( int page, const QImage &image )
+{
+    const qulonglong budget = documentMetaData( "CacheMemoryBudget" ).toULongLong();
+    const qulonglong imageMemory = image.byteCount();
+    if ( image.isNull() || imageMemory > budget )
+        return;
+
+    CachedImage cached;
+    cached.page = page;
+    cached.image = image;
+    QMutexLocker lock( &mImageCacheMutex );
+    mImageCache.append( cached );
+    mImageCacheMemory += imageMemory;
+
+    while ( mImageCache.count() > MaxCachedImages || mImageCacheMemory > budget ) {
+        mImageCacheMemory -= mImageCache.takeFirst().image.byteCount();
+    }
+}
 
-    QImage image = mDocument.pageImage( request->pageNumber() );
+qulonglong ComicBookGenerator::cacheMemory() const
+{
+    QMutexLocker lock( &mImageCacheMutex );
+    return mImageCacheMemory;
+}
 
-    return image.scaled( width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+qulonglong ComicBookGenerator::freeCacheMemory( qulonglong memoryToFree )
+{
+    // the images are shared, so the ones being returned by image() stay valid
+    QMutexLocker lock( &mImageCacheMutex );
+    qulonglong freed = 0;
+    while ( freed < memoryToFree && !mImageCache.isEmpty() ) {
+        freed += mImageCache.takeFirst().image.byteCount();
+    }
+    mImageCacheMemory -= freed;
+    return freed;
 }
 
 bool ComicBookGenerator::print( QPrinter& printer )
@@ -90,7 +172,9 @@ bool ComicBookGenerator::print( QPrinter& printer )
 
     for ( int i = 0; i < pageList.count(); ++i ) {
 
+        userMutex()->lock();
         QImage image = mDocument.pageImage( pageList[i] - 1 );
+        userMutex()->unlock();
 
         if ( ( image.width() > printer.width() ) || ( image.height() > printer.height() ) )
 
@@ -12,6 +12,10 @@
 
 #include <core/generator.h>
 
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtGui/QImage>
+
 #include "document.h"
 
 class ComicBookGenerator : public Okular::Generator
@@ -32,8 +36,27 @@ class ComicBookGenerator : public Okular::Generator
         bool doCloseDocument();
         QImage image( Okular::PixmapRequest * request );
 
+    protected slots:
+        qulonglong cacheMemory() const;
+        qulonglong freeCacheMemory( qulonglong memoryToFree );
+
+    private slots:
+        void pageSizeFound( int page, const QSize &size );
+
     private:
+      // the last images decoded, the most recently used at the end; they
+      // have their own mutex, not to wait for a rendering to look at them
+      struct CachedImage
+      {
+          int page;
+          QImage image;
+      };
+      void cacheImage( int page, const QImage &image );
+
       ComicBook::Document mDocument;
+      mutable QMutex mImageCacheMutex;
+      QList<CachedImage> mImageCache;
+      qulonglong mImageCacheMemory;
 };
 
 #endif
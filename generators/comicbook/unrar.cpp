@@ -11,7 +11,10 @@
 
 #include <QtCore/QEventLoop>
 #include <QtCore/QFile>
+#include <QtCore/QFileInfo>
 #include <QtCore/QRegExp>
+#include <QtCore/QRunnable>
+#include <QtCore/QSet>
 
 #include <kdebug.h>
 #include <kglobal.h>
@@ -39,6 +42,11 @@ struct UnrarHelper
 
 K_GLOBAL_STATIC( UnrarHelper, helper )
 
+#define ComicBookDebug 4716
+
+// how much disk the extracted files can use, besides the last one extracted
+static const qint64 CacheBudget = 64 * 1024 * 1024;
+
 static UnrarFlavour* detectUnrar( const QString &unrarPath )
 {
     UnrarFlavour* kind = 0;
@@ -74,12 +82,12 @@ UnrarHelper::UnrarHelper()
     if ( !kind )
     {
         // no luck, print that
-        kDebug() << "No unrar detected.";
+        kDebug(ComicBookDebug) << "No unrar detected.";
     }
     else
     {
         unrarPath = path;
-        kDebug() << "detected:" << path << "(" << kind->name() << ")";
+        kDebug(ComicBookDebug) << "detected:" << path << "(" << kind->name() << ")";
     }
 }
 
@@ -89,13 +97,80 @@ UnrarHelper::~UnrarHelper()
 }
 
 
+/**
+ * A file of the cache, which is not deleted as long as it is open.
+ */
+class Unrar::CachedFile : public QFile
+{
+    public:
+        CachedFile( const Unrar *unrar, const QString &fileName, const QString &path )
+          : QFile( path ), mUnrar( unrar ), mFileName( fileName ), mPinned( false ) { }
+
+        ~CachedFile()
+        {
+            close();
+            if ( mPinned )
+                mUnrar->releaseFile( mFileName );
+        }
+
+        // called with the cache mutex locked
+        void pin()
+        {
+            ++mUnrar->mOpenFiles[ mFileName ];
+            mPinned = true;
+        }
+
+    private:
+        const Unrar *mUnrar;
+        QString mFileName;
+        bool mPinned;
+};
+
+
+class Unrar::PrefetchJob : public QRunnable
+{
+    public:
+        explicit PrefetchJob( Unrar *unrar )
+          : mUnrar( unrar ) { }
+
+        void run()
+        {
+            forever {
+                QStringList fileNames;
+                {
+                    QMutexLocker locker( &mUnrar->mPrefetchMutex );
+                    if ( mUnrar->mPrefetchQueue.isEmpty() ) {
+                        mUnrar->mPrefetchRunning = false;
+                        return;
+                    }
+                    fileNames = mUnrar->mPrefetchQueue;
+                    mUnrar->mPrefetchQueue.clear();
+                }
+                // all the queued files at once, as on solid archives every
+                // run of unrar decompresses the archive from its start
+                QMutexLocker locker( &mUnrar->mCacheMutex );
+                mUnrar->extract( fileNames );
+            }
+        }
+
+    private:
+        Unrar *mUnrar;
+};
+
+
 Unrar::Unrar()
-    : QObject( 0 ), mLoop( 0 ), mTempDir( 0 )
+    : QObject( 0 ), mLoop( 0 ), mTempDir( 0 ), mCachedBytes( 0 ), mPrefetchRunning( false )
 {
+    mPrefetchPool.setMaxThreadCount( 1 );
 }
 
 Unrar::~Unrar()
 {
+    mPrefetchMutex.lock();
+    mPrefetchQueue.clear();
+    mPrefetchMutex.unlock();
+    mPrefetchPool.waitForDone();
+
     delete mTempDir;
 }
 
@@ -110,59 +185,159 @@ bool Unrar::open( const QString &fileName )
     mFileName = fileName;
 
     /**
-     * Extract the archive to a temporary directory
+     * Only list the archive, the files are extracted when needed
      */
     mStdOutData.clear();
     mStdErrData.clear();
 
-    int ret = startSyncProcess( QStringList() << "e" << mFileName << mTempDir->name() );
-    bool ok = ret == 0;
+    int ret = startSyncProcess( QStringList() << "lb" << mFileName );
+    if ( ret != 0 )
+        return false;
+
+    const QStringList listFiles = helper->kind->processListing( QString::fromLocal8Bit( mStdOutData ).split( '\n', QString::SkipEmptyParts ) );
 
-    return ok;
+    // the listing has the directories too, skip them
+    QSet< QString > directories;
+    Q_FOREACH ( const QString &f, listFiles ) {
+        int slash = f.lastIndexOf( '/' );
+        while ( slash > 0 ) {
+            directories.insert( f.left( slash ) );
+            slash = f.lastIndexOf( '/', slash - 1 );
+        }
+    }
+
+    mEntries.clear();
+    Q_FOREACH ( const QString &f, listFiles ) {
+        if ( !directories.contains( f ) ) {
+            mEntries.append( f );
+        }
+    }
+
+    return true;
 }
 
 QStringList Unrar::list()
 {
-    mStdOutData.clear();
-    mStdErrData.clear();
+    return mEntries;
+}
 
+QIODevice* Unrar::createDevice( const QString &fileName ) const
+{
     if ( !isSuitableVersionAvailable() )
-        return QStringList();
+        return 0;
 
-    startSyncProcess( QStringList() << "lb" << mFileName );
+    QMutexLocker locker( &mCacheMutex );
 
-    const QStringList listFiles = helper->kind->processListing( QString::fromLocal8Bit( mStdOutData ).split( '\n', QString::SkipEmptyParts ) );
-    QStringList newList;
-    Q_FOREACH ( const QString &f, listFiles ) {
-        if ( QFile::exists( mTempDir->name() + f ) ) {
-            newList.append( f );
-        }
+    // a prefetch may be extracting the file already
+    while ( mExtractingFiles.contains( fileName ) )
+        mExtracted.wait( &mCacheMutex );
+
+    if ( !mCachedSizes.contains( fileName ) ) {
+        extract( QStringList() << fileName );
+        if ( !mCachedSizes.contains( fileName ) )
+            return 0;
     }
-    return newList;
+
+    mCachedFiles.removeOne( fileName );
+    mCachedFiles.append( fileName );
+
+    std::auto_ptr< CachedFile > file( new CachedFile( this, fileName, mTempDir->name() + fileName ) );
+    if ( !file->open( QIODevice::ReadOnly ) )
+        return 0;
+    file->pin();
+
+    return file.release();
 }
 
-QByteArray Unrar::contentOf( const QString &fileName ) const
+void Unrar::prefetch( const QStringList &fileNames )
 {
     if ( !isSuitableVersionAvailable() )
-        return QByteArray();
+        return;
 
-    QFile file( mTempDir->name() + fileName );
-    if ( !file.open( QIODevice::ReadOnly ) )
-        return QByteArray();
+    QMutexLocker locker( &mPrefetchMutex );
+    Q_FOREACH ( const QString &f, fileNames ) {
+        if ( !mPrefetchQueue.contains( f ) ) {
+            mPrefetchQueue.append( f );
+        }
+    }
 
-    return file.readAll();
+    if ( !mPrefetchRunning && !mPrefetchQueue.isEmpty() ) {
+        mPrefetchRunning = true;
+        mPrefetchPool.start( new PrefetchJob( this ) );
+    }
 }
 
-QIODevice* Unrar::createDevice( const QString &fileName ) const
+/**
+ * Extracts with one run of unrar the files with the given names which are
+ * neither extracted nor being extracted yet.
+ * This can be called from any thread, with mCacheMutex locked; the mutex is
+ * released while unrar runs.
+ */
+void Unrar::extract( const QStringList &fileNames ) const
 {
-    if ( !isSuitableVersionAvailable() )
-        return 0;
+    QStringList files;
+    Q_FOREACH ( const QString &f, fileNames ) {
+        if ( !mCachedSizes.contains( f ) && !mExtractingFiles.contains( f ) && !files.contains( f ) ) {
+            files.append( f );
+        }
+    }
+    if ( files.isEmpty() )
+        return;
 
-    std::auto_ptr< QFile> file( new QFile( mTempDir->name() + fileName ) );
-    if ( !file->open( QIODevice::ReadOnly ) )
-        return 0;
+    Q_FOREACH ( const QString &f, files ) {
+        mExtractingFiles.insert( f );
+    }
+    mCacheMutex.unlock();
+
+    // a plain process, as this does not run in the thread of this object;
+    // "--" as the names may start with '-' or '@'
+    QProcess process;
+    process.start( helper->unrarPath, QStringList() << "x" << "-o+" << "-p-" << "-inul" << "--" << mFileName << files << mTempDir->name() );
+    const bool ok = process.waitForFinished( -1 ) && process.exitStatus() == QProcess::NormalExit && process.exitCode() == 0;
+    if ( !ok )
+        kDebug(ComicBookDebug) << "Cannot extract" << files;
+
+    mCacheMutex.lock();
+    Q_FOREACH ( const QString &f, files ) {
+        mExtractingFiles.remove( f );
+
+        const QString path = mTempDir->name() + f;
+        const QFileInfo info( path );
+        if ( !info.isFile() )
+            continue;
+
+        // what is there may be truncated
+        if ( !ok ) {
+            QFile::remove( path );
+            continue;
+        }
 
-    return file.release();
+        mCachedFiles.append( f );
+        mCachedSizes.insert( f, info.size() );
+        mCachedBytes += info.size();
+    }
+
+    // the files just extracted and the open ones are kept anyway
+    QStringList::iterator it = mCachedFiles.begin();
+    while ( mCachedBytes > CacheBudget && it != mCachedFiles.end() ) {
+        if ( files.contains( *it ) || mOpenFiles.contains( *it ) ) {
+            ++it;
+            continue;
+        }
+        mCachedBytes -= mCachedSizes.take( *it );
+        QFile::remove( mTempDir->name() + *it );
+        it = mCachedFiles.erase( it );
+    }
+
+    mExtracted.wakeAll();
+}
+
+void Unrar::releaseFile( const QString &fileName ) const
+{
+    QMutexLocker locker( &mCacheMutex );
+    QHash< QString, int >::iterator it = mOpenFiles.find( fileName );
+    if ( it != mOpenFiles.end() && --it.value() == 0 )
+        mOpenFiles.erase( it );
 }
 
 bool Unrar::isAvailable()
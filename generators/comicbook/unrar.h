@@ -10,11 +10,17 @@
 #ifndef UNRAR_H
 #define UNRAR_H
 
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
 #include <QtCore/QProcess>
+#include <QtCore/QSet>
 #include <QtCore/QStringList>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
 
 class QEventLoop;
+class QFile;
 class KTempDir;
 class KPtyProcess;
 
@@ -34,7 +40,7 @@ class Unrar : public QObject
         ~Unrar();
 
         /**
-         * Opens given rar archive.
+         * Opens given rar archive, reading only the list of its files.
          */
         bool open( const QString &fileName );
 
@@ -44,14 +50,16 @@ class Unrar : public QObject
         QStringList list();
 
         /**
-         * Returns the content of the file with the given name.
+         * Returns a new device for reading the file with the given name,
+         * extracting it first if needed.
          */
-        QByteArray contentOf( const QString &fileName ) const;
+        QIODevice* createDevice( const QString &fileName ) const;
 
         /**
-         * Returns a new device for reading the file with the given name.
+         * Extracts the files with the given names in the background, so
+         * they are ready when a device is created for them.
          */
-        QIODevice* createDevice( const QString &fileName ) const;
+        void prefetch( const QStringList &fileNames );
 
         static bool isAvailable();
         static bool isSuitableVersionAvailable();
@@ -62,8 +70,15 @@ class Unrar : public QObject
         void finished( int exitCode, QProcess::ExitStatus exitStatus );
 
     private:
+        class CachedFile;
+        class PrefetchJob;
+        friend class CachedFile;
+        friend class PrefetchJob;
+
         int startSyncProcess( const QStringList &args );
         void writeToProcess( const QByteArray &data );
+        void extract( const QStringList &fileNames ) const;
+        void releaseFile( const QString &fileName ) const;
 
 #if defined(Q_OS_WIN)
         QProcess *mProcess;
@@ -75,6 +90,22 @@ class Unrar : public QObject
         QByteArray mStdOutData;
         QByteArray mStdErrData;
         KTempDir *mTempDir;
+        QStringList mEntries;
+
+        // the extracted files, the most recently used at the end, the
+        // ones being extracted and how many times each one is open
+        mutable QMutex mCacheMutex;
+        mutable QStringList mCachedFiles;
+        mutable QHash< QString, qint64 > mCachedSizes;
+        mutable qint64 mCachedBytes;
+        mutable QSet< QString > mExtractingFiles;
+        mutable QWaitCondition mExtracted;
+        mutable QHash< QString, int > mOpenFiles;
+
+        QMutex mPrefetchMutex;
+        QStringList mPrefetchQueue;
+        bool mPrefetchRunning;
+        QThreadPool mPrefetchPool;
 };
 
 #endif
@@ -88,16 +88,19 @@ DjVuGenerator::DjVuGenerator( QObject *parent, const QVariantList &args )
 {
     setFeature( TextExtraction );
     setFeature( Threaded );
+    setFeature( ConcurrentRendering );
     setFeature( PrintPostscript );
     if ( Okular::FilePrinter::ps2pdfAvailable() )
         setFeature( PrintToFile );
 
     m_djvu = new KDjVu();
     m_djvu->setCacheEnabled( false );
+    m_djvu->setTilesThreadPool( &m_tilesThreadPool );
 }
 
 DjVuGenerator::~DjVuGenerator()
 {
+    qDeleteAll( m_renderDocuments );
     delete m_djvu;
 }
 
@@ -107,8 +110,12 @@ bool DjVuGenerator::loadDocument( const QString & fileName, QVector< Okular::Pag
     if ( !m_djvu->openFile( fileName ) )
         return false;
 
+    m_fileName = fileName;
+    m_djvu->setCacheBudget( renderDocumentCacheBudget() );
     locker.unlock();
 
+    updateTilesThreadPool();
+
     loadPages( pagesVector, 0 );
 
     return true;
@@ -120,6 +127,13 @@ bool DjVuGenerator::doCloseDocument()
     m_djvu->closeFile();
     userMutex()->unlock();
 
+    m_renderDocumentsMutex.lock();
+    qDeleteAll( m_renderDocuments );
+    m_renderDocuments.clear();
+    m_freeRenderDocuments.clear();
+    m_fileName.clear();
+    m_renderDocumentsMutex.unlock();
+
     delete m_docInfo;
     m_docInfo = 0;
     delete m_docSyn;
@@ -130,12 +144,113 @@ bool DjVuGenerator::doCloseDocument()
 
 QImage DjVuGenerator::image( Okular::PixmapRequest *request )
 {
-    userMutex()->lock();
-    QImage img = m_djvu->image( request->pageNumber(), request->width(), request->height(), request->page()->rotation() );
-    userMutex()->unlock();
+    QImage img;
+    KDjVu *djvu = acquireRenderDocument();
+    if ( djvu )
+    {
+        img = djvu->image( request->pageNumber(), request->width(), request->height(), request->page()->rotation() );
+        releaseRenderDocument( djvu );
+    }
+    else
+    {
+        userMutex()->lock();
+        img = m_djvu->image( request->pageNumber(), request->width(), request->height(), request->page()->rotation() );
+        userMutex()->unlock();
+    }
     return img;
 }
 
+KDjVu* DjVuGenerator::acquireRenderDocument()
+{
+    // the budget follows the memory profile, which can change anytime
+    const qulonglong cacheBudget = renderDocumentCacheBudget();
+    updateTilesThreadPool();
+
+    QMutexLocker locker( &m_renderDocumentsMutex );
+    if ( !m_freeRenderDocuments.isEmpty() )
+    {
+        KDjVu *djvu = m_freeRenderDocuments.takeLast();
+        djvu->setCacheBudget( cacheBudget );
+        return djvu;
+    }
+
+    const QString fileName = m_fileName;
+    locker.unlock();
+
+    if ( fileName.isEmpty() )
+        return 0;
+
+    KDjVu *djvu = new KDjVu();
+    djvu->setCacheEnabled( false );
+    djvu->setCacheBudget( cacheBudget );
+    djvu->setTilesThreadPool( &m_tilesThreadPool );
+    if ( !djvu->openFile( fileName ) )
+    {
+        delete djvu;
+        return 0;
+    }
+
+    locker.relock();
+    m_renderDocuments.append( djvu );
+    return djvu;
+}
+
+void DjVuGenerator::releaseRenderDocument( KDjVu *djvu )
+{
+    QMutexLocker locker( &m_renderDocumentsMutex );
+    m_freeRenderDocuments.append( djvu );
+}
+
+qulonglong DjVuGenerator::renderDocumentCacheBudget() const
+{
+    // the budget is for the whole document, so it is shared by the copies
+    // of the rendering threads and m_djvu; a big page still fits, as each
+    // KDjVu keeps its last decoded page anyway
+    const int documents = qMax( 1, documentMetaData( "RenderingThreads" ).toInt() ) + 1;
+    return documentMetaData( "CacheMemoryBudget" ).toULongLong() / documents;
+}
+
+void DjVuGenerator::updateTilesThreadPool()
+{
+    // the thread asking for a page renders tiles as well, so the tiles of
+    // a page are rendered at most by as many threads as the rendering ones
+    const int threads = qMax( 1, documentMetaData( "RenderingThreads" ).toInt() );
+    m_tilesThreadPool.setMaxThreadCount( threads - 1 );
+}
+
+qulonglong DjVuGenerator::cacheMemory() const
+{
+    // the documents busy rendering are accounted too, with the page they
+    // are rendering
+    qulonglong memory = m_djvu->cacheMemory();
+    QMutexLocker locker( &m_renderDocumentsMutex );
+    foreach ( KDjVu *djvu, m_renderDocuments )
+        memory += djvu->cacheMemory();
+    return memory;
+}
+
+qulonglong DjVuGenerator::freeCacheMemory( qulonglong memoryToFree )
+{
+    // called from the GUI thread, so do not wait for the documents in use;
+    // they keep within their share of the budget anyway
+    qulonglong freed = 0;
+    m_renderDocumentsMutex.lock();
+    foreach ( KDjVu *djvu, m_freeRenderDocuments )
+    {
+        if ( freed >= memoryToFree )
+            break;
+        freed += djvu->freeCacheMemory( memoryToFree - freed );
+    }
+    m_renderDocumentsMutex.unlock();
+
+    if ( freed < memoryToFree && userMutex()->tryLock() )
+    {
+        freed += m_djvu->freeCacheMemory( memoryToFree - freed );
+        userMutex()->unlock();
+    }
+    return freed;
+}
+
 const Okular::DocumentInfo * DjVuGenerator::generateDocumentInfo()
 {
     if ( m_docInfo )
@@ -12,6 +12,9 @@
 
 #include <core/generator.h>
 
+#include <qlist.h>
+#include <qmutex.h>
+#include <qthreadpool.h>
 #include <qvector.h>
 
 #include "kdjvu.h"
@@ -44,12 +47,31 @@ class DjVuGenerator : public Okular::Generator
         QImage image( Okular::PixmapRequest *request );
         Okular::TextPage* textPage( Okular::Page *page );
 
+    protected slots:
+        qulonglong cacheMemory() const;
+        qulonglong freeCacheMemory( qulonglong memoryToFree );
+
     private:
         void loadPages( QVector<Okular::Page*> & pagesVector, int rotation );
         Okular::ObjectRect* convertKDjVuLink( int page, KDjVu::Link * link ) const;
         Okular::Annotation* convertKDjVuAnnotation( int w, int h, KDjVu::Annotation * ann ) const;
 
+        // copies of m_djvu, used to render more pages at the same time
+        KDjVu* acquireRenderDocument();
+        void releaseRenderDocument( KDjVu *djvu );
+        // the share of the memory budget of the document each KDjVu can
+        // use for its caches
+        qulonglong renderDocumentCacheBudget() const;
+        void updateTilesThreadPool();
+
         KDjVu *m_djvu;
+        QString m_fileName;
+        // all the copies, and the ones not rendering
+        QList<KDjVu*> m_renderDocuments;
+        QList<KDjVu*> m_freeRenderDocuments;
+        mutable QMutex m_renderDocumentsMutex;
+        // helps rendering the tiles of big pages
+        QThreadPool m_tilesThreadPool;
 
         Okular::DocumentInfo *m_docInfo;
         Okular::DocumentSynopsis *m_docSyn;
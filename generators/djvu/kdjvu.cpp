@@ -10,13 +10,18 @@
 #include "kdjvu.h"
 
 #include <qbytearray.h>
+#include <qcache.h>
 #include <qdom.h>
 #include <qfile.h>
 #include <qhash.h>
 #include <qlist.h>
+#include <qmutex.h>
 #include <qpainter.h>
 #include <qqueue.h>
+#include <qrunnable.h>
 #include <qstring.h>
+#include <qthreadpool.h>
+#include <qwaitcondition.h>
 
 #include <kdebug.h>
 #include <klocale.h>
@@ -24,6 +29,7 @@
 #include <libdjvu/ddjvuapi.h>
 #include <libdjvu/miniexp.h>
 
+#include <limits.h>
 #include <stdio.h>
 
 QDebug &operator<<( QDebug & s, const ddjvu_rect_t &r )
@@ -143,20 +149,64 @@ static bool find_replace_or_add_second_in_pair( miniexp_t theexp, const char* wh
     return false;
 }
 
-// ImageCacheItem
+// ImageCacheKey
 
-class ImageCacheItem
+class ImageCacheKey
 {
     public:
-        ImageCacheItem( int p, int w, int h, const QImage& i )
-          : page( p ), width( w ), height( h ), img( i ) { }
+        ImageCacheKey( int p, int w, int h )
+          : page( p ), width( w ), height( h ) { }
+
+        bool operator==( const ImageCacheKey &other ) const
+        {
+            return page == other.page && width == other.width && height == other.height;
+        }
 
         int page;
         int width;
         int height;
-        QImage img;
 };
 
+static inline uint qHash( const ImageCacheKey &key )
+{
+    return ::qHash( key.page ) ^ ::qHash( ( key.width << 16 ) ^ key.height );
+}
+
+// DecodedPage
+
+class DecodedPage
+{
+    public:
+        explicit DecodedPage( ddjvu_page_t *p )
+          : page( p ) { }
+
+        ~DecodedPage()
+        {
+            ddjvu_page_release( page );
+        }
+
+        // a rough estimate of the memory of the decoded page, in KiB: the
+        // decoded data (mostly the wavelets of the background) takes about
+        // one byte per pixel of the page at full resolution
+        int cost() const
+        {
+            return qMax( 1, ddjvu_page_get_width( page ) * ddjvu_page_get_height( page ) / 1024 );
+        }
+
+        ddjvu_page_t *page;
+};
+
+// the costs of the caches are in KiB, to not overflow the int costs of QCache
+static int imageCost( const QImage &img )
+{
+    return qMax( 1, img.byteCount() / 1024 );
+}
+
+static int kibCost( qulonglong bytes )
+{
+    return (int)qMin( bytes / 1024, (qulonglong)INT_MAX );
+}
+
 
 // KdjVu::Page
 
@@ -430,12 +480,27 @@ class KDjVu::Private
     public:
         Private()
           : m_djvu_cxt( 0 ), m_djvu_document( 0 ), m_format( 0 ), m_docBookmarks( 0 ),
-            m_cacheEnabled( true )
+            m_lastPage( 0 ), m_lastPageNumber( -1 ), m_cacheBudget( 32 * 1024 * 1024 ),
+            m_cacheMemory( 0 ), m_cacheEnabled( true ), m_tilesThreadPool( 0 )
         {
+            updateCacheCosts();
         }
 
+        // splits the memory budget between the two caches
+        void updateCacheCosts();
+        // records the memory of the caches, plus the one of the page
+        // being rendered if any
+        void updateCacheMemory( const DecodedPage *renderedPage = 0 );
+
         QImage generateImageTile( ddjvu_page_t *djvupage, int& res,
             int width, int row, int xdelta, int height, int col, int ydelta );
+        class TilesJob;
+        class TilesHelper;
+
+        // render the tiles of the image in the calling thread and in the
+        // free threads of m_tilesThreadPool
+        int generateImageTiles( ddjvu_page_t *djvupage, QImage &image,
+            int width, int xparts, int xdelta, int height, int yparts, int ydelta );
 
         void readBookmarks();
         void fillBookmarksRecurse( QDomDocument& maindoc, QDomNode& curnode,
@@ -450,9 +515,17 @@ class KDjVu::Private
         ddjvu_format_t *m_format;
 
         QVector<KDjVu::Page*> m_pages;
-        QVector<ddjvu_page_t *> m_pages_cache;
-
-        QList<ImageCacheItem*> mImgCache;
+        // the decoded pages and the rendered images, least recently used
+        // first out; the costs are in KiB
+        QCache<int, DecodedPage> m_pagesCache;
+        QCache<ImageCacheKey, QImage> m_imgCache;
+        // the most recently decoded page, kept out of the cache so that it
+        // is there even when the budget is too small for it
+        DecodedPage *m_lastPage;
+        int m_lastPageNumber;
+        qulonglong m_cacheBudget;
+        // the memory of the caches in KiB, readable from any thread
+        QAtomicInt m_cacheMemory;
 
         QHash<QString, QVariant> m_metaData;
         QDomDocument * m_docBookmarks;
@@ -461,11 +534,110 @@ class KDjVu::Private
 
         bool m_cacheEnabled;
 
+        QThreadPool *m_tilesThreadPool;
+        // the message queue of the context is not safe to be handled
+        // by more threads at the same time
+        QMutex m_messagesMutex;
+
         static unsigned int s_formatmask[4];
 };
 
+// KDjVu::Private::TilesJob
+
+class KDjVu::Private::TilesJob
+{
+    public:
+        TilesJob( KDjVu::Private *p, ddjvu_page_t *pg, QImage *img,
+            int w, int xp, int xd, int h, int yp, int yd )
+          : priv( p ), page( pg ), image( img ), width( w ), xparts( xp ), xdelta( xd ),
+            height( h ), yparts( yp ), ydelta( yd ), nextTile( 0 ), res( 10000 ), helpers( 0 )
+        {
+        }
+
+        // render the tiles not taken yet by the other threads
+        void renderTiles()
+        {
+            const int parts = xparts * yparts;
+            int i;
+            while ( ( i = nextTile.fetchAndAddOrdered( 1 ) ) < parts )
+            {
+                const int row = i % xparts;
+                const int col = i / xparts;
+                int tmpres = 0;
+                QImage tempp = priv->generateImageTile( page, tmpres,
+                        width, row, xdelta, height, col, ydelta );
+
+                QMutexLocker locker( &mutex );
+                if ( tmpres )
+                {
+                    QPainter p( image );
+                    p.drawImage( row * xdelta, col * ydelta, tempp );
+                }
+                res = qMin( tmpres, res );
+            }
+        }
+
+        KDjVu::Private *priv;
+        ddjvu_page_t *page;
+        QImage *image;
+        int width, xparts, xdelta;
+        int height, yparts, ydelta;
+        QAtomicInt nextTile;
+        // protect the following and the painting on the image
+        QMutex mutex;
+        int res;
+        int helpers;
+        QWaitCondition helpersDone;
+};
+
+class KDjVu::Private::TilesHelper : public QRunnable
+{
+    public:
+        explicit TilesHelper( TilesJob *job )
+          : m_job( job )
+        {
+        }
+
+        void run()
+        {
+            m_job->renderTiles();
+
+            QMutexLocker locker( &m_job->mutex );
+            --m_job->helpers;
+            m_job->helpersDone.wakeAll();
+        }
+
+    private:
+        TilesJob *m_job;
+};
+
 unsigned int KDjVu::Private::s_formatmask[4] = { 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000 };
 
+void KDjVu::Private::updateCacheCosts()
+{
+    if ( m_cacheEnabled )
+    {
+        m_pagesCache.setMaxCost( kibCost( m_cacheBudget / 2 ) );
+        m_imgCache.setMaxCost( kibCost( m_cacheBudget / 2 ) );
+    }
+    else
+    {
+        m_pagesCache.setMaxCost( kibCost( m_cacheBudget ) );
+        m_imgCache.clear();
+    }
+    updateCacheMemory();
+}
+
+void KDjVu::Private::updateCacheMemory( const DecodedPage *renderedPage )
+{
+    int memory = m_pagesCache.totalCost() + m_imgCache.totalCost();
+    if ( m_lastPage )
+        memory += m_lastPage->cost();
+    if ( renderedPage )
+        memory += renderedPage->cost();
+    m_cacheMemory = memory;
+}
+
 QImage KDjVu::Private::generateImageTile( ddjvu_page_t *djvupage, int& res,
     int width, int row, int xdelta, int height, int col, int ydelta )
 {
@@ -487,7 +659,9 @@ QImage KDjVu::Private::generateImageTile( ddjvu_page_t *djvupage, int& res,
 #ifdef KDJVU_DEBUG
     kDebug() << "pagerect:" << pagerect;
 #endif
+    m_messagesMutex.lock();
     handle_ddjvu_messages( m_djvu_cxt, false );
+    m_messagesMutex.unlock();
     QImage res_img( realwidth, realheight, QImage::Format_RGB32 );
     // the following line workarounds a rare crash in djvulibre;
     // it should be fixed with >= 3.5.21
@@ -497,11 +671,50 @@ QImage KDjVu::Private::generateImageTile( ddjvu_page_t *djvupage, int& res,
 #ifdef KDJVU_DEBUG
     kDebug() << "rendering result:" << res;
 #endif
+    m_messagesMutex.lock();
     handle_ddjvu_messages( m_djvu_cxt, false );
+    m_messagesMutex.unlock();
 
     return res_img;
 }
 
+int KDjVu::Private::generateImageTiles( ddjvu_page_t *djvupage, QImage &image,
+    int width, int xparts, int xdelta, int height, int yparts, int ydelta )
+{
+    TilesJob job( this, djvupage, &image, width, xparts, xdelta, height, yparts, ydelta );
+
+    // every tile is rendered by its own ddjvu_page_render() call on the
+    // same decoded page: ask for help only the threads free now, as the
+    // calling thread renders the tiles left anyway; note that QThreadPool
+    // starts a thread when it has none, even with a maximum of zero
+    if ( m_tilesThreadPool && m_tilesThreadPool->maxThreadCount() > 0 )
+    {
+        for ( int i = 1; i < xparts * yparts; ++i )
+        {
+            TilesHelper *helper = new TilesHelper( &job );
+            job.mutex.lock();
+            ++job.helpers;
+            job.mutex.unlock();
+            if ( !m_tilesThreadPool->tryStart( helper ) )
+            {
+                delete helper;
+                job.mutex.lock();
+                --job.helpers;
+                job.mutex.unlock();
+                break;
+            }
+        }
+    }
+
+    job.renderTiles();
+
+    // the helpers use the job until they are done
+    QMutexLocker locker( &job.mutex );
+    while ( job.helpers > 0 )
+        job.helpersDone.wait( &job.mutex );
+    return job.res;
+}
+
 void KDjVu::Private::readBookmarks()
 {
     if ( !m_djvu_document )
@@ -682,8 +895,6 @@ bool KDjVu::openFile( const QString & fileName )
     int numofpages = ddjvu_document_get_pagenum( d->m_djvu_document );
     d->m_pages.clear();
     d->m_pages.resize( numofpages );
-    d->m_pages_cache.clear();
-    d->m_pages_cache.resize( numofpages );
 
     // get the document type
     QString doctype;
@@ -754,13 +965,13 @@ void KDjVu::closeFile()
     qDeleteAll( d->m_pages );
     d->m_pages.clear();
     // releasing the djvu pages
-    QVector<ddjvu_page_t *>::Iterator it = d->m_pages_cache.begin(), itEnd = d->m_pages_cache.end();
-    for ( ; it != itEnd; ++it )
-        ddjvu_page_release( *it );
-    d->m_pages_cache.clear();
+    d->m_pagesCache.clear();
+    delete d->m_lastPage;
+    d->m_lastPage = 0;
+    d->m_lastPageNumber = -1;
     // clearing the image cache
-    qDeleteAll( d->mImgCache );
-    d->mImgCache.clear();
+    d->m_imgCache.clear();
+    d->updateCacheMemory();
     // clearing the old metadata
     d->m_metaData.clear();
     // cleaing the page names mapping
@@ -909,39 +1120,36 @@ QImage KDjVu::image( int page, int width, int height, int rotation )
 {
     if ( d->m_cacheEnabled )
     {
-    bool found = false;
-    QList<ImageCacheItem*>::Iterator it = d->mImgCache.begin(), itEnd = d->mImgCache.end();
-    for ( ; ( it != itEnd ) && !found; ++it )
-    {
-        ImageCacheItem* cur = *it;
-        if ( ( cur->page == page ) &&
-             ( rotation % 2 == 0
-               ? cur->width == width && cur->height == height
-               : cur->width == height && cur->height == width ) )
-            found = true;
+        const ImageCacheKey key = rotation % 2 == 0
+                                  ? ImageCacheKey( page, width, height )
+                                  : ImageCacheKey( page, height, width );
+        // looking up the image also makes it the most recently used one
+        const QImage *cached = d->m_imgCache.object( key );
+        if ( cached )
+            return *cached;
     }
-    if ( found )
-    {
-        // taking the element and pushing to the top of the list
-        --it;
-        ImageCacheItem* cur2 = *it;
-        d->mImgCache.erase( it );
-        d->mImgCache.push_front( cur2 );
 
-        return cur2->img;
-    }
+    // take the decoded page out of the cache while rendering it, so it is
+    // not evicted meanwhile; it becomes the most recently decoded one
+    DecodedPage *decoded = 0;
+    if ( d->m_lastPage && d->m_lastPageNumber == page )
+    {
+        decoded = d->m_lastPage;
+        d->m_lastPage = 0;
     }
-
-    if ( !d->m_pages_cache.at( page ) )
+    else
+        decoded = d->m_pagesCache.take( page );
+    if ( !decoded )
     {
         ddjvu_page_t *newpage = ddjvu_page_create_by_pageno( d->m_djvu_document, page );
         // wait for the new page to be loaded
         ddjvu_status_t sts;
         while ( ( sts = ddjvu_page_decoding_status( newpage ) ) < DDJVU_JOB_OK )
             handle_ddjvu_messages( d->m_djvu_cxt, true );
-        d->m_pages_cache[page] = newpage;
+        decoded = new DecodedPage( newpage );
     }
-    ddjvu_page_t *djvupage = d->m_pages_cache[page];
+    d->updateCacheMemory( decoded );
+    ddjvu_page_t *djvupage = decoded->page;
 
 /*
     if ( ddjvu_page_get_rotation( djvupage ) != flipRotation( rotation ) )
@@ -972,25 +1180,17 @@ QImage KDjVu::image( int page, int width, int height, int rotation )
         // more than one part -- need to render piece-by-piece and to compose
         // the results
         newimg = QImage( width, height, QImage::Format_RGB32 );
-        QPainter p;
-        p.begin( &newimg );
-        int parts = xparts * yparts;
-        for ( int i = 0; i < parts; ++i )
-        {
-            int row = i % xparts;
-            int col = i / xparts;
-            int tmpres = 0;
-            QImage tempp = d->generateImageTile( djvupage, tmpres,
-                    width, row, xdelta, height, col, ydelta );
-            if ( tmpres )
-            {
-                p.drawImage( row * xdelta, col * ydelta, tempp );
-            }
-            res = qMin( tmpres, res );
-        }
-        p.end();
+        res = d->generateImageTiles( djvupage, newimg,
+                width, xparts, xdelta, height, yparts, ydelta );
     }
 
+    // the previous most recently decoded page goes to the cache, which
+    // releases it now if it is bigger than the whole cache
+    if ( d->m_lastPage )
+        d->m_pagesCache.insert( d->m_lastPageNumber, d->m_lastPage, d->m_lastPage->cost() );
+    d->m_lastPage = decoded;
+    d->m_lastPageNumber = page;
+
     if ( res && d->m_cacheEnabled )
     {
         // delete all the cached pixmaps for the current page with a size that
@@ -998,29 +1198,20 @@ QImage KDjVu::image( int page, int width, int height, int rotation )
         int imgsize = newimg.width() * newimg.height();
         if ( imgsize > 0 )
         {
-            for( int i = 0; i < d->mImgCache.count(); )
+            foreach ( const ImageCacheKey &key, d->m_imgCache.keys() )
             {
-                ImageCacheItem* cur = d->mImgCache.at(i);
-                if ( ( cur->page == page ) &&
-                     ( abs( cur->img.width() * cur->img.height() - imgsize ) < imgsize * 0.35 ) )
-                {
-                    d->mImgCache.removeAt( i );
-                    delete cur;
-                }
-                else
-                    ++i;
+                if ( key.page != page )
+                    continue;
+
+                const QImage *cur = d->m_imgCache.object( key );
+                if ( abs( cur->width() * cur->height() - imgsize ) < imgsize * 0.35 )
+                    d->m_imgCache.remove( key );
             }
         }
 
-        // the image cache has too many elements, remove the last
-        if ( d->mImgCache.size() >= 10 )
-        {
-            delete d->mImgCache.last();
-            d->mImgCache.removeLast();
-        }
-        ImageCacheItem* ich = new ImageCacheItem( page, width, height, newimg );
-        d->mImgCache.push_front( ich );
+        d->m_imgCache.insert( ImageCacheKey( page, width, height ), new QImage( newimg ), imageCost( newimg ) );
     }
+    d->updateCacheMemory();
 
     return newimg;
 }
@@ -1137,11 +1328,7 @@ void KDjVu::setCacheEnabled( bool enable )
         return;
 
     d->m_cacheEnabled = enable;
-    if ( !d->m_cacheEnabled )
-    {
-        qDeleteAll( d->mImgCache );
-        d->mImgCache.clear();
-    }
+    d->updateCacheCosts();
 }
 
 bool KDjVu::isCacheEnabled() const
@@ -1149,6 +1336,57 @@ bool KDjVu::isCacheEnabled() const
     return d->m_cacheEnabled;
 }
 
+void KDjVu::setTilesThreadPool( QThreadPool *pool )
+{
+    d->m_tilesThreadPool = pool;
+}
+
+void KDjVu::setCacheBudget( qulonglong bytes )
+{
+    d->m_cacheBudget = bytes;
+    d->updateCacheCosts();
+}
+
+qulonglong KDjVu::cacheBudget() const
+{
+    return d->m_cacheBudget;
+}
+
+qulonglong KDjVu::cacheMemory() const
+{
+    return (qulonglong)(int)d->m_cacheMemory * 1024;
+}
+
+qulonglong KDjVu::freeCacheMemory( qulonglong bytes )
+{
+    // the most recently decoded page is kept anyway, it is very likely
+    // needed again right away (tiles, zoom steps)
+    const qulonglong before = cacheMemory();
+    if ( bytes >= before )
+    {
+        d->m_imgCache.clear();
+        d->m_pagesCache.clear();
+        d->updateCacheMemory();
+        return before - cacheMemory();
+    }
+
+    // shrinking a QCache evicts its least recently used entries; the
+    // rendered images go first, the decoded pages are needed to render anything
+    const int pagesMaxCost = d->m_pagesCache.maxCost();
+    const int imgMaxCost = d->m_imgCache.maxCost();
+    int toFree = kibCost( bytes ) + 1;
+    const int imgFree = qMin( toFree, d->m_imgCache.totalCost() );
+    d->m_imgCache.setMaxCost( d->m_imgCache.totalCost() - imgFree );
+    toFree -= imgFree;
+    if ( toFree > 0 )
+        d->m_pagesCache.setMaxCost( qMax( 0, d->m_pagesCache.totalCost() - toFree ) );
+    d->m_pagesCache.setMaxCost( pagesMaxCost );
+    d->m_imgCache.setMaxCost( imgMaxCost );
+    d->updateCacheMemory();
+
+    return before - cacheMemory();
+}
+
 int KDjVu::pageNumber( const QString & name ) const
 {
     if ( !d->m_djvu_document )
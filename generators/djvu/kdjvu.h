@@ -20,6 +20,7 @@
 
 class QDomDocument;
 class QFile;
+class QThreadPool;
 
 #ifndef MINIEXP_H
 typedef struct miniexp_s* miniexp_t;
@@ -251,9 +252,8 @@ class KDjVu
         void linksAndAnnotationsForPage( int pageNum, QList<KDjVu::Link*> *links, QList<KDjVu::Annotation*> *annotations ) const;
 
         /**
-         * Check if the image for the specified \p page with the specified
-         * \p width, \p height and \p rotation is already in cache, and returns
-         * it. If not, a null image is returned.
+         * Render the specified \p page with the specified \p width, \p height
+         * and \p rotation, unless the image is already in cache.
          */
         QImage image( int page, int width, int height, int rotation );
 
@@ -284,6 +284,35 @@ class KDjVu
          */
         bool isCacheEnabled() const;
 
+        /**
+         * Set the thread \p pool whose free threads help rendering the tiles of
+         * the big pages; without one, the tiles are rendered one after the other.
+         */
+        void setTilesThreadPool( QThreadPool *pool );
+
+        /**
+         * Set the memory, in bytes, the decoded pages and the rendered pages
+         * can take at most; the least recently used ones are released first,
+         * while the most recently decoded page is always kept.
+         */
+        void setCacheBudget( qulonglong bytes );
+        /**
+         * \returns the memory budget of the caches, in bytes
+         */
+        qulonglong cacheBudget() const;
+        /**
+         * \returns the memory currently taken by the caches and by the page
+         * being rendered, in bytes; unlike the other methods, this can be
+         * called while another thread renders
+         */
+        qulonglong cacheMemory() const;
+        /**
+         * Release the least recently used cached pages until at least \p bytes
+         * have been freed, or only the most recently decoded page is left.
+         * \returns the memory actually freed, in bytes
+         */
+        qulonglong freeCacheMemory( qulonglong bytes );
+
         /**
          * Return the page number of the page whose title is \p name.
          */
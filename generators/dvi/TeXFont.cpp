@@ -2,7 +2,22 @@
 #include <config.h>
 
 #include "TeXFont.h"
+#include "fontpool.h"
 
 
 TeXFont::~TeXFont()
-{}
+{
+  parent->font_pool->removeGlyphs(this);
+}
+
+
+bool TeXFont::restoreGlyph(quint16 ch, const QColor& color)
+{
+  return parent->font_pool->findGlyph(this, ch, parent->displayResolution_in_dpi, color, glyphtable+ch);
+}
+
+
+void TeXFont::storeGlyph(quint16 ch)
+{
+  parent->font_pool->insertGlyph(this, ch, parent->displayResolution_in_dpi, glyphtable+ch);
+}
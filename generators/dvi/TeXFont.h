@@ -41,6 +41,16 @@ class TeXFont {
   QString            errorMessage;
 
  protected:
+  /** Restores the pixmap of the character @p ch, rasterized at the
+      current display resolution in the color @p color, from the glyph
+      cache of the font pool. Returns false if it is not cached. */
+  bool restoreGlyph(quint16 ch, const QColor& color);
+
+  /** Stores the pixmap of the character @p ch, just rasterized at the
+      current display resolution, in the glyph cache of the font
+      pool. */
+  void storeGlyph(quint16 ch);
+
   glyph              glyphtable[TeXFontDefinition::max_num_of_chars_in_font];
   TeXFontDefinition *parent;
 };
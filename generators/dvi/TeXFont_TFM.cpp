@@ -133,7 +133,8 @@ glyph* TeXFont_TFM::getGlyph(quint16 characterCode, bool generateCharacterPixmap
   // This is the address of the glyph that will be returned.
   class glyph *g = glyphtable+characterCode;
 
-  if ((generateCharacterPixmap == true) && ((g->shrunkenCharacter.isNull()) || (color != g->color)) ) {
+  if ((generateCharacterPixmap == true) && ((g->shrunkenCharacter.isNull()) || (color != g->color)) &&
+      (restoreGlyph(characterCode, color) == false)) {
     g->color = color;
     quint16 pixelWidth = (quint16)(parent->displayResolution_in_dpi *
                                      design_size_in_TeX_points.toDouble() *
@@ -153,6 +154,7 @@ glyph* TeXFont_TFM::getGlyph(quint16 characterCode, bool generateCharacterPixmap
     g->shrunkenCharacter.fill(color.rgba());
     g->x2 = 0;
     g->y2 = pixelHeight;
+    storeGlyph(characterCode);
   }
 
   return g;
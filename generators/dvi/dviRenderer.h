@@ -128,6 +128,13 @@ public:
 
   void setEventLoop(QEventLoop *el);
 
+  /** The glyph cache of the font pool, which keeps the glyphs
+      rasterized at all the resolutions the pages are drawn at. See
+      fontPool::setGlyphCacheSize() and the following methods. */
+  void       setGlyphCacheSize(qulonglong bytes) {font_pool.setGlyphCacheSize(bytes);}
+  qulonglong glyphCacheMemory() const {return font_pool.glyphCacheMemory();}
+  qulonglong freeGlyphCache(qulonglong memoryToFree) {return font_pool.freeGlyphCache(memoryToFree);}
+
 #if 0
   /** Called by the exporter or editor in order to update the
    *  contents of the global info dialog with @c text.
@@ -150,6 +157,7 @@ public:
   void          html_href_special(const QString& msg);
   void          html_anchor_end();
   void          draw_page();
+  void          draw_text();
   void          export_finished(const DVIExport*);
 //void          editor_finished(const DVISourceEditor*);
 
@@ -613,7 +613,11 @@ void dviRenderer::draw_page()
   }
 #endif
 
-  // Render the PostScript background, if there is one.
+  // Render the PostScript background, if there is one. If ghostscript
+  // has to render it, the text is drawn meanwhile into a layer of its
+  // own, which is put on top of the background afterwards.
+  QPainter *pagePainter = foreGroundPainter;
+  QImage textLayer;
   if (_postscript)
   {
 #if 0
@@ -628,9 +632,31 @@ void dviRenderer::draw_page()
 #endif
       PS_interface->restoreBackgroundColor(current_page);
 
-    PS_interface->graphics(current_page, resolutionInDPI, dviFile->getMagnification(), foreGroundPainter);
+    const QSize pageSize = pagePainter->viewport().size();
+    if (PS_interface->requestGraphics(current_page, resolutionInDPI, dviFile->getMagnification(), pageSize))
+    {
+      textLayer = QImage(pageSize, QImage::Format_ARGB32_Premultiplied);
+      textLayer.fill(0);
+      foreGroundPainter = new QPainter(&textLayer);
+    }
+    else
+      PS_interface->graphics(current_page, resolutionInDPI, dviFile->getMagnification(), pagePainter);
+  }
+
+  draw_text();
+
+  if (foreGroundPainter != pagePainter)
+  {
+    delete foreGroundPainter;
+    foreGroundPainter = pagePainter;
+    PS_interface->graphics(current_page, resolutionInDPI, dviFile->getMagnification(), pagePainter);
+    pagePainter->drawImage(0, 0, textLayer);
   }
+}
 
+
+void dviRenderer::draw_text()
+{
   // Now really write the text
   if (dviFile->page_offset.isEmpty() == true)
     return;
@@ -17,11 +17,16 @@
 #include <QApplication>
 #include <QPainter>
 
+#include <climits>
+
 #include <cmath>
 #include <math.h>
 
 //#define DEBUG_FONTPOOL
 
+// Memory used by the glyph cache, unless set otherwise
+static const int defaultGlyphCacheSize = 16 * 1024 * 1024;
+
 
 // List of permissible MetaFontModes which are supported by kdvi.
 
@@ -54,6 +59,7 @@ fontPool::fontPool(bool useFontHinting)
   useFontHints             = useFontHinting;
   CMperDVIunit             = 0;
   extraSearchPath.clear();
+  glyphCache.setMaxCost(defaultGlyphCacheSize);
 
 #ifdef HAVE_FREETYPE
   // Initialize the Freetype Library
@@ -107,6 +113,9 @@ fontPool::~fontPool()
   kDebug(kvs::dvi) << "fontPool::~fontPool() called";
 #endif
 
+  // no need to look up the glyphs of every font being deleted
+  glyphCache.clear();
+
   // need to manually clear the fonts _before_ freetype gets unloaded
   qDeleteAll(fontList);
   fontList.clear();
@@ -122,6 +131,8 @@ void fontPool::setParameters( bool _useFontHints )
 {
   // Check if glyphs need to be cleared
   if (_useFontHints != useFontHints) {
+    glyphCache.clear();
+    glyphCacheChanged();
     double displayResolution = displayResolution_in_dpi;
     QList<TeXFontDefinition*>::iterator it_fontp = fontList.begin();
     for (; it_fontp != fontList.end(); ++it_fontp) {
@@ -470,6 +481,79 @@ void fontPool::release_fonts()
 }
 
 
+bool fontPool::findGlyph(const TeXFont *font, quint16 ch, double resolution_in_dpi, const QColor &color, glyph *g)
+{
+  const glyphCacheKey key = { font, ch, qRound(resolution_in_dpi), color.rgba() };
+  const cachedGlyph *cached = glyphCache.object(key);
+  if (cached == 0)
+    return false;
+
+  g->color             = color;
+  g->shrunkenCharacter = cached->shrunkenCharacter;
+  g->x2                = cached->x2;
+  g->y2                = cached->y2;
+  return true;
+}
+
+
+void fontPool::insertGlyph(const TeXFont *font, quint16 ch, double resolution_in_dpi, const glyph *g)
+{
+  const glyphCacheKey key = { font, ch, qRound(resolution_in_dpi), g->color.rgba() };
+  cachedGlyph *cached = new cachedGlyph;
+  // The image data is shared with the glyph table of the font
+  cached->shrunkenCharacter = g->shrunkenCharacter;
+  cached->x2                = g->x2;
+  cached->y2                = g->y2;
+  glyphCache.insert(key, cached, g->shrunkenCharacter.byteCount());
+  glyphCacheChanged();
+}
+
+
+void fontPool::removeGlyphs(const TeXFont *font)
+{
+  foreach(const glyphCacheKey &key, glyphCache.keys())
+    if (key.font == font)
+      glyphCache.remove(key);
+  glyphCacheChanged();
+}
+
+
+void fontPool::setGlyphCacheSize(qulonglong bytes)
+{
+  glyphCache.setMaxCost((int)qMin(bytes, (qulonglong)INT_MAX));
+  glyphCacheChanged();
+}
+
+
+qulonglong fontPool::glyphCacheMemory() const
+{
+  return (int)glyphCacheBytes;
+}
+
+
+qulonglong fontPool::freeGlyphCache(qulonglong memoryToFree)
+{
+  // Shrinking the cache drops the least recently used glyphs first
+  const int maxCost = glyphCache.maxCost();
+  const int memory  = glyphCache.totalCost();
+  glyphCache.setMaxCost(memory - (int)qMin(memoryToFree, (qulonglong)memory));
+  glyphCache.setMaxCost(maxCost);
+  glyphCacheChanged();
+
+  // The glyph tables of the fonts share the images of the glyphs last
+  // drawn, which would stay in memory after being dropped from the
+  // cache; the fonts take them again from the cache when needed.
+  QList<TeXFontDefinition*>::iterator it_fontp = fontList.begin();
+  for (; it_fontp != fontList.end(); ++it_fontp) {
+    TeXFontDefinition *fontp = *it_fontp;
+    if (fontp->font != 0)
+      fontp->font->setDisplayResolution();
+  }
+
+  return memory - glyphCache.totalCost();
+}
+
+
 void fontPool::mf_output_receiver()
 {
   const QString output_data =
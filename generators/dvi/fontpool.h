@@ -12,6 +12,10 @@
 #include "fontprogress.h"
 #include "TeXFontDefinition.h"
 
+#include <QAtomicInt>
+#include <QCache>
+#include <QColor>
+#include <QImage>
 #include <QList>
 #include <QObject>
 #include <QProcess>
@@ -21,6 +25,35 @@
 #include FT_FREETYPE_H
 #endif
 
+class glyph;
+class TeXFont;
+
+
+/**
+ * Key of the glyph cache of the fontPool. Glyphs are rasterized for
+ * one resolution and one color, so these are part of the key. The
+ * resolution is rounded to whole dpi, a difference which would
+ * hardly be visible anyway.
+ **/
+
+struct glyphCacheKey {
+  const TeXFont *font;
+  quint16 character;
+  int resolution_in_dpi;
+  QRgb color;
+};
+
+inline bool operator==(const glyphCacheKey &a, const glyphCacheKey &b)
+{
+  return a.font == b.font && a.character == b.character
+    && a.resolution_in_dpi == b.resolution_in_dpi && a.color == b.color;
+}
+
+inline uint qHash(const glyphCacheKey &key)
+{
+  return qHash(key.font) ^ (key.character << 16) ^ (key.resolution_in_dpi << 4) ^ key.color;
+}
+
 
 /**
  *  A list of fonts and a compilation of utility functions
@@ -94,6 +127,38 @@ public:
       mark_fonts_as_unused method. */
   void release_fonts();
 
+  /** Looks up the pixmap of the character @p ch of @p font, rasterized
+      at the resolution @p resolution_in_dpi in the color @p color, in
+      the glyph cache. If it is found, the shrunken character and its
+      offsets are copied to @p g, and true is returned.
+
+      The glyph cache is shared by all the resolutions the pages are
+      rendered at, e.g. for the thumbnails and the page view, so that
+      switching between them does not rasterize the glyphs again. */
+  bool findGlyph(const TeXFont *font, quint16 ch, double resolution_in_dpi, const QColor &color, glyph *g);
+
+  /** Stores the shrunken character of @p g, the character @p ch of @p
+      font rasterized at the resolution @p resolution_in_dpi, in the
+      glyph cache. */
+  void insertGlyph(const TeXFont *font, quint16 ch, double resolution_in_dpi, const glyph *g);
+
+  /** Removes all the glyphs of @p font from the glyph cache. Called
+      when the font is deleted. */
+  void removeGlyphs(const TeXFont *font);
+
+  /** Sets the maximal memory, in bytes, used by the glyph cache. The
+      least recently used glyphs are dropped to stay within it. */
+  void setGlyphCacheSize(qulonglong bytes);
+
+  /** Returns the memory, in bytes, used by the glyph cache. Unlike the
+      other methods, this can be called while another thread draws. */
+  qulonglong glyphCacheMemory() const;
+
+  /** Drops the least recently used glyphs from the glyph cache, until
+      at least @p memoryToFree bytes are freed or the cache is
+      empty. Returns the memory actually freed, in bytes. */
+  qulonglong freeGlyphCache(qulonglong memoryToFree);
+
 #ifdef HAVE_FREETYPE
   /** A handle to the FreeType library, which is used by TeXFont_PFM
       font objects, if KDVI is compiled with FreeType support.  */
@@ -158,6 +223,20 @@ private:
   // Number of centimeters per DVI unit
   double CMperDVIunit;
 
+  // The pixmap of a glyph, as stored in the glyph cache
+  struct cachedGlyph {
+    QImage shrunkenCharacter;
+    short  x2, y2;
+  };
+
+  // The glyphs rasterized so far, at all the resolutions used. The
+  // cost of a glyph is the memory used by its pixmap.
+  QCache<glyphCacheKey, cachedGlyph> glyphCache;
+
+  // The total cost of glyphCache, updated after each change to it
+  QAtomicInt glyphCacheBytes;
+  void glyphCacheChanged() {glyphCacheBytes = glyphCache.totalCost();}
+
 
   /** Members used for font location */
 
@@ -121,6 +121,12 @@ bool DviGenerator::loadDocument( const QString & fileName, QVector< Okular::Page
 
     kDebug(DviDebug) << "# of pages:" << m_dviRenderer->dviFile->total_pages;
 
+    // the glyphs are kept for all the resolutions the pages are drawn at
+    // a budget of 0 is honoured, only a missing one keeps the default
+    const QVariant budget = documentMetaData( "CacheMemoryBudget" );
+    if ( budget.isValid() )
+        m_dviRenderer->setGlyphCacheSize( budget.toULongLong() );
+
     m_resolution = Okular::Utils::dpiY();
     loadPages( pagesVector );
 
@@ -273,6 +279,23 @@ QImage DviGenerator::image( Okular::PixmapRequest *request )
     return ret;
 }
 
+qulonglong DviGenerator::cacheMemory() const
+{
+    return m_dviRenderer ? m_dviRenderer->glyphCacheMemory() : 0;
+}
+
+qulonglong DviGenerator::freeCacheMemory( qulonglong memoryToFree )
+{
+    // the glyphs are in use while drawing a page, and this is called from
+    // the GUI thread, so try again later rather than wait for the drawing
+    if ( !m_dviRenderer || !userMutex()->tryLock() )
+        return 0;
+
+    const qulonglong freed = m_dviRenderer->freeGlyphCache( memoryToFree );
+    userMutex()->unlock();
+    return freed;
+}
+
 Okular::TextPage* DviGenerator::textPage( Okular::Page *page )
 {
     kDebug(DviDebug);
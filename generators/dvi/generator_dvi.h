@@ -48,6 +48,10 @@ class DviGenerator : public Okular::Generator
         QImage image( Okular::PixmapRequest * request );
         Okular::TextPage* textPage( Okular::Page *page );
 
+    protected slots:
+        qulonglong cacheMemory() const;
+        qulonglong freeCacheMemory( qulonglong memoryToFree );
+
     private:
         double m_resolution;
         bool m_fontExtracted;
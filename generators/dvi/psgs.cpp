@@ -18,9 +18,11 @@
 #include <klocale.h>
 #include <kmessagebox.h>
 #include <kprocess.h>
+#include <ktempdir.h>
 #include <ktemporaryfile.h>
 #include <kurl.h>
 
+#include <QCryptographicHash>
 #include <QDir>
 #include <QPainter>
 #include <QPixmap>
@@ -31,6 +33,18 @@
 
 //extern char psheader[];
 
+// Memory used by the figure cache, in bytes
+static const int figureCacheSize = 32 * 1024 * 1024;
+
+// How long ghostscript may take to render a page, in milliseconds
+static const int workerTimeout = 30000;
+
+static QByteArray figureKey(const QByteArray &PostScript, double resolution, int width, int height)
+{
+  return QCryptographicHash::hash(PostScript, QCryptographicHash::Md5)
+    + QString(" %1 %2x%3").arg(resolution).arg(width).arg(height).toLatin1();
+}
+
 pageInfo::pageInfo(const QString& _PostScriptString) {
   PostScriptString = new QString(_PostScriptString);
   background  = Qt::white;
@@ -46,9 +60,182 @@ pageInfo::~pageInfo() {
 
 // ======================================================
 
-ghostscript_interface::ghostscript_interface() {
+figureJob::figureJob()
+  : resolution(0), workerFailed(false), finished(false)
+{
+}
+
+
+ghostscriptWorker::ghostscriptWorker(const QString &_device)
+  : device(_device), stopping(false), failed(false)
+{
+  start();
+}
+
+
+ghostscriptWorker::~ghostscriptWorker()
+{
+  mutex.lock();
+  stopping = true;
+  jobQueued.wakeAll();
+  mutex.unlock();
+  wait();
+}
+
+
+void ghostscriptWorker::render(figureJob *job)
+{
+  QMutexLocker locker(&mutex);
+  if (failed) {
+    job->workerFailed = true;
+    job->finished = true;
+    return;
+  }
+  jobs.append(job);
+  jobQueued.wakeAll();
+}
+
+
+bool ghostscriptWorker::waitFor(figureJob *job)
+{
+  QMutexLocker locker(&mutex);
+  while (!job->finished)
+    jobFinished.wait(&mutex);
+  return !job->workerFailed;
+}
+
+
+void ghostscriptWorker::run()
+{
+  // Ghostscript writes the pages here, one at a time
+  KTempDir outputDir;
+  KProcess *gs = 0;
+  QString gsIncludePath;
+
+  forever {
+    mutex.lock();
+    while (jobs.isEmpty() && !stopping)
+      jobQueued.wait(&mutex);
+    if (stopping) {
+      mutex.unlock();
+      break;
+    }
+    figureJob *job = jobs.first();
+    mutex.unlock();
+
+    // The files ghostscript may read are fixed when it is started
+    if ((gs != 0) && ((gs->state() != QProcess::Running) || (gsIncludePath != job->includePath))) {
+      delete gs;
+      gs = 0;
+    }
+    if (gs == 0) {
+      gsIncludePath = job->includePath;
+      gs = new KProcess;
+      gs->setOutputChannelMode(KProcess::SeparateChannels);
+      *gs << "gs";
+      *gs << "-dSAFER" << "-dPARANOIDSAFER" << "-dDELAYSAFER" << "-dNOPAUSE" << "-q";
+      *gs << QString("-sDEVICE=%1").arg(device);
+      *gs << QString("-sOutputFile=%1figure%d").arg(outputDir.name());
+      *gs << QString("-sExtraIncludePath=%1").arg(gsIncludePath);
+      *gs << "-dTextAlphaBits=4" << "-dGraphicsAlphaBits=2"; // Antialiasing
+      *gs << "-c" << "<< /PermitFileReading [ ExtraIncludePath ] /PermitFileWriting [] /PermitFileControl [] >> setuserparams .locksafe";
+      *gs << "-f" << "-";
+#ifdef DEBUG_PSGS
+      kDebug(kvs::dvi) << gs->program().join(" ");
+#endif
+      gs->start();
+    }
+
+    const bool ok = gs->waitForStarted() && renderJob(gs, outputDir.name(), job);
+    if (!ok) {
+      kError(kvs::dvi) << "The ghostscript process failed, it will be started for every page from now on." << endl;
+      delete gs;
+      gs = 0;
+    }
+
+    mutex.lock();
+    jobs.removeFirst();
+    job->finished = true;
+    if (!ok) {
+      failed = true;
+      job->workerFailed = true;
+      foreach(figureJob *queued, jobs) {
+        queued->workerFailed = true;
+        queued->finished = true;
+      }
+      jobs.clear();
+    }
+    jobFinished.wakeAll();
+    mutex.unlock();
+  }
+
+  if (gs != 0) {
+    gs->closeWriteChannel();
+    if (!gs->waitForFinished(1000))
+      gs->kill();
+    delete gs;
+  }
+}
+
+
+bool ghostscriptWorker::renderJob(KProcess *gs, const QString &outputDir, figureJob *job)
+{
+  QDir dir(outputDir);
+  foreach(const QString &file, dir.entryList(QDir::Files))
+    dir.remove(file);
+
+  // Every page is run in a save level of its own, and read through a
+  // filter, so that after an error the rest of the page is skipped
+  // and the interpreter is left as it was for the following pages.
+  QByteArray data;
+  data += "/OkularSave save def\n";
+  data += QString("<< /HWResolution [%1 %1] /PageSize [%2 %3] >> setpagedevice\n")
+    .arg(job->resolution)
+    .arg(72*job->size.width()/job->resolution)
+    .arg(72*job->size.height()/job->resolution).toLatin1();
+  data += "/OkularRun { currentfile 0 (%%OkularEndOfJob) /SubFileDecode filter "
+          "dup /OkularJob exch def cvx stopped { OkularJob flushfile } if } def\n"
+          "OkularRun\n";
+  data += job->PostScript;
+  data += "\n%%OkularEndOfJob\n"
+          "clear cleardictstack OkularSave restore\n"
+          "(\\n%%OkularDone\\n) print flush\n";
+
+  if (gs->write(data) != data.size())
+    return false;
+
+  QByteArray output;
+  while (!output.contains("%%OkularDone")) {
+    if (!gs->waitForReadyRead(workerTimeout))
+      return false;
+    output += gs->readAllStandardOutput();
+  }
+  const QByteArray errors = gs->readAllStandardError();
+#ifdef DEBUG_PSGS
+  kDebug(kvs::dvi) << output << errors;
+#else
+  Q_UNUSED(errors);
+#endif
+
+  const QStringList files = dir.entryList(QDir::Files);
+  if (files.isEmpty())
+    kError(kvs::dvi) << "GS did not produce output." << endl;
+  else
+    job->image = QImage(dir.absoluteFilePath(files.first()));
+  return true;
+}
+
+
+// ======================================================
+
+ghostscript_interface::ghostscript_interface()
+  : worker(0),
+    workerFailed(false),
+    pendingJob(0)
+{
 
   PostScriptHeaderString = new QString();
+  figureCache.setMaxCost(figureCacheSize);
 
   knownDevices.append("png16m");
   knownDevices.append("jpeg");
@@ -58,6 +245,12 @@ ghostscript_interface::ghostscript_interface() {
 }
 
 ghostscript_interface::~ghostscript_interface() {
+  if (pendingJob != 0) {
+    bool failed;
+    takePendingFigure(&failed);
+  }
+  delete worker;
+
   if (PostScriptHeaderString != 0L)
     delete PostScriptHeaderString;
   qDeleteAll(pageList);
@@ -142,30 +335,15 @@ void ghostscript_interface::clear() {
   // Deletes all items, removes temporary files, etc.
   qDeleteAll(pageList);
   pageList.clear();
+  figureCache.clear();
 }
 
 
-void ghostscript_interface::gs_generate_graphics_file(const PageNumber& page, const QString& filename, long magnification) {
-#ifdef DEBUG_PSGS
-  kDebug(kvs::dvi) << "ghostscript_interface::gs_generate_graphics_file( " << page << ", " << filename << " )";
-#endif
-
-  if (knownDevices.isEmpty()) {
-    kError(kvs::dvi) << "No known devices found" << endl;
-    return;
-  }
-
+QByteArray ghostscript_interface::PostScriptDocument(const PageNumber& page, long magnification) const {
   pageInfo *info = pageList.value(page);
 
-  // Generate a PNG-file
-  // Step 1: Write the PostScriptString to a File
-  KTemporaryFile PSfile;
-  PSfile.setAutoRemove(false);
-  PSfile.setSuffix(".ps");
-  PSfile.open();
-  const QString PSfileName = PSfile.fileName();
-
-  QTextStream os(&PSfile);
+  QByteArray PostScript;
+  QTextStream os(&PostScript, QIODevice::WriteOnly);
   os << "%!PS-Adobe-2.0\n"
      << "%%Creator: kdvi\n"
      << "%%Title: KDVI temporary PostScript\n"
@@ -210,7 +388,30 @@ void ghostscript_interface::gs_generate_graphics_file(const PageNumber& page, co
 
   os << "end\n"
      << "showpage \n";
+  os.flush();
+
+  return PostScript;
+}
+
+
+void ghostscript_interface::gs_generate_graphics_file(const PageNumber& page, const QString& filename, long magnification) {
+#ifdef DEBUG_PSGS
+  kDebug(kvs::dvi) << "ghostscript_interface::gs_generate_graphics_file( " << page << ", " << filename << " )";
+#endif
 
+  if (knownDevices.isEmpty()) {
+    kError(kvs::dvi) << "No known devices found" << endl;
+    return;
+  }
+
+  // Generate a PNG-file
+  // Step 1: Write the PostScriptString to a File
+  KTemporaryFile PSfile;
+  PSfile.setAutoRemove(false);
+  PSfile.setSuffix(".ps");
+  PSfile.open();
+  const QString PSfileName = PSfile.fileName();
+  PSfile.write(PostScriptDocument(page, magnification));
   PSfile.close();
 
   // Step 2: Call GS with the File
@@ -321,6 +522,54 @@ void ghostscript_interface::graphics(const PageNumber& page, double dpi, long ma
     return;
   }
 
+  const QImage MemoryCopy = figure(page, magnification);
+  paint->drawImage(0, 0, MemoryCopy);
+  return;
+}
+
+
+bool ghostscript_interface::requestGraphics(const PageNumber& page, double dpi, long magnification, const QSize& size) {
+#ifdef DEBUG_PSGS
+  kDebug(kvs::dvi) << "ghostscript_interface::requestGraphics( " << page << ", " << dpi << ", ... ) called.";
+#endif
+
+  pageInfo *info = pageList.value(page);
+  if ((info == 0) || (info->PostScriptString->isEmpty()) || workerFailed || knownDevices.isEmpty())
+    return false;
+
+  resolution   = dpi;
+  pixel_page_w = size.width();
+  pixel_page_h = size.height();
+
+  const QByteArray PostScript = PostScriptDocument(page, magnification);
+  const QByteArray key = figureKey(PostScript, resolution, pixel_page_w, pixel_page_h);
+  if (figureCache.contains(key))
+    return false;
+
+  if ((pendingJob == 0) || (pendingKey != key))
+    startFigure(PostScript, key);
+  return true;
+}
+
+
+QImage ghostscript_interface::figure(const PageNumber& page, long magnification) {
+  const QByteArray PostScript = PostScriptDocument(page, magnification);
+  const QByteArray key = figureKey(PostScript, resolution, pixel_page_w, pixel_page_h);
+  if (QImage *cached = figureCache.object(key))
+    return *cached;
+
+  if (!workerFailed && !knownDevices.isEmpty()) {
+    if ((pendingJob == 0) || (pendingKey != key))
+      startFigure(PostScript, key);
+
+    bool failed;
+    const QImage image = takePendingFigure(&failed);
+    if (!failed)
+      return image;
+  }
+
+  // No ghostscript running in the background, start one just for
+  // this page.
   QTemporaryFile gfxFile;
   gfxFile.open();
   const QString gfxFileName = gfxFile.fileName();
@@ -328,10 +577,51 @@ void ghostscript_interface::graphics(const PageNumber& page, double dpi, long ma
   gfxFile.close();
 
   gs_generate_graphics_file(page, gfxFileName, magnification);
-  
-  QImage MemoryCopy(gfxFileName);
-  paint->drawImage(0, 0, MemoryCopy);
-  return;
+
+  const QImage image(gfxFileName);
+  figureCache.insert(key, new QImage(image), image.byteCount());
+  return image;
+}
+
+
+void ghostscript_interface::startFigure(const QByteArray& PostScript, const QByteArray& key) {
+  // The worker renders one page at a time, the previous one is kept
+  // in the cache anyway
+  if (pendingJob != 0) {
+    bool failed;
+    takePendingFigure(&failed);
+    if (failed)
+      return;
+  }
+
+  if (worker == 0)
+    worker = new ghostscriptWorker(*gsDevice);
+
+  pendingJob = new figureJob;
+  pendingJob->PostScript  = PostScript;
+  pendingJob->resolution  = resolution;
+  pendingJob->size        = QSize(pixel_page_w, pixel_page_h);
+  pendingJob->includePath = includePath;
+  pendingKey = key;
+  worker->render(pendingJob);
+}
+
+
+QImage ghostscript_interface::takePendingFigure(bool *failed) {
+  QImage image;
+  *failed = (pendingJob == 0) || !worker->waitFor(pendingJob);
+  if (pendingJob != 0 && !*failed) {
+    image = pendingJob->image;
+    // Pages which ghostscript could not render are remembered as well
+    figureCache.insert(pendingKey, new QImage(image), image.byteCount());
+  }
+  if (*failed)
+    workerFailed = true;
+
+  delete pendingJob;
+  pendingJob = 0;
+  pendingKey.clear();
+  return image;
 }
 
 
@@ -11,11 +11,17 @@
 #define _PSGS_H_
 
 #include <QApplication>
+#include <QCache>
 #include <QColor>
 #include <QCustomEvent>
 #include <QHash>
+#include <QImage>
+#include <QMutex>
 #include <QObject>
+#include <QThread>
+#include <QWaitCondition>
 
+class KProcess;
 class KUrl;
 class PageNumber;
 class QPainter;
@@ -33,6 +39,67 @@ public:
 };
 
 
+/** A PostScript document of one page, to be rasterized by the
+    ghostscriptWorker */
+
+class figureJob
+{
+public:
+  figureJob();
+
+  QByteArray PostScript;
+  double     resolution;   // in dots per inch
+  QSize      size;         // in pixels
+  QString    includePath;
+
+  // Set by the worker: the rasterized page, and whether the worker
+  // failed, in which case ghostscript has to be run the usual way
+  QImage     image;
+  bool       workerFailed;
+  bool       finished;
+};
+
+
+/** A ghostscript interpreter which is kept running in the background,
+    so that the PostScript of the pages does not need a new
+    ghostscript process each time it is rendered. The pages are sent
+    to it through a pipe, wrapped so that an error in one of them
+    does not disturb the following ones. The worker thread owns the
+    process, so the pages can be queued from any thread, and rendered
+    while the caller does something else. */
+
+class ghostscriptWorker : public QThread
+{
+ Q_OBJECT
+
+public:
+  ghostscriptWorker(const QString &device);
+  ~ghostscriptWorker();
+
+  // Queues the job, and returns immediately
+  void render(figureJob *job);
+
+  // Waits until the job is finished. Returns false if the worker
+  // failed, and is no longer usable.
+  bool waitFor(figureJob *job);
+
+protected:
+  void run();
+
+private:
+  bool renderJob(KProcess *gs, const QString &outputDir, figureJob *job);
+
+  QString               device;
+
+  QMutex                mutex;
+  QWaitCondition        jobQueued;
+  QWaitCondition        jobFinished;
+  QList<figureJob*>     jobs;
+  bool                  stopping;
+  bool                  failed;
+};
+
+
 class ghostscript_interface  : public QObject
 {
  Q_OBJECT
@@ -63,6 +130,12 @@ public:
   // the page does not contain any graphics, nothing happens
   void     graphics(const PageNumber& page, double dpi, long magnification, QPainter* paint);
 
+  // Starts rendering the graphics of the page in the background, for a
+  // later call to graphics() with the same arguments. Returns true if
+  // it was started, false if there is no need for it, e.g. because the
+  // page has no graphics or they are already cached.
+  bool     requestGraphics(const PageNumber& page, double dpi, long magnification, const QSize& size);
+
   // Returns the background color for a certain page. If no color was
   // set, Qt::white is returned.
   QColor   getBackgroundColor(const PageNumber& page) const;
@@ -79,9 +152,37 @@ public:
   static  QString locateEPSfile(const QString &filename, const KUrl &base);
 
 private:
+  // The PostScript document which is rendered for the page, for the
+  // current resolution and page size
+  QByteArray            PostScriptDocument(const PageNumber& page, long magnification) const;
+
+  // Returns the rasterized graphics of the page, from the figure cache,
+  // the background job, or rendered right now
+  QImage                figure(const PageNumber& page, long magnification);
+
+  // Starts rendering the PostScript document in the background
+  void                  startFigure(const QByteArray& PostScript, const QByteArray& key);
+
+  // Waits for the job running in the background, and returns its image
+  QImage                takePendingFigure(bool *failed);
+
   void                  gs_generate_graphics_file(const PageNumber& page, const QString& filename, long magnification);
   QHash<quint16,pageInfo*>   pageList;
 
+  // The rasterized graphics, keyed by a hash of the PostScript
+  // document, which contains the graphics of the page, and by the
+  // resolution and size in pixels. The cost is the memory used.
+  QCache<QByteArray,QImage> figureCache;
+
+  // The persistent ghostscript interpreter; 0 if it is not started
+  // yet, or if it failed.
+  ghostscriptWorker     *worker;
+  bool                  workerFailed;
+
+  // The job running in the background, and its key in the figure cache
+  figureJob             *pendingJob;
+  QByteArray            pendingKey;
+
   double                resolution;   // in dots per inch
   int                   pixel_page_w; // in pixels
   int                   pixel_page_h; // in pixels
@@ -9,7 +9,9 @@
 
 #include "converter.h"
 
+#include <QtCore/QBuffer>
 #include <QtGui/QAbstractTextDocumentLayout>
+#include <QtGui/QImageReader>
 #include <QtGui/QTextDocument>
 #include <QtGui/QTextFrame>
 #include <QTextDocumentFragment>
@@ -20,7 +22,7 @@
 
 using namespace Epub;
 
-Converter::Converter() : mTextDocument(NULL)
+Converter::Converter() : mTextDocument(NULL), mSpineDone(true)
 {
 }
 
@@ -62,6 +64,23 @@ void Converter::_emitData(Okular::DocumentInfo::Key key,
   }
 }
 
+// Every file but the first one starts in a new page; this is left to
+// the layout, so that nothing needs to be laid out while converting
+static QTextBlockFormat pageBreakFormat()
+{
+  QTextBlockFormat format;
+  format.setPageBreakPolicy(QTextFormat::PageBreak_AlwaysBefore);
+  return format;
+}
+
+// the links to the section are resolved only when they are followed, so
+// that the document needs no layout here
+void Converter::_add_section(const QString &name, const QTextBlock &block)
+{
+  mSectionMap.insert(name, block);
+  emit addDestination(name, block);
+}
+
 // Got over the blocks from start and add them to hashes use name as the 
 // prefix for local links
 void Converter::_handle_anchors(const QTextBlock &start, const QString &name) {
@@ -75,24 +94,22 @@ void Converter::_handle_anchors(const QTextBlock &start, const QString &name) {
         QUrl href(frag.charFormat().anchorHref());
 
         if (href.isValid() && !href.isEmpty()) {
-          if (href.isRelative()) { // Inside document link
-            mLocalLinks.insert(href.toString(),
-                               QPair<int, int>(frag.position(),
-                                               frag.position()+frag.length()));
+          Okular::Action *action;
+          if (href.isRelative()) { // Inside document link, maybe to a file not converted yet
+            action = new Okular::GotoAction(QString(), href.toString());
           } else { // Outside document link       
-            Okular::BrowseAction *action =
-              new Okular::BrowseAction(href.toString());
-
-            emit addAction(action, frag.position(),
-                           frag.position() + frag.length());
+            action = new Okular::BrowseAction(href.toString());
           }
+
+          emit addAction(action, frag.position(),
+                         frag.position() + frag.length());
         }
 
         const QStringList &names = frag.charFormat().anchorNames();
         if (!names.empty()) {
           for (QStringList::const_iterator lit = names.constBegin();
                lit != names.constEnd(); ++lit) {
-            mSectionMap.insert(name + '#' + *lit, bit);
+            _add_section(name + '#' + *lit, bit);
           }
         }
 
@@ -101,6 +118,157 @@ void Converter::_handle_anchors(const QTextBlock &start, const QString &name) {
   }
 }
 
+// Go over the blocks from start and make the names of the images relative
+// to the epub instead of the current sub document, as they are loaded only
+// when they are drawn; the images are kept encoded by the document until then
+void Converter::_handle_images(const QTextBlock &start) {
+
+  QList<QPair<int, int> > positions;
+  QList<QTextImageFormat> formats;
+
+  for (QTextBlock bit = start; bit != mTextDocument->end(); bit = bit.next()) {
+    for (QTextBlock::iterator fit = bit.begin(); !(fit.atEnd()); ++fit) {
+
+      QTextFragment frag = fit.fragment();
+
+      if (frag.isValid() && frag.charFormat().isImageFormat()) {
+        QTextImageFormat format = frag.charFormat().toImageFormat();
+        const QString name = mTextDocument->resolveUrl(format.name());
+        format.setName(name);
+
+        if (!mTextDocument->imageSize(name).isValid()) {
+          char *data = 0;
+          int size = epub_get_data(mTextDocument->getEpub(), name.toUtf8(), &data);
+          if (data) {
+            mTextDocument->addImage(name, QByteArray(data, size));
+            free(data);
+          }
+        }
+
+        // set both width and height, so the layout does not need to decode the image
+        const QSize size = mTextDocument->imageSize(name);
+        if (!size.isEmpty()) {
+          const bool hasWidth = format.hasProperty(QTextFormat::ImageWidth);
+          const bool hasHeight = format.hasProperty(QTextFormat::ImageHeight);
+          if (!hasWidth && !hasHeight) {
+            format.setWidth(size.width());
+            format.setHeight(size.height());
+          } else if (!hasHeight) {
+            format.setHeight(format.width() * size.height() / size.width());
+          } else if (!hasWidth) {
+            format.setWidth(format.height() * size.width() / size.height());
+          }
+          mTextDocument->setImageDisplaySize(name, QSizeF(format.width(), format.height()));
+        }
+
+        positions.append(QPair<int, int>(frag.position(),
+                                         frag.position() + frag.length()));
+        formats.append(format);
+      }
+    }
+  }
+
+  // change the formats only now, as it changes the fragments
+  QTextCursor cursor(mTextDocument);
+  for (int i = 0; i < positions.count(); ++i) {
+    cursor.setPosition(positions.at(i).first);
+    cursor.setPosition(positions.at(i).second, QTextCursor::KeepAnchor);
+    cursor.setCharFormat(formats.at(i));
+  }
+}
+
+// Convert the current file of the spine at the end of the document, and
+// move to the next one; returns whether there is one
+bool Converter::_convert_file()
+{
+  struct eiterator *it = mTextDocument->getSpineIterator();
+  if (!it)
+    return false;
+
+  if (epub_it_get_curr(it)) {
+    QTextCursor cursor(mTextDocument);
+    cursor.movePosition(QTextCursor::End);
+
+    // insert block for links
+    const bool firstFile = mSectionMap.isEmpty();
+    cursor.insertBlock();
+
+    QString link = QString::fromUtf8(epub_it_get_curr_url(it));
+    mTextDocument->setCurrentSubDocument(link);
+
+    // Pass on all the anchor since last block
+    const QTextBlock &before = cursor.block();
+    _add_section(link, before);
+    cursor.insertHtml(QString::fromUtf8(epub_it_get_curr(it)));
+
+    // Add anchors to hashes
+    _handle_anchors(before, link);
+    _handle_images(before);
+
+    // Start new file in a new page
+    if (!firstFile)
+      QTextCursor(before).mergeBlockFormat(pageBreakFormat());
+
+    // the names of the images are not relative to the file anymore
+    mTextDocument->setCurrentSubDocument(QString());
+  }
+
+  return epub_it_get_next(it);
+}
+
+// Convert the files the table of contents refers to but the spine does not
+void Converter::_convert_toc_files()
+{
+  QTextCursor cursor(mTextDocument);
+  cursor.movePosition(QTextCursor::End);
+
+  foreach (const QString &link, mTocLinks) {
+    if (mSectionMap.contains(link))
+      continue;
+
+    char *data = 0;
+    int size = epub_get_data(mTextDocument->getEpub(), link.toUtf8(), &data);
+    if (!data) {
+      kDebug() << "Error: no block found for"<< link;
+      continue;
+    }
+
+    // Start new file in a new page
+    cursor.insertBlock(pageBreakFormat());
+
+    // try to load as image and if not load as html; the image
+    // is decoded only when it is drawn, its size is enough here
+    const QTextBlock block = cursor.block();
+    const QByteArray imageData(data, size);
+    QBuffer imageBuffer;
+    imageBuffer.setData(imageData);
+    imageBuffer.open(QIODevice::ReadOnly);
+    QImageReader imageReader(&imageBuffer);
+    if (imageReader.canRead()) {
+      mTextDocument->addImage(link, imageData);
+      QTextImageFormat format;
+      format.setName(link);
+      const QSize imageSize = mTextDocument->imageSize(link);
+      if (imageSize.isValid()) {
+        format.setWidth(imageSize.width());
+        format.setHeight(imageSize.height());
+        mTextDocument->setImageDisplaySize(link, imageSize);
+      }
+      cursor.insertImage(format);
+    } else {
+      cursor.insertHtml(QString::fromUtf8(data));
+      // Add anchors to hashes
+      _handle_anchors(block, link);
+      _handle_images(block);
+    }
+    _add_section(link, block);
+
+    free(data);
+  }
+
+  mTocLinks.clear();
+}
+
 QTextDocument* Converter::convert( const QString &fileName )
 {
   EpubDocument *newDocument = new EpubDocument(fileName);
@@ -113,16 +281,14 @@ QTextDocument* Converter::convert( const QString &fileName )
 
   mTextDocument->setPageSize(QSizeF(600, 800));
 
-  QTextCursor *_cursor = new QTextCursor( mTextDocument );
-
   QTextFrameFormat frameFormat;
   frameFormat.setMargin( 20 );
 
   QTextFrame *rootFrame = mTextDocument->rootFrame();
   rootFrame->setFrameFormat( frameFormat );
 
-  mLocalLinks.clear();
   mSectionMap.clear();
+  mTocLinks.clear();
 
   // Emit the document meta data
   _emitData(Okular::DocumentInfo::Title, EPUB_TITLE);
@@ -137,37 +303,10 @@ QTextDocument* Converter::convert( const QString &fileName )
   _emitData(Okular::DocumentInfo::Copyright, EPUB_RIGHTS);
   emit addMetaData( Okular::DocumentInfo::MimeType, "application/epub+zip");
 
-  struct eiterator *it;
-
-  // iterate over the book
-  it = epub_get_iterator(mTextDocument->getEpub(), EITERATOR_SPINE, 0);
-
-  do {
-    if (epub_it_get_curr(it)) {
-
-      // insert block for links
-      _cursor->insertBlock();
-
-      QString link = QString::fromUtf8(epub_it_get_curr_url(it));
-      mTextDocument->setCurrentSubDocument(link);
-
-      // Pass on all the anchor since last block
-      const QTextBlock &before = _cursor->block();
-      mSectionMap.insert(link, before);
-      _cursor->insertHtml(QString::fromUtf8(epub_it_get_curr(it)));
-
-      // Add anchors to hashes
-      _handle_anchors(before, link);
-
-      // Start new file in a new page
-      int page = mTextDocument->pageCount();
-      while(mTextDocument->pageCount() == page)
-        _cursor->insertText("\n");
-    }
-  } while (epub_it_get_next(it));
-
-  epub_free_iterator(it);
-  mTextDocument->setCurrentSubDocument(QString());
+  // only the first file of the book is converted now, the others are
+  // converted in reading order while the document is laid out, or up to
+  // the destination of a link followed meanwhile (see convertMore())
+  mSpineDone = !_convert_file();
 
   // handle toc
   struct titerator *tit;
@@ -183,45 +322,18 @@ QTextDocument* Converter::convert( const QString &fileName )
         char *clink = epub_tit_get_curr_link(tit);
         QString link = QString::fromUtf8(clink);
         char *label = epub_tit_get_curr_label(tit);
-        QTextBlock block = mTextDocument->begin(); // must point somewhere
 
+        // the titles of the files not converted yet lead to their
+        // destination, which comes along with the file
         if (mSectionMap.contains(link)) {
-          block = mSectionMap.value(link);
-        } else { // load missing resource
-          char *data = 0;
-          int size = epub_get_data(mTextDocument->getEpub(), clink, &data);
-          if (data) {
-            _cursor->insertBlock();
-
-            // try to load as image and if not load as html
-            block = _cursor->block();
-            QImage image;
-            mSectionMap.insert(link, block);
-            if (image.loadFromData((unsigned char *)data, size)) {
-              mTextDocument->addResource(QTextDocument::ImageResource,
-                                         QUrl(link), image);
-              _cursor->insertImage(link);
-            } else {
-              _cursor->insertHtml(QString::fromUtf8(data));
-              // Add anchors to hashes
-              _handle_anchors(block, link);
-            }
-
-            // Start new file in a new page
-            int page = mTextDocument->pageCount();
-            while(mTextDocument->pageCount() == page)
-              _cursor->insertText("\n");
-          }
-
-          free(data);
-        }
-
-        if (block.isValid()) { // be sure we actually got a block
           emit addTitle(epub_tit_get_curr_depth(tit),
                         QString::fromUtf8(label),
-                        block);
+                        mSectionMap.value(link));
         } else {
-          kDebug() << "Error: no block found for"<< link;
+          emit addTitle(epub_tit_get_curr_depth(tit),
+                        QString::fromUtf8(label),
+                        link);
+          mTocLinks.append(link);
         }
 
         if (clink)
@@ -236,25 +348,23 @@ QTextDocument* Converter::convert( const QString &fileName )
     kDebug() << "no toc found";
   }
 
-  // adding link actions
-  QHashIterator<QString, QPair<int, int> > hit(mLocalLinks);
-  while (hit.hasNext()) {
-    hit.next();
-
-    const QTextBlock block = mSectionMap.value(hit.key());
-    if (block.isValid()) { // be sure we actually got a block
-      Okular::DocumentViewport viewport =
-        calculateViewport(mTextDocument, block);
+  return mTextDocument;
+}
 
-      Okular::GotoAction *action = new Okular::GotoAction(QString(), viewport);
+bool Converter::convertMore()
+{
+  if (!mTextDocument)
+    return false;
 
-      emit addAction(action, hit.value().first, hit.value().second);
-    } else {
-      kDebug() << "Error: no block found for "<< hit.key();
-    }
+  // one file of the spine at a time
+  if (!mSpineDone) {
+    mSpineDone = !_convert_file();
+    return true;
   }
 
-  delete _cursor;
-
-  return mTextDocument;
+  // then the files only the table of contents refers to, all at once
+  _convert_toc_files();
+  return false;
 }
+
+#include "converter.moc"
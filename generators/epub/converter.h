@@ -20,20 +20,32 @@ class QTextCursor;
 namespace Epub {
   class Converter : public Okular::TextDocumentConverter
     {
+      Q_OBJECT
+
     public:
       Converter();
       ~Converter();
 
       virtual QTextDocument *convert( const QString &fileName );
 
+    protected slots:
+      bool convertMore();
+
     private:
 
       void _emitData(Okular::DocumentInfo::Key key, enum epub_metadata type); 
+      void _add_section(const QString &name, const QTextBlock &block);
       void _handle_anchors(const QTextBlock &start, const QString &name);
+      void _handle_images(const QTextBlock &start);
+      bool _convert_file();
+      void _convert_toc_files();
       EpubDocument *mTextDocument;
 
       QHash<QString, QTextBlock> mSectionMap;
-      QHash<QString, QPair<int, int> > mLocalLinks;
+      // the files the table of contents refers to, which may be missing
+      // from the spine
+      QStringList mTocLinks;
+      bool mSpineDone;
     };
 }
 
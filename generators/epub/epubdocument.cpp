@@ -23,7 +23,8 @@ QString resourceUrl(const KUrl &baseUrl, const QString &u)
 
 }
 
-EpubDocument::EpubDocument(const QString &fileName) : QTextDocument()
+EpubDocument::EpubDocument(const QString &fileName) : Okular::TextDocument(),
+  mSpineIterator(NULL)
 {
   mEpub = epub_open(qPrintable(fileName), 3);
 }
@@ -35,6 +36,9 @@ bool EpubDocument::isValid()
 
 EpubDocument::~EpubDocument() {
 
+  if (mSpineIterator)
+    epub_free_iterator(mSpineIterator);
+
   if (mEpub)
     epub_close(mEpub);
 
@@ -46,18 +50,38 @@ struct epub *EpubDocument::getEpub()
   return mEpub;
 }
 
+struct eiterator *EpubDocument::getSpineIterator()
+{
+  if (!mSpineIterator && mEpub)
+    mSpineIterator = epub_get_iterator(mEpub, EITERATOR_SPINE, 0);
+
+  return mSpineIterator;
+}
+
 void EpubDocument::setCurrentSubDocument(const QString &doc)
 {
   mCurrentSubDocument = KUrl::fromPath("/" + doc);
 }
 
+// the path of url in the epub, as resources of the current sub document
+// refer to it
+QString EpubDocument::resolveUrl(const QString &url) const
+{
+  return resourceUrl(mCurrentSubDocument, url);
+}
+
 QVariant EpubDocument::loadResource(int type, const QUrl &name)
 {
+  // the images of the pages are decoded only at the size they are shown,
+  // and kept only for a while
+  if (type == QTextDocument::ImageResource && imageSize(name.toString()).isValid())
+    return Okular::TextDocument::loadResource(type, name);
+
   int size;
   char *data;
 
   // Get the data from the epub file
-  size = epub_get_data(mEpub, resourceUrl(mCurrentSubDocument, name.toString()).toUtf8(), &data);
+  size = epub_get_data(mEpub, resolveUrl(name.toString()).toUtf8(), &data);
 
   QVariant resource;
 
@@ -75,8 +99,5 @@ QVariant EpubDocument::loadResource(int type, const QUrl &name)
     free(data);
   }
 
-  // add to cache
-  addResource(type, name, resource); 
-
   return resource;
 }
@@ -10,29 +10,34 @@
 #ifndef EPUB_DOCUMENT_H
 #define EPUB_DOCUMENT_H
 
-#include <QTextDocument>
 #include <QUrl>
 #include <QVariant>
 #include <QImage>
 #include <kurl.h>
 #include <epub.h>
 
+#include <core/textdocumentgenerator.h>
+
 namespace Epub {
 
-  class EpubDocument : public QTextDocument {
+  class EpubDocument : public Okular::TextDocument {
 
   public:
     EpubDocument(const QString &fileName);
     bool isValid();
     ~EpubDocument();
     struct epub *getEpub();
+    // the iterator over the spine, it lives as long as the epub
+    struct eiterator *getSpineIterator();
     void setCurrentSubDocument(const QString &doc);
+    QString resolveUrl(const QString &url) const;
 
   protected:
     virtual QVariant loadResource(int type, const QUrl &name);
 
   private:
     struct epub *mEpub;
+    struct eiterator *mSpineIterator;
     KUrl mCurrentSubDocument;
   };
 
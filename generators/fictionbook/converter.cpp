@@ -70,7 +70,7 @@ QTextDocument* Converter::convert( const QString &fileName )
         return false;
     }
 
-    mTextDocument = new QTextDocument;
+    mTextDocument = new Okular::TextDocument;
     mCursor = new QTextCursor( mTextDocument );
     mSectionCounter = 0;
     mLocalLinks.clear();
@@ -583,7 +583,7 @@ bool Converter::convertBinary( const QDomElement &element )
     QByteArray data = textNode.data().toLatin1();
     data = QByteArray::fromBase64( data );
 
-    mTextDocument->addResource( QTextDocument::ImageResource, QUrl( id ), QImage::fromData( data ) );
+    mTextDocument->addImage( id, data );
 
     return true;
 }
@@ -610,16 +610,20 @@ bool Converter::convertImage( const QDomElement &element )
     if ( href.startsWith( '#' ) )
         href = href.mid( 1 );
 
-    const QImage img = qVariantValue<QImage>( mTextDocument->resource( QTextDocument::ImageResource, QUrl( href ) ) );
+    const QSize size = mTextDocument->imageSize( href );
 
     QTextImageFormat format;
     format.setName( href );
 
-    if ( img.width() > 560 )
+    // set both width and height, so the layout does not need to decode the image
+    if ( size.width() > 560 )
         format.setWidth( 560 );
+    else if ( size.isValid() )
+        format.setWidth( size.width() );
 
-    format.setHeight( img.height() );
+    format.setHeight( qMax( size.height(), 0 ) );
 
+    mTextDocument->setImageDisplaySize( href, QSizeF( format.width(), format.height() ) );
     mCursor->insertImage( format );
 
     return true;
@@ -55,7 +55,7 @@ class Converter : public Okular::TextDocumentConverter
         bool convertDate( const QDomElement &element, QDate &date );
         bool convertTextNode( const QDomElement &element, QString &data );
 
-        QTextDocument *mTextDocument;
+        Okular::TextDocument *mTextDocument;
         QTextCursor *mCursor;
 
         class TitleInfo;
@@ -80,7 +80,7 @@ QTextDocument* Converter::convert( const QString &fileName )
     return 0;
   }
 
-  mTextDocument = new QTextDocument;
+  mTextDocument = new Okular::TextDocument;
   mCursor = new QTextCursor( mTextDocument );
 
   /**
@@ -113,14 +113,15 @@ QTextDocument* Converter::convert( const QString &fileName )
   }
 
   /**
-   * Add all images of the document to resource framework
+   * Add all images of the document to resource framework,
+   * they are decoded only when they are drawn
    */
   const QMap<QString, QByteArray> images = oooDocument.images();
   QMapIterator<QString, QByteArray> it( images );
   while ( it.hasNext() ) {
     it.next();
 
-    mTextDocument->addResource( QTextDocument::ImageResource, QUrl( it.key() ), QImage::fromData( it.value() ) );
+    mTextDocument->addImage( it.key(), it.value() );
   }
 
   /**
@@ -516,6 +517,7 @@ bool Converter::convertFrame( const QDomElement &element )
       format.setHeight( StyleParser::convertUnit( element.attribute( "height" ) ) );
       format.setName( href );
 
+      mTextDocument->setImageDisplaySize( href, QSizeF( format.width(), format.height() ) );
       mCursor->insertImage( format );
     }
 
@@ -45,7 +45,7 @@ class Converter : public Okular::TextDocumentConverter
     bool convertFrame( const QDomElement &element );
     bool convertAnnotation( QTextCursor *cursor, const QDomElement &element );
 
-    QTextDocument *mTextDocument;
+    Okular::TextDocument *mTextDocument;
     QTextCursor *mCursor;
 
     StyleInformation *mStyleInformation;
@@ -11,6 +11,8 @@
 #include <poppler-annotation.h>
 
 // qt/kde includes
+#include <qmap.h>
+#include <qpair.h>
 #include <qvariant.h>
 
 #include <core/annotations.h>
@@ -59,7 +61,7 @@ static int maskExportedFlags(int flags)
 
 //BEGIN PopplerAnnotationProxy implementation
 PopplerAnnotationProxy::PopplerAnnotationProxy( Poppler::Document *doc, QMutex *userMutex )
-    : ppl_doc ( doc ), mutex ( userMutex )
+    : ppl_doc ( doc ), mutex ( userMutex ), changed ( false ), formRevision ( 0 )
 {
 }
 
@@ -67,6 +69,100 @@ PopplerAnnotationProxy::~PopplerAnnotationProxy()
 {
 }
 
+bool PopplerAnnotationProxy::annotationsChanged() const
+{
+    QMutexLocker ml(mutex);
+    return changed;
+}
+
+void PopplerAnnotationProxy::notifyFormChange( int page, const Poppler::FormField *field )
+{
+    QMutexLocker ml(mutex);
+    FormChange change;
+    change.page = page;
+    change.revision = ++formRevision;
+    change.type = field->type();
+    change.state = false;
+    switch ( field->type() )
+    {
+        case Poppler::FormField::FormButton:
+            change.state = static_cast<const Poppler::FormFieldButton*>( field )->state();
+            break;
+        case Poppler::FormField::FormText:
+            change.text = static_cast<const Poppler::FormFieldText*>( field )->text();
+            break;
+        case Poppler::FormField::FormChoice:
+            change.choices = static_cast<const Poppler::FormFieldChoice*>( field )->currentChoices();
+            break;
+        default: ;
+    }
+    formChanges.insert( field->id(), change );
+}
+
+int PopplerAnnotationProxy::copyFormChanges( Poppler::Document *doc, int revision ) const
+{
+    // take the changes not in doc yet, in the order they were done (setting
+    // a radio button unsets its siblings), and set them out of the lock, as
+    // doc is used by the calling thread only
+    QMap<int, QPair<int, FormChange> > changes;
+    int currentRevision;
+    {
+        QMutexLocker ml(mutex);
+        currentRevision = formRevision;
+        if ( revision == currentRevision )
+            return revision;
+
+        QHash<int, FormChange>::const_iterator it = formChanges.constBegin(), itEnd = formChanges.constEnd();
+        for ( ; it != itEnd; ++it )
+            if ( it.value().revision > revision )
+                changes.insert( it.value().revision, qMakePair( it.key(), it.value() ) );
+    }
+
+    // the fields of the pages with changes, by id
+    QHash<int, Poppler::FormField*> fields;
+    QList<int> pages;
+    QMap<int, QPair<int, FormChange> >::const_iterator it = changes.constBegin(), itEnd = changes.constEnd();
+    for ( ; it != itEnd; ++it )
+    {
+        const int pageNumber = it.value().second.page;
+        if ( pages.contains( pageNumber ) )
+            continue;
+        pages.append( pageNumber );
+
+        Poppler::Page *page = doc->page( pageNumber );
+        if ( !page )
+            continue;
+        foreach ( Poppler::FormField *field, page->formFields() )
+            fields.insert( field->id(), field );
+        delete page;
+    }
+
+    for ( it = changes.constBegin(); it != itEnd; ++it )
+    {
+        Poppler::FormField *field = fields.value( it.value().first );
+        const FormChange &change = it.value().second;
+        if ( !field || field->type() != change.type )
+            continue;
+
+        switch ( change.type )
+        {
+            case Poppler::FormField::FormButton:
+                static_cast<Poppler::FormFieldButton*>( field )->setState( change.state );
+                break;
+            case Poppler::FormField::FormText:
+                static_cast<Poppler::FormFieldText*>( field )->setText( change.text );
+                break;
+            case Poppler::FormField::FormChoice:
+                static_cast<Poppler::FormFieldChoice*>( field )->setCurrentChoices( change.choices );
+                break;
+            default: ;
+        }
+    }
+    qDeleteAll( fields );
+
+    return currentRevision;
+}
+
 bool PopplerAnnotationProxy::supports( Capability cap ) const
 {
     switch ( cap )
@@ -91,6 +187,7 @@ void PopplerAnnotationProxy::notifyAddition( Okular::Annotation *okl_ann, int pa
     Okular::AnnotationUtils::storeAnnotation( okl_ann, dom_ann, doc );
 
     QMutexLocker ml(mutex);
+    changed = true;
 
     // Create poppler annotation
     Poppler::Annotation *ppl_ann = Poppler::AnnotationUtils::createAnnotation( dom_ann );
@@ -144,6 +241,7 @@ void PopplerAnnotationProxy::notifyModification( const Okular::Annotation *okl_a
         return;
 
     QMutexLocker ml(mutex);
+    changed = true;
 
     if ( okl_ann->flags() & Okular::Annotation::BeingMoved )
     {
@@ -254,6 +352,7 @@ void PopplerAnnotationProxy::notifyRemoval( Okular::Annotation *okl_ann, int pag
         return;
 
     QMutexLocker ml(mutex);
+    changed = true;
 
     Poppler::Page *ppl_page = ppl_doc->page( page );
     ppl_page->removeAnnotation( ppl_ann ); // Also destroys ppl_ann
@@ -11,8 +11,10 @@
 #define _OKULAR_GENERATOR_PDF_ANNOTS_H_
 
 #include <poppler-annotation.h>
+#include <poppler-form.h>
 #include <poppler-qt4.h>
 
+#include <qhash.h>
 #include <qmutex.h>
 
 #include "core/annotations.h"
@@ -30,9 +32,33 @@ class PopplerAnnotationProxy : public Okular::AnnotationProxy
         void notifyAddition( Okular::Annotation *annotation, int page );
         void notifyModification( const Okular::Annotation *annotation, int page, bool appearanceChanged );
         void notifyRemoval( Okular::Annotation *annotation, int page );
+
+        // whether the annotations of the document were changed
+        bool annotationsChanged() const;
+
+        // the value of the form @p field of the @p page has been changed
+        void notifyFormChange( int page, const Poppler::FormField *field );
+
+        // sets the form values changed after @p revision in @p doc, a copy
+        // of the document, and returns the revision it is now at
+        int copyFormChanges( Poppler::Document *doc, int revision ) const;
     private:
+        struct FormChange
+        {
+            int page;
+            int revision;
+            Poppler::FormField::FormType type;
+            bool state;
+            QString text;
+            QList<int> choices;
+        };
+
         Poppler::Document *ppl_doc;
         QMutex *mutex;
+        bool changed;
+        // the last value of the changed form fields, by id
+        QHash<int, FormChange> formChanges;
+        int formRevision;
 };
 
 #endif
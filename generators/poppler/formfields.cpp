@@ -9,6 +9,8 @@
 
 #include "formfields.h"
 
+#include "annots.h"
+
 #include "core/action.h"
 
 #include <poppler-qt4.h>
@@ -17,8 +19,8 @@
 
 extern Okular::Action* createLinkFromPopplerLink(const Poppler::Link *popplerLink);
 
-PopplerFormFieldButton::PopplerFormFieldButton( Poppler::FormFieldButton * field )
-    : Okular::FormFieldButton(), m_field( field )
+PopplerFormFieldButton::PopplerFormFieldButton( Poppler::FormFieldButton * field, int page, PopplerAnnotationProxy * proxy )
+    : Okular::FormFieldButton(), m_field( field ), m_page( page ), m_proxy( proxy )
 {
     m_rect = Okular::NormalizedRect::fromQRectF( m_field->rect() );
     Poppler::Link *aAction = field->activationAction();
@@ -90,6 +92,8 @@ bool PopplerFormFieldButton::state() const
 void PopplerFormFieldButton::setState( bool state )
 {
     m_field->setState( state );
+    // the copies of the document used for rendering get the new value too
+    m_proxy->notifyFormChange( m_page, m_field );
 }
 
 QList< int > PopplerFormFieldButton::siblings() const
@@ -98,8 +102,8 @@ QList< int > PopplerFormFieldButton::siblings() const
 }
 
 
-PopplerFormFieldText::PopplerFormFieldText( Poppler::FormFieldText * field )
-    : Okular::FormFieldText(), m_field( field )
+PopplerFormFieldText::PopplerFormFieldText( Poppler::FormFieldText * field, int page, PopplerAnnotationProxy * proxy )
+    : Okular::FormFieldText(), m_field( field ), m_page( page ), m_proxy( proxy )
 {
     m_rect = Okular::NormalizedRect::fromQRectF( m_field->rect() );
     Poppler::Link *aAction = field->activationAction();
@@ -166,6 +170,7 @@ QString PopplerFormFieldText::text() const
 void PopplerFormFieldText::setText( const QString& text )
 {
     m_field->setText( text );
+    m_proxy->notifyFormChange( m_page, m_field );
 }
 
 bool PopplerFormFieldText::isPassword() const
@@ -194,8 +199,8 @@ bool PopplerFormFieldText::canBeSpellChecked() const
 }
 
 
-PopplerFormFieldChoice::PopplerFormFieldChoice( Poppler::FormFieldChoice * field )
-    : Okular::FormFieldChoice(), m_field( field )
+PopplerFormFieldChoice::PopplerFormFieldChoice( Poppler::FormFieldChoice * field, int page, PopplerAnnotationProxy * proxy )
+    : Okular::FormFieldChoice(), m_field( field ), m_page( page ), m_proxy( proxy )
 {
     m_rect = Okular::NormalizedRect::fromQRectF( m_field->rect() );
     Poppler::Link *aAction = field->activationAction();
@@ -275,6 +280,7 @@ QList<int> PopplerFormFieldChoice::currentChoices() const
 void PopplerFormFieldChoice::setCurrentChoices( const QList<int>& choices )
 {
     m_field->setCurrentChoices( choices );
+    m_proxy->notifyFormChange( m_page, m_field );
 }
 
 Qt::Alignment PopplerFormFieldChoice::textAlignment() const
@@ -13,10 +13,12 @@
 #include <poppler-form.h>
 #include "core/form.h"
 
+class PopplerAnnotationProxy;
+
 class PopplerFormFieldButton : public Okular::FormFieldButton
 {
     public:
-        PopplerFormFieldButton( Poppler::FormFieldButton * field );
+        PopplerFormFieldButton( Poppler::FormFieldButton * field, int page, PopplerAnnotationProxy * proxy );
         virtual ~PopplerFormFieldButton();
 
         // inherited from Okular::FormField
@@ -36,6 +38,8 @@ class PopplerFormFieldButton : public Okular::FormFieldButton
 
     private:
         Poppler::FormFieldButton * m_field;
+        int m_page;
+        PopplerAnnotationProxy * m_proxy;
         Okular::NormalizedRect m_rect;
 
 };
@@ -43,7 +47,7 @@ class PopplerFormFieldButton : public Okular::FormFieldButton
 class PopplerFormFieldText : public Okular::FormFieldText
 {
     public:
-        PopplerFormFieldText( Poppler::FormFieldText * field );
+        PopplerFormFieldText( Poppler::FormFieldText * field, int page, PopplerAnnotationProxy * proxy );
         virtual ~PopplerFormFieldText();
 
         // inherited from Okular::FormField
@@ -66,6 +70,8 @@ class PopplerFormFieldText : public Okular::FormFieldText
 
     private:
         Poppler::FormFieldText * m_field;
+        int m_page;
+        PopplerAnnotationProxy * m_proxy;
         Okular::NormalizedRect m_rect;
 
 };
@@ -73,7 +79,7 @@ class PopplerFormFieldText : public Okular::FormFieldText
 class PopplerFormFieldChoice : public Okular::FormFieldChoice
 {
     public:
-        PopplerFormFieldChoice( Poppler::FormFieldChoice * field );
+        PopplerFormFieldChoice( Poppler::FormFieldChoice * field, int page, PopplerAnnotationProxy * proxy );
         virtual ~PopplerFormFieldChoice();
 
         // inherited from Okular::FormField
@@ -96,6 +102,8 @@ class PopplerFormFieldChoice : public Okular::FormFieldChoice
 
     private:
         Poppler::FormFieldChoice * m_field;
+        int m_page;
+        PopplerAnnotationProxy * m_proxy;
         Okular::NormalizedRect m_rect;
 
 };
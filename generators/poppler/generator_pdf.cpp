@@ -14,6 +14,7 @@
 // qt/kde includes
 #include <qcheckbox.h>
 #include <qcolor.h>
+#include <qdatetime.h>
 #include <qfile.h>
 #include <qimage.h>
 #include <qlayout.h>
@@ -21,6 +22,7 @@
 #include <qregexp.h>
 #include <qstack.h>
 #include <qtextstream.h>
+#include <qtimer.h>
 #include <QtGui/QPrinter>
 #include <QtGui/QPainter>
 
@@ -382,9 +384,11 @@ PDFGenerator::PDFGenerator( QObject *parent, const QVariantList &args )
     docInfoDirty( true ), docSynopsisDirty( true ),
     docEmbeddedFilesDirty( true ), nextFontPage( 0 ),
     dpiX( 72.0 /*Okular::Utils::dpiX()*/ ), dpiY( 72.0 /*Okular::Utils::dpiY()*/ ),
-    annotProxy( 0 ), synctex_scanner( 0 )
+    annotProxy( 0 ), nextPageData( 0 ), synctex_scanner( 0 )
 {
     setFeature( Threaded );
+    setFeature( ConcurrentRendering );
+    setFeature( TiledRendering );
     setFeature( TextExtraction );
     setFeature( FontInfo );
 #ifdef Q_OS_WIN32
@@ -420,6 +424,7 @@ bool PDFGenerator::loadDocument( const QString & filePath, QVector<Okular::Page*
 #endif
     // create PDFDoc for the given file
     pdfdoc = Poppler::Document::load( filePath, 0, 0 );
+    documentFilePath = filePath;
     bool success = init(pagesVector, filePath.section('/', -1, -1));
     if (success)
     {
@@ -445,6 +450,7 @@ bool PDFGenerator::loadDocumentFromData( const QByteArray & fileData, QVector<Ok
 #endif
     // create PDFDoc for the given file
     pdfdoc = Poppler::Document::loadFromData( fileData, 0, 0 );
+    documentData = fileData;
     return init(pagesVector, QString());
 }
 
@@ -504,7 +510,8 @@ bool PDFGenerator::init(QVector<Okular::Page*> & pagesVector, const QString &wal
         }
 
         // 2. reopen the document using the password
-        pdfdoc->unlock( password.toLatin1(), password.toLatin1() );
+        documentPassword = password.toLatin1();
+        pdfdoc->unlock( documentPassword, documentPassword );
 
         // 3. if the password is correct and the user chose to remember it, store it to the wallet
         if ( !pdfdoc->isLocked() && wallet && /*safety check*/ wallet->isOpen() && keep )
@@ -534,6 +541,9 @@ bool PDFGenerator::init(QVector<Okular::Page*> & pagesVector, const QString &wal
     // create annotation proxy
     annotProxy = new PopplerAnnotationProxy( pdfdoc, userMutex() );
 
+    // load the data of the pages not shown yet without blocking
+    QTimer::singleShot( 0, this, SLOT(loadPendingPagesData()) );
+
     // the file has been loaded correctly
     return true;
 }
@@ -547,6 +557,12 @@ bool PDFGenerator::doCloseDocument()
     delete pdfdoc;
     pdfdoc = 0;
     userMutex()->unlock();
+    qDeleteAll(renderDocuments);
+    renderDocuments.clear();
+    renderDocumentFormRevisions.clear();
+    documentFilePath.clear();
+    documentData.clear();
+    documentPassword.clear();
     docInfoDirty = true;
     docSynopsisDirty = true;
     docSyn.clear();
@@ -555,6 +571,9 @@ bool PDFGenerator::doCloseDocument()
     docEmbeddedFiles.clear();
     nextFontPage = 0;
     rectsGenerated.clear();
+    pages.clear();
+    pageDataLoaded.clear();
+    nextPageData = 0;
     if ( synctex_scanner )
     {
         synctex_scanner_free( synctex_scanner );
@@ -589,25 +608,11 @@ void PDFGenerator::loadPages(QVector<Okular::Page*> &pagesVector, int rotation,
             }
             if (rotation % 2 == 1)
             qSwap(w,h);
-            // init a Okular::page, add transition and annotation information
+            // init a Okular::page; the transition, the annotations, the actions
+            // and the form fields are loaded later, see loadPageData()
             page = new Okular::Page( i, w, h, orientation );
-            addTransition( p, page );
-            if ( true ) //TODO real check
-            addAnnotations( p, page );
-            Poppler::Link * tmplink = p->action( Poppler::Page::Opening );
-            if ( tmplink )
-            {
-                page->setPageAction( Okular::Page::Opening, createLinkFromPopplerLink( tmplink ) );
-            }
-            tmplink = p->action( Poppler::Page::Closing );
-            if ( tmplink )
-            {
-                page->setPageAction( Okular::Page::Closing, createLinkFromPopplerLink( tmplink ) );
-            }
             page->setDuration( p->duration() );
             page->setLabel( p->label() );
-
-            addFormFields( p, page );
 //        kWarning(PDFDebug).nospace() << page->width() << "x" << page->height();
 
 #ifdef PDFGENERATOR_DEBUG
@@ -625,6 +630,74 @@ void PDFGenerator::loadPages(QVector<Okular::Page*> &pagesVector, int rotation,
         // set the Okular::page at the right position in document's pages vector
         pagesVector[i] = page;
     }
+
+    pages = pagesVector;
+    pageDataLoaded.fill( false, count );
+    nextPageData = 0;
+}
+
+void PDFGenerator::loadPageData( Okular::Page * page )
+{
+    const int i = page->number();
+    if ( i >= pageDataLoaded.size() || pageDataLoaded.testBit( i ) )
+        return;
+    pageDataLoaded.setBit( i );
+
+    // the rendering threads may be using pdfdoc meanwhile
+    userMutex()->lock();
+    Poppler::Page * p = pdfdoc->page( i );
+    if ( p )
+    {
+        addTransition( p, page );
+        addAnnotations( p, page );
+        Poppler::Link * tmplink = p->action( Poppler::Page::Opening );
+        if ( tmplink )
+        {
+            page->setPageAction( Okular::Page::Opening, createLinkFromPopplerLink( tmplink ) );
+        }
+        tmplink = p->action( Poppler::Page::Closing );
+        if ( tmplink )
+        {
+            page->setPageAction( Okular::Page::Closing, createLinkFromPopplerLink( tmplink ) );
+        }
+
+        addFormFields( p, page );
+        delete p;
+    }
+    userMutex()->unlock();
+
+    // the observers know only about the page size yet
+    if ( !page->annotations().isEmpty() || !page->formFields().isEmpty() )
+        updatePageData( i );
+}
+
+void PDFGenerator::loadPendingPagesData()
+{
+    if ( !pdfdoc )
+        return;
+
+    // load in short slices, so that the GUI never blocks
+    QTime time;
+    time.start();
+    while ( nextPageData < pages.count() && time.elapsed() < 20 )
+        loadPageData( pages.at( nextPageData++ ) );
+
+    if ( nextPageData < pages.count() )
+        QTimer::singleShot( 0, this, SLOT(loadPendingPagesData()) );
+}
+
+void PDFGenerator::generatePixmap( Okular::PixmapRequest * request )
+{
+    // the page must be complete before being rendered, as the links
+    // resolved in image() refer to its annotations
+    loadPageData( request->page() );
+    Generator::generatePixmap( request );
+}
+
+void PDFGenerator::generateTextPage( Okular::Page * page )
+{
+    loadPageData( page );
+    Generator::generateTextPage( page );
 }
 
 const Okular::DocumentInfo * PDFGenerator::generateDocumentInfo()
@@ -862,16 +935,33 @@ QImage PDFGenerator::image( Okular::PixmapRequest * request )
     // generate links rects only the first time
     bool genObjectRects = !rectsGenerated.at( page->number() );
 
-    // 0. LOCK [waits for the thread end]
-    userMutex()->lock();
+    // 0. render on a private copy of the document if possible, so that other
+    //    pages can be rendered at the same time; else LOCK [waits for the thread end]
+    Poppler::Document *renderdoc = acquireRenderDocument();
+    if ( !renderdoc )
+        userMutex()->lock();
 
     // 1. Set OutputDev parameters and Generate contents
     // note: thread safety is set on 'false' for the GUI (this) thread
-    Poppler::Page *p = pdfdoc->page(page->number());
+    Poppler::Page *p = ( renderdoc ? renderdoc : pdfdoc )->page(page->number());
 
     // 2. Take data from outputdev and attach it to the Page
     QImage img;
-    if (p)
+    if ( request->isTile() )
+    {
+        // render only the requested part of the page
+        const QRect tileRect = request->normalizedRect().roundedGeometry( request->width(), request->height() );
+        if (p)
+        {
+            img = p->renderToImage(fakeDpiX, fakeDpiY, tileRect.x(), tileRect.y(), tileRect.width(), tileRect.height(), Poppler::Page::Rotate0 );
+        }
+        else
+        {
+            img = QImage( tileRect.width(), tileRect.height(), QImage::Format_Mono );
+            img.fill( Qt::white );
+        }
+    }
+    else if (p)
     {
         img = p->renderToImage(fakeDpiX, fakeDpiY, -1, -1, -1, -1, Poppler::Page::Rotate0 );
     }
@@ -881,6 +971,19 @@ QImage PDFGenerator::image( Okular::PixmapRequest * request )
         img.fill( Qt::white );
     }
 
+    // the links are always taken from the main document, as they are bound
+    // to its annotations
+    if ( renderdoc )
+    {
+        delete p;
+        p = 0;
+        releaseRenderDocument( renderdoc );
+
+        userMutex()->lock();
+        if ( genObjectRects )
+            p = pdfdoc->page( page->number() );
+    }
+
     if ( p && genObjectRects )
     {
         // TODO previously we extracted Image type rects too, but that needed porting to poppler
@@ -900,6 +1003,71 @@ QImage PDFGenerator::image( Okular::PixmapRequest * request )
     return img;
 }
 
+Poppler::Document *PDFGenerator::acquireRenderDocument()
+{
+    // the copies do not know about the annotations changed in pdfdoc, so
+    // stop using them as soon as that happens
+    if ( !annotProxy || annotProxy->annotationsChanged() )
+        return 0;
+
+    renderDocumentsMutex.lock();
+    Poppler::Document *doc = renderDocuments.isEmpty() ? 0 : renderDocuments.takeLast();
+    int formRevision = doc ? renderDocumentFormRevisions.value( doc ) : 0;
+    renderDocumentsMutex.unlock();
+
+    if ( !doc )
+    {
+        if ( !documentFilePath.isEmpty() )
+            doc = Poppler::Document::load( documentFilePath, 0, 0 );
+        else if ( !documentData.isEmpty() )
+            doc = Poppler::Document::loadFromData( documentData, 0, 0 );
+
+        if ( doc && doc->isLocked() )
+            doc->unlock( documentPassword, documentPassword );
+        if ( doc && doc->isLocked() )
+        {
+            delete doc;
+            doc = 0;
+        }
+        if ( !doc )
+            return 0;
+    }
+
+    // sync the render settings with the ones of pdfdoc, they might have changed
+    userMutex()->lock();
+    const QColor paperColor = pdfdoc->paperColor();
+    const Poppler::Document::RenderHints hints = pdfdoc->renderHints();
+    userMutex()->unlock();
+    doc->setPaperColor( paperColor );
+    doc->setRenderHint( Poppler::Document::Antialiasing, hints & Poppler::Document::Antialiasing );
+    doc->setRenderHint( Poppler::Document::TextAntialiasing, hints & Poppler::Document::TextAntialiasing );
+#ifdef HAVE_POPPLER_0_12_1
+    doc->setRenderHint( Poppler::Document::TextHinting, hints & Poppler::Document::TextHinting );
+#endif
+
+    // the forms changed in pdfdoc, instead, are changed in the copy too
+    formRevision = annotProxy->copyFormChanges( doc, formRevision );
+    renderDocumentsMutex.lock();
+    renderDocumentFormRevisions.insert( doc, formRevision );
+    renderDocumentsMutex.unlock();
+
+    return doc;
+}
+
+void PDFGenerator::releaseRenderDocument( Poppler::Document *doc )
+{
+    const bool annotationsChanged = annotProxy->annotationsChanged();
+    QMutexLocker locker( &renderDocumentsMutex );
+    if ( annotationsChanged )
+    {
+        renderDocumentFormRevisions.remove( doc );
+        delete doc;
+        return;
+    }
+
+    renderDocuments.append( doc );
+}
+
 void PDFGenerator::resolveMovieLinkReference( Okular::Action *action, Okular::Page *page )
 {
 #ifdef HAVE_POPPLER_0_20
@@ -951,12 +1119,16 @@ Okular::TextPage* PDFGenerator::textPage( Okular::Page *page )
     // build a TextList...
     QList<Poppler::TextBox*> textList;
     double pageWidth, pageHeight;
-    Poppler::Page *pp = pdfdoc->page( page->number() );
+    // extract on a private copy of the document if possible, so that the text
+    // of more pages can be extracted at the same time (see ConcurrentRendering)
+    // without holding the GUI thread; else keep the whole access to pdfdoc locked
+    Poppler::Document *textdoc = acquireRenderDocument();
+    if ( !textdoc )
+        userMutex()->lock();
+    Poppler::Page *pp = ( textdoc ? textdoc : pdfdoc )->page( page->number() );
     if (pp)
     {
-        userMutex()->lock();
         textList = pp->textList();
-        userMutex()->unlock();
 
         QSizeF s = pp->pageSizeF();
         pageWidth = s.width();
@@ -969,6 +1141,10 @@ Okular::TextPage* PDFGenerator::textPage( Okular::Page *page )
         pageWidth = defaultPageWidth;
         pageHeight = defaultPageHeight;
     }
+    if ( textdoc )
+        releaseRenderDocument( textdoc );
+    else
+        userMutex()->unlock();
 
     Okular::TextPage *tp = abstractTextPage(textList, pageHeight, pageWidth, (Poppler::Page::Rotation)page->orientation());
     qDeleteAll(textList);
@@ -1462,13 +1638,13 @@ void PDFGenerator::addFormFields( Poppler::Page * popplerPage, Okular::Page * pa
         switch ( f->type() )
         {
             case Poppler::FormField::FormButton:
-                of = new PopplerFormFieldButton( static_cast<Poppler::FormFieldButton*>( f ) );
+                of = new PopplerFormFieldButton( static_cast<Poppler::FormFieldButton*>( f ), page->number(), annotProxy );
                 break;
             case Poppler::FormField::FormText:
-                of = new PopplerFormFieldText( static_cast<Poppler::FormFieldText*>( f ) );
+                of = new PopplerFormFieldText( static_cast<Poppler::FormFieldText*>( f ), page->number(), annotProxy );
                 break;
             case Poppler::FormField::FormChoice:
-                of = new PopplerFormFieldChoice( static_cast<Poppler::FormFieldChoice*>( f ) );
+                of = new PopplerFormFieldChoice( static_cast<Poppler::FormFieldChoice*>( f ), page->number(), annotProxy );
                 break;
             default: ;
         }
@@ -1644,6 +1820,19 @@ PDFGenerator::PrintError PDFGenerator::printError() const
     return lastPrintError;
 }
 
+QImage PDFGenerator::thumbnail( int page )
+{
+    // called in the thumbnail store thread, like textPage()
+    QMutexLocker locker( userMutex() );
+    Poppler::Page *pp = pdfdoc->page( page );
+    if ( !pp )
+        return QImage();
+
+    const QImage image = pp->thumbnail();
+    delete pp;
+    return image;
+}
+
 void PDFGenerator::fillViewportFromSourceReference( Okular::DocumentViewport & viewport, const QString & reference ) const
 {
     if ( !synctex_scanner )
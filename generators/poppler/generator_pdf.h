@@ -18,6 +18,8 @@
 #include <poppler-qt4.h>
 
 #include <qbitarray.h>
+#include <qhash.h>
+#include <qmutex.h>
 #include <qpointer.h>
 
 #include <core/document.h>
@@ -75,6 +77,8 @@ class PDFGenerator : public Okular::Generator, public Okular::ConfigInterface, p
 
         // [INHERITED] perform actions on document / pages
         QImage image( Okular::PixmapRequest *page );
+        void generatePixmap( Okular::PixmapRequest *request );
+        void generateTextPage( Okular::Page *page );
 
         // [INHERITED] print page using an already configured kprinter
         bool print( QPrinter& printer );
@@ -106,6 +110,13 @@ class PDFGenerator : public Okular::Generator, public Okular::ConfigInterface, p
         void requestFontData(const Okular::FontInfo &font, QByteArray *data);
         const Okular::SourceReference * dynamicSourceReference( int pageNr, double absX, double absY );
         Okular::Generator::PrintError printError() const;
+        QImage thumbnail( int page );
+        // fetch the annotations, the form fields, the actions and the transition of the page, if not done yet
+        void loadPageData( Okular::Page * page );
+
+    private slots:
+        // load the data of some of the pages not loaded yet, and schedule the next ones
+        void loadPendingPagesData();
 
     private:
         bool init(QVector<Okular::Page*> & pagesVector, const QString &walletKey);
@@ -132,9 +143,22 @@ class PDFGenerator : public Okular::Generator, public Okular::ConfigInterface, p
 
         bool setDocumentRenderHints();
 
+        // private copies of pdfdoc, used to render more pages at the same time
+        Poppler::Document *acquireRenderDocument();
+        void releaseRenderDocument( Poppler::Document *doc );
+
         // poppler dependant stuff
         Poppler::Document *pdfdoc;
 
+        // what is needed to open again the document, and the idle copies
+        QString documentFilePath;
+        QByteArray documentData;
+        QByteArray documentPassword;
+        QList<Poppler::Document*> renderDocuments;
+        // the revision of the form changes each copy is at
+        QHash<Poppler::Document*, int> renderDocumentFormRevisions;
+        QMutex renderDocumentsMutex;
+
 
         // misc variables for document info and synopsis caching
         bool docInfoDirty;
@@ -151,6 +175,12 @@ class PDFGenerator : public Okular::Generator, public Okular::ConfigInterface, p
 
         QBitArray rectsGenerated;
 
+        // the pages are created with their size only, the rest of their
+        // data is loaded when they are used or in background
+        QVector<Okular::Page*> pages;
+        QBitArray pageDataLoaded;
+        int nextPageData;
+
         QPointer<PDFOptionsPage> pdfOptionsPage;
         
         synctex_scanner_t synctex_scanner;
@@ -263,6 +263,16 @@ bool GSGenerator::canGeneratePixmap() const
     return !m_request;
 }
 
+bool GSGenerator::cancelPixmapRequest( Okular::PixmapRequest *request )
+{
+    // only the requests still waiting for the renderer can be cancelled
+    if ( request != m_request || !GSRendererThread::getCreateRenderer()->cancelRequest( request ) )
+        return false;
+
+    m_request = 0;
+    return true;
+}
+
 const Okular::DocumentInfo * GSGenerator::generateDocumentInfo()
 {
     if (!m_docInfo)
@@ -53,6 +53,9 @@ class GSGenerator : public Okular::Generator, public Okular::ConfigInterface
     protected:
         bool doCloseDocument();
 
+    protected slots:
+        bool cancelPixmapRequest( Okular::PixmapRequest *request );
+
     private:
         bool loadPages( QVector< Okular::Page * > & pagesVector );
         Okular::Rotation orientation(SpectreOrientation orientation) const;
@@ -17,6 +17,10 @@
 #include "core/page.h"
 #include "core/utils.h"
 
+// how many times a request can be passed over by requests with a better
+// priority, so that the ones of the documents in the background still get done
+static const int MaxPassedOver = 4;
+
 GSRendererThread *GSRendererThread::theRenderer = 0;
 
 GSRendererThread *GSRendererThread::getCreateRenderer()
@@ -38,11 +42,37 @@ GSRendererThread::~GSRendererThread()
 void GSRendererThread::addRequest(const GSRendererThreadRequest &req)
 {
     m_queueMutex.lock();
-    m_queue.enqueue(req);
+    // the requests of all the documents are queued by priority
+    int i = m_queue.count();
+    while (i > 0 && m_queue.at(i - 1).request->priority() > req.request->priority()
+           && m_queue.at(i - 1).passedOver < MaxPassedOver)
+    {
+        --i;
+        m_queue[i].passedOver++;
+    }
+    m_queue.insert(i, req);
     m_queueMutex.unlock();
     m_semaphore.release();
 }
 
+bool GSRendererThread::cancelRequest(Okular::PixmapRequest *request)
+{
+    QMutexLocker locker(&m_queueMutex);
+    for (int i = 0; i < m_queue.count(); ++i)
+    {
+        if (m_queue.at(i).request == request)
+        {
+            spectre_page_free(m_queue.at(i).spectrePage);
+            m_queue.removeAt(i);
+            // if the renderer took the count of the request already,
+            // it finds the queue empty and waits again
+            m_semaphore.tryAcquire();
+            return true;
+        }
+    }
+    return false;
+}
+
 void GSRendererThread::run()
 {
     while(1)
@@ -50,7 +80,12 @@ void GSRendererThread::run()
         m_semaphore.acquire();
         {
             m_queueMutex.lock();
-            GSRendererThreadRequest req = m_queue.dequeue();
+            if (m_queue.isEmpty())
+            {
+                m_queueMutex.unlock();
+                continue;
+            }
+            GSRendererThreadRequest req = m_queue.takeFirst();
             m_queueMutex.unlock();
 
             spectre_render_context_set_scale(m_renderContext, req.magnify, req.magnify);
@@ -10,8 +10,8 @@
 #ifndef _OKULAR_GSRENDERERTHREAD_H_
 #define _OKULAR_GSRENDERERTHREAD_H_
 
+#include <qlist.h>
 #include <qmutex.h>
-#include <qqueue.h>
 #include <qsemaphore.h>
 #include <qstring.h>
 #include <qthread.h>
@@ -37,6 +37,7 @@ struct GSRendererThreadRequest
         , magnify(1.0)
         , orientation(0)
         , platformFonts(true)
+        , passedOver(0)
     {}
 
     GSGenerator *owner;
@@ -47,6 +48,8 @@ struct GSRendererThreadRequest
     double magnify;
     int orientation;
     bool platformFonts;
+    // how many requests were queued before this one, despite coming later
+    int passedOver;
 };
 Q_DECLARE_TYPEINFO(GSRendererThreadRequest, Q_MOVABLE_TYPE);
 
@@ -59,6 +62,7 @@ Q_OBJECT
         ~GSRendererThread();
 
         void addRequest(const GSRendererThreadRequest &req);
+        bool cancelRequest(Okular::PixmapRequest *request);
 
     signals:
         void imageDone(QImage *image, Okular::PixmapRequest *request);
@@ -73,7 +77,7 @@ Q_OBJECT
         void run();
 
         SpectreRenderContext *m_renderContext;
-        QQueue<GSRendererThreadRequest> m_queue;
+        QList<GSRendererThreadRequest> m_queue;
         QMutex m_queueMutex;
 };
 
@@ -15,7 +15,9 @@
 #include <qfileinfo.h>
 #include <qimage.h>
 #include <qlist.h>
+#include <qmutex.h>
 #include <qpainter.h>
+#include <qvector.h>
 #include <QtGui/QPrinter>
 
 #include <kaboutdata.h>
@@ -31,8 +33,15 @@
 #include <tiff.h>
 #include <tiffio.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define TiffDebug 4714
 
+// biggest band of decoded RGBA rows kept in memory while downscaling a page
+static const uint32 MaxBandBytes = 8 * 1024 * 1024;
+
 tsize_t okular_tiffReadProc( thandle_t handle, tdata_t buf, tsize_t size )
 {
     QIODevice * device = static_cast< QIODevice * >( handle );
@@ -86,17 +95,326 @@ void okular_tiffUnmapProc( thandle_t, tdata_t, toff_t )
 }
 
 
+// a reduced-resolution version of a page, either in its SubIFDs or
+// following it in the main directory chain
+struct ResolutionLevel
+{
+    toff_t offset;
+    uint32 width;
+    uint32 height;
+};
+
 class TIFFGenerator::Private
 {
     public:
         Private()
           : tiff( 0 ), dev( 0 ) {}
 
+        TIFF* acquireRenderHandle();
+        void releaseRenderHandle( TIFF *handle );
+        void closeRenderHandles();
+
         TIFF* tiff;
         QByteArray data;
         QIODevice* dev;
+        QString fileName;
+        // idle handles used by the rendering threads, each one with its own device
+        QList< TIFF* > renderHandles;
+        QMutex renderHandlesMutex;
+        // directory -> reduced-resolution levels of that page
+        QHash< int, QList< ResolutionLevel > > reducedLevels;
+};
+
+TIFF* TIFFGenerator::Private::acquireRenderHandle()
+{
+    renderHandlesMutex.lock();
+    TIFF *handle = renderHandles.isEmpty() ? 0 : renderHandles.takeLast();
+    renderHandlesMutex.unlock();
+    if ( handle )
+        return handle;
+
+    QIODevice *device = 0;
+    QByteArray name;
+    if ( !fileName.isEmpty() )
+    {
+        device = new QFile( fileName );
+        name = QFile::encodeName( QFileInfo( fileName ).fileName() );
+    }
+    else
+    {
+        QBuffer *buffer = new QBuffer();
+        buffer->setData( data );
+        device = buffer;
+        name = "<stdin>";
+    }
+    if ( !device->open( QIODevice::ReadOnly ) )
+    {
+        delete device;
+        return 0;
+    }
+
+    handle = TIFFClientOpen( name.constData(), "r", device,
+                  okular_tiffReadProc, okular_tiffWriteProc, okular_tiffSeekProc,
+                  okular_tiffCloseProc, okular_tiffSizeProc,
+                  okular_tiffMapProc, okular_tiffUnmapProc );
+    if ( !handle )
+        delete device;
+
+    return handle;
+}
+
+void TIFFGenerator::Private::releaseRenderHandle( TIFF *handle )
+{
+    QMutexLocker locker( &renderHandlesMutex );
+    renderHandles.append( handle );
+}
+
+void TIFFGenerator::Private::closeRenderHandles()
+{
+    QMutexLocker locker( &renderHandlesMutex );
+    foreach ( TIFF *handle, renderHandles )
+    {
+        QIODevice *device = static_cast< QIODevice * >( TIFFClientdata( handle ) );
+        TIFFClose( handle );
+        delete device;
+    }
+    renderHandles.clear();
+}
+
+// an image read by TIFFRGBAImage is ABGR, we need ARGB, so swap red and blue
+static void swapRedBlue( uint32 *data, uint32 size )
+{
+    uint32 i = 0;
+#ifdef __SSE2__
+    const __m128i agMask = _mm_set1_epi32( 0xFF00FF00 );
+    const __m128i rbMask = _mm_set1_epi32( 0x00FF00FF );
+    for ( ; i + 4 <= size; i += 4 )
+    {
+        __m128i *p = reinterpret_cast< __m128i * >( data + i );
+        const __m128i pixels = _mm_loadu_si128( p );
+        const __m128i rb = _mm_and_si128( pixels, rbMask );
+        const __m128i swapped = _mm_or_si128( _mm_slli_epi32( rb, 16 ), _mm_srli_epi32( rb, 16 ) );
+        _mm_storeu_si128( p, _mm_or_si128( _mm_and_si128( pixels, agMask ), swapped ) );
+    }
+#endif
+    for ( ; i < size; ++i )
+    {
+        uint32 red = ( data[i] & 0x00FF0000 ) >> 16;
+        uint32 blue = ( data[i] & 0x000000FF ) << 16;
+        data[i] = ( data[i] & 0xFF00FF00 ) + red + blue;
+    }
+}
+
+/*
+ * Box-filters the rows of an image, in the ABGR format of TIFFRGBAImage,
+ * down to an image of @p outWidth x @p outHeight; the rows are given in
+ * order, a band at a time.
+ */
+class ScaledImageBuilder
+{
+    public:
+        ScaledImageBuilder( uint32 width, uint32 height, int outWidth, int outHeight )
+            : m_width( width ), m_height( height ), m_columnMap( width ), m_columnCount( outWidth, 0 ),
+              m_image( outWidth, outHeight, QImage::Format_RGB32 ), m_sums( outWidth * 3, 0 ),
+              m_currentRow( 0 ), m_rowsInSums( 0 ), m_nextRow( 0 )
+        {
+            // every source column and row falls in exactly one output pixel
+            for ( uint32 x = 0; x < width; ++x )
+            {
+                m_columnMap[ x ] = (quint64)x * outWidth / width * 3;
+                ++m_columnCount[ m_columnMap[ x ] / 3 ];
+            }
+        }
+
+        void addRows( const uint32 *rows, uint32 count )
+        {
+            for ( uint32 y = 0; y < count; ++y, ++m_nextRow )
+            {
+                const int outRow = (quint64)m_nextRow * m_image.height() / m_height;
+                if ( outRow != m_currentRow )
+                {
+                    flushRow();
+                    m_currentRow = outRow;
+                }
+
+                // the channels are summed straight from ABGR, so no swap is needed
+                const uint32 *src = rows + y * m_width;
+                quint64 *sum = m_sums.data();
+                for ( uint32 x = 0; x < m_width; ++x )
+                {
+                    quint64 *s = sum + m_columnMap[ x ];
+                    s[0] += TIFFGetR( src[ x ] );
+                    s[1] += TIFFGetG( src[ x ] );
+                    s[2] += TIFFGetB( src[ x ] );
+                }
+                ++m_rowsInSums;
+            }
+        }
+
+        QImage image()
+        {
+            flushRow();
+            return m_image;
+        }
+
+    private:
+        // writes the averages accumulated in m_sums as the current row of the image
+        void flushRow()
+        {
+            if ( !m_rowsInSums )
+                return;
+
+            QRgb *line = reinterpret_cast< QRgb * >( m_image.scanLine( m_currentRow ) );
+            quint64 *sum = m_sums.data();
+            for ( int x = 0; x < m_image.width(); ++x, sum += 3 )
+            {
+                const quint64 count = (quint64)m_columnCount[ x ] * m_rowsInSums;
+                line[ x ] = qRgb( int( ( sum[0] + count / 2 ) / count ), int( ( sum[1] + count / 2 ) / count ), int( ( sum[2] + count / 2 ) / count ) );
+                sum[0] = sum[1] = sum[2] = 0;
+            }
+            m_rowsInSums = 0;
+        }
+
+        uint32 m_width;
+        uint32 m_height;
+        QVector< int > m_columnMap;
+        QVector< uint32 > m_columnCount;
+        QImage m_image;
+        QVector< quint64 > m_sums;
+        int m_currentRow;
+        uint32 m_rowsInSums;
+        uint32 m_nextRow;
 };
 
+/*
+ * Returns whether the scanlines of the current directory of @p tiff are in
+ * one of the simple formats (bilevel, 8 bit gray or RGB) turned into ABGR
+ * pixels by scanlineToABGR().
+ */
+static bool canConvertScanlines( TIFF *tiff, uint16 *photometric, uint16 *bitsPerSample, uint16 *samplesPerPixel )
+{
+    uint16 planar = PLANARCONFIG_CONTIG;
+    if ( !TIFFGetField( tiff, TIFFTAG_PHOTOMETRIC, photometric ) )
+        return false;
+    TIFFGetFieldDefaulted( tiff, TIFFTAG_BITSPERSAMPLE, bitsPerSample );
+    TIFFGetFieldDefaulted( tiff, TIFFTAG_SAMPLESPERPIXEL, samplesPerPixel );
+    TIFFGetFieldDefaulted( tiff, TIFFTAG_PLANARCONFIG, &planar );
+
+    switch ( *photometric )
+    {
+        case PHOTOMETRIC_MINISWHITE:
+        case PHOTOMETRIC_MINISBLACK:
+            return *samplesPerPixel == 1 && ( *bitsPerSample == 1 || *bitsPerSample == 8 );
+        case PHOTOMETRIC_RGB:
+            return planar == PLANARCONFIG_CONTIG && *bitsPerSample == 8 && ( *samplesPerPixel == 3 || *samplesPerPixel == 4 );
+    }
+    return false;
+}
+
+static void scanlineToABGR( const uchar *line, uint32 width, uint16 photometric, uint16 bitsPerSample, uint16 samplesPerPixel, uint32 *abgr )
+{
+    for ( uint32 x = 0; x < width; ++x )
+    {
+        uint32 r, g, b;
+        if ( photometric == PHOTOMETRIC_RGB )
+        {
+            const uchar *pixel = line + x * samplesPerPixel;
+            r = pixel[0];
+            g = pixel[1];
+            b = pixel[2];
+        }
+        else
+        {
+            if ( bitsPerSample == 1 )
+                r = ( line[ x >> 3 ] >> ( 7 - ( x & 7 ) ) ) & 1 ? 255 : 0;
+            else
+                r = line[ x ];
+            if ( photometric == PHOTOMETRIC_MINISWHITE )
+                r = 255 - r;
+            g = b = r;
+        }
+        abgr[ x ] = 0xff000000 | ( b << 16 ) | ( g << 8 ) | r;
+    }
+}
+
+/*
+ * Reads the current directory of @p tiff, which is @p width x @p height
+ * and at least as big as @p outWidth x @p outHeight, box-filtering it down
+ * to the requested size.
+ * Only a strip (or a row of tiles) is decoded at a time, so the memory used
+ * depends on the output size and not on the size of the page; the images
+ * in a single strip, common for scans and faxes, are read a scanline at a
+ * time when their format allows that.
+ */
+static bool readScaledImage( TIFF *tiff, uint32 width, uint32 height, uint32 orientation, int outWidth, int outHeight, QImage *result )
+{
+    ScaledImageBuilder builder( width, height, outWidth, outHeight );
+
+    uint32 stripHeight = 0;
+    if ( TIFFIsTiled( tiff ) )
+        TIFFGetField( tiff, TIFFTAG_TILELENGTH, &stripHeight );
+    else
+        TIFFGetFieldDefaulted( tiff, TIFFTAG_ROWSPERSTRIP, &stripHeight );
+
+    uint16 photometric = 0, bitsPerSample = 1, samplesPerPixel = 1;
+    if ( !TIFFIsTiled( tiff ) && stripHeight >= height && orientation == ORIENTATION_TOPLEFT
+         && canConvertScanlines( tiff, &photometric, &bitsPerSample, &samplesPerPixel ) )
+    {
+        QVector< uchar > line( TIFFScanlineSize( tiff ) );
+        QVector< uint32 > abgr( width );
+        for ( uint32 row = 0; row < height; ++row )
+        {
+            if ( TIFFReadScanline( tiff, line.data(), row, 0 ) < 0 )
+                return false;
+            scanlineToABGR( line.constData(), width, photometric, bitsPerSample, samplesPerPixel, abgr.data() );
+            builder.addRows( abgr.constData(), 1 );
+        }
+        *result = builder.image();
+        return true;
+    }
+
+    char emsg[1024];
+    TIFFRGBAImage rgba;
+    if ( !TIFFRGBAImageOK( tiff, emsg ) || !TIFFRGBAImageBegin( &rgba, tiff, 0, emsg ) )
+    {
+        kDebug(TiffDebug) << "Cannot decode the image:" << emsg;
+        return false;
+    }
+    // same orientation as the file, so no flipping happens (like in the full size path)
+    rgba.req_orientation = orientation;
+
+    // a band never splits a strip (or a row of tiles), as every band asked to
+    // TIFFRGBAImageGet() decodes its strips from their start; so the single
+    // strip of an image not readable by scanlines is decoded once, as a whole
+    const uint32 maxBandHeight = qMax( (uint32)1, MaxBandBytes / ( width * 4 ) );
+    uint32 bandHeight = maxBandHeight;
+    if ( stripHeight > 0 )
+        bandHeight = qMax( (uint32)1, maxBandHeight / stripHeight ) * stripHeight;
+    bandHeight = qMin( bandHeight, height );
+
+    QVector< uint32 > band( width * bandHeight );
+    bool ok = true;
+    for ( uint32 row = 0; row < height; row += bandHeight )
+    {
+        const uint32 rows = qMin( bandHeight, height - row );
+        rgba.row_offset = row;
+        rgba.col_offset = 0;
+        if ( !TIFFRGBAImageGet( &rgba, band.data(), width, rows ) )
+        {
+            ok = false;
+            break;
+        }
+        builder.addRows( band.constData(), rows );
+    }
+    TIFFRGBAImageEnd( &rgba );
+
+    if ( !ok )
+        return false;
+
+    *result = builder.image();
+    return true;
+}
+
 static QDateTime convertTIFFDateTime( const char* tiffdate )
 {
     if ( !tiffdate )
@@ -181,6 +499,7 @@ TIFFGenerator::TIFFGenerator( QObject *parent, const QVariantList &args )
       d( new Private ), m_docInfo( 0 )
 {
     setFeature( Threaded );
+    setFeature( ConcurrentRendering );
     setFeature( PrintNative );
     setFeature( PrintToFile );
     setFeature( ReadRawData );
@@ -188,6 +507,7 @@ TIFFGenerator::TIFFGenerator( QObject *parent, const QVariantList &args )
 
 TIFFGenerator::~TIFFGenerator()
 {
+    d->closeRenderHandles();
     if ( d->tiff )
     {
         TIFFClose( d->tiff );
@@ -203,6 +523,7 @@ bool TIFFGenerator::loadDocument( const QString & fileName, QVector<Okular::Page
     QFile* qfile = new QFile( fileName );
     qfile->open( QIODevice::ReadOnly );
     d->dev = qfile;
+    d->fileName = fileName;
     d->data = QFile::encodeName( QFileInfo( *qfile ).fileName() );
     return loadTiff( pagesVector, d->data.constData() );
 }
@@ -238,6 +559,7 @@ bool TIFFGenerator::loadTiff( QVector< Okular::Page * > & pagesVector, const cha
 bool TIFFGenerator::doCloseDocument()
 {
     // closing the old document
+    d->closeRenderHandles();
     if ( d->tiff )
     {
         TIFFClose( d->tiff );
@@ -245,9 +567,11 @@ bool TIFFGenerator::doCloseDocument()
         delete d->dev;
         d->dev = 0;
         d->data.clear();
+        d->fileName.clear();
         delete m_docInfo;
         m_docInfo = 0;
         m_pageMapping.clear();
+        d->reducedLevels.clear();
     }
 
     return true;
@@ -258,43 +582,80 @@ QImage TIFFGenerator::image( Okular::PixmapRequest * request )
     bool generated = false;
     QImage img;
 
-    if ( TIFFSetDirectory( d->tiff, mapPage( request->page()->number() ) ) )
+    // every rendering thread works on its own handle, as the current
+    // directory is part of the TIFF state
+    TIFF *tiff = d->acquireRenderHandle();
+
+    const int dir = mapPage( request->page()->number() );
+    if ( tiff && TIFFSetDirectory( tiff, dir ) )
     {
         int rotation = request->page()->rotation();
+        int reqwidth = request->width();
+        int reqheight = request->height();
+        if ( rotation % 2 == 1 )
+            qSwap( reqwidth, reqheight );
+
         uint32 width = 1;
         uint32 height = 1;
         uint32 orientation = 0;
-        TIFFGetField( d->tiff, TIFFTAG_IMAGEWIDTH, &width );
-        TIFFGetField( d->tiff, TIFFTAG_IMAGELENGTH, &height );
-
-        if ( !TIFFGetField( d->tiff, TIFFTAG_ORIENTATION, &orientation ) )
-            orientation = ORIENTATION_TOPLEFT;
+        TIFFGetField( tiff, TIFFTAG_IMAGEWIDTH, &width );
+        TIFFGetField( tiff, TIFFTAG_IMAGELENGTH, &height );
 
-        QImage image( width, height, QImage::Format_RGB32 );
-        uint32 * data = (uint32 *)image.bits();
-
-        // read data
-        if ( TIFFReadRGBAImageOriented( d->tiff, width, height, data, orientation ) != 0 )
+        // use the smallest reduced-resolution level still big enough for the request
+        const ResolutionLevel *level = 0;
+        const QList< ResolutionLevel > levels = d->reducedLevels.value( dir );
+        for ( int i = 0; i < levels.count(); ++i )
+        {
+            const ResolutionLevel &l = levels.at( i );
+            if ( l.width >= (uint32)reqwidth && l.height >= (uint32)reqheight
+                 && (quint64)l.width * l.height < (quint64)width * height
+                 && ( !level || (quint64)l.width * l.height < (quint64)level->width * level->height ) )
+                level = &l;
+        }
+        bool dirOk = true;
+        if ( level )
         {
-            // an image read by ReadRGBAImage is ABGR, we need ARGB, so swap red and blue
-            uint32 size = width * height;
-            for ( uint32 i = 0; i < size; ++i )
+            if ( TIFFSetSubDirectory( tiff, level->offset ) )
             {
-                uint32 red = ( data[i] & 0x00FF0000 ) >> 16;
-                uint32 blue = ( data[i] & 0x000000FF ) << 16;
-                data[i] = ( data[i] & 0xFF00FF00 ) + red + blue;
+                width = level->width;
+                height = level->height;
             }
+            else
+            {
+                dirOk = TIFFSetDirectory( tiff, dir );
+            }
+        }
 
-            int reqwidth = request->width();
-            int reqheight = request->height();
-            if ( rotation % 2 == 1 )
-                qSwap( reqwidth, reqheight );
-            img = image.scaled( reqwidth, reqheight, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+        if ( !TIFFGetField( tiff, TIFFTAG_ORIENTATION, &orientation ) )
+            orientation = ORIENTATION_TOPLEFT;
 
-            generated = true;
+        if ( !dirOk )
+        {
+            kWarning(TiffDebug) << "Cannot go back to the directory of page" << request->page()->number();
+        }
+        else if ( width >= (uint32)reqwidth && height >= (uint32)reqheight )
+        {
+            generated = readScaledImage( tiff, width, height, orientation, reqwidth, reqheight, &img );
+        }
+        else
+        {
+            QImage image( width, height, QImage::Format_RGB32 );
+            uint32 * data = (uint32 *)image.bits();
+
+            // read data
+            if ( TIFFReadRGBAImageOriented( tiff, width, height, data, orientation ) != 0 )
+            {
+                swapRedBlue( data, width * height );
+                img = image.scaled( reqwidth, reqheight, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+
+                generated = true;
+            }
         }
     }
 
+    if ( tiff )
+        d->releaseRenderHandle( tiff );
+
     if ( !generated )
     {
         img = QImage( request->width(), request->height(), QImage::Format_RGB32 );
@@ -364,6 +725,29 @@ void TIFFGenerator::loadPages( QVector<Okular::Page*> & pagesVector )
              TIFFGetField( d->tiff, TIFFTAG_IMAGELENGTH, &height ) != 1 )
             continue;
 
+        // a reduced-resolution image in the main chain belongs to the page before it
+        uint32 subfiletype = 0;
+        if ( realdirs > 0 && TIFFGetField( d->tiff, TIFFTAG_SUBFILETYPE, &subfiletype )
+             && ( subfiletype & FILETYPE_REDUCEDIMAGE ) )
+        {
+            ResolutionLevel level;
+            level.offset = TIFFCurrentDirOffset( d->tiff );
+            level.width = width;
+            level.height = height;
+            d->reducedLevels[ m_pageMapping.value( realdirs - 1 ) ].append( level );
+            continue;
+        }
+
+        // the SubIFD offsets, copied as switching directory frees them
+        QVector< toff_t > subIfds;
+        uint16 subIfdCount = 0;
+        toff_t *subIfdOffsets = 0;
+        if ( TIFFGetField( d->tiff, TIFFTAG_SUBIFD, &subIfdCount, &subIfdOffsets ) && subIfdOffsets )
+        {
+            for ( uint16 j = 0; j < subIfdCount; ++j )
+                subIfds.append( subIfdOffsets[ j ] );
+        }
+
         adaptSizeToResolution( d->tiff, TIFFTAG_XRESOLUTION, dpiX, &width );
         adaptSizeToResolution( d->tiff, TIFFTAG_YRESOLUTION, dpiY, &height );
 
@@ -372,6 +756,27 @@ void TIFFGenerator::loadPages( QVector<Okular::Page*> & pagesVector )
 
         m_pageMapping[ realdirs ] = i;
 
+        foreach ( toff_t offset, subIfds )
+        {
+            uint32 levelWidth = 0;
+            uint32 levelHeight = 0;
+            uint32 levelType = 0;
+            if ( !TIFFSetSubDirectory( d->tiff, offset )
+                 || TIFFGetField( d->tiff, TIFFTAG_IMAGEWIDTH, &levelWidth ) != 1
+                 || TIFFGetField( d->tiff, TIFFTAG_IMAGELENGTH, &levelHeight ) != 1 )
+                continue;
+
+            // SubIFDs can hold other things than smaller versions of the page
+            if ( TIFFGetField( d->tiff, TIFFTAG_SUBFILETYPE, &levelType ) && !( levelType & FILETYPE_REDUCEDIMAGE ) )
+                continue;
+
+            ResolutionLevel level;
+            level.offset = offset;
+            level.width = levelWidth;
+            level.height = levelHeight;
+            d->reducedLevels[ i ].append( level );
+        }
+
         ++realdirs;
     }
 
@@ -403,16 +808,7 @@ bool TIFFGenerator::print( QPrinter& printer )
 
         // read data
         if ( TIFFReadRGBAImageOriented( d->tiff, width, height, data, ORIENTATION_TOPLEFT ) != 0 )
-        {
-            // an image read by ReadRGBAImage is ABGR, we need ARGB, so swap red and blue
-            uint32 size = width * height;
-            for ( uint32 i = 0; i < size; ++i )
-            {
-                uint32 red = ( data[i] & 0x00FF0000 ) >> 16;
-                uint32 blue = ( data[i] & 0x000000FF ) << 16;
-                data[i] = ( data[i] & 0xFF00FF00 ) + red + blue;
-            }
-        }
+            swapRedBlue( data, width * height );
 
         if ( i != 0 )
             printer.newPage();
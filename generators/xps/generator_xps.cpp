@@ -24,6 +24,7 @@
 #include <qlist.h>
 #include <qpainter.h>
 #include <qprinter.h>
+#include <qtimer.h>
 #include <kaboutdata.h>
 #include <kglobal.h>
 #include <klocale.h>
@@ -31,6 +32,7 @@
 #include <QBuffer>
 #include <QImageReader>
 #include <QMutex>
+#include <QSet>
 
 #include <core/document.h>
 #include <core/page.h>
@@ -570,7 +572,7 @@ static const KArchiveEntry* loadEntry( KZip *archive, const QString &fileName, Q
         entryName = fileName;
     }
     const KArchiveEntry * newEntry = archive->directory()->entry( path );
-    if ( newEntry->isDirectory() ) {
+    if ( newEntry && newEntry->isDirectory() ) {
         const KArchiveDirectory* relDir = static_cast< const KArchiveDirectory * >( newEntry );
         QStringList relEntries = relDir->entries();
         qSort( relEntries );
@@ -586,7 +588,7 @@ static const KArchiveEntry* loadEntry( KZip *archive, const QString &fileName, Q
 static const KZipFileEntry* loadFile( KZip *archive, const QString &fileName, Qt::CaseSensitivity cs )
 {
     const KArchiveEntry *entry = loadEntry( archive, fileName, cs );
-    return entry->isFile() ? static_cast< const KZipFileEntry * >( entry ) : 0;
+    return entry && entry->isFile() ? static_cast< const KZipFileEntry * >( entry ) : 0;
 }
 
 /**
@@ -744,9 +746,12 @@ static QString unicodeString( const QString &raw )
 }
 
 
-XpsHandler::XpsHandler(XpsPage *page): m_page(page)
+XpsHandler::XpsHandler(XpsPage *page): m_page(page), m_opacity(1.0),
+    m_metricsDevice( 1, 1, QImage::Format_ARGB32 )
 {
-    m_painter = NULL;
+    // Set one point = one drawing unit. Useful for fonts, because xps specifies font size using drawing units, not points as usual
+    m_metricsDevice.setDotsPerMeterX( 2835 );
+    m_metricsDevice.setDotsPerMeterY( 2835 );
 }
 
 XpsHandler::~XpsHandler()
@@ -810,7 +815,9 @@ void XpsHandler::processGlyph( XpsRenderNode &node )
 
     QString att;
 
-    m_painter->save();
+    XpsDisplayItem item;
+    item.matrix = m_matrix;
+    item.opacity = m_opacity;
 
     // Get font (doesn't work well because qt doesn't allow to load font from file)
     // This works despite the fact that font size isn't specified in points as required by qt. It's because I set point size to be equal to drawing unit.
@@ -818,7 +825,6 @@ void XpsHandler::processGlyph( XpsRenderNode &node )
     // kDebug(XpsDebug) << "Font Rendering EmSize:" << fontSize;
     // a value of 0.0 means the text is not visible (see XPS specs, chapter 12, "Glyphs")
     if ( fontSize < 0.1 ) {
-        m_painter->restore();
         return;
     }
     QFont font = m_page->m_file->getFontByName( node.attributes.value("FontUri"), fontSize );
@@ -833,7 +839,7 @@ void XpsHandler::processGlyph( XpsRenderNode &node )
             font.setBold( true );
         }
     }
-    m_painter->setFont(font);
+    item.font = font;
 
     //Origin
     QPointF origin( node.attributes.value("OriginX").toDouble(), node.attributes.value("OriginY").toDouble() );
@@ -848,19 +854,17 @@ void XpsHandler::processGlyph( XpsRenderNode &node )
         } else {
             // no "Fill" attribute and no "Glyphs.Fill" child, so show nothing
             // (see XPS specs, 5.10)
-            m_painter->restore();
             return;
         }
     } else {
         brush = parseRscRefColorForBrush( att );
         if ( brush.style() > Qt::NoBrush && brush.style() < Qt::LinearGradientPattern
              && brush.color().alpha() == 0 ) {
-            m_painter->restore();
             return;
         }
     }
-    m_painter->setBrush( brush );
-    m_painter->setPen( QPen( brush, 0 ) );
+    item.brush = brush;
+    item.pen = QPen( brush, 0 );
 
     // Opacity
     att = node.attributes.value("Opacity");
@@ -868,9 +872,8 @@ void XpsHandler::processGlyph( XpsRenderNode &node )
         bool ok = true;
         double value = att.toDouble( &ok );
         if ( ok && value >= 0.1 ) {
-            m_painter->setOpacity( value );
+            item.opacity = value;
         } else {
-            m_painter->restore();
             return;
         }
     }
@@ -878,25 +881,21 @@ void XpsHandler::processGlyph( XpsRenderNode &node )
     //RenderTransform
     att = node.attributes.value("RenderTransform");
     if (!att.isEmpty()) {
-        m_painter->setWorldMatrix( parseRscRefMatrix( att ), true);
+        item.matrix = parseRscRefMatrix( att ) * item.matrix;
     }
 
     // Clip
     att = node.attributes.value( "Clip" );
     if ( !att.isEmpty() ) {
-        QPainterPath clipPath = parseRscRefPath( att );
-        if ( !clipPath.isEmpty() ) {
-            m_painter->setClipPath( clipPath );
-        }
+        item.clipPath = parseRscRefPath( att );
     }
 
     // BiDiLevel - default Left-to-Right
-    m_painter->setLayoutDirection( Qt::LeftToRight );
     att = node.attributes.value( "BiDiLevel" );
     if ( !att.isEmpty() ) {
         if ( (att.toInt() % 2) == 1 ) {
             // odd BiDiLevel, so Right-to-Left
-            m_painter->setLayoutDirection( Qt::RightToLeft );
+            item.layoutDirection = Qt::RightToLeft;
         }
     }
 
@@ -929,12 +928,13 @@ void XpsHandler::processGlyph( XpsRenderNode &node )
     }
 
     // UnicodeString
-    QString stringToDraw( unicodeString( node.attributes.value( "UnicodeString" ) ) );
+    item.text = unicodeString( node.attributes.value( "UnicodeString" ) );
+    item.positions.reserve( item.text.size() );
     QPointF originAdvance(0, 0);
-    QFontMetrics metrics = m_painter->fontMetrics();
-    for ( int i = 0; i < stringToDraw.size(); ++i ) {
-        QChar thisChar = stringToDraw.at( i );
-        m_painter->drawText( origin + originAdvance, QString( thisChar ) );
+    QFontMetrics metrics( font, &m_metricsDevice );
+    for ( int i = 0; i < item.text.size(); ++i ) {
+        QChar thisChar = item.text.at( i );
+        item.positions.append( origin + originAdvance );
 	const qreal advanceWidth = advanceWidths.value( i, qreal(-1.0) );
         if ( advanceWidth > 0.0 ) {
             originAdvance.rx() += advanceWidth;
@@ -946,7 +946,9 @@ void XpsHandler::processGlyph( XpsRenderNode &node )
     // kDebug(XpsDebug) << "    Origin: " << atts.value("OriginX") << "," << atts.value("OriginY");
     // kDebug(XpsDebug) << "    Unicode: " << atts.value("UnicodeString");
 
-    m_painter->restore();
+    if ( !item.text.isEmpty() && item.opacity > 0.0 ) {
+        m_page->m_displayList.append( item );
+    }
 }
 
 void XpsHandler::processFill( XpsRenderNode &node )
@@ -1014,11 +1016,14 @@ void XpsHandler::processPath( XpsRenderNode &node )
     //TODO Ignored attributes: Clip, OpacityMask, StrokeEndLineCap, StorkeStartLineCap, Name, FixedPage.NavigateURI, xml:lang, x:key, AutomationProperties.Name, AutomationProperties.HelpText, SnapsToDevicePixels
     //TODO Ignored child elements: RenderTransform, Clip, OpacityMask
     // Handled separately: RenderTransform
-    m_painter->save();
 
     QString att;
     QVariant data;
 
+    XpsDisplayItem item;
+    item.matrix = m_matrix;
+    item.opacity = m_opacity;
+
     // Get path
     XpsPathGeometry * pathdata = node.getChildData( "Path.Data" ).value< XpsPathGeometry * >();
     att = node.attributes.value( "Data" );
@@ -1030,7 +1035,6 @@ void XpsHandler::processPath( XpsRenderNode &node )
     }
     if ( !pathdata ) {
         // nothing to draw
-        m_painter->restore();
         return;
     }
 
@@ -1045,7 +1049,6 @@ void XpsHandler::processPath( XpsRenderNode &node )
             brush = data.value<QBrush>();
         }
     }
-    m_painter->setBrush( brush );
 
     // Stroke (pen)
     att = node.attributes.value( "Stroke" );
@@ -1124,31 +1127,32 @@ void XpsHandler::processPath( XpsRenderNode &node )
             pen.setMiterLimit( limit / 2 );
         }
     }
-    m_painter->setPen( pen );
+    item.pen = pen;
 
     // Opacity
     att = node.attributes.value("Opacity");
     if (! att.isEmpty()) {
-        m_painter->setOpacity(att.toDouble());
+        item.opacity = att.toDouble();
     }
 
     // RenderTransform
     att = node.attributes.value( "RenderTransform" );
     if (! att.isEmpty() ) {
-        m_painter->setWorldMatrix( parseRscRefMatrix( att ), true );
+        item.matrix = parseRscRefMatrix( att ) * item.matrix;
     }
     if ( !pathdata->transform.isIdentity() ) {
-        m_painter->setWorldMatrix( pathdata->transform, true );
+        item.matrix = pathdata->transform * item.matrix;
     }
 
-    Q_FOREACH ( XpsPathFigure *figure, pathdata->paths ) {
-        m_painter->setBrush( figure->isFilled ? brush : QBrush() );
-        m_painter->drawPath( figure->path );
+    if ( item.opacity > 0.0 ) {
+        Q_FOREACH ( XpsPathFigure *figure, pathdata->paths ) {
+            item.brush = figure->isFilled ? brush : QBrush();
+            item.path = figure->path;
+            m_page->m_displayList.append( item );
+        }
     }
 
     delete pathdata;
-
-    m_painter->restore();
 }
 
 void XpsHandler::processPathData( XpsRenderNode &node )
@@ -1289,20 +1293,20 @@ void XpsHandler::processPathFigure( XpsRenderNode &node )
 void XpsHandler::processStartElement( XpsRenderNode &node )
 {
     if (node.name == "Canvas") {
-        m_painter->save();
+        m_savedStates.push( qMakePair( m_matrix, m_opacity ) );
         QString att = node.attributes.value( "RenderTransform" );
         if ( !att.isEmpty() ) {
-            m_painter->setWorldMatrix( parseRscRefMatrix( att ), true );
+            m_matrix = parseRscRefMatrix( att ) * m_matrix;
         }
         att = node.attributes.value( "Opacity" );
         if ( !att.isEmpty() ) {
             double value = att.toDouble();
             if ( value > 0.0 && value <= 1.0 ) {
-                m_painter->setOpacity( m_painter->opacity() * value );
+                m_opacity = m_opacity * value;
             } else {
                 // setting manually to 0 is necessary to "disable"
                 // all the stuff inside
-                m_painter->setOpacity( 0.0 );
+                m_opacity = 0.0;
             }
         }
     }
@@ -1320,10 +1324,14 @@ void XpsHandler::processEndElement( XpsRenderNode &node )
     } else if ((node.name == "Canvas.RenderTransform") || (node.name == "Glyphs.RenderTransform") || (node.name == "Path.RenderTransform"))  {
         QVariant data = node.getRequiredChildData( "MatrixTransform" );
         if (data.canConvert<QMatrix>()) {
-            m_painter->setWorldMatrix( data.value<QMatrix>(), true );
+            m_matrix = data.value<QMatrix>() * m_matrix;
         }
     } else if (node.name == "Canvas") {
-        m_painter->restore();
+        if ( !m_savedStates.isEmpty() ) {
+            const QPair<QMatrix, qreal> state = m_savedStates.pop();
+            m_matrix = state.first;
+            m_opacity = state.second;
+        }
     } else if ((node.name == "Path.Fill") || (node.name == "Glyphs.Fill")) {
         processFill( node );
     } else if (node.name == "Path.Stroke") {
@@ -1400,13 +1408,17 @@ void XpsHandler::processEndElement( XpsRenderNode &node )
     }
 }
 
-XpsPage::XpsPage(XpsFile *file, const QString &fileName): m_file( file ),
-    m_fileName( fileName ), m_pageIsRendered(false)
+XpsPage::XpsPage(XpsFile *file, const QString &fileName, const QSizeF &sizeHint): m_file( file ),
+    m_fileName( fileName ), m_pageSize( sizeHint ), m_thumbnailIsLoaded( false ),
+    m_displayListLoaded( false ), m_displayListMemory( 0 )
 {
-    m_pageImage = NULL;
-
     // kDebug(XpsDebug) << "page file name: " << fileName;
 
+    if ( m_pageSize.isValid() ) {
+        // no need to read the page now
+        return;
+    }
+
     const KZipFileEntry* pageFile = static_cast<const KZipFileEntry *>(m_file->xpsArchive()->directory()->entry( fileName ));
 
     QXmlStreamReader xml;
@@ -1430,38 +1442,58 @@ XpsPage::XpsPage(XpsFile *file, const QString &fileName): m_file( file ),
 
 XpsPage::~XpsPage()
 {
-    delete m_pageImage;
 }
 
 bool XpsPage::renderToImage( QImage *p )
 {
+    p->fill( qRgba( 255, 255, 255, 255 ) );
+    QPainter painter( p );
+    return renderToPainter( &painter );
+}
 
-    if ((m_pageImage == NULL) || (m_pageImage->size() != p->size())) {
-        delete m_pageImage;
-        m_pageImage = new QImage( p->size(), QImage::Format_ARGB32 );
-        // Set one point = one drawing unit. Useful for fonts, because xps specifies font size using drawing units, not points as usual
-        m_pageImage->setDotsPerMeterX( 2835 );
-        m_pageImage->setDotsPerMeterY( 2835 );
+bool XpsPage::renderToPainter( QPainter *painter )
+{
+    loadDisplayList();
 
-        m_pageIsRendered = false;
-    }
-    if (! m_pageIsRendered) {
-        m_pageImage->fill( qRgba( 255, 255, 255, 255 ) );
-        QPainter painter( m_pageImage );
-        renderToPainter( &painter );
-        m_pageIsRendered = true;
-    }
+    const QMatrix scale = QMatrix().scale( (qreal)painter->device()->width() / size().width(), (qreal)painter->device()->height() / size().height() );
+    // the font sizes are in drawing units, that is points at 72 dpi
+    const qreal fontScale = 72.0 / painter->device()->logicalDpiY();
 
-    *p = *m_pageImage;
+    Q_FOREACH ( const XpsDisplayItem &item, m_displayList ) {
+        painter->save();
+        painter->setWorldMatrix( item.matrix * scale );
+        painter->setOpacity( item.opacity );
+        if ( !item.clipPath.isEmpty() ) {
+            painter->setClipPath( item.clipPath );
+        }
+        painter->setPen( item.pen );
+        painter->setBrush( item.brush );
+        if ( item.text.isEmpty() ) {
+            painter->drawPath( item.path );
+        } else {
+            QFont font = item.font;
+            if ( font.pointSizeF() > 0 ) {
+                font.setPointSizeF( font.pointSizeF() * fontScale );
+            }
+            painter->setFont( font );
+            painter->setLayoutDirection( item.layoutDirection );
+            for ( int i = 0; i < item.text.size(); ++i ) {
+                painter->drawText( item.positions.at( i ), QString( item.text.at( i ) ) );
+            }
+        }
+        painter->restore();
+    }
 
     return true;
 }
 
-bool XpsPage::renderToPainter( QPainter *painter )
+void XpsPage::loadDisplayList()
 {
+    if ( m_displayListLoaded ) {
+        return;
+    }
+
     XpsHandler handler( this );
-    handler.m_painter = painter;
-    handler.m_painter->setWorldMatrix(QMatrix().scale((qreal)painter->device()->width() / size().width(), (qreal)painter->device()->height() / size().height()));
     QXmlSimpleReader parser;
     parser.setContentHandler( &handler );
     parser.setErrorHandler( &handler );
@@ -1472,7 +1504,40 @@ bool XpsPage::renderToPainter( QPainter *painter )
     bool ok = parser.parse( source );
     kDebug(XpsDebug) << "Parse result: " << ok;
 
-    return true;
+    // a rough estimate: the items, the path elements, the glyphs and the
+    // images of the brushes
+    m_displayListMemory = 0;
+    QSet<qint64> images;
+    Q_FOREACH ( const XpsDisplayItem &item, m_displayList ) {
+        m_displayListMemory += sizeof( XpsDisplayItem )
+                               + ( item.path.elementCount() + item.clipPath.elementCount() ) * sizeof( QPainterPath::Element )
+                               + item.text.size() * ( sizeof( QChar ) + sizeof( QPointF ) );
+        if ( item.brush.style() == Qt::TexturePattern ) {
+            const QImage image = item.brush.textureImage();
+            if ( !images.contains( image.cacheKey() ) ) {
+                images.insert( image.cacheKey() );
+                m_displayListMemory += image.byteCount();
+            }
+        }
+    }
+    m_displayListLoaded = true;
+}
+
+void XpsPage::clearDisplayList()
+{
+    m_displayList.clear();
+    m_displayListLoaded = false;
+    m_displayListMemory = 0;
+}
+
+bool XpsPage::hasDisplayList() const
+{
+    return m_displayListLoaded;
+}
+
+qulonglong XpsPage::displayListMemory() const
+{
+    return m_displayListMemory;
 }
 
 QSizeF XpsPage::size() const
@@ -1607,6 +1672,45 @@ QImage XpsPage::loadImageFromFile( const QString &fileName )
     return image;
 }
 
+QImage XpsPage::thumbnail()
+{
+    if ( m_thumbnailIsLoaded ) {
+        return m_thumbnail;
+    }
+    m_thumbnailIsLoaded = true;
+
+    // the thumbnail is among the relationships of the page
+    const int slashPosition = m_fileName.lastIndexOf( '/' );
+    const QString relationshipFile = absolutePath( entryPath( m_fileName ), "_rels/" + m_fileName.mid( slashPosition + 1 ) + ".rels" );
+    const KArchiveEntry* relEntry = m_file->xpsArchive()->directory()->entry( relationshipFile );
+    if ( !relEntry ) {
+        return m_thumbnail;
+    }
+
+    QXmlStreamReader xml;
+    xml.addData( readFileOrDirectoryParts( relEntry ) );
+    while ( !xml.atEnd() && m_thumbnailFileName.isEmpty() )
+    {
+        xml.readNext();
+        if ( xml.isStartElement() && ( xml.name() == "Relationship" ) ) {
+            QXmlStreamAttributes attributes = xml.attributes();
+            if ( attributes.value( "Type" ).toString() == "http://schemas.openxmlformats.org/package/2006/relationships/metadata/thumbnail" ) {
+                m_thumbnailFileName = attributes.value( "Target" ).toString();
+            }
+        }
+    }
+    if ( xml.error() ) {
+        kDebug(XpsDebug) << "Could not parse XPS page relationships file ( "
+                         << relationshipFile
+                         << " ) - " << xml.errorString() << endl;
+    }
+
+    if ( !m_thumbnailFileName.isEmpty() ) {
+        m_thumbnail = loadImageFromFile( m_thumbnailFileName );
+    }
+    return m_thumbnail;
+}
+
 Okular::TextPage* XpsPage::textPage()
 {
     // kDebug(XpsDebug) << "Parsing XpsPage, text extraction";
@@ -1801,16 +1905,25 @@ XpsDocument::XpsDocument(XpsFile *file, const QString &fileName): m_file(file),
         docXml.readNext();
         if ( docXml.isStartElement() ) {
             if ( docXml.name() == "PageContent" ) {
-                QString pagePath = docXml.attributes().value("Source").toString();
+                QXmlStreamAttributes attributes = docXml.attributes();
+                QString pagePath = attributes.value("Source").toString();
                 kDebug(XpsDebug) << "Page Path: " << pagePath;
-                XpsPage *page = new XpsPage( file, absolutePath( documentFilePath, pagePath ) );
-                m_pages.append(page);
+                m_pageFileNames.append( absolutePath( documentFilePath, pagePath ) );
+                // the size of the page is optional here, see XPS specs, 3.3
+                QSizeF sizeHint;
+                bool widthOk = false, heightOk = false;
+                const double width = attributes.value( "Width" ).toString().toDouble( &widthOk );
+                const double height = attributes.value( "Height" ).toString().toDouble( &heightOk );
+                if ( widthOk && heightOk ) {
+                    sizeHint = QSizeF( width, height );
+                }
+                m_pageSizeHints.append( sizeHint );
             } else if ( docXml.name() == "PageContent.LinkTargets" ) {
                 // do nothing - wait for the real LinkTarget elements
             } else if ( docXml.name() == "LinkTarget" ) {
                 QString targetName = docXml.attributes().value( "Name" ).toString();
                 if ( ! targetName.isEmpty() ) {
-                    m_docStructurePageMap[ targetName ] = m_pages.count() - 1;
+                    m_docStructurePageMap[ targetName ] = m_pageFileNames.count() - 1;
                 }
             } else if ( docXml.name() == "FixedDocument" ) {
                 // we just ignore this - it is just a container
@@ -1822,6 +1935,8 @@ XpsDocument::XpsDocument(XpsFile *file, const QString &fileName): m_file(file),
     if ( docXml.error() ) {
         kDebug(XpsDebug) << "Could not parse main XPS document file: " << docXml.errorString();
     }
+    // the pages are read only when needed
+    m_pages.fill( 0, m_pageFileNames.count() );
 
     // There might be a relationships entry for this document - typically used to tell us where to find the
     // content structure description
@@ -1873,9 +1988,7 @@ XpsDocument::XpsDocument(XpsFile *file, const QString &fileName): m_file(file),
 
 XpsDocument::~XpsDocument()
 {
-    for (int i = 0; i < m_pages.size(); i++) {
-        delete m_pages.at( i );
-    }
+    qDeleteAll( m_pages );
     m_pages.clear();
 
     if ( m_docStructure )
@@ -1884,15 +1997,26 @@ XpsDocument::~XpsDocument()
 
 int XpsDocument::numPages() const
 {
-    return m_pages.size();
+    return m_pageFileNames.size();
 }
 
 XpsPage* XpsDocument::page(int pageNum) const
 {
-    return m_pages.at(pageNum);
+    if ( !m_pages.at( pageNum ) ) {
+        m_pages[ pageNum ] = new XpsPage( m_file, m_pageFileNames.at( pageNum ), m_pageSizeHints.at( pageNum ) );
+    }
+    return m_pages.at( pageNum );
+}
+
+QSizeF XpsDocument::pageSizeHint(int pageNum) const
+{
+    if ( m_pages.at( pageNum ) ) {
+        return m_pages.at( pageNum )->size();
+    }
+    return m_pageSizeHints.at( pageNum );
 }
 
-XpsFile::XpsFile() : m_docInfo( 0 )
+XpsFile::XpsFile() : m_thumbnailIsLoaded( false ), m_docInfo( 0 )
 {
 }
 
@@ -1976,10 +2100,6 @@ bool XpsFile::loadDocument(const QString &filename)
             if ( fixedRepXml.name() == "DocumentReference" ) {
                 const QString source = fixedRepXml.attributes().value("Source").toString();
                 XpsDocument *doc = new XpsDocument( this, absolutePath( fixedRepresentationFilePath, source ) );
-                for (int lv = 0; lv < doc->numPages(); ++lv) {
-                    // our own copy of the pages list
-                    m_pages.append( doc->page( lv ) );
-                }
                 m_documents.append(doc);
             } else if ( fixedRepXml.name() == "FixedDocumentSequence") {
                 // we don't do anything here - this is just a container for one or more DocumentReference elements
@@ -1996,6 +2116,24 @@ bool XpsFile::loadDocument(const QString &filename)
     return true;
 }
 
+QImage XpsFile::thumbnail()
+{
+    if ( m_thumbnailIsLoaded ) {
+        return m_thumbnail;
+    }
+    m_thumbnailIsLoaded = true;
+
+    if ( m_thumbnailFileName.isEmpty() ) {
+        return m_thumbnail;
+    }
+
+    const KZipFileEntry* thumbnailFile = loadFile( m_xpsArchive, absolutePath( "/", m_thumbnailFileName ), Qt::CaseInsensitive );
+    if ( thumbnailFile ) {
+        m_thumbnail = QImage::fromData( thumbnailFile->data() );
+    }
+    return m_thumbnail;
+}
+
 const Okular::DocumentInfo * XpsFile::generateDocumentInfo()
 {
     if ( m_docInfo )
@@ -2071,7 +2209,11 @@ bool XpsFile::closeDocument()
 
 int XpsFile::numPages() const
 {
-    return m_pages.size();
+    int pages = 0;
+    Q_FOREACH ( XpsDocument *doc, m_documents ) {
+        pages += doc->numPages();
+    }
+    return pages;
 }
 
 int XpsFile::numDocuments() const
@@ -2086,11 +2228,17 @@ XpsDocument* XpsFile::document(int documentNum) const
 
 XpsPage* XpsFile::page(int pageNum) const
 {
-    return m_pages.at( pageNum );
+    Q_FOREACH ( XpsDocument *doc, m_documents ) {
+        if ( pageNum < doc->numPages() ) {
+            return doc->page( pageNum );
+        }
+        pageNum -= doc->numPages();
+    }
+    return 0;
 }
 
 XpsGenerator::XpsGenerator( QObject *parent, const QVariantList &args )
-  : Okular::Generator( parent, args ), m_xpsFile( 0 )
+  : Okular::Generator( parent, args ), m_xpsFile( 0 ), m_displayListsMemory( 0 ), m_renderingPage( 0 )
 {
     setFeature( TextExtraction );
     setFeature( PrintNative );
@@ -2118,23 +2266,66 @@ bool XpsGenerator::loadDocument( const QString & fileName, QVector<Okular::Page*
     pagesVector.resize( m_xpsFile->numPages() );
 
     int pagesVectorOffset = 0;
+    QSizeF lastPageSize;
 
     for (int docNum = 0; docNum < m_xpsFile->numDocuments(); ++docNum )
     {
         XpsDocument *doc = m_xpsFile->document( docNum );
         for (int pageNum = 0; pageNum < doc->numPages(); ++pageNum )
         {
-            QSizeF pageSize = doc->page( pageNum )->size();
+            // do not read the pages just for their sizes: the ones the
+            // document does not tell get the size of the previous page for
+            // now, and are read later
+            QSizeF pageSize = doc->pageSizeHint( pageNum );
+            if ( !pageSize.isValid() ) {
+                if ( lastPageSize.isValid() ) {
+                    pageSize = lastPageSize;
+                    m_pendingPageSizes.append( pagesVectorOffset );
+                } else {
+                    pageSize = doc->page( pageNum )->size();
+                }
+            }
+            lastPageSize = pageSize;
             pagesVector[pagesVectorOffset] = new Okular::Page( pagesVectorOffset, pageSize.width(), pageSize.height(), Okular::Rotation0 );
             ++pagesVectorOffset;
         }
     }
 
+    if ( !m_pendingPageSizes.isEmpty() )
+        QTimer::singleShot( 0, this, SLOT(loadPendingPageSizes()) );
+
     return true;
 }
 
+void XpsGenerator::loadPendingPageSizes()
+{
+    if ( !m_xpsFile )
+        return;
+
+    // read in short slices, so that the GUI never blocks
+    QTime time;
+    time.start();
+    while ( !m_pendingPageSizes.isEmpty() && time.elapsed() < 20 )
+    {
+        const int pageNumber = m_pendingPageSizes.takeFirst();
+        userMutex()->lock();
+        const QSizeF pageSize = m_xpsFile->page( pageNumber )->size();
+        userMutex()->unlock();
+        updatePageSize( pageNumber, pageSize.width(), pageSize.height() );
+    }
+
+    if ( !m_pendingPageSizes.isEmpty() )
+        QTimer::singleShot( 0, this, SLOT(loadPendingPageSizes()) );
+}
+
 bool XpsGenerator::doCloseDocument()
 {
+    m_pendingPageSizes.clear();
+    m_displayListsMutex.lock();
+    m_displayListPages.clear();
+    m_displayListsMemory = 0;
+    m_displayListsMutex.unlock();
+
     m_xpsFile->closeDocument();
     delete m_xpsFile;
     m_xpsFile = 0;
@@ -2148,7 +2339,74 @@ QImage XpsGenerator::image( Okular::PixmapRequest * request )
     QSize size( (int)request->width(), (int)request->height() );
     QImage image( size, QImage::Format_RGB32 );
     XpsPage *pageToRender = m_xpsFile->page( request->page()->number() );
+    displayListUsing( pageToRender );
     pageToRender->renderToImage( &image );
+    displayListUsed( pageToRender );
+    return image;
+}
+
+void XpsGenerator::displayListUsing( XpsPage *page )
+{
+    QMutexLocker lock( &m_displayListsMutex );
+    m_renderingPage = page;
+}
+
+void XpsGenerator::displayListUsed( XpsPage *page )
+{
+    const qulonglong budget = documentMetaData( "CacheMemoryBudget" ).toULongLong();
+
+    QMutexLocker lock( &m_displayListsMutex );
+    m_renderingPage = 0;
+    if ( m_displayListPages.removeOne( page ) ) {
+        m_displayListPages.append( page );
+        return;
+    }
+    m_displayListPages.append( page );
+    m_displayListsMemory += page->displayListMemory();
+
+    // the display list just used is kept anyway
+    while ( m_displayListsMemory > budget && m_displayListPages.count() > 1 ) {
+        XpsPage *oldPage = m_displayListPages.takeFirst();
+        m_displayListsMemory -= oldPage->displayListMemory();
+        oldPage->clearDisplayList();
+    }
+}
+
+qulonglong XpsGenerator::cacheMemory() const
+{
+    QMutexLocker lock( &m_displayListsMutex );
+    return m_displayListsMemory;
+}
+
+qulonglong XpsGenerator::freeCacheMemory( qulonglong memoryToFree )
+{
+    // the display list of the page being rendered is the only one in use
+    QMutexLocker lock( &m_displayListsMutex );
+    qulonglong freed = 0;
+    QList<XpsPage*>::iterator it = m_displayListPages.begin();
+    while ( freed < memoryToFree && it != m_displayListPages.end() ) {
+        if ( *it == m_renderingPage ) {
+            ++it;
+            continue;
+        }
+        freed += (*it)->displayListMemory();
+        (*it)->clearDisplayList();
+        it = m_displayListPages.erase( it );
+    }
+    m_displayListsMemory -= freed;
+    return freed;
+}
+
+QImage XpsGenerator::thumbnail( int page )
+{
+    QMutexLocker lock( userMutex() );
+    if ( !m_xpsFile || page < 0 || page >= m_xpsFile->numPages() )
+        return QImage();
+
+    QImage image = m_xpsFile->page( page )->thumbnail();
+    // the thumbnail of the whole file shows its first page
+    if ( image.isNull() && page == 0 )
+        image = m_xpsFile->thumbnail();
     return image;
 }
 
@@ -2200,6 +2458,7 @@ bool XpsGenerator::exportTo( const QString &fileName, const Okular::ExportFormat
         QTextStream ts( &f );
         for ( int i = 0; i < m_xpsFile->numPages(); ++i )
         {
+            QMutexLocker lock( userMutex() );
             Okular::TextPage* textPage = m_xpsFile->page(i)->textPage();
             QString text = textPage->text();
             ts << text;
@@ -2228,8 +2487,11 @@ bool XpsGenerator::print( QPrinter &printer )
             printer.newPage();
 
         const int page = pageList.at( i ) - 1;
+        QMutexLocker lock( userMutex() );
         XpsPage *pageToRender = m_xpsFile->page( page );
+        displayListUsing( pageToRender );
         pageToRender->renderToPainter( &painter );
+        displayListUsed( pageToRender );
     }
 
     return true;
@@ -23,13 +23,18 @@
 #include <core/generator.h>
 #include <core/textpage.h>
 
+#include <QBrush>
 #include <QColor>
 #include <QDomDocument>
 #include <QFontDatabase>
 #include <QImage>
+#include <QMutex>
+#include <QPainterPath>
+#include <QPen>
 #include <QXmlStreamReader>
 #include <QXmlDefaultHandler>
 #include <QStack>
+#include <QStringList>
 #include <QVariant>
 
 #include <kzip.h>
@@ -103,6 +108,33 @@ struct XpsPathGeometry
     XpsMatrixTransform transform;
 };
 
+/**
+    One drawing operation of a page, with the state of the painter it needs,
+    so that a page is parsed only once and then replayed at any scale.
+    The coordinates are in drawing units of the page.
+*/
+struct XpsDisplayItem
+{
+    XpsDisplayItem()
+        : opacity( 1.0 ), layoutDirection( Qt::LeftToRight )
+    {}
+
+    QMatrix matrix;
+    qreal opacity;
+    QPainterPath clipPath;
+    QPen pen;
+    QBrush brush;
+
+    // the path to draw, for the items without text
+    QPainterPath path;
+
+    // the glyph run: each character of the text is drawn at its position
+    QFont font;
+    Qt::LayoutDirection layoutDirection;
+    QString text;
+    QVector<QPointF> positions;
+};
+
 class XpsPage;
 class XpsFile;
 
@@ -137,9 +169,13 @@ protected:
     void processPathGeometry( XpsRenderNode &node );
     void processPathFigure( XpsRenderNode &node );
 
-    QPainter *m_painter;
+    // the state of the painter while parsing; the display items take it
+    QMatrix m_matrix;
+    qreal m_opacity;
+    QStack< QPair<QMatrix, qreal> > m_savedStates;
 
-    QImage m_image;
+    // the glyphs are measured at 72 dpi, where one point is one drawing unit
+    QImage m_metricsDevice;
 
     QStack<XpsRenderNode> m_nodes;
 
@@ -149,7 +185,10 @@ protected:
 class XpsPage
 {
 public:
-    XpsPage(XpsFile *file, const QString &fileName);
+    /**
+       the size of the page is read from its file, unless \p sizeHint is valid
+    */
+    XpsPage(XpsFile *file, const QString &fileName, const QSizeF &sizeHint = QSizeF());
     ~XpsPage();
 
     QSizeF size() const;
@@ -159,6 +198,28 @@ public:
 
     QImage loadImageFromFile( const QString &filename );
 
+    /**
+       the thumbnail of the page stored in the file, if any
+    */
+    QImage thumbnail();
+
+    /**
+       parse the page into its display list, unless already done
+    */
+    void loadDisplayList();
+
+    /**
+       release the display list, to be parsed again at the next rendering
+    */
+    void clearDisplayList();
+
+    bool hasDisplayList() const;
+
+    /**
+       an estimate of the memory taken by the display list, in bytes
+    */
+    qulonglong displayListMemory() const;
+
 private:
     XpsFile *m_file;
     const QString m_fileName;
@@ -171,8 +232,9 @@ private:
     QImage m_thumbnail;
     bool m_thumbnailIsLoaded;
 
-    QImage *m_pageImage;
-    bool m_pageIsRendered;
+    QList<XpsDisplayItem> m_displayList;
+    bool m_displayListLoaded;
+    qulonglong m_displayListMemory;
 
     friend class XpsHandler;
     friend class XpsTextExtractionHandler;
@@ -202,6 +264,12 @@ public:
     */
     XpsPage* page(int pageNum) const;
 
+    /**
+       the size of a page as written in the document, if any; it does not
+       need to read the page, which is created only when first requested
+    */
+    QSizeF pageSizeHint(int pageNum) const;
+
     /**
       whether this document has a Document Structure
     */
@@ -215,7 +283,9 @@ public:
 private:
     void parseDocumentStructure( const QString &documentStructureFileName );
 
-    QList<XpsPage*> m_pages;
+    QStringList m_pageFileNames;
+    QList<QSizeF> m_pageSizeHints;
+    mutable QVector<XpsPage*> m_pages;
     XpsFile * m_file;
     bool m_haveDocumentStructure;
     Okular::DocumentSynopsis *m_docStructure;
@@ -279,7 +349,6 @@ private:
     int loadFontByName( const QString &fontName );
 
     QList<XpsDocument*> m_documents;
-    QList<XpsPage*> m_pages;
 
     QString m_thumbnailFileName;
     bool m_thumbnailMightBeAvailable;
@@ -320,8 +389,36 @@ class XpsGenerator : public Okular::Generator
         QImage image( Okular::PixmapRequest *page );
         Okular::TextPage* textPage( Okular::Page * page );
 
+    protected slots:
+        qulonglong cacheMemory() const;
+        qulonglong freeCacheMemory( qulonglong memoryToFree );
+        QImage thumbnail( int page );
+
+    private slots:
+        // read the sizes of some of the pages without a size hint, and
+        // schedule the next ones
+        void loadPendingPageSizes();
+
     private:
+        // mark the page as being rendered, so that its display list is
+        // not released meanwhile
+        void displayListUsing( XpsPage *page );
+        // mark the display list of the page as just used, and release the
+        // least recently used ones beyond the memory budget
+        void displayListUsed( XpsPage *page );
+
         XpsFile *m_xpsFile;
+
+        // the pages with a display list, least recently rendered first, and
+        // the one being rendered; they have their own mutex, not to wait
+        // for a rendering to look at them
+        mutable QMutex m_displayListsMutex;
+        QList<XpsPage*> m_displayListPages;
+        qulonglong m_displayListsMemory;
+        XpsPage *m_renderingPage;
+
+        // the pages given a provisional size, as their documents do not say it
+        QList<int> m_pendingPageSizes;
 };
 
 #endif
@@ -1032,6 +1032,9 @@ void Part::slotGeneratorPreferences( )
 
 void Part::notifySetup( const QVector< Okular::Page * > & /*pages*/, int setupFlags )
 {
+    if ( setupFlags & Okular::DocumentObserver::PagesAppended )
+        updateViewActions();
+
     if ( !( setupFlags & Okular::DocumentObserver::DocumentChanged ) )
         return;
 
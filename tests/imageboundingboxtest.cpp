@@ -0,0 +1,111 @@
+/***************************************************************************
+ *   Copyright (C) 2012 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <qtest_kde.h>
+#include <qimage.h>
+#include <qpainter.h>
+
+#include "../core/utils.h"
+
+Q_DECLARE_METATYPE( QImage )
+
+class ImageBoundingBoxTest
+    : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void testBoundingBox_data();
+        void testBoundingBox();
+        void benchmarkBoundingBox_data();
+        void benchmarkBoundingBox();
+};
+
+static QImage whiteImage( int width, int height, QImage::Format format = QImage::Format_RGB32 )
+{
+    QImage image( width, height, format );
+    image.fill( Qt::white );
+    return image;
+}
+
+static QImage imageWithRect( int width, int height, const QRect &rect, QImage::Format format = QImage::Format_RGB32 )
+{
+    QImage image = whiteImage( width, height, format );
+    QPainter painter( &image );
+    painter.fillRect( rect, Qt::black );
+    return image;
+}
+
+// an A4 page at 150 dpi with 2cm margins, filled with lines of "text"
+static QImage pageImage()
+{
+    QImage image = whiteImage( 1240, 1754 );
+    QPainter painter( &image );
+    for ( int y = 118; y < 1754 - 118; y += 24 )
+        for ( int x = 118; x < 1240 - 118; x += 60 )
+            painter.fillRect( x, y, 50, 12, Qt::darkGray );
+    return image;
+}
+
+void ImageBoundingBoxTest::testBoundingBox_data()
+{
+    QTest::addColumn<QImage>( "image" );
+    QTest::addColumn<QRect>( "bbox" );
+
+    QTest::newRow( "blank" ) << whiteImage( 100, 100 ) << QRect();
+    QTest::newRow( "top left pixel" ) << imageWithRect( 100, 100, QRect( 0, 0, 1, 1 ) ) << QRect( 0, 0, 1, 1 );
+    QTest::newRow( "bottom right pixel" ) << imageWithRect( 100, 100, QRect( 99, 99, 1, 1 ) ) << QRect( 99, 99, 1, 1 );
+    QTest::newRow( "full" ) << imageWithRect( 100, 100, QRect( 0, 0, 100, 100 ) ) << QRect( 0, 0, 100, 100 );
+    // odd sizes and positions, so that the bounds fall inside the blocks of pixels checked at once
+    QTest::newRow( "inner rect" ) << imageWithRect( 101, 67, QRect( 17, 5, 31, 40 ) ) << QRect( 17, 5, 31, 40 );
+    QTest::newRow( "narrow image" ) << imageWithRect( 7, 30, QRect( 2, 3, 3, 4 ) ) << QRect( 2, 3, 3, 4 );
+    QTest::newRow( "page" ) << pageImage() << QRect( 118, 118, 1010, 1524 );
+    QTest::newRow( "argb32" ) << imageWithRect( 100, 100, QRect( 33, 15, 20, 1 ), QImage::Format_ARGB32 ) << QRect( 33, 15, 20, 1 );
+    QTest::newRow( "mono" ) << imageWithRect( 100, 100, QRect( 10, 20, 30, 40 ), QImage::Format_Mono ) << QRect( 10, 20, 30, 40 );
+
+    // the rightmost pixel of a row next to the ones found so far
+    QImage image = imageWithRect( 100, 100, QRect( 10, 10, 10, 10 ) );
+    image.setPixel( 20, 15, qRgb( 0, 0, 0 ) );
+    QTest::newRow( "right + 1" ) << image << QRect( 10, 10, 11, 10 );
+}
+
+void ImageBoundingBoxTest::testBoundingBox()
+{
+    QFETCH( QImage, image );
+    QFETCH( QRect, bbox );
+
+    const Okular::NormalizedRect result = Okular::Utils::imageBoundingBox( &image );
+    if ( bbox.isNull() )
+        QVERIFY( result.isNull() );
+    else
+        QCOMPARE( result.roundedGeometry( image.width(), image.height() ), bbox );
+}
+
+void ImageBoundingBoxTest::benchmarkBoundingBox_data()
+{
+    QTest::addColumn<QImage>( "image" );
+
+    QTest::newRow( "page" ) << pageImage();
+    QTest::newRow( "blank page" ) << whiteImage( 1240, 1754 );
+    QTest::newRow( "page without margins" ) << imageWithRect( 1240, 1754, QRect( 0, 0, 1240, 1754 ) );
+    QTest::newRow( "big page" ) << pageImage().scaled( 4960, 7016 );
+}
+
+void ImageBoundingBoxTest::benchmarkBoundingBox()
+{
+    QFETCH( QImage, image );
+
+    QBENCHMARK {
+        Okular::Utils::imageBoundingBox( &image );
+    }
+}
+
+QTEST_KDEMAIN_CORE( ImageBoundingBoxTest )
+
+#include "imageboundingboxtest.moc"
@@ -0,0 +1,145 @@
+/***************************************************************************
+ *   Copyright (C) 2012 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <qtest_kde.h>
+#include <qtextcursor.h>
+#include <qtextdocument.h>
+
+#include "../core/textdocumentgenerator_p.h"
+
+class TextDocumentTextPageTest
+    : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void testTextPage_data();
+        void testTextPage();
+        void benchmarkTextPage_data();
+        void benchmarkTextPage();
+};
+
+static const char loremIpsum[] =
+    "Lorem ipsum dolor sit amet, consectetur adipisicing elit, sed do eiusmod tempor "
+    "incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud "
+    "exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat.";
+
+static QTextDocument *createDocument( const QString &html )
+{
+    QTextDocument *document = new QTextDocument;
+    document->setHtml( html );
+    document->setPageSize( QSizeF( 600, 800 ) );
+    return document;
+}
+
+static QString paragraphs( int count )
+{
+    QString html;
+    for ( int i = 0; i < count; ++i )
+        html += QString( "<p>%1 %2</p>" ).arg( i ).arg( loremIpsum );
+    return html;
+}
+
+/**
+ * The text page as it is built by looking up the block and the line
+ * of every single character.
+ */
+static Okular::TextPage *createTextPagePerCharacter( QTextDocument *document, int pageNumber )
+{
+    Okular::TextPage *textPage = new Okular::TextPage;
+
+    int start, end;
+    Okular::TextDocumentUtils::calculatePositions( document, pageNumber, start, end );
+
+    QTextCursor cursor( document );
+    for ( int i = start; i < end - 1; ++i ) {
+        cursor.setPosition( i );
+        cursor.setPosition( i + 1, QTextCursor::KeepAnchor );
+
+        QString text = cursor.selectedText();
+        if ( text.length() == 1 ) {
+            QRectF rect;
+            Okular::TextDocumentUtils::calculateBoundingRect( document, i, i + 1, rect, pageNumber );
+            if ( pageNumber == -1 )
+                text = "\n";
+
+            textPage->append( text, new Okular::NormalizedRect( rect.left(), rect.top(), rect.right(), rect.bottom() ) );
+        }
+    }
+
+    return textPage;
+}
+
+void TextDocumentTextPageTest::testTextPage_data()
+{
+    QTest::addColumn<QString>( "html" );
+
+    QTest::newRow( "single line" ) << "<p>Okular</p>";
+    QTest::newRow( "wrapped lines" ) << QString( "<p>%1 %1 %1</p>" ).arg( loremIpsum );
+    QTest::newRow( "empty paragraphs" ) << "<p>first</p><p></p><p></p><p>last</p>";
+    QTest::newRow( "formatted text" ) << QString( "<p><b>%1</b> <i>%1</i> <big>%1</big></p>" ).arg( loremIpsum );
+    QTest::newRow( "list" ) << "<ul><li>one</li><li>two</li><li>three</li></ul>";
+    QTest::newRow( "several pages" ) << paragraphs( 60 );
+}
+
+void TextDocumentTextPageTest::testTextPage()
+{
+    QFETCH( QString, html );
+
+    QTextDocument *document = createDocument( html );
+
+    for ( int page = 0; page < document->pageCount(); ++page ) {
+        Okular::TextPage *expectedPage = createTextPagePerCharacter( document, page );
+        Okular::TextPage *textPage = Okular::TextDocumentUtils::createTextPage( document, page );
+
+        const Okular::TextEntity::List expected = expectedPage->words( 0, Okular::TextPage::AnyPixelTextAreaInclusionBehaviour );
+        const Okular::TextEntity::List words = textPage->words( 0, Okular::TextPage::AnyPixelTextAreaInclusionBehaviour );
+
+        QCOMPARE( words.count(), expected.count() );
+        for ( int i = 0; i < words.count(); ++i ) {
+            QCOMPARE( words.at( i )->text(), expected.at( i )->text() );
+            QCOMPARE( *words.at( i )->area(), *expected.at( i )->area() );
+        }
+
+        qDeleteAll( expected );
+        qDeleteAll( words );
+        delete expectedPage;
+        delete textPage;
+    }
+
+    delete document;
+}
+
+void TextDocumentTextPageTest::benchmarkTextPage_data()
+{
+    QTest::addColumn<bool>( "perCharacter" );
+
+    QTest::newRow( "per character" ) << true;
+    QTest::newRow( "line walking" ) << false;
+}
+
+void TextDocumentTextPageTest::benchmarkTextPage()
+{
+    QFETCH( bool, perCharacter );
+
+    QTextDocument *document = createDocument( paragraphs( 200 ) );
+    const int page = document->pageCount() / 2;
+
+    QBENCHMARK {
+        Okular::TextPage *textPage = perCharacter ? createTextPagePerCharacter( document, page )
+                                                  : Okular::TextDocumentUtils::createTextPage( document, page );
+        delete textPage;
+    }
+
+    delete document;
+}
+
+QTEST_KDEMAIN( TextDocumentTextPageTest, GUI )
+
+#include "textdocumenttextpagetest.moc"
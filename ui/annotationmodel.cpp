@@ -54,6 +54,7 @@ public:
     AnnotationModel *q;
     AnnItem *root;
     QPointer< Okular::Document > document;
+    int pageCount;
 };
 
 
@@ -83,7 +84,7 @@ AnnItem::~AnnItem()
 
 
 AnnotationModelPrivate::AnnotationModelPrivate( AnnotationModel *qq )
-    : q( qq ), root( new AnnItem )
+    : q( qq ), root( new AnnItem ), pageCount( 0 )
 {
 }
 
@@ -99,14 +100,27 @@ uint AnnotationModelPrivate::observerId() const
 
 void AnnotationModelPrivate::notifySetup( const QVector< Okular::Page * > &pages, int setupFlags )
 {
+    if ( !( setupFlags & ( Okular::DocumentObserver::DocumentChanged | Okular::DocumentObserver::PagesAppended ) ) )
+        return;
+
+    // only new pages at the end: just add the branches of their annotations
     if ( !( setupFlags & Okular::DocumentObserver::DocumentChanged ) )
+    {
+        for ( int i = pageCount; i < pages.count(); ++i )
+        {
+            if ( !pages.at( i )->annotations().isEmpty() )
+                notifyPageChanged( i, Okular::DocumentObserver::Annotations );
+        }
+        pageCount = pages.count();
         return;
+    }
 
     qDeleteAll( root->children );
     root->children.clear();
     q->reset();
 
     rebuildTree( pages );
+    pageCount = pages.count();
 }
 
 void AnnotationModelPrivate::notifyPageChanged( int page, int flags )
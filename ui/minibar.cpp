@@ -73,8 +73,8 @@ int MiniBarLogic::currentPage() const
 
 void MiniBarLogic::notifySetup( const QVector< Okular::Page * > & pageVector, int setupFlags )
 {
-    // only process data when document changes
-    if ( !( setupFlags & Okular::DocumentObserver::DocumentChanged ) )
+    // only process data when document changes, or when it grows
+    if ( !( setupFlags & ( Okular::DocumentObserver::DocumentChanged | Okular::DocumentObserver::PagesAppended ) ) )
         return;
 
     // if document is closed or has no pages, hide widget
@@ -122,6 +122,13 @@ void MiniBarLogic::notifySetup( const QVector< Okular::Page * > & pageVector, in
 
         miniBar->setEnabled( true );
     }
+
+    // the current page is still the same, show it again
+    if ( !( setupFlags & Okular::DocumentObserver::DocumentChanged ) )
+    {
+        m_currentPage = -1;
+        notifyViewportChanged( false );
+    }
 }
 
 void MiniBarLogic::notifyViewportChanged( bool /*smoothMove*/ )
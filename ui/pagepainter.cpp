@@ -10,6 +10,7 @@
 #include "pagepainter.h"
 
 // qt / kde includes
+#include <qcache.h>
 #include <qrect.h>
 #include <qpainter.h>
 #include <qpalette.h>
@@ -18,7 +19,6 @@
 #include <kiconloader.h>
 #include <kdebug.h>
 #include <QApplication>
-#include <qimageblitz.h>
 
 // system includes
 #include <math.h>
@@ -27,6 +27,7 @@
 #include "core/area.h"
 #include "core/page.h"
 #include "core/annotations.h"
+#include "core/tilesmanager_p.h"
 #include "core/utils.h"
 #include "guiutils.h"
 #include "settings.h"
@@ -35,6 +36,17 @@ K_GLOBAL_STATIC_WITH_ARGS( QPixmap, busyPixmap, ( KIconLoader::global()->loadIco
 
 #define TEXTANNOTATION_ICONSIZE 24
 
+// the page pixmaps recolored according to the accessibility settings, by
+// the cacheKey() of the original pixmap
+struct AccessibilityCache
+{
+    QCache< qint64, QPixmap > pixmaps;
+    // the render mode and its parameters used for the pixmaps
+    QString parameters;
+};
+
+K_GLOBAL_STATIC( AccessibilityCache, accessibilityCache )
+
 inline QPen buildPen( const Okular::Annotation *ann, double width, const QColor &color )
 {
     QPen p(
@@ -85,11 +97,83 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
     }
     destPainter->fillRect( limits, color );
 
-    /** 1B - IF NO PIXMAP, DRAW EMPTY PAGE **/
+    QRect limitsInPixmap = limits.translated( scaledCrop.topLeft() );
+        // limits within full (scaled but uncropped) pixmap
+
     double pixmapRescaleRatio = pixmap ? scaledWidth / (double)pixmap->width() : -1;
     long pixmapPixels = pixmap ? (long)pixmap->width() * (long)pixmap->height() : 0;
-    if ( !pixmap || pixmapRescaleRatio > 20.0 || pixmapRescaleRatio < 0.25 ||
-         (scaledWidth != pixmap->width() && pixmapPixels > 6000000L) )
+    bool pixmapUsable = pixmap && pixmapRescaleRatio <= 20.0 && pixmapRescaleRatio >= 0.25 &&
+         (scaledWidth == pixmap->width() || pixmapPixels <= 6000000L);
+
+    // the colors are changed once for every pixmap, not at every paint
+    const bool accessibility = (flags & Accessibility) && Okular::Settings::changeColors() && (Okular::Settings::renderMode() != Okular::Settings::EnumRenderMode::Paper);
+    QPixmap accessiblePixmap;
+    bool accessibilityOnLimits = false;
+    if ( accessibility && pixmapUsable )
+    {
+        accessiblePixmap = accessibilityPixmap( *pixmap );
+        // too big to be cached, only the painted part is changed at every paint
+        if ( accessiblePixmap.isNull() )
+            accessibilityOnLimits = true;
+        else
+            pixmap = &accessiblePixmap;
+    }
+
+    /** 1A - IF THE PAGE IS SPLIT IN TILES, COMPOSE THE VISIBLE ONES **/
+    // the composed pixmap covers only limitsInPixmap, the parts not rendered
+    // yet are taken from the nearest pixmap (if any)
+    QPixmap tiledPixmap;
+    const Okular::TilesManager *tilesManager = page->tilesManager( pixID );
+    if ( tilesManager && tilesManager->width() == scaledWidth && tilesManager->height() == scaledHeight )
+    {
+        const QList< Okular::Tile > tiles = tilesManager->tilesAt( Okular::NormalizedRect( limitsInPixmap, scaledWidth, scaledHeight ) );
+        bool hasTiles = false;
+        foreach ( const Okular::Tile &tile, tiles )
+            hasTiles = hasTiles || tile.pixmap();
+
+        if ( hasTiles )
+        {
+            tiledPixmap = QPixmap( limitsInPixmap.size() );
+            tiledPixmap.fill( accessibility ? color : QColor( Qt::white ) );
+            QPainter p( &tiledPixmap );
+            if ( pixmapUsable )
+            {
+                QImage fallbackImage;
+                scalePixmapOnImage( fallbackImage, pixmap, scaledWidth, scaledHeight, limitsInPixmap );
+                if ( accessibilityOnLimits )
+                    accessibilityImage( fallbackImage );
+                p.drawImage( 0, 0, fallbackImage );
+            }
+            foreach ( const Okular::Tile &tile, tiles )
+            {
+                if ( !tile.pixmap() )
+                    continue;
+
+                const QPoint tilePos = tile.geometry().topLeft() - limitsInPixmap.topLeft();
+                const QPixmap accessibleTile = accessibility ? accessibilityPixmap( *tile.pixmap() ) : QPixmap();
+                if ( !accessibility )
+                    p.drawPixmap( tilePos, *tile.pixmap() );
+                else if ( !accessibleTile.isNull() )
+                    p.drawPixmap( tilePos, accessibleTile );
+                else
+                {
+                    QImage tileImage = tile.pixmap()->toImage();
+                    accessibilityImage( tileImage );
+                    p.drawImage( tilePos, tileImage );
+                }
+            }
+            p.end();
+
+            pixmap = &tiledPixmap;
+            pixmapUsable = true;
+            // the composed pixmap has the colors changed already
+            accessibilityOnLimits = false;
+        }
+    }
+    const bool tiled = !tiledPixmap.isNull();
+
+    /** 1B - IF NO PIXMAP, DRAW EMPTY PAGE **/
+    if ( !pixmapUsable )
     {
         // draw something on the blank page: the okular icon or a cross (as a fallback)
         if ( !busyPixmap->isNull() )
@@ -220,18 +304,17 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
     }
 
     /** 3 - ENABLE BACKBUFFERING IF DIRECT IMAGE MANIPULATION IS NEEDED **/
-    bool bufferAccessibility = (flags & Accessibility) && Okular::Settings::changeColors() && (Okular::Settings::renderMode() != Okular::Settings::EnumRenderMode::Paper);
-    bool useBackBuffer = bufferAccessibility || bufferedHighlights || bufferedAnnotations || viewPortPoint;
+    bool useBackBuffer = accessibilityOnLimits || bufferedHighlights || bufferedAnnotations || viewPortPoint;
     QPixmap * backPixmap = 0;
     QPainter * mixedPainter = 0;
-    QRect limitsInPixmap = limits.translated( crop.geometry( scaledWidth, scaledHeight ).topLeft() );
-        // limits within full (scaled but uncropped) pixmap
 
     /** 4A -- REGULAR FLOW. PAINT PIXMAP NORMAL OR RESCALED USING GIVEN QPAINTER **/
     if ( !useBackBuffer )
     {
         // 4A.1. if size is ok, draw the page pixmap using painter
-        if ( pixmap->width() == scaledWidth && pixmap->height() == scaledHeight )
+        if ( tiled )
+            destPainter->drawPixmap( limits.topLeft(), *pixmap );
+        else if ( pixmap->width() == scaledWidth && pixmap->height() == scaledHeight )
             destPainter->drawPixmap( limits.topLeft(), *pixmap, limitsInPixmap );
 
         // else draw a scaled portion of the magnified pixmap
@@ -254,49 +337,17 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
         bool has_alpha = pixmap->hasAlpha();
 
         // 4B.1. draw the page pixmap: normal or scaled
-        if ( pixmap->width() == scaledWidth && pixmap->height() == scaledHeight )
+        if ( tiled )
+            cropPixmapOnImage( backImage, pixmap, QRect( QPoint( 0, 0 ), pixmap->size() ) );
+        else if ( pixmap->width() == scaledWidth && pixmap->height() == scaledHeight )
             cropPixmapOnImage( backImage, pixmap, limitsInPixmap );
         else
             scalePixmapOnImage( backImage, pixmap, scaledWidth, scaledHeight, limitsInPixmap );
 
-        // 4B.2. modify pixmap following accessibility settings
-        if ( bufferAccessibility )
-        {
-            switch ( Okular::Settings::renderMode() )
-            {
-                case Okular::Settings::EnumRenderMode::Inverted:
-                    // Invert image pixels using QImage internal function
-                    backImage.invertPixels(QImage::InvertRgb);
-                    break;
-                case Okular::Settings::EnumRenderMode::Recolor:
-                    // Recolor image using Blitz::flatten with dither:0
-                    Blitz::flatten( backImage, Okular::Settings::recolorForeground(), Okular::Settings::recolorBackground() );
-                    break;
-                case Okular::Settings::EnumRenderMode::BlackWhite:
-                    // Manual Gray and Contrast
-                    unsigned int * data = (unsigned int *)backImage.bits();
-                    int val, pixels = backImage.width() * backImage.height(),
-                        con = Okular::Settings::bWContrast(), thr = 255 - Okular::Settings::bWThreshold();
-                    for( int i = 0; i < pixels; ++i )
-                    {
-                        val = qGray( data[i] );
-                        if ( val > thr )
-                            val = 128 + (127 * (val - thr)) / (255 - thr);
-                        else if ( val < thr )
-                            val = (128 * val) / thr;
-                        if ( con > 2 )
-                        {
-                            val = con * ( val - thr ) / 2 + thr;
-                            if ( val > 255 )
-                                val = 255;
-                            else if ( val < 0 )
-                                val = 0;
-                        }
-                        data[i] = qRgba( val, val, val, 255 );
-                    }
-                    break;
-            }
-        }
+        // 4B.2. modify the painted part following accessibility settings
+        if ( accessibilityOnLimits )
+            accessibilityImage( backImage );
+
         // 4B.3. highlight rects in page
         if ( bufferedHighlights )
         {
@@ -819,6 +870,165 @@ void PagePainter::scalePixmapOnImage ( QImage & dest, const QPixmap * src,
     }
 }
 
+// flip the color components of all the pixels, keeping the alpha
+static void invertImage( QImage & image )
+{
+    const int width = image.width();
+    for ( int y = 0; y < image.height(); ++y )
+    {
+        // a plain loop over whole words, that the compiler can vectorize
+        quint32 * line = (quint32 *)image.scanLine( y );
+        for ( int x = 0; x < width; ++x )
+            line[ x ] ^= 0x00FFFFFF;
+    }
+}
+
+// the same as Blitz::flatten: the mean of the color components of each pixel
+// selects its color in the gradient from 'foreground' to 'background'
+static void recolorImage( QImage & image, const QColor & foreground, const QColor & background )
+{
+    const int r1 = foreground.red(), r2 = background.red(),
+              g1 = foreground.green(), g2 = background.green(),
+              b1 = foreground.blue(), b2 = background.blue();
+    const float sr = ( (float) r2 - r1 ) / 255,
+                sg = ( (float) g2 - g1 ) / 255,
+                sb = ( (float) b2 - b1 ) / 255;
+
+    // the color for each sum of the components, so that there is no
+    // arithmetic left for the pixels
+    QRgb colors[ 3 * 255 + 1 ];
+    for ( int sum = 0; sum <= 3 * 255; ++sum )
+    {
+        const int mean = sum / 3;
+        colors[ sum ] = qRgba( (int)( sr * mean + r1 + 0.5 ), (int)( sg * mean + g1 + 0.5 ), (int)( sb * mean + b1 + 0.5 ), 0 );
+    }
+
+    const int width = image.width();
+    for ( int y = 0; y < image.height(); ++y )
+    {
+        QRgb * line = (QRgb *)image.scanLine( y );
+        for ( int x = 0; x < width; ++x )
+        {
+            const QRgb pixel = line[ x ];
+            line[ x ] = colors[ qRed( pixel ) + qGreen( pixel ) + qBlue( pixel ) ] | ( pixel & 0xFF000000 );
+        }
+    }
+}
+
+// turn the image to gray levels, changing their contrast
+static void blackWhiteImage( QImage & image, int contrast, int threshold )
+{
+    // the new value of each gray level
+    QRgb grays[ 256 ];
+    const int thr = 255 - threshold;
+    for ( int gray = 0; gray < 256; ++gray )
+    {
+        int val = gray;
+        if ( val > thr )
+            val = 128 + (127 * (val - thr)) / (255 - thr);
+        else if ( val < thr )
+            val = (128 * val) / thr;
+        if ( contrast > 2 )
+        {
+            val = contrast * ( val - thr ) / 2 + thr;
+            if ( val > 255 )
+                val = 255;
+            else if ( val < 0 )
+                val = 0;
+        }
+        grays[ gray ] = qRgba( val, val, val, 255 );
+    }
+
+    const int width = image.width();
+    for ( int y = 0; y < image.height(); ++y )
+    {
+        QRgb * line = (QRgb *)image.scanLine( y );
+        for ( int x = 0; x < width; ++x )
+            line[ x ] = grays[ qGray( line[ x ] ) ];
+    }
+}
+
+void PagePainter::accessibilityImage( QImage & image )
+{
+    // the opaque images stay so, as the highlights are composed differently on them
+    const bool hasAlpha = image.hasAlphaChannel();
+    const QImage::Format format = image.format();
+    switch ( Okular::Settings::renderMode() )
+    {
+        case Okular::Settings::EnumRenderMode::Inverted:
+            image = image.convertToFormat( hasAlpha ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32 );
+            invertImage( image );
+            break;
+        case Okular::Settings::EnumRenderMode::Recolor:
+            image = image.convertToFormat( hasAlpha ? QImage::Format_ARGB32 : QImage::Format_RGB32 );
+            recolorImage( image, Okular::Settings::recolorForeground(), Okular::Settings::recolorBackground() );
+            break;
+        case Okular::Settings::EnumRenderMode::BlackWhite:
+            image = image.convertToFormat( hasAlpha ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32 );
+            blackWhiteImage( image, Okular::Settings::bWContrast(), Okular::Settings::bWThreshold() );
+            break;
+        default:
+            return;
+    }
+
+    if ( image.format() != format )
+        image = image.convertToFormat( format );
+}
+
+QPixmap PagePainter::accessibilityPixmap( const QPixmap & pixmap )
+{
+    QString parameters = QString::number( Okular::Settings::renderMode() );
+    switch ( Okular::Settings::renderMode() )
+    {
+        case Okular::Settings::EnumRenderMode::Recolor:
+            parameters += QLatin1Char( ' ' ) + Okular::Settings::recolorForeground().name() + QLatin1Char( ' ' ) + Okular::Settings::recolorBackground().name();
+            break;
+        case Okular::Settings::EnumRenderMode::BlackWhite:
+            parameters += QLatin1Char( ' ' ) + QString::number( Okular::Settings::bWContrast() ) + QLatin1Char( ' ' ) + QString::number( Okular::Settings::bWThreshold() );
+            break;
+        default: ;
+    }
+
+    // the pixmaps made with other settings are useless now
+    AccessibilityCache *cache = accessibilityCache;
+    if ( cache->parameters != parameters )
+    {
+        cache->pixmaps.clear();
+        cache->parameters = parameters;
+    }
+
+    // keep some screenfuls of pages, in KiB
+    switch ( Okular::Settings::memoryLevel() )
+    {
+        case Okular::Settings::EnumMemoryLevel::Low:
+            cache->pixmaps.setMaxCost( 32 * 1024 );
+            break;
+        case Okular::Settings::EnumMemoryLevel::Normal:
+            cache->pixmaps.setMaxCost( 64 * 1024 );
+            break;
+        default:
+            cache->pixmaps.setMaxCost( 128 * 1024 );
+            break;
+    }
+
+    if ( QPixmap * cached = cache->pixmaps.object( pixmap.cacheKey() ) )
+        return *cached;
+
+    // the cache would refuse it, and changing all of it at every paint
+    // is slower than changing the painted part only
+    const int cost = qMax( 1, (int)( (qint64)pixmap.width() * pixmap.height() * 4 / 1024 ) );
+    if ( cost > cache->pixmaps.maxCost() )
+        return QPixmap();
+
+    QImage image = pixmap.toImage();
+    accessibilityImage( image );
+
+    QPixmap * result = new QPixmap( QPixmap::fromImage( image ) );
+    const QPixmap copy = *result;
+    cache->pixmaps.insert( pixmap.cacheKey(), result, cost );
+    return copy;
+}
+
 /** Private Helpers :: Image Drawing **/
 // from Arthur - qt4
 inline int qt_div_255(int x) { return (x + (x>>8) + 0x80) >> 8; }
@@ -52,6 +52,15 @@ class PagePainter
             const Okular::NormalizedRect & crop, Okular::NormalizedPoint *viewPortPoint );
 
     private:
+        // the pixmap with the colors changed as in the accessibility settings,
+        // cached for the next paints of the same pixmap; it is null if the
+        // pixmap is too big for the cache
+        static QPixmap accessibilityPixmap( const QPixmap & pixmap );
+
+        // change the colors of the image as in the accessibility settings,
+        // keeping its format
+        static void accessibilityImage( QImage & image );
+
         static void cropPixmapOnImage( QImage & dest, const QPixmap * src, const QRect & r );
 
         // create an image taking the 'cropRect' portion of an image scaled
@@ -87,6 +87,15 @@ static inline double normClamp( double value, double def )
     return ( value < 0.0 || value > 1.0 ) ? def : value;
 }
 
+// pages bigger than this (in pixels) are rendered only around the viewport
+static const long TILED_PAGE_MIN_PIXELS = 8000000L;
+
+static bool useTiles( const Okular::Document *document, const PageViewItem *item )
+{
+    return document->supportsTiles() && item->page()->rotation() == Okular::Rotation0 &&
+           (long)item->uncroppedWidth() * (long)item->uncroppedHeight() > TILED_PAGE_MIN_PIXELS;
+}
+
 struct TableSelectionPart {
     PageViewItem * item;
     Okular::NormalizedRect rectInItem;
@@ -109,6 +118,7 @@ public:
     FormWidgetsController* formWidgetsController();
     OkularTTS* tts();
     QString selectedText() const;
+    void itemRange( const QRect &rect, int *first, int *last ) const;
 
     // the document, pageviewItems and the 'visible cache'
     PageView *q;
@@ -116,6 +126,16 @@ public:
     QVector< PageViewItem * > items;
     QLinkedList< PageViewItem * > visibleItems;
 
+    // the rows of the layout, to find the items in the viewport without
+    // walking all of them: the top of each row and the bottom of the last one
+    QVector< int > rowTops;
+    int rowColumns;
+    int rowFirstOffset;     // empty cells before the first page
+    int rowVisible;         // the only row shown if not continuous, otherwise -1
+    int rowItemCount;       // the items laid out
+    // the pages whose form and video widgets were placed in the viewport
+    QSet< int > itemsWithPlacedWidgets;
+
     // view layout (columns and continuous in Settings), zoom and mouse
     PageView::ZoomMode zoomMode;
     float zoomFactor;
@@ -208,8 +228,27 @@ public:
 };
 
 PageViewPrivate::PageViewPrivate( PageView *qq )
-    : q( qq )
+    : q( qq ), rowColumns( 1 ), rowFirstOffset( 0 ), rowVisible( -1 ), rowItemCount( 0 )
+{
+}
+
+void PageViewPrivate::itemRange( const QRect &rect, int *first, int *last ) const
 {
+    *first = 0;
+    *last = items.count() - 1;
+    // the layout is not up to date, so look at all the items
+    if ( dirtyLayout || rowTops.isEmpty() || rowItemCount != items.count() )
+        return;
+
+    int firstRow = rowVisible, lastRow = rowVisible;
+    if ( rowVisible == -1 )
+    {
+        QVector< int >::const_iterator tops = rowTops.constBegin(), topsEnd = rowTops.constEnd();
+        firstRow = qUpperBound( tops + 1, topsEnd, rect.top() ) - ( tops + 1 );
+        lastRow = qUpperBound( tops, topsEnd - 1, rect.bottom() ) - tops - 1;
+    }
+    *first = qMax( 0, firstRow * rowColumns - rowFirstOffset );
+    *last = qMin( items.count() - 1, ( lastRow + 1 ) * rowColumns - rowFirstOffset - 1 );
 }
 
 FormWidgetsController* PageViewPrivate::formWidgetsController()
@@ -812,12 +851,28 @@ void PageView::notifySetup( const QVector< Okular::Page * > & pageSet, int setup
             return;
     }
 
+    // only new pages at the end, so keep the items of the others
+    if ( ( setupFlags & Okular::DocumentObserver::PagesAppended ) && !documentChanged && pageSet.count() > d->items.count() )
+    {
+        for ( int i = d->items.count(); i < pageSet.count(); ++i )
+        {
+            PageViewItem * item = new PageViewItem( pageSet[i] );
+            d->items.push_back( item );
+            createItemWidgets( item );
+        }
+        d->dirtyLayout = true;
+        QMetaObject::invokeMethod(this, "slotRelayoutPages", Qt::QueuedConnection);
+        return;
+    }
+
     // delete all widgets (one for each page in pageSet)
     QVector< PageViewItem * >::const_iterator dIt = d->items.constBegin(), dEnd = d->items.constEnd();
     for ( ; dIt != dEnd; ++dIt )
         delete *dIt;
     d->items.clear();
     d->visibleItems.clear();
+    d->rowTops.clear();
+    d->itemsWithPlacedWidgets.clear();
     d->pagesWithTextSelection.clear();
     toggleFormWidgets( false );
     if ( d->formsWidgetController )
@@ -834,35 +889,8 @@ void PageView::notifySetup( const QVector< Okular::Page * > & pageSet, int setup
 #ifdef PAGEVIEW_DEBUG
         kDebug().nospace() << "cropped geom for " << d->items.last()->pageNumber() << " is " << d->items.last()->croppedGeometry();
 #endif
-        const QLinkedList< Okular::FormField * > pageFields = (*setIt)->formFields();
-        QLinkedList< Okular::FormField * >::const_iterator ffIt = pageFields.constBegin(), ffEnd = pageFields.constEnd();
-        for ( ; ffIt != ffEnd; ++ffIt )
-        {
-            Okular::FormField * ff = *ffIt;
-            FormWidgetIface * w = FormWidgetFactory::createWidget( ff, viewport() );
-            if ( w )
-            {
-                w->setPageItem( item );
-                w->setFormWidgetsController( d->formWidgetsController() );
-                w->setVisibility( false );
-                w->setCanBeFilled( d->document->isAllowed( Okular::AllowFillForms ) );
-                item->formWidgets().insert( ff->id(), w );
-                hasformwidgets = true;
-            }
-        }
-        const QLinkedList< Okular::Annotation * > annotations = (*setIt)->annotations();
-        QLinkedList< Okular::Annotation * >::const_iterator aIt = annotations.constBegin(), aEnd = annotations.constEnd();
-        for ( ; aIt != aEnd; ++aIt )
-        {
-            Okular::Annotation * a = *aIt;
-            if ( a->subType() == Okular::Annotation::AMovie )
-            {
-                Okular::MovieAnnotation * movieAnn = static_cast< Okular::MovieAnnotation * >( a );
-                VideoWidget * vw = new VideoWidget( movieAnn, d->document, viewport() );
-                item->videoWidgets().insert( movieAnn->movie(), vw );
-                vw->hide();
-            }
-        }
+        if ( createItemWidgets( item ) )
+            hasformwidgets = true;
     }
 
     // invalidate layout so relayout/repaint will happen on next viewport change
@@ -906,6 +934,45 @@ void PageView::notifySetup( const QVector< Okular::Page * > & pageSet, int setup
     selectionClear();
 }
 
+bool PageView::createItemWidgets( PageViewItem * item )
+{
+    // the widgets already there are kept, as the form fields and the
+    // annotations of a page may be loaded after the page itself
+    const QLinkedList< Okular::FormField * > pageFields = item->page()->formFields();
+    QLinkedList< Okular::FormField * >::const_iterator ffIt = pageFields.constBegin(), ffEnd = pageFields.constEnd();
+    for ( ; ffIt != ffEnd; ++ffIt )
+    {
+        Okular::FormField * ff = *ffIt;
+        if ( item->formWidgets().contains( ff->id() ) )
+            continue;
+        FormWidgetIface * w = FormWidgetFactory::createWidget( ff, viewport() );
+        if ( w )
+        {
+            w->setPageItem( item );
+            w->setFormWidgetsController( d->formWidgetsController() );
+            w->setVisibility( false );
+            w->setCanBeFilled( d->document->isAllowed( Okular::AllowFillForms ) );
+            item->formWidgets().insert( ff->id(), w );
+        }
+    }
+    const QLinkedList< Okular::Annotation * > annotations = item->page()->annotations();
+    QLinkedList< Okular::Annotation * >::const_iterator aIt = annotations.constBegin(), aEnd = annotations.constEnd();
+    for ( ; aIt != aEnd; ++aIt )
+    {
+        Okular::Annotation * a = *aIt;
+        if ( a->subType() == Okular::Annotation::AMovie )
+        {
+            Okular::MovieAnnotation * movieAnn = static_cast< Okular::MovieAnnotation * >( a );
+            if ( item->videoWidgets().contains( movieAnn->movie() ) )
+                continue;
+            VideoWidget * vw = new VideoWidget( movieAnn, d->document, viewport() );
+            item->videoWidgets().insert( movieAnn->movie(), vw );
+            vw->hide();
+        }
+    }
+    return !item->formWidgets().isEmpty();
+}
+
 void PageView::updateActionState( bool haspages, bool documentChanged, bool hasformwidgets )
 {
     if ( d->aPageSizes )
@@ -1156,6 +1223,22 @@ void PageView::notifyPageChanged( int pageNumber, int changedFlags )
                 delete w; 
             }
         }
+
+        // the form fields and the movies of the page may have been loaded now
+        PageViewItem * item = pageNumber < d->items.count() ? d->items[ pageNumber ] : 0;
+        if ( item )
+        {
+            const int itemWidgets = item->formWidgets().count() + item->videoWidgets().count();
+            createItemWidgets( item );
+            if ( item->formWidgets().count() + item->videoWidgets().count() != itemWidgets )
+            {
+                item->setWHZC( item->croppedWidth(), item->croppedHeight(), item->zoomFactor(), item->crop() );
+                item->moveTo( item->croppedGeometry().left(), item->croppedGeometry().top() );
+                item->setFormWidgetsVisible( d->m_formsVisible );
+                if ( d->aToggleForms && !item->formWidgets().isEmpty() )
+                    d->aToggleForms->setEnabled( true );
+            }
+        }
     }
 
     if ( changedFlags & DocumentObserver::BoundingBox )
@@ -3826,6 +3909,9 @@ void PageView::slotRelayoutPages()
                 item->setVisible( false );
             }
             item->setFormWidgetsVisible( d->m_formsVisible );
+            // the widgets are placed again for the new layout
+            if ( !item->formWidgets().isEmpty() || !item->videoWidgets().isEmpty() )
+                d->itemsWithPlacedWidgets.insert( item->pageNumber() );
             // advance col/row index
             insertX += cWidth;
             if ( ++cIdx == nCols )
@@ -3840,6 +3926,16 @@ void PageView::slotRelayoutPages()
 #endif
         }
 
+        // remember the rows, to find the visible items quickly
+        d->rowTops.resize( nRows + 1 );
+        d->rowTops[ 0 ] = origInsertY;
+        for ( int i = 0; i < nRows; i++ )
+            d->rowTops[ i + 1 ] = d->rowTops[ i ] + rowHeight[ i ];
+        d->rowColumns = nCols;
+        d->rowFirstOffset = centerFirstPage ? nCols - 1 : 0;
+        d->rowVisible = continuousView ? -1 : pageRowIdx;
+        d->rowItemCount = pageCount;
+
         delete [] colWidth;
         delete [] rowHeight;
 
@@ -3914,14 +4010,28 @@ void PageView::slotRequestVisiblePixmaps( int newValue )
            focusedY = 0.0,
            minDistance = -1.0;
 
-    // iterate over all items
+    // iterate over the items which may intersect the viewport
     d->visibleItems.clear();
     QLinkedList< Okular::PixmapRequest * > requestedPixmaps;
     QVector< Okular::VisiblePageRect * > visibleRects;
-    QVector< PageViewItem * >::const_iterator iIt = d->items.constBegin(), iEnd = d->items.constEnd();
-    for ( ; iIt != iEnd; ++iIt )
+    int firstItem, lastItem;
+    d->itemRange( viewportRect, &firstItem, &lastItem );
+
+    // move the form and video widgets of those items, and of the ones
+    // whose widgets were in the viewport before, so none is left behind
+    QSet< int > widgetItems;
+    for ( int index = firstItem; index <= lastItem; ++index )
     {
-        PageViewItem * i = *iIt;
+        PageViewItem * i = d->items[ index ];
+        if ( !i->formWidgets().isEmpty() || !i->videoWidgets().isEmpty() )
+            widgetItems.insert( index );
+    }
+    d->itemsWithPlacedWidgets.unite( widgetItems );
+    foreach ( int index, d->itemsWithPlacedWidgets )
+    {
+        if ( index >= d->items.count() )
+            continue;
+        PageViewItem * i = d->items[ index ];
         foreach( FormWidgetIface *fwi, i->formWidgets() )
         {
             Okular::NormalizedRect r = fwi->rect();
@@ -3935,13 +4045,18 @@ void PageView::slotRequestVisiblePixmaps( int newValue )
             vw->move(
                 qRound( i->uncroppedGeometry().left() + i->uncroppedWidth() * r.left ) + 1 - viewportRect.left(),
                 qRound( i->uncroppedGeometry().top() + i->uncroppedHeight() * r.top ) + 1 - viewportRect.top() );
-            
+
             if ( vw->isPlaying() && viewportRectAtZeroZero.intersect( vw->geometry() ).isEmpty() ) {
                 vw->stop();
                 vw->hide();
             }
         }
+    }
+    d->itemsWithPlacedWidgets = widgetItems;
 
+    for ( int index = firstItem; index <= lastItem; ++index )
+    {
+        PageViewItem * i = d->items[ index ];
         if ( !i->isVisible() )
             continue;
 #ifdef PAGEVIEW_DEBUG
@@ -3961,9 +4076,22 @@ void PageView::slotRequestVisiblePixmaps( int newValue )
         kWarning() << "checking for pixmap for page" << i->pageNumber() << "=" << i->page()->hasPixmap( PAGEVIEW_ID, i->uncroppedWidth(), i->uncroppedHeight() );
         kWarning() << "checking for text for page" << i->pageNumber() << "=" << i->page()->hasTextPage();
 #endif
+        // if the page is huge, request only the tiles around the visible area
+        if ( useTiles( d->document, i ) )
+        {
+            const int marginX = viewportRect.width() / 4, marginY = viewportRect.height() / 4;
+            const QRect tilesRect = intersectionRect.adjusted( -marginX, -marginY, marginX, marginY ).intersect( i->uncroppedGeometry() );
+            const Okular::NormalizedRect tilesNormRect( tilesRect.translated( -i->uncroppedGeometry().topLeft() ), i->uncroppedWidth(), i->uncroppedHeight() );
+            if ( !i->page()->hasPixmap( PAGEVIEW_ID, i->uncroppedWidth(), i->uncroppedHeight(), tilesNormRect ) )
+            {
+                Okular::PixmapRequest * p = new Okular::PixmapRequest(
+                        PAGEVIEW_ID, i->pageNumber(), i->uncroppedWidth(), i->uncroppedHeight(), PAGEVIEW_PRIO, true );
+                p->setNormalizedRect( tilesNormRect );
+                requestedPixmaps.push_back( p );
+            }
+        }
         // if the item has not the right pixmap, add a request for it
-        // TODO: We presently request a pixmap for the full page, and then render just the crop part. This waste memory and cycles.
-        if ( !i->page()->hasPixmap( PAGEVIEW_ID, i->uncroppedWidth(), i->uncroppedHeight() ) )
+        else if ( !i->page()->hasPixmap( PAGEVIEW_ID, i->uncroppedWidth(), i->uncroppedHeight() ) )
         {
 #ifdef PAGEVIEW_DEBUG
             kWarning() << "rerequesting visible pixmaps for page" << i->pageNumber() << "!";
@@ -4014,8 +4142,8 @@ void PageView::slotRequestVisiblePixmaps( int newValue )
             if ( tailRequest < (int)d->items.count() )
             {
                 PageViewItem * i = d->items[ tailRequest ];
-                // request the pixmap if not already present
-                if ( !i->page()->hasPixmap( PAGEVIEW_ID, i->uncroppedWidth(), i->uncroppedHeight() ) && i->uncroppedWidth() > 0 )
+                // request the pixmap if not already present (huge pages are not preloaded)
+                if ( !i->page()->hasPixmap( PAGEVIEW_ID, i->uncroppedWidth(), i->uncroppedHeight() ) && i->uncroppedWidth() > 0 && !useTiles( d->document, i ) )
                     requestedPixmaps.push_back( new Okular::PixmapRequest(
                                 PAGEVIEW_ID, i->pageNumber(), i->uncroppedWidth(), i->uncroppedHeight(), PAGEVIEW_PRELOAD_PRIO, true ) );
             }
@@ -4028,8 +4156,8 @@ void PageView::slotRequestVisiblePixmaps( int newValue )
             if ( headRequest >= 0 )
             {
                 PageViewItem * i = d->items[ headRequest ];
-                // request the pixmap if not already present
-                if ( !i->page()->hasPixmap( PAGEVIEW_ID, i->uncroppedWidth(), i->uncroppedHeight() ) && i->uncroppedWidth() > 0 )
+                // request the pixmap if not already present (huge pages are not preloaded)
+                if ( !i->page()->hasPixmap( PAGEVIEW_ID, i->uncroppedWidth(), i->uncroppedHeight() ) && i->uncroppedWidth() > 0 && !useTiles( d->document, i ) )
                     requestedPixmaps.push_back( new Okular::PixmapRequest(
                                 PAGEVIEW_ID, i->pageNumber(), i->uncroppedWidth(), i->uncroppedHeight(), PAGEVIEW_PRELOAD_PRIO, true ) );
             }
@@ -182,6 +182,8 @@ Q_OBJECT
         void center(int cx, int cy);
 
         void toggleFormWidgets( bool on );
+        // creates the form and video widgets of the item not created yet
+        bool createItemWidgets( PageViewItem * item );
 
         void resizeContentArea( const QSize & newSize );
         void updatePageStep();
@@ -286,21 +286,28 @@ PresentationWidget::~PresentationWidget()
 
 void PresentationWidget::notifySetup( const QVector< Okular::Page * > & pageSet, int setupFlags )
 {
+    // pages added at the end of the document just get their frames
+    const bool pagesAppended = !( setupFlags & Okular::DocumentObserver::DocumentChanged ) &&
+                               ( setupFlags & Okular::DocumentObserver::PagesAppended ) && m_isSetup;
+
     // same document, nothing to change - here we assume the document sets up
     // us with the whole document set as first notifySetup()
-    if ( !( setupFlags & Okular::DocumentObserver::DocumentChanged ) )
+    if ( !( setupFlags & Okular::DocumentObserver::DocumentChanged ) && !pagesAppended )
         return;
 
-    // delete previous frames (if any (shouldn't be))
-    QVector< PresentationFrame * >::iterator fIt = m_frames.begin(), fEnd = m_frames.end();
-    for ( ; fIt != fEnd; ++fIt )
-        delete *fIt;
-    if ( !m_frames.isEmpty() )
-        kWarning() << "Frames setup changed while a Presentation is in progress.";
-    m_frames.clear();
+    if ( !pagesAppended )
+    {
+        // delete previous frames (if any (shouldn't be))
+        QVector< PresentationFrame * >::iterator fIt = m_frames.begin(), fEnd = m_frames.end();
+        for ( ; fIt != fEnd; ++fIt )
+            delete *fIt;
+        if ( !m_frames.isEmpty() )
+            kWarning() << "Frames setup changed while a Presentation is in progress.";
+        m_frames.clear();
+    }
 
     // create the new frames
-    QVector< Okular::Page * >::const_iterator setIt = pageSet.begin(), setEnd = pageSet.end();
+    QVector< Okular::Page * >::const_iterator setIt = pageSet.begin() + m_frames.count(), setEnd = pageSet.end();
     float screenRatio = (float)m_height / (float)m_width;
     for ( ; setIt != setEnd; ++setIt )
     {
@@ -324,6 +331,9 @@ void PresentationWidget::notifySetup( const QVector< Okular::Page * > & pageSet,
         m_frames.push_back( frame );
     }
 
+    if ( pagesAppended )
+        return;
+
     // get metadata from the document
     m_metaStrings.clear();
     const Okular::DocumentInfo * info = m_document->documentInfo();
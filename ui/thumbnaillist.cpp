@@ -235,6 +235,35 @@ ThumbnailList::~ThumbnailList()
 //BEGIN DocumentObserver inherited methods
 void ThumbnailList::notifySetup( const QVector< Okular::Page * > & pages, int setupFlags )
 {
+    // only new pages at the end: add their thumbnails after the others,
+    // unless the thumbnails are filtered by a search, which the new pages
+    // have no highlights of
+    if ( ( setupFlags & Okular::DocumentObserver::PagesAppended ) &&
+         !( setupFlags & Okular::DocumentObserver::DocumentChanged ) && !d->m_thumbnails.isEmpty() )
+    {
+        if ( d->m_thumbnails.first()->page()->hasHighlights( SW_SEARCH_ID ) )
+            return;
+
+        const int width = viewport()->width();
+        const ThumbnailWidget * last = d->m_thumbnails.last();
+        int height = last->pos().y() + last->height() + KDialog::spacingHint();
+        for ( int i = d->m_thumbnails.count(); i < pages.count(); ++i )
+        {
+            ThumbnailWidget * t = new ThumbnailWidget( d, pages[i] );
+            t->move( 0, height );
+            d->m_thumbnails.push_back( t );
+            t->resizeFitWidth( width );
+            height += t->height() + KDialog::spacingHint();
+        }
+
+        height -= KDialog::spacingHint();
+        widget()->resize( width, height );
+        verticalScrollBar()->setEnabled( viewport()->height() < height );
+
+        d->delayedRequestVisiblePixmaps( 200 );
+        return;
+    }
+
     // if there was a widget selected, save its pagenumber to restore
     // its selection (if available in the new set of pages)
     int prevPage = -1;
@@ -13,6 +13,7 @@
 #include <qdom.h>
 #include <qheaderview.h>
 #include <qlayout.h>
+#include <qtimer.h>
 #include <qtreeview.h>
 
 #include <klineedit.h>
@@ -50,6 +51,13 @@ TOC::TOC(QWidget *parent, Okular::Document *document) : QWidget(parent), m_docum
     connect( m_treeView, SIGNAL(clicked(QModelIndex)), this, SLOT(slotExecuted(QModelIndex)) );
     connect( m_treeView, SIGNAL(activated(QModelIndex)), this, SLOT(slotExecuted(QModelIndex)) );
     m_searchLine->addTreeView( m_treeView );
+
+    // the synopsis of a document still getting pages is read again at most
+    // every second, and it only gets new items and viewports meanwhile
+    m_updateTimer = new QTimer( this );
+    m_updateTimer->setSingleShot( true );
+    m_updateTimer->setInterval( 1000 );
+    connect( m_updateTimer, SIGNAL(timeout()), this, SLOT(updateContents()) );
 }
 
 TOC::~TOC()
@@ -65,7 +73,15 @@ uint TOC::observerId() const
 void TOC::notifySetup( const QVector< Okular::Page * > & /*pages*/, int setupFlags )
 {
     if ( !( setupFlags & Okular::DocumentObserver::DocumentChanged ) )
+    {
+        if ( setupFlags & Okular::DocumentObserver::PagesComplete )
+            updateContents();
+        else if ( ( setupFlags & Okular::DocumentObserver::PagesAppended ) && !m_updateTimer->isActive() )
+            m_updateTimer->start();
         return;
+    }
+
+    m_updateTimer->stop();
 
     // clear contents
     m_model->clear();
@@ -86,6 +102,19 @@ void TOC::notifySetup( const QVector< Okular::Page * > & /*pages*/, int setupFla
     emit hasTOC( !m_model->isEmpty() );
 }
 
+void TOC::updateContents()
+{
+    m_updateTimer->stop();
+
+    const Okular::DocumentSynopsis * syn = m_document->documentSynopsis();
+    if ( !syn )
+        return;
+
+    m_model->update( syn );
+    m_model->setCurrentViewport( m_document->viewport() );
+    emit hasTOC( !m_model->isEmpty() );
+}
+
 void TOC::notifyViewportChanged( bool /*smoothMove*/ )
 {
     int newpage = m_document->viewport().pageNumber;
@@ -130,6 +159,11 @@ void TOC::slotExecuted( const QModelIndex &index )
     {
         m_document->setViewport( viewport );
     }
+    else if ( !m_model->destinationForIndex( index ).isEmpty() )
+    {
+        Okular::GotoAction action( QString(), m_model->destinationForIndex( index ) );
+        m_document->processAction( &action );
+    }
 }
 
 void TOC::saveSearchOptions()
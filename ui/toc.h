@@ -15,6 +15,7 @@
 
 class QDomNode;
 class QModelIndex;
+class QTimer;
 class QTreeView;
 class KTreeViewSearchLine;
 class TOCModel;
@@ -43,6 +44,7 @@ Q_OBJECT
     private slots:
         void slotExecuted( const QModelIndex & );
         void saveSearchOptions();
+        void updateContents();
 
     private:
         Okular::Document *m_document;
@@ -50,6 +52,7 @@ Q_OBJECT
         KTreeViewSearchLine *m_searchLine;
         TOCModel *m_model;
         int m_currentPage;
+        QTimer *m_updateTimer;
 };
 
 #endif
@@ -27,8 +27,11 @@ struct TOCItem
     TOCItem( TOCItem *parent, const QDomElement &e );
     ~TOCItem();
 
+    void loadViewport( const QDomElement &e );
+
     QString text;
     Okular::DocumentViewport viewport;
+    QString destination;
     QString extFileName;
     QString url;
     bool highlight : 1;
@@ -45,6 +48,7 @@ public:
     ~TOCModelPrivate();
 
     void addChildren( const QDomNode &parentNode, TOCItem * parentItem );
+    void updateChildren( const QDomNode &parentNode, TOCItem * parentItem );
     QModelIndex indexForItem( TOCItem *item ) const;
     void findViewport( const Okular::DocumentViewport &viewport, TOCItem *item, QList< TOCItem* > &list ) const;
 
@@ -69,7 +73,16 @@ TOCItem::TOCItem( TOCItem *_parent, const QDomElement &e )
     model = parent->model;
     text = e.tagName();
 
-    // viewport loading
+    loadViewport( e );
+
+    extFileName = e.attribute( "ExternalFileName" );
+    url = e.attribute( "URL" );
+}
+
+void TOCItem::loadViewport( const QDomElement &e )
+{
+    destination.clear();
+
     if ( e.hasAttribute( "Viewport" ) )
     {
         // if the node has a viewport, set it
@@ -82,10 +95,10 @@ TOCItem::TOCItem( TOCItem *_parent, const QDomElement &e )
         QString viewport_string = model->document->metaData( "NamedViewport", page ).toString();
         if ( !viewport_string.isEmpty() )
             viewport = Okular::DocumentViewport( viewport_string );
+        else
+            // the generator may need to get to it first, see destinationForIndex()
+            destination = page;
     }
-
-    extFileName = e.attribute( "ExternalFileName" );
-    url = e.attribute( "URL" );
 }
 
 TOCItem::~TOCItem()
@@ -132,6 +145,39 @@ void TOCModelPrivate::addChildren( const QDomNode & parentNode, TOCItem * parent
     }
 }
 
+void TOCModelPrivate::updateChildren( const QDomNode & parentNode, TOCItem * parentItem )
+{
+    // the synopsis only grows, so the items there already keep their place
+    int row = 0;
+    QDomNode n = parentNode.firstChild();
+    for ( ; !n.isNull(); n = n.nextSibling(), ++row )
+    {
+        QDomElement e = n.toElement();
+
+        if ( row < parentItem->children.count() )
+        {
+            TOCItem * item = parentItem->children.at( row );
+            if ( !item->viewport.isValid() )
+            {
+                item->loadViewport( e );
+                if ( item->viewport.isValid() )
+                {
+                    const QModelIndex index = indexForItem( item );
+                    emit q->dataChanged( index, index );
+                }
+            }
+            updateChildren( n, item );
+            continue;
+        }
+
+        q->beginInsertRows( indexForItem( parentItem ), row, row );
+        TOCItem * item = new TOCItem( parentItem, e );
+        if ( e.hasChildNodes() )
+            addChildren( n, item );
+        q->endInsertRows();
+    }
+}
+
 QModelIndex TOCModelPrivate::indexForItem( TOCItem *item ) const
 {
     if ( item->parent )
@@ -268,6 +314,22 @@ void TOCModel::fill( const Okular::DocumentSynopsis *toc )
     d->itemsToOpen.clear();
 }
 
+void TOCModel::update( const Okular::DocumentSynopsis *toc )
+{
+    if ( !toc )
+        return;
+
+    if ( d->root->children.isEmpty() )
+    {
+        fill( toc );
+        return;
+    }
+
+    d->updateChildren( *toc, d->root );
+    // the items opened by the synopsis are left as the user set them
+    d->itemsToOpen.clear();
+}
+
 void TOCModel::clear()
 {
     if ( !d->dirty )
@@ -339,6 +401,15 @@ Okular::DocumentViewport TOCModel::viewportForIndex( const QModelIndex &index )
     return item->viewport;
 }
 
+QString TOCModel::destinationForIndex( const QModelIndex &index ) const
+{
+    if ( !index.isValid() )
+        return QString();
+
+    TOCItem *item = static_cast< TOCItem* >( index.internalPointer() );
+    return item->destination;
+}
+
 QString TOCModel::urlForIndex( const QModelIndex &index ) const
 {
     if ( !index.isValid() )
@@ -38,6 +38,8 @@ class TOCModel : public QAbstractItemModel
         virtual int rowCount( const QModelIndex &parent = QModelIndex() ) const;
 
         void fill( const Okular::DocumentSynopsis *toc );
+        // adds the items new in the grown synopsis, keeping the others as they are
+        void update( const Okular::DocumentSynopsis *toc );
         void clear();
         void setCurrentViewport( const Okular::DocumentViewport &viewport );
 
@@ -45,6 +47,7 @@ class TOCModel : public QAbstractItemModel
 
         QString externalFileNameForIndex( const QModelIndex &index ) const;
         Okular::DocumentViewport viewportForIndex( const QModelIndex &index ) const;
+        QString destinationForIndex( const QModelIndex &index ) const;
         QString urlForIndex( const QModelIndex &index ) const;
 
     private: